@@ -147,7 +147,7 @@ int cmePayloadManagerInit (void)
 int cmeCreate () 
 {
 	
-	mxml_node_t *xml = NULL;
+	UITS_PAYLOAD_WRITER *payloadWriter;
 	FILE		*payloadFP;
 	char		*payloadXMLString;
 	
@@ -160,20 +160,15 @@ int cmeCreate ()
 	
 	/* Set the element value in the uits metadata array */
 	
-	/* create the XML in an mxml data structure from the metadata array */
-	
-	xml = uitsCreatePayloadXML (CME_XML, cmeMetadataDesc, cmeSignatureDesc);
-	uitsHandleErrorPTR(cmePayloadModuleName, "cmeCreate", xml, ERR_PAYLOAD,
-					   "Error: Couldn't create XML payload\n");
-	
-	/* convert the mxml data structure into a string containing the XML */
-	payloadXMLString = uitsMXMLToXMLString(xml);
+	/* write the payload XML from the metadata array */
 	
+	payloadWriter = uitsPayloadWriterCreate();
+	payloadXMLString = uitsPayloadWrite (payloadWriter, CME_XML, cmeMetadataDesc, cmeSignatureDesc);
 	
 	// validate the xml payload that was created
 	vprintf("Validating payload ...\n");
 	
-	err =  uitsVerifyPayloadXML (xml, payloadXMLString, cmeXSDFileName, TRUE, cmeSignatureDesc);
+	err =  uitsVerifyPayloadString (payloadXMLString, cmeXSDFileName, VERIFY_LEVEL_SCHEMA, cmeSignatureDesc);
 	uitsHandleErrorINT(cmePayloadModuleName, "cmeCreate", err, OK, ERR_PAYLOAD, 
 					   "Error: Couldn't validate XML payload\n");
 	
@@ -182,16 +177,18 @@ int cmeCreate ()
 	
 	vprintf("Writing standalone CME payload to file: %s ...\n", payloadFileName);
 	
-	payloadFP = fopen(payloadFileName, "wb");
+	payloadFP = uitsIOOpen(payloadFileName, "wb");
 	uitsHandleErrorPTR(cmePayloadModuleName, "cmeCreate", payloadFP, ERR_FILE,
 					   "Error: Couldn't open payload file\n");
 	
-	err = mxmlSaveFile(xml, payloadFP, MXML_NO_CALLBACK);
-	uitsHandleErrorINT(cmePayloadModuleName, "cmeCreate", err, 0, ERR_FILE,
+	err = fprintf(payloadFP, "%s\n", payloadXMLString);	// mxmlSaveFile ended the file with a new line
+	uitsHandleErrorINT(cmePayloadModuleName, "cmeCreate", (err < 0) ? ERROR : OK, OK, ERR_FILE,
 					   "Error: Couldn't open save xml to file\n");
 	
 	fclose(payloadFP);
 	
+	uitsPayloadWriterFree(payloadWriter);
+	
 	vprintf("Success\n");
 	return (OK);
 	
@@ -207,7 +204,6 @@ int cmeCreate ()
 int cmeVerify (void) 
 {
 	char *payloadXMLString;
-	mxml_node_t *xml;
 	
 	vprintf("Verify CME payload ...\n");
 	
@@ -220,12 +216,7 @@ int cmeVerify (void)
 	
 	payloadXMLString = uitsReadFile(payloadFileName);
 	
-	/*	convert the XML string to an mxml tree */
-	xml = mxmlLoadString (NULL, payloadXMLString, MXML_OPAQUE_CALLBACK);
-	uitsHandleErrorPTR(cmePayloadModuleName, "cmeVerify", xml, ERR_PAYLOAD,
-					   "Couldn't convert payload XML to  xml tree\n");
-	
-	err =  uitsVerifyPayloadXML (xml, payloadXMLString, cmeXSDFileName, TRUE, cmeSignatureDesc);
+	err =  uitsVerifyPayloadString (payloadXMLString, cmeXSDFileName, VERIFY_LEVEL_SCHEMA, cmeSignatureDesc);
 	uitsHandleErrorINT(cmePayloadModuleName, "cmeVerifyPayloadFile", err, 0, ERR_VERIFY,
 					   "Error: Payload failed validation\n");
 	
@@ -146,6 +146,14 @@ void uitsPrintHelp (char *command)
 		printf("--input     (-i)   [file-name] (REQUIRED): Input file for which to generate media hash\n");
 		printf("--b64       (-c)               (OPTIONAL): Base-64 encode the media hash (DEFAULT is hex)\n");
 		printf("--output    (-o)   [file-name] (OPTIONAL): Output file to write the hash to (DEFAULT is stdout)\n");
+		printf("--digests   (-g)   [names]     (OPTIONAL): Comma-delimited list of other digests of the audio data to create\n");
+		printf("                                           in the same pass (eg. SHA1,SHA512). Each digest is written on its\n");
+		printf("                                           own line as: name value, starting with the SHA256 media hash\n");
+		printf("--list      (-l)   [file-name] (OPTIONAL): File listing audio files to hash, one per line, instead of --input.\n");
+		printf("                                           The files are hashed together and each hash is written on its own\n");
+		printf("                                           line as: media-hash file-name\n");
+		printf("--mmap      (-m)               (OPTIONAL): Map the audio files into memory and hash them in place instead\n");
+		printf("                                           of reading them through a buffer\n");
 
 	} else if (strcmp(command, "key") == 0) {
 		printf("Usage: uits_tool key [options]\n");
@@ -160,11 +168,18 @@ void uitsPrintHelp (char *command)
 		printf("--silent    (-s)                            Run in silent mode \n");
 		printf("--input     (-i)    [file-name] (REQUIRED if embed selected or no hash specified)\n");
 		printf("                                            Name of the input file for which to create payload\n");
+		printf("                                            Use - with --embed and --hash to stream MP3, FLAC, AIFF\n");
+		printf("                                            or WAV audio from standard input\n");
 		printf("--uits      (-u)    [file-name] (REQUIRED): Name of UITS payload file\n");
+		printf("                                            Use - to write streamed audio to standard output\n");
 		printf("--embed     (-e)                (OPTIONAL): Embed UITS payload into the audio and write to payload file\n");
+		printf("--inplace   (-n)                (OPTIONAL): Embed UITS payload directly into the input file instead of\n");
+		printf("                                            writing a payload file. Supported for FLAC, AIFF and WAV\n");
 		printf("--algorithm (-r)    [name]      (OPTIONAL): Name of the algorithm to use for signing. \n");
 		printf("                                            Possible values: RSA2048 (DEFAULT)\n"); 
 		printf("                                                             DSA2048\n");
+		printf("                                                             ECDSA-P256\n");
+		printf("                                                             Ed25519 (needs OpenSSL 1.1.1)\n");
 		printf("--pub       (-b)    [file-name] (REQUIRED): Name of the file containing the public key\n");
 		printf("--priv      (-p)    [file-name] (REQUIRED): Name of the file contianing the private key for signing\n");
 		printf("--pubID     (-k)    [value]     (REQUIRED): The SHA1 hash of the public key needed to \n");
@@ -180,6 +195,11 @@ void uitsPrintHelp (char *command)
 		printf("                                            DEFAULT is a single line for signature\n");
 		printf("--b64       (-c)                (OPTIONAL): Base 64 encode the media hash. Media hash is hex by default\n"); 
 		printf("--hash      (-h)    [hash-value](OPTIONAL): Use the passed hash value instead of calculating from audio frames\n"); 
+		printf("--stamp     (-l)    [file-name] (OPTIONAL): Embed a payload into a copy of the input file for each line of the\n"); 
+		printf("                                            file. Each line is: output-file TID UID (use - for no value)\n"); 
+		printf("                                            The audio is read and hashed once. Requires --embed, replaces --uits\n"); 
+		printf("--threads   (-t)    [count]     (OPTIONAL): Number of threads signing the --stamp payloads, 0 for one per CPU\n"); 
+		printf("                                            DEFAULT is 1, signing each payload before it is written\n"); 
 		printf("\n");
 		printf("The following parameters are UITS metadata. All values are treated as text. \n");
 		printf("--nonce                 [value] (REQUIRED)\n");
@@ -233,7 +253,7 @@ void uitsPrintHelp (char *command)
 		printf("\n");
 		printf("--verbose    (-v)                           Run in verbose mode (DEFAULT)\n");
 		printf("--silent     (-s)                           Run in silent mode \n");
-		printf("--nohash     (-n)				 (OPTIONAL) Disable media hash validation.\n");
+		printf("--nohash     (-n)				 (OPTIONAL) Disable media hash validation, the same as --level schema.\n");
 		printf("--input      (-i)   [file-name]  (REQUIRED if hash validation enabled and no hash or hashfile specified)\n");
 		printf("                                            Name of the input file for which to verify payload\n");
 		printf("                                            If the input file contains a UITS payload, that \n");
@@ -248,12 +268,36 @@ void uitsPrintHelp (char *command)
 		printf("                                            Name of a file containing the reference media hash value\n");
 		printf("                                            The reference media hash value will be compared with the value \n");
 		printf("                                            in the payload for verification. \n");
+		printf("--hashcache  (-c)   [file-name] (OPTIONAL): Name of a file for caching media hashes between runs. The hash\n");
+		printf("                                            of an unchanged input file is read from the cache instead of\n");
+		printf("                                            being calculated from the audio. The file is created if needed.\n");
 		printf("--algorithm  (-r)   [name]      (OPTIONAL): Name of the algorithm to use for signing. \n");
 		printf("                                            Possible values: RSA2048 (DEFAULT)\n");
 		printf("                                                             DSA2048\n");
+		printf("                                                             ECDSA-P256\n");
+		printf("                                                             Ed25519 (needs OpenSSL 1.1.1)\n");
 		printf("--pub        (-b)   [file-name] (REQUIRED): Name of the file containing the public key for validating\n");
 		printf("--xsd        (-x)   [file-name] (OPTIONAL): Name of the schema to use for validation\n"); 
 		printf("                                            DEFAULT is uits.xsd in current directory\n");
+		printf("--list       (-l)   [file-name] (OPTIONAL): Verify the payload of each media file named in the file, one per\n"); 
+		printf("                                            line, and report the result for every file: OK, SCHEMA, PAYLOAD,\n"); 
+		printf("                                            SIGNATURE or MEDIAHASH. Replaces --input, --uits, --hash and --hashfile\n"); 
+		printf("--threads    (-t)   [count]     (OPTIONAL): Number of threads checking the --list payloads, 0 for one per CPU\n"); 
+		printf("                                            DEFAULT is 1\n"); 
+		printf("--output     (-o)   [file-name] (OPTIONAL): Name of the file for the --list report. DEFAULT is standard output\n"); 
+		printf("--verifycache (-g)  [file-name] (OPTIONAL): Name of a file for caching schema-valid payloads between runs. A\n"); 
+		printf("                                            payload that already passed schema validation with the same\n"); 
+		printf("                                            schema isn't validated again. The signature and the media hash\n"); 
+		printf("                                            are always checked. The file is created if needed, readable by\n"); 
+		printf("                                            its owner only\n"); 
+		printf("--level      (-e)   [name]      (OPTIONAL): How far to verify. The checks run cheapest first and stop\n"); 
+		printf("                                            at the first failure. Possible values:\n"); 
+		printf("                                                structure (the payload values can be read)\n"); 
+		printf("                                                signature (and the signature is good)\n"); 
+		printf("                                                schema    (and the payload is valid against the schema)\n"); 
+		printf("                                                full      (and the media hash matches the audio) (DEFAULT)\n"); 
+		printf("--mmap       (-m)               (OPTIONAL): Map the audio files into memory and hash them in place instead\n"); 
+		printf("                                            of reading them through a buffer\n"); 
 
 	} else if (strcmp(command, "extract") == 0) {
 		printf("Usage: uits_tool extract [options]\n");
@@ -266,6 +310,8 @@ void uitsPrintHelp (char *command)
 		printf("--algorithm (-r)      [name]      (OPTIONAL): If verifying, name of the algorithm to use for signing. \n");
 		printf("                                              Possible values: RSA2048 (DEFAULT)\n");
 		printf("                                                               DSA2048\n");
+		printf("                                                               ECDSA-P256\n");
+		printf("                                                               Ed25519 (needs OpenSSL 1.1.1)\n");
 		printf("--pub       (-b)     [file-name] (REQUIRED for verify): Name of the file containing the public key for validating\n");
 		printf("--xsd       (-x)     [file-name] (OPTIONAL): Name of the schema to use for validation\n"); 
 		printf("                                             DEFAULT is uits.xsd in current directory\n");
@@ -281,6 +327,8 @@ void uitsPrintHelp (char *command)
 		printf("--algorithm (-r)    [name]      (OPTIONAL): Name of the algorithm to use for signing. \n");
 		printf("                                            Possible values: RSA2048 (DEFAULT)\n"); 
 		printf("                                                             DSA2048\n");
+		printf("                                                             ECDSA-P256\n");
+		printf("                                                             Ed25519 (needs OpenSSL 1.1.1)\n");
 		printf("--pub       (-b)    [file-name] (REQUIRED): Name of the file containing the public key\n");
 		printf("--priv      (-p)    [file-name] (REQUIRED): Name of the file contianing the private key for signing\n");
 		printf("--pubID     (-k)    [value]     (REQUIRED): The SHA1 hash of the public key needed to \n");
@@ -341,6 +389,8 @@ void uitsPrintHelp (char *command)
 		printf("--algorithm  (-r)   [name]      (OPTIONAL): Name of the algorithm to use for signing. \n");
 		printf("                                            Possible values: RSA2048 (DEFAULT)\n");
 		printf("                                                             DSA2048\n");
+		printf("                                                             ECDSA-P256\n");
+		printf("                                                             Ed25519 (needs OpenSSL 1.1.1)\n");
 		printf("--pub        (-b)   [file-name] (REQUIRED): Name of the file containing the public key for validating\n");
 		printf("--xsd        (-x)   [file-name] (OPTIONAL): Name of the schema to use for validation\n"); 
 		printf("                                            DEFAULT is uits.xsd in current directory\n");
@@ -453,8 +503,9 @@ int uitsGetOptCreate (int argc, const char * argv[])
 		{"input",   		required_argument,	0,	'i'},	// input file
 		{"uits",	        required_argument,	0,	'u'},	// uits payload file
 		{"embed",			no_argument,		0,	'e'},	// embed audio into audio file
+		{"inplace",			no_argument,		0,	'n'},	// embed payload into the input audio file itself
 		{"metadata_file",	required_argument,	0,	'f'},	// metadata file
-		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'DSA2048' or 'RSA2048'
+		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'RSA2048', 'DSA2048', 'ECDSA-P256' or 'Ed25519'
 		{"pub",	            required_argument,	0,	'b'},	// public key file
 		{"priv",            required_argument,	0,	'p'},	// private key file
 		{"pubID",	        required_argument,	0,	'k'},	// public key id (sha1 hash of pub key file)
@@ -463,6 +514,8 @@ int uitsGetOptCreate (int argc, const char * argv[])
 		{"ml",              no_argument,		0,	'm'},	// generate a multi-line signature
 		{"b64",             no_argument,		0,	'c'},	// base64 encode media hash
 		{"hash",		    required_argument,	0,	'h'},	// hash value to use instead of calculating from audio frames
+		{"stamp",		    required_argument,	0,	'l'},	// list of output files and TID/UID values to stamp the audio with
+		{"threads",		    required_argument,	0,	't'},	// number of threads signing stamp list payloads
 		/* end of option list */
 		{0,			0,				0,				0}
 	};
@@ -517,7 +570,7 @@ int uitsGetOptCreate (int argc, const char * argv[])
 	}
 	
 	while (1) {
-		c = getopt_long (argc, argv, "wvsemcoa:u:f:h:r:b:i:k:d:x:m:h:Y:Z:", long_options, &option_index);
+		c = getopt_long (argc, argv, "wvsemcnoa:u:f:h:r:b:i:k:d:x:m:h:l:t:Y:Z:", long_options, &option_index);
 		dprintf("Got option: %c, value: %s\n", c, optarg);
 		
 		fflush(stdout);
@@ -564,6 +617,7 @@ int uitsGetOptCreate (int argc, const char * argv[])
 				
 			case 'r':		// set algorithm name
 				option_value = strdup(optarg);
+				uitsCheckSignatureAlgorithm(option_value);
 				uitsSetSignatureParamValue ("algorithm", option_value);
 				dprintf ("algorithm '%s'\n", option_value);
 				break;
@@ -592,11 +646,22 @@ int uitsGetOptCreate (int argc, const char * argv[])
 				uitsSetCLMediaHashValue (option_value);
 				break;
 				
+			case 'l':		// set stamp list file name
+				option_value = strdup(optarg);
+				dprintf ("stamp list file '%s'\n", option_value);
+				uitsSetIOFileName (STAMPLIST, option_value);
+				break;
+				
 			case 'd':		// set padding
 				uitsSetCommandLineParam ("pad", atoi(optarg));
 				dprintf ("padding '%s'\n", option_value);
 				break;
 				
+			case 't':		// set number of signing threads
+				uitsSetCommandLineParam ("threads", atoi(optarg));
+				dprintf ("signing threads '%s'\n", optarg);
+				break;
+				
 			case 'm':		// set b64 line feed flag
 				uitsSetSignatureParamValue ("b64LFFlag", "TRUE");
 				dprintf ("base 64 linefeeds enabled\n");
@@ -612,6 +677,11 @@ int uitsGetOptCreate (int argc, const char * argv[])
 				dprintf ("Embed payload in audio file\n");
 				break;
 				
+			case 'n':		// set in place flag
+				uitsSetCommandLineParam ("inplace", TRUE);
+				dprintf ("Embed payload in place\n");
+				break;
+				
 				// the UITS metadata parameters all have a short option of "Y"	
 			case 'Y':
 				option_value = strdup(optarg);
@@ -661,17 +731,24 @@ int uitsGetOptVerify (int argc, const char * argv[])
 		{"uits",			required_argument,	0,	'u'},	// payload file
 		{"hash",			required_argument,	0,	'h'},	// media hash value against which to verify
 		{"hashfile",		required_argument,	0,	'f'},	// file containing media hash value against which to verify
-		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'DSA2048' or 'RSA2048'
+		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'RSA2048', 'DSA2048', 'ECDSA-P256' or 'Ed25519'
 		{"pub",				required_argument,	0,	'b'},	// public key file
 		{"xsd",				required_argument,	0,	'x'},	// xsd file for schema validation
 		{"nohash",			no_argument,		0,	'n'},	// don't validate media hash
+		{"hashcache",		required_argument,	0,	'c'},	// file for caching media hashes between runs
+		{"list",			required_argument,	0,	'l'},	// list of media files whose payloads are verified together
+		{"threads",			required_argument,	0,	't'},	// number of threads verifying the list
+		{"output",			required_argument,	0,	'o'},	// report file for the list
+		{"verifycache",		required_argument,	0,	'g'},	// file for caching schema-valid payloads between runs
+		{"level",			required_argument,	0,	'e'},	// how far to verify: 'structure', 'signature', 'schema' or 'full'
+		{"mmap",			no_argument,		0,	'm'},	// map the audio files into memory for hashing
 		
 		/* end of option list */
 		{0,			0,				0,				0}
 	};
 		
 	while (1) {
-		c = getopt_long (argc, argv, "wvsa:u:h:f:r:b:x:", long_options, &option_index);
+		c = getopt_long (argc, argv, "wvsma:u:h:f:r:b:x:c:l:t:o:g:e:", long_options, &option_index);
 		
 		if (c == -1) { break; }
 		
@@ -722,6 +799,7 @@ int uitsGetOptVerify (int argc, const char * argv[])
 				
 			case 'r':		// set algorithm name
 				option_value = strdup(optarg);
+				uitsCheckSignatureAlgorithm(option_value);
 				uitsSetSignatureParamValue ("algorithm", option_value);
 				dprintf("algorithm '%s'\n", option_value);
 				break;
@@ -737,6 +815,45 @@ int uitsGetOptVerify (int argc, const char * argv[])
 				dprintf("Media hash will not be verified\n");
 				break;
 				
+			case 'c':		// set media hash cache file name
+				option_value = strdup(optarg);
+				dprintf("media hash cache file '%s'\n", option_value);
+				uitsSetIOFileName (HASHCACHE, option_value);
+				break;
+				
+			case 'l':		// set verify list file name
+				option_value = strdup(optarg);
+				dprintf("verify list file '%s'\n", option_value);
+				uitsSetIOFileName (VERIFYLIST, option_value);
+				break;
+				
+			case 't':		// set number of verification threads
+				uitsSetCommandLineParam ("threads", atoi(optarg));
+				dprintf ("verification threads '%s'\n", optarg);
+				break;
+				
+			case 'o':		// set report file name
+				option_value = strdup(optarg);
+				dprintf("report file '%s'\n", option_value);
+				uitsSetIOFileName (OUTPUT, option_value);
+				break;
+				
+			case 'g':		// set verify cache file name
+				option_value = strdup(optarg);
+				dprintf("verify cache file '%s'\n", option_value);
+				uitsSetIOFileName (VERIFYCACHE, option_value);
+				break;
+				
+			case 'e':		// set verification level
+				uitsSetCommandLineParam ("level", uitsGetVerifyLevel(optarg));
+				dprintf ("verification level '%s'\n", optarg);
+				break;
+				
+			case 'm':		// map the audio files into memory
+				uitsIOSetMmapFlag (TRUE);
+				dprintf ("Audio files will be mapped into memory\n");
+				break;
+				
 			default: 
 				snprintf(errStr, ERRSTR_LEN, "Error processing options: unknown option: %c\n", c);
 				uitsHandleErrorINT(moduleName, "uitsGetOptVerify", ERROR, OK, ERR_VALUE, errStr);
@@ -780,7 +897,7 @@ int cmeGetOptCreate (int argc, const char * argv[])
 		{"verbose",			no_argument,		0,	'v'},	// turn on verbose mode
 		{"silent",			no_argument,		0,	's'},	// turn on silent mode
 		{"cme_uits",	    required_argument,	0,	'u'},	// uits payload file
-		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'DSA2048' or 'RSA2048'
+		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'RSA2048', 'DSA2048', 'ECDSA-P256' or 'Ed25519'
 		{"pub",	            required_argument,	0,	'b'},	// public key file
 		{"priv",            required_argument,	0,	'p'},	// private key file
 		{"pubID",	        required_argument,	0,	'k'},	// public key id (sha1 hash of pub key file)
@@ -875,6 +992,7 @@ int cmeGetOptCreate (int argc, const char * argv[])
 				
 			case 'r':		// set algorithm name
 				option_value = strdup(optarg);
+				uitsCheckSignatureAlgorithm(option_value);
 				cmeSetSignatureParamValue ("algorithm", option_value);
 				dprintf ("algorithm '%s'\n", option_value);
 				break;
@@ -994,6 +1112,7 @@ int cmeGetOptVerify (int argc, const char * argv[])
 				
 			case 'r':		// set algorithm name
 				option_value = strdup(optarg);
+				uitsCheckSignatureAlgorithm(option_value);
 				cmeSetSignatureParamValue ("algorithm", option_value);
 				dprintf("algorithm '%s'\n", option_value);
 				break;
@@ -1041,7 +1160,7 @@ int uitsGetOptExtract (int argc, const char * argv[])
 		{"audio",		    required_argument,	0,	'a'},	// audio file (DEPRECATED)
 		{"input",		    required_argument,	0,	'i'},	// input file
 		{"uits",			required_argument,	0,	'u'},	// payload file
-		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'DSA2048' or 'RSA2048'
+		{"algorithm",		required_argument,	0,	'r'},	// algorithm for signature encryption file: 'RSA2048', 'DSA2048', 'ECDSA-P256' or 'Ed25519'
 		{"pub",				required_argument,	0,	'b'},	// public key file
 		{"xsd",				required_argument,	0,	'x'},	// xsd file for schema validation
 		
@@ -1096,6 +1215,7 @@ int uitsGetOptExtract (int argc, const char * argv[])
 				
 			case 'r':		// set algorithm name
 				option_value = strdup(optarg);
+				uitsCheckSignatureAlgorithm(option_value);
 				uitsSetSignatureParamValue ("algorithm", option_value);
 				dprintf ("algorithm '%s'\n", option_value);
 				break;
@@ -1141,13 +1261,16 @@ int uitsGetOptGenHash (int argc, const char * argv[])
 		{"audio",			required_argument,	0,	'a'},	// audio file		
 		{"input",			required_argument,	0,	'i'},	// input file		
 		{"output",			required_argument,	0,	'o'},	// output file		
+		{"digests",			required_argument,	0,	'g'},	// other digests to create from the same audio data
+		{"list",			required_argument,	0,	'l'},	// list of audio files to hash
+		{"mmap",			no_argument,		0,	'm'},	// map the audio files into memory for hashing
 		/* end of option list */
 		{0,			0,				0,				0}
 	};
 	
 	
 	while (1) {
-		c = getopt_long (argc, argv, "vca:o:w:", long_options, &option_index);
+		c = getopt_long (argc, argv, "vcma:o:w:g:l:", long_options, &option_index);
 		
 		if (c == -1) { break; }
 		
@@ -1180,6 +1303,22 @@ int uitsGetOptGenHash (int argc, const char * argv[])
 				dprintf ("Media hash will be base 64 encoded\n");
 				break;
 							
+			case 'g':		// set the other digests to create
+				option_value = strdup(optarg);
+				dprintf ("digests '%s'\n", option_value);
+				uitsSetMediaDigestNames (option_value);
+				break;
+				
+			case 'l':		// set the list of audio files to hash
+				option_value = strdup(optarg);
+				dprintf ("hash list file '%s'\n", option_value);
+				uitsSetIOFileName (HASHLIST, option_value);
+				break;
+				
+			case 'm':		// map the audio files into memory
+				uitsIOSetMmapFlag (TRUE);
+				dprintf ("Audio files will be mapped into memory\n");
+				break;
 				
 			default: 
 				snprintf(errStr, ERRSTR_LEN, "Error processing options: unknown option: %c\n", c);
@@ -1297,10 +1436,10 @@ unsigned char *uitsReadFile (char *filename)
 {
 	
 	FILE *fp=NULL;
-	int fileLen;
+	off_t fileLen;
 	unsigned char *fileData;	
 	
-	fp = fopen(filename, "r");	
+	fp = uitsIOOpen(filename, "r");	
 	if (!fp) {
 		snprintf(errStr, ERRSTR_LEN, "ERROR: Couldn't open file: %s\n", filename);
 		uitsHandleErrorINT(moduleName, "uitsReadFile", ERROR, OK, ERR_FILE, errStr);
@@ -1328,16 +1467,17 @@ unsigned char *uitsReadFile (char *filename)
 
 /*
  * Function: uitsGetFileSize
- * Purpose:  Seek from the current location to end of a file to find the remaining size of the file
+ * Purpose:  Seek from the current location to end of a file to find the size of the file
+ *			 Sizes are 64-bit (off_t) so that files larger than 4GB are supported
  * Passed:   pointer to file
  * Returns:  File size, fp left at original location
  *
  */
 
-int uitsGetFileSize (FILE *fp) 
+off_t uitsGetFileSize (FILE *fp) 
 {
-	unsigned long fileSize;
-	unsigned long saveSeek;
+	off_t fileSize;
+	off_t saveSeek;
 	
 	saveSeek = ftello(fp);
 	
@@ -21,22 +21,79 @@
  * Include necessary headers...
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE				/* fopencookie (see uitsIOManager.c) */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include <getopt.h>
 
+/* signing threads (see uitsSignEngine.c) */
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+ * Vector SHA256 and base 64 (see uitsMultiHash.c and uitsBase64.c). The AVX2 code is
+ * compiled with a per-function target attribute and picked at run time with
+ * __builtin_cpu_supports, so it needs GCC 4.9 or a clang with both. Older compilers,
+ * like Apple's gcc 4.2, build without it.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  if defined(__clang__)
+#    if defined(__has_attribute) && defined(__has_builtin)
+#      if __has_attribute(target) && __has_builtin(__builtin_cpu_supports)
+#        define UITS_X86_SIMD
+#      endif
+#    endif
+#  elif (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+#    define UITS_X86_SIMD
+#  endif
+#endif
+
 #define LIBXML_SCHEMAS_ENABLED
 #include <libxml/xmlschemastypes.h>
 
 #include <mxml.h>
 
+#include "uitsByteOrder.h"
 #include "uitsError.h"
 #include "uitsOpenSSL.h"
+#include "uitsBase64.h"
 #include "uitsPayloadManager.h"
+#include "uitsPayloadWriter.h"
+#include "uitsPayloadScanner.h"
+#include "uitsSignEngine.h"
+#include "uitsVerifyScheduler.h"
+#include "uitsVerifyCache.h"
+#include "uitsIOManager.h"
 #include "uitsAudioFileManager.h"
+#include "uitsEmbedPlan.h"
+#include "uitsHashCache.h"
+#include "uitsMultiHash.h"
+#include "uitsContainerIndex.h"
 #include "uitsMP3Manager.h"
 #include "uitsMP4Manager.h"
 #include "uitsFLACManager.h"
@@ -44,7 +101,9 @@
 #include "uitsWAVManager.h"
 #include "uitsHTMLManager.h"
 #include "uitsGenericManager.h"
+#include "uitsStampManager.h"
 #include "xmlManager.h"
+#include "uitsSchemaCheck.h"
 #include "cmePayloadManager.h"
 
 
@@ -66,7 +125,7 @@ int debugFlag;						// debug message flag set via command line
 
 
 unsigned char *uitsReadFile		(char *filename); 
-int			  uitsGetFileSize	(FILE *fp);
+off_t		  uitsGetFileSize	(FILE *fp);
 
 void uitsPrintHelp (char *command); 
 int	 uitsInit(void);										// uits initialization housekeeping
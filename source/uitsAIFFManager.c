@@ -31,7 +31,7 @@ int aiffIsValidFile (char *audioFileName)
 	char *formType = calloc(sizeof(char), 4);
 	int  isAIFF = FALSE;
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(aiffModuleName, "aiffIsValidFile", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
 	/* Read the first 8 bytes of the file and check to see if they represent an AIFF "FORM" chunk */
@@ -73,40 +73,20 @@ char *aiffGetMediaHash (char *audioFileName)
 	UITS_digest			*mediaHash = NULL;
 	char				*mediaHashString = NULL;
 	
-	unsigned long	fileLength;
-	unsigned long	audioFrameStart, audioFrameEnd;
-
-	AIFF_CHUNK_HEADER *ssndChunk;
+	UITS_CONTAINER_ENTRY *ssndChunk;
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(aiffModuleName, "aiffGetMediaHash", audioFP, ERR_FILE, "Couldn't open AIFF audio file for reading\n");
 	
-	/* seek past the FORM chunk */
-	/* FORM chunk is 12 bytes: */
-	/*  chunk ID    (4-bytes)
-	 *  chunk size  (4-bytes)
-	 *  form type   (4-bytes)
-	 */
-	
-	fseeko(audioFP, 12, SEEK_CUR);
-	
-	/* now skip chunks until 'SSND' chunk */
-	/* get file size */
-	fileLength = uitsGetFileSize(audioFP);
-
-	ssndChunk = aiffFindChunkHeader(audioFP, "SSND", NULL, fileLength);
+	/* find the 'SSND' chunk */
+	ssndChunk = aiffFindChunkHeader(audioFP, "SSND", NULL);
 	uitsHandleErrorPTR(aiffModuleName, "aiffGetMediaHash", ssndChunk, ERR_AIFF, "Couldn't find 'SSND' chunk in audio file\n");
 	
-	/* move fp to start of SSND */
-	fseeko(audioFP, ssndChunk->saveSeek, SEEK_SET);
-	
-	/*skip past ID and size */
-	fseeko(audioFP, 8L, SEEK_CUR);
+	/* move fp to start of SSND data, past ID and size */
+	fseeko(audioFP, ssndChunk->offset + AIFF_HEADER_SIZE, SEEK_SET);
 	
 	/* fp is (hopefully) at start of audio frame data */
-	audioFrameStart = ftello(audioFP);
-		
-	mediaHash = uitsCreateDigestBuffered (audioFP, ssndChunk->chunkSize, "SHA256") ;
+	mediaHash = uitsCreateMediaDigest (audioFP, ssndChunk->size) ;
 	mediaHashString = uitsDigestToString(mediaHash);
 	
 	fclose(audioFP);
@@ -120,9 +100,11 @@ char *aiffGetMediaHash (char *audioFileName)
  * Function: aiffEmbedPayload
  * Purpose:	 Embed the UITS payload into an AIFF file
  *			 The following algorithm is used to embed the payload:
- *				1. Copy the input file to the output file
+ *				1. Clone the input file to the output file (nothing to do if embedding in place)
  *              2. Append an 'APPL' chunk with an "OSType" string of 'UITS' and the payload
  *				3. Update the size of the FORM chunk to reflect the additional 'APPL' chunk
+ *			 Steps 2 and 3 only touch the header and the end of the output file, so the audio
+ *			 data is never rewritten.
  *
  *
  * Returns:   OK or ERROR
@@ -135,11 +117,11 @@ int aiffEmbedPayload  (char *audioFileName,
 {
 	FILE			*audioInFP, *audioOutFP;
 	AIFF_CHUNK_HEADER *formChunk = NULL;
-	AIFF_CHUNK_HEADER *applChunk = NULL;
-	unsigned long	audioInFileSize;
+	UITS_CONTAINER_ENTRY *applChunk = NULL;
 	
 	unsigned long	udtaChunkDataSize;
 	unsigned long	payloadXMLSize;
+	unsigned char	sizeBytes[4];
 	
 	vprintf("About to embed payload for %s into %s\n", audioFileName, audioFileNameOut);
 	if (numPadBytes) {
@@ -148,47 +130,39 @@ int aiffEmbedPayload  (char *audioFileName,
 	
 	payloadXMLSize = strlen(uitsPayloadXML);
 	
-	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	/* open the audio input file */
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(aiffModuleName, "aiffEmbedPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioOutFP = fopen(audioFileNameOut, "wb");
-	uitsHandleErrorPTR(aiffModuleName, "aiffEmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
-	
-	/* calculate how long the input audio file is by seeking to EOF and saving size  */
-	audioInFileSize = uitsGetFileSize(audioInFP);
-
-	
 	/* make sure there isn't an existing UITS payload */
-	fseeko(audioInFP, AIFF_HEADER_SIZE + 4, SEEK_CUR);	/* seek past FORM header and type */
-	applChunk = aiffFindChunkHeader (audioInFP, "APPL", "UITS", audioInFileSize);
+	applChunk = aiffFindChunkHeader (audioInFP, "APPL", "UITS");
 	if (applChunk) {
 		uitsHandleErrorPTR(aiffModuleName, "aiffEmbedPayload", NULL, ERR_AIFF, "Audio file already contains a UITS payload\n");
 	}
 	
-	/* no existing payload, rewind and create new file */
-	rewind(audioInFP);
+	fclose(audioInFP);
 
-	/* copy the entire file */
-	uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize);
+	/* no existing payload, clone the input and update the output in place */
+	uitsAudioCloneFile(audioFileName, audioFileNameOut);
+
+	audioOutFP = uitsIOOpen(audioFileNameOut, "r+b");
+	uitsHandleErrorPTR(aiffModuleName, "aiffEmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
 
 	/* update the FORM chunk to include the size of the new APPL chunk */
 	udtaChunkDataSize = 4 + payloadXMLSize;	/* chunk data size is payload size + 4 bytes of OSType */
 	
-	rewind(audioOutFP);
-	rewind(audioInFP);
-	formChunk = aiffReadChunkHeader(audioInFP);
+	formChunk = aiffReadChunkHeader(audioOutFP);
 	formChunk->chunkSize += AIFF_HEADER_SIZE + udtaChunkDataSize ;	/* APPL chunk size includes header + data */
-	fseeko(audioOutFP, 4, SEEK_CUR);
-	lswap(&formChunk->chunkSize);
-	fwrite(&formChunk->chunkSize, 1, 4, audioOutFP);
+	fseeko(audioOutFP, 4, SEEK_SET);
+	uitsWriteBE32(sizeBytes, formChunk->chunkSize);
+	fwrite(sizeBytes, 1, 4, audioOutFP);
 	
 	
 	/* add an APPL chunk to the end of the output file*/	
 	fseeko(audioOutFP, 0, SEEK_END);
 	fwrite("APPL", 1, 4, audioOutFP);						/* 4-bytes ID */
-	lswap(&udtaChunkDataSize);								/* handle big vs little endianness */
-	fwrite(&udtaChunkDataSize, 1, 4, audioOutFP);			/* 4-bytes size */
+	uitsWriteBE32(sizeBytes, udtaChunkDataSize);			/* AIFF sizes are big-endian */
+	fwrite(sizeBytes, 1, 4, audioOutFP);					/* 4-bytes size */
 	fwrite("UITS", 1, 4, audioOutFP);						/* 4-bytes OSType */
 	fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP);	/* UITS payload */
 	
@@ -197,9 +171,90 @@ int aiffEmbedPayload  (char *audioFileName,
 		fwrite("\0", 1, 1, audioOutFP);
 	}
 	
+	err = fclose(audioOutFP);
+	uitsHandleErrorINT(aiffModuleName, "aiffEmbedPayload", err, OK, ERR_FILE, "Couldn't write audio output file\n");
+	
+	/* the output file may have been indexed (and may be the input file) */
+	uitsContainerIndexInvalidate();
+	
 	return(OK);
 }
 
+/*
+ *
+ * Function: aiffEmbedPayloadStream
+ * Purpose:	 Embed the UITS payload into an AIFF stream. The FORM size is updated for the
+ *			 new APPL chunk before the header is written, the chunks are copied through,
+ *			 and the APPL chunk is appended at the end of the stream.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int aiffEmbedPayloadStream (UITS_AUDIO_STREAM *stream,
+							FILE *audioOutFP,
+							char *uitsPayloadXML,
+							int  numPadBytes)
+{
+	unsigned char	formHeader[AIFF_HEADER_SIZE + 4];
+	unsigned char	chunkHeader[AIFF_HEADER_SIZE + 4];
+	unsigned char	sizeBytes[4];
+	unsigned long	udtaChunkDataSize;
+	unsigned long	payloadXMLSize;
+	off_t			chunkSize;
+	size_t			bytesRead;
+	
+	if (numPadBytes) {
+		vprintf("WARNING: Tried to add pad bytes to AIFF file. This is not supported.\n");
+	}
+	
+	payloadXMLSize	  = strlen(uitsPayloadXML);
+	udtaChunkDataSize = 4 + payloadXMLSize;	/* chunk data size is payload size + 4 bytes of OSType */
+	
+	/* update the FORM chunk to include the size of the new APPL chunk */
+	uitsAudioStreamRead(stream, formHeader, AIFF_HEADER_SIZE + 4);
+	uitsWriteBE32(&formHeader[4], uitsReadBE32(&formHeader[4]) + AIFF_HEADER_SIZE + udtaChunkDataSize);
+	fwrite(formHeader, 1, AIFF_HEADER_SIZE + 4, audioOutFP);
+	
+	/* copy the chunks, checking for an existing UITS payload on the way */
+	while ((bytesRead = uitsAudioStreamRead(stream, chunkHeader, AIFF_HEADER_SIZE)) == AIFF_HEADER_SIZE) {
+		chunkSize = uitsReadBE32(&chunkHeader[4]);
+		chunkSize += chunkSize & 1;
+		
+		if (strncmp((char *) chunkHeader, "APPL", 4) == 0 && chunkSize >= 4) {
+			bytesRead = AIFF_HEADER_SIZE + uitsAudioStreamRead(stream, &chunkHeader[AIFF_HEADER_SIZE], 4);
+			if (strncmp((char *) &chunkHeader[AIFF_HEADER_SIZE], "UITS", 4) == 0) {
+				uitsHandleErrorINT(aiffModuleName, "aiffEmbedPayloadStream", ERROR, OK, ERR_AIFF,
+								   "Audio stream already contains a UITS payload\n");
+			}
+			chunkSize -= bytesRead - AIFF_HEADER_SIZE;
+		}
+		fwrite(chunkHeader, 1, bytesRead, audioOutFP);
+		
+		if (uitsAudioStreamCopy(stream, audioOutFP, chunkSize) != chunkSize) {
+			bytesRead = 0;
+			break;			/* truncated last chunk, copied as is */
+		}
+	}
+	
+	/* anything after the last complete chunk is passed through */
+	fwrite(chunkHeader, 1, (bytesRead < AIFF_HEADER_SIZE) ? bytesRead : 0, audioOutFP);
+	uitsAudioStreamCopy(stream, audioOutFP, -1);
+	
+	/* add an APPL chunk to the end of the output */
+	fwrite("APPL", 1, 4, audioOutFP);						/* 4-bytes ID */
+	uitsWriteBE32(sizeBytes, udtaChunkDataSize);			/* AIFF sizes are big-endian */
+	fwrite(sizeBytes, 1, 4, audioOutFP);					/* 4-bytes size */
+	fwrite("UITS", 1, 4, audioOutFP);						/* 4-bytes OSType */
+	fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP);	/* UITS payload */
+	
+	/* the pad byte if necessary */
+	if (payloadXMLSize & 1) {
+		fwrite("\0", 1, 1, audioOutFP);
+	}
+	
+	return (ferror(audioOutFP) ? ERROR : OK);
+}
+
 /*
  *
  * Function: aiffExtractPayload
@@ -211,37 +266,34 @@ int aiffEmbedPayload  (char *audioFileName,
 char *aiffExtractPayload (char *audioFileName) 
 {
 	
-	AIFF_CHUNK_HEADER *applChunkHeader = NULL;
+	UITS_CONTAINER_ENTRY *applChunkHeader = NULL;
 	FILE			*audioInFP;
-	unsigned long	audioInFileSize;
 	char			*payloadXML;
 	int				payloadXMLSize;
 	
 	/* open the audio input file */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(aiffModuleName, "aiffExtractPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioInFileSize = uitsGetFileSize(audioInFP);
-	
-	/* seek to start of 'FORM' chunk header and type (4 bytes)*/
-	
-	fseeko(audioInFP, AIFF_HEADER_SIZE + 4, SEEK_CUR);
-	
 	/* find an 'APPL' chunk with an OSType of "UITS" */	
-	applChunkHeader = aiffFindChunkHeader (audioInFP, "APPL", "UITS", audioInFileSize);
-	uitsHandleErrorPTR(aiffModuleName, "aiffExtractPayload", applChunkHeader, ERR_AIFF, "Coudln't find UITS payload in AIFF file\n");
+	applChunkHeader = aiffFindChunkHeader (audioInFP, "APPL", "UITS");
+	if (!applChunkHeader) {
+		vprintf("Couldn't find UITS payload in AIFF file\n");
+		fclose(audioInFP);
+		return (NULL);
+	}
 	
-	fseeko(audioInFP, applChunkHeader->saveSeek, SEEK_SET);	/* seek to start of chunk */
-	fseeko(audioInFP, AIFF_HEADER_SIZE, SEEK_CUR);				/* seek past ID and Size in header */
-	fseeko(audioInFP, 4, SEEK_CUR);								/* seek past "UITS" OSType */
+	fseeko(audioInFP, applChunkHeader->offset + AIFF_HEADER_SIZE + 4, SEEK_SET);	/* seek past header and "UITS" OSType */
 		
 	/* will be null-terminated when it's read from the file because size includes 4 bytes of OSType */
-	payloadXML = calloc(applChunkHeader->chunkSize, 1);	
-	payloadXMLSize = applChunkHeader->chunkSize - 4;
+	payloadXML = calloc(applChunkHeader->size, 1);	
+	payloadXMLSize = applChunkHeader->size - 4;
 	
 	err = fread(payloadXML, 1L, payloadXMLSize, audioInFP);
 	uitsHandleErrorINT(aiffModuleName, "aiffExtractPayload", err, payloadXMLSize, ERR_AIFF, "Couldn't read UITS payload\n");
 	
+	fclose(audioInFP);
+	
 	return (payloadXML);
 }
 
@@ -257,7 +309,6 @@ AIFF_CHUNK_HEADER *aiffReadChunkHeader (FILE *fpin)
 {
 	AIFF_CHUNK_HEADER *chunkHeader = calloc(sizeof(AIFF_CHUNK_HEADER), 1);
 	unsigned char	  header[AIFF_HEADER_SIZE];
-	unsigned long     chunkSize;
 	
 	
 	chunkHeader->saveSeek = ftello(fpin);
@@ -269,9 +320,7 @@ AIFF_CHUNK_HEADER *aiffReadChunkHeader (FILE *fpin)
 	
 	memcpy (chunkHeader->chunkID, &header[0], 4); 
 	
-	memcpy(&chunkSize, &header[4], 4);
-	lswap(&chunkSize);
-	chunkHeader->chunkSize = chunkSize;	/* size does NOT include 8 header bytes */
+	chunkHeader->chunkSize = uitsReadBE32(&header[4]);	/* size does NOT include 8 header bytes */
 	
  	
 	/* return file pointer to original position */
@@ -284,70 +333,71 @@ AIFF_CHUNK_HEADER *aiffReadChunkHeader (FILE *fpin)
 /*
  *
  * Function: aiffFindChunkHeader
- * Purpose:	 Find an AIFF chunk header within an AIFF file
+ * Purpose:	 Find a top-level chunk in an AIFF file
  *           Chunk header format is :
  *               id:   4-bytes
  *               size: 4-bytes (if size is odd, data is padded to even size)
  *
  *				 some chunks have a 4-byte type as their first bit of data (FORM, APPL) 
  *				if a chunkType is passed to this function, only return a chunk header of the requested type 
+ *			 The chunks are looked up in the file's container index, so the file is only
+ *			 walked once no matter how many chunks are searched for.
  *           The file pointer is returned to it's original position
- * Passed:   File pointer (should point to file location to start search)
+ * Passed:   File pointer
  *			 ID of chunk to find
  *           Chunk Type (NULL if don't care)
- *			 Location to end searching
- * Returns:  Pointer to header structure or NULL if error
+ * Returns:  Pointer to the index entry (owned by the index) or NULL if not found
  */
 
 
-AIFF_CHUNK_HEADER *aiffFindChunkHeader (FILE *fpin, char *chunkID, char *chunkType, unsigned long endSeek)
+UITS_CONTAINER_ENTRY *aiffFindChunkHeader (FILE *fpin, char *chunkID, char *chunkType)
 {
-	AIFF_CHUNK_HEADER *chunkHeader = calloc(sizeof(AIFF_CHUNK_HEADER), 1);
-	unsigned long	saveSeek, bytesLeft;
-	unsigned long sizeWithPad;
-	int	chunkTypeLen = 0;
-	char *currChunkType = NULL;
-	int chunkFound = FALSE;
+	UITS_CONTAINER_INDEX *index;
 	
-	saveSeek = ftello(fpin);
+	index = uitsContainerIndexGet(fpin, CONTAINER_AIFF);
 	
-	bytesLeft = endSeek - saveSeek;
-	
-	if (chunkType) {
-		chunkTypeLen = strlen(chunkType);
-		currChunkType = calloc(chunkTypeLen + 1, 1);  /* calloc space for type and null terminator */
+	return (uitsContainerIndexFindChild(index, NULL, chunkID, chunkType));
+}
 
-	}
-	
-	/* read chunks until finding the chunk ID (and possibly type) or end of search */
-	while (!chunkFound && bytesLeft) {
-		chunkHeader = aiffReadChunkHeader(fpin);
-		/* seek past header */
-		fseeko(fpin, AIFF_HEADER_SIZE, SEEK_CUR);
-		bytesLeft -= AIFF_HEADER_SIZE;
+/*
+ *
+ * Function: aiffGetEmbedPlan
+ * Purpose:	 Plan the payload embedding for an AIFF file. The APPL chunk is appended, so
+ *			 only the FORM size changes.
+ * Returns:  OK or ERROR
+ *
+ */
 
-		if (strncmp(chunkHeader->chunkID, chunkID, 4) == 0) {
-			/* if the chunk header needs to be of a particular type, check this chunk's type */
-			if (chunkType) {
-				fread(currChunkType, chunkTypeLen, 1, fpin);
-				if (strncmp(currChunkType, chunkType, chunkTypeLen) == 0) {
-					chunkFound = TRUE;
-				}
-				fseeko(fpin, -chunkTypeLen, SEEK_CUR);
-			} else {
-				chunkFound = TRUE;
-			}
-		}		
-		/* seek past data and pad byte (if necessary) */
-		sizeWithPad = chunkHeader->chunkSize;
-		sizeWithPad += (chunkHeader->chunkSize & 0x01);
-		fseeko(fpin, sizeWithPad, SEEK_CUR);
-		bytesLeft -= sizeWithPad;
-	}
+int aiffGetEmbedPlan (char *audioFileName, UITS_EMBED_PLAN *plan)
+{
+	FILE *audioInFP;
 	
-	fseeko(fpin, saveSeek, SEEK_SET);
-    return (chunkFound ? chunkHeader : NULL);
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(aiffModuleName, "aiffGetEmbedPlan", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
+	/* make sure there isn't an existing UITS payload */
+	if (aiffFindChunkHeader(audioInFP, "APPL", "UITS")) {
+		uitsHandleErrorPTR(aiffModuleName, "aiffGetEmbedPlan", NULL, ERR_AIFF, "Audio file already contains a UITS payload\n");
+	}
+	
+	/* the FORM size counts the APPL header, OSType and payload (as aiffEmbedPayload writes it) */
+	err = uitsEmbedPlanReadHeader(plan, audioInFP, AIFF_HEADER_SIZE + 4);
+	if (err == OK) {
+		err = uitsEmbedPlanAddPatch(plan, 4, PLAN_FIELD_BE32, AIFF_HEADER_SIZE + 4, FALSE);
+	}
+	fclose(audioInFP);
+	
+	/* 'APPL', size, 'UITS', payload, pad byte */
+	plan->trailerFlag	 = TRUE;
+	plan->trailerPadFlag = TRUE;
+	plan->trailerLength	 = AIFF_HEADER_SIZE + 4;
+	memcpy(plan->trailer, "APPL", 4);
+	memcpy(&plan->trailer[AIFF_HEADER_SIZE], "UITS", 4);
+	plan->trailerPatch.offset	  = 4;
+	plan->trailerPatch.fieldType  = PLAN_FIELD_BE32;
+	plan->trailerPatch.sizeAdjust = 4;
+	
+	return (err);
 }
 
 // EOF
@@ -28,7 +28,7 @@
 typedef struct {
 	unsigned char   chunkID[4];
 	unsigned long	chunkSize;		
-	unsigned long   saveSeek;	/* saved seek location for the header start */
+	off_t			saveSeek;	/* saved seek location for the header start */
 } AIFF_CHUNK_HEADER;
 
 /* 
@@ -42,10 +42,18 @@ int aiffEmbedPayload	(char *audioFileName,
 						 char *uitsPayloadXML,
 						 int  numPadBytes);
 
+int aiffEmbedPayloadStream	(UITS_AUDIO_STREAM *stream,
+							 FILE *audioOutFP,
+							 char *uitsPayloadXML,
+							 int  numPadBytes);
+
 char *aiffExtractPayload (char *audioFileName); 
 
 char *aiffGetMediaHash	(char *audioFileName);
 
+int aiffGetEmbedPlan	(char *audioFileName, 
+						 UITS_EMBED_PLAN *plan);
+
 
 /*
  * PRIVATE Functions
@@ -53,7 +61,7 @@ char *aiffGetMediaHash	(char *audioFileName);
 
 AIFF_CHUNK_HEADER *aiffReadChunkHeader (FILE *audioInFP);
 char			  *aiffReadChunkData   (FILE *audioInFP);
-AIFF_CHUNK_HEADER *aiffFindChunkHeader (FILE *fpin, char *chunkID, char *chunkType, unsigned long endSeek);
+UITS_CONTAINER_ENTRY *aiffFindChunkHeader (FILE *fpin, char *chunkID, char *chunkType);
 
 
 #endif
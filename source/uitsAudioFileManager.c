@@ -8,6 +8,8 @@
  *       GetMediaHash:   Generates a media hash for the audio data
  *       EmbedPayload:   Embeds a UITS payload into the audio file
  *       ExtractPayload: Extracts a UITS payload from the audio file
+ *  and, for formats that can be embedded in one pass over a non-seekable stream:
+ *       EmbedPayloadStream: Embeds a UITS payload while copying stdin to stdout
  *
  *  Version 1.0 of the tool only supports MP3.
  *  Version 2.0 adds MP4, FLAC, AIFF and WAV
@@ -25,22 +27,23 @@
 char *audioModuleName = "uitsAudioFileManager.c";
 
 UITS_AUDIO_CALLBACKS uitsAudioCB [] = {
-	{ MP3,		mp3IsValidFile,		mp3GetMediaHash,	 mp3EmbedPayload,		mp3ExtractPayload },
-	{ MP4,		mp4IsValidFile,		mp4GetMediaHash,	 mp4EmbedPayload,		mp4ExtractPayload },
-	{ FLAC,		flacIsValidFile,	flacGetMediaHash,	 flacEmbedPayload,		flacExtractPayload },
-	{ AIFF,		aiffIsValidFile,	aiffGetMediaHash,	 aiffEmbedPayload,		aiffExtractPayload },
-	{ WAV,		wavIsValidFile,		wavGetMediaHash,	 wavEmbedPayload,		wavExtractPayload },
-	{ HTML,		htmlIsValidFile,	htmlGetMediaHash,	 htmlEmbedPayload,		htmlExtractPayload },
-	{ GENERIC,  genericIsValidFile, genericGetMediaHash, genericEmbedPayload,	genericExtractPayload },
-	{ 0, 0, 0, 0, 0}
+	{ MP3,		mp3IsValidFile,		mp3GetMediaHash,	 mp3EmbedPayload,		mp3ExtractPayload,		mp3EmbedPayloadStream,	mp3GetEmbedPlan },
+	{ MP4,		mp4IsValidFile,		mp4GetMediaHash,	 mp4EmbedPayload,		mp4ExtractPayload,		NULL,					mp4GetEmbedPlan },
+	{ FLAC,		flacIsValidFile,	flacGetMediaHash,	 flacEmbedPayload,		flacExtractPayload,		flacEmbedPayloadStream,	flacGetEmbedPlan },
+	{ AIFF,		aiffIsValidFile,	aiffGetMediaHash,	 aiffEmbedPayload,		aiffExtractPayload,		aiffEmbedPayloadStream,	aiffGetEmbedPlan },
+	{ WAV,		wavIsValidFile,		wavGetMediaHash,	 wavEmbedPayload,		wavExtractPayload,		wavEmbedPayloadStream,	wavGetEmbedPlan },
+	{ HTML,		htmlIsValidFile,	htmlGetMediaHash,	 htmlEmbedPayload,		htmlExtractPayload,		NULL,					NULL },
+	{ GENERIC,  genericIsValidFile, genericGetMediaHash, genericEmbedPayload,	genericExtractPayload,	NULL,					NULL },
+	{ 0, 0, 0, 0, 0, 0, 0}
 };
 
-int bigEndianFlag = 1;
-
 /*
  *
  * Function: uitsAudioEmbedPayload
  * Purpose:	 Embed the UITS payload into an audio file and write the output to a new file
+ *			 If the output file name is the same as the input file name, the payload is
+ *			 embedded in place. Only formats that can add a payload without moving the
+ *			 audio data (FLAC, AIFF and WAV) support this.
  * Returns:  OK or ERROR
  *
  */
@@ -54,6 +57,13 @@ int uitsAudioEmbedPayload  (char *audioFileName,
 	
 	currAudioCB = uitsAudioGetCB (audioFileName);
 	
+	if (strcmp(audioFileName, audioOutFileName) == 0) {
+		if (!uitsAudioCanEmbedInPlace(currAudioCB->uitsAudioFileType)) {
+			uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedPayload", ERROR, OK, ERR_EMBED, 
+							   "In place embedding is only supported for FLAC, AIFF and WAV files\n");
+		}
+	}
+	
 	err = currAudioCB->uitsAudioEmbedPayload (audioFileName, audioOutFileName, uitsPayloadXML, numPadBytes);
 	uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedPayload", err, OK, ERR_EMBED, "Couldn't embed UITS payload into audio file\n");
 	
@@ -86,6 +96,37 @@ char *uitsAudioExtractPayload (char *audioFileName)
 	
 }
 
+/*
+ *
+ * Function: uitsAudioReadPayload
+ * Purpose:	 Extract the UITS payload from an audio file for a list of files, where a
+ *			 file that can't be opened or doesn't have a payload shouldn't stop the run.
+ *			 A file that has a payload but is damaged still exits.
+ * Returns:  Pointer to string containing XML, or NULL
+ *
+ */
+
+char *uitsAudioReadPayload (char *audioFileName)
+{
+	UITS_AUDIO_CALLBACKS *currAudioCB;
+	FILE *audioFP;
+	
+	audioFP = uitsIOOpen(audioFileName, "rb");
+	if (!audioFP) {
+		vprintf("Couldn't open audio file %s for reading\n", audioFileName);
+		return (NULL);
+	}
+	fclose(audioFP);
+	
+	/* files of an unknown type can't have an embedded payload */
+	currAudioCB = uitsAudioGetCB (audioFileName);
+	if (currAudioCB->uitsAudioFileType == GENERIC) {
+		return (NULL);
+	}
+	
+	return (currAudioCB->uitsAudioExtractPayload (audioFileName));
+}
+
 /*
  *
  * Function: uitsAudioGetMediaHash
@@ -102,7 +143,14 @@ char *uitsAudioGetMediaHash (char *audioFileName)
 	
 	currAudioCB = uitsAudioGetCB (audioFileName);
 	
+	/* an unchanged file may have a cached hash (see uitsHashCache.c) */
+	mediaHashValue = uitsHashCacheLookup (audioFileName, currAudioCB->uitsAudioFileType);
+	if (mediaHashValue) {
+		return (mediaHashValue);
+	}
+	
 	mediaHashValue = currAudioCB->uitsAudioGetMediaHash (audioFileName);
+	uitsHashCacheAdd (audioFileName, currAudioCB->uitsAudioFileType, mediaHashValue);
 	
 	return (mediaHashValue);
 }
@@ -137,17 +185,29 @@ UITS_AUDIO_CALLBACKS *uitsAudioGetCB (char *audioFileName) {
  *
  */
 
-int uitsAudioBufferedCopy (FILE *audioInFP, FILE *audioOutFP, unsigned long numBytes)
+off_t uitsAudioBufferedCopy (FILE *audioInFP, FILE *audioOutFP, off_t numBytes)
 {
-	unsigned char *ioBuffer = calloc(AUDIO_IO_BUFFER_SIZE, 1);
-	unsigned long  bytesLeft;
-	unsigned long  bufferSize;		/* size of the buffer to write */
-	unsigned long  bytesRead;			/* number of bytes read from the input file */
-	unsigned long  bytesWritten;		/* number of bytes written to the output file */
-	unsigned long  totalBytesWritten = 0;
+	unsigned char *ioBuffer;
+	off_t		   bytesLeft;
+	size_t		   bufferSize;		/* size of the buffer to write */
+	size_t		   bytesRead;			/* number of bytes read from the input file */
+	size_t		   bytesWritten;		/* number of bytes written to the output file */
+	off_t		   totalBytesWritten = 0;
+	
+	// large copies between real files are done inside the kernel where possible
+	if (numBytes >= AUDIO_KERNEL_COPY_MIN_SIZE) {
+		totalBytesWritten = uitsAudioKernelCopy(audioInFP, audioOutFP, numBytes);
+	}
+	
+	bytesLeft = numBytes - totalBytesWritten;
+	if (!bytesLeft) {
+		return (totalBytesWritten);
+	}
+	
+	ioBuffer = malloc((bytesLeft > AUDIO_IO_BUFFER_SIZE) ? AUDIO_IO_BUFFER_SIZE : bytesLeft);
+	uitsHandleErrorPTR(audioModuleName, "uitsAudioBufferedCopy", ioBuffer, ERR_FILE, "Couldn't allocate copy buffer\n");
 	
 	// read and process the data in the file in  chunks 
-	bytesLeft = numBytes;
 	while (bytesLeft) {
 		bufferSize = (bytesLeft > AUDIO_IO_BUFFER_SIZE) ? AUDIO_IO_BUFFER_SIZE : bytesLeft;
 		bytesRead = fread(ioBuffer, 1, bufferSize, audioInFP);
@@ -168,86 +228,409 @@ int uitsAudioBufferedCopy (FILE *audioInFP, FILE *audioOutFP, unsigned long numB
 }
 
 /*
- *  Housekeeping functions - to convert endian-ness of 2, 4, and 8-byte integers, when necessary...
  *
- *	First the 2-byte version...
+ *	Function: uitsAudioKernelCopy
+ *	Purpose:  Copy bytes from the audio input file to the audio output file without moving
+ *			  them through user space. In order, tries:
+ *				- a FICLONERANGE reflink, which shares the data blocks (XFS, Btrfs). Only the
+ *				  part of the range that is aligned to the file system block size is cloned.
+ *				- copy_file_range, which copies inside the kernel (and on some file systems
+ *				  also reflinks or does a server-side copy)
+ *				- sendfile
+ *			  Each step carries on from where the previous one stopped. Only files opened
+ *			  with stdio are handled (not memory buffers or other uitsIOOpen backends).
+ *			  If the output is a pipe or socket, only sendfile is used and the data is
+ *			  appended to what has been written so far.
+ *			  Leaves input and output file pointers at end of copied bytes.
+ *	Returns:  Number of bytes copied, 0 if none could be copied this way. The caller copies
+ *			  the rest.
+ *
+ */
+
+off_t uitsAudioKernelCopy (FILE *audioInFP, FILE *audioOutFP, off_t numBytes)
+{
+	off_t bytesCopied = 0;
+	
+#ifdef __linux__
+	int			inFD  = fileno(audioInFP);
+	int			outFD = fileno(audioOutFP);
+	off_t		inOffset, outOffset;
+	struct stat inStat;
+	long		bytesSent;
+	int			outSeekable;
+	
+	if (inFD < 0 || outFD < 0 || uitsIOGetStream(audioInFP) || uitsIOGetStream(audioOutFP)) {
+		return (0);
+	}
+	
+	/* the kernel copies at the file offsets, so anything stdio is holding has to go first */
+	err = fflush(audioOutFP);
+	uitsHandleErrorINT(audioModuleName, "uitsAudioKernelCopy", err, OK, ERR_FILE, "Couldn't write audio output file\n");
+	
+	inOffset  = ftello(audioInFP);
+	outOffset = ftello(audioOutFP);
+	if (inOffset < 0 || fstat(inFD, &inStat) != OK) {
+		return (0);
+	}
+	
+	/* pipes and sockets have no file offset */
+	outSeekable = (outOffset >= 0);
+	if (!outSeekable) {
+		outOffset = 0;
+	}
+	
+#ifdef FICLONERANGE
+	if (outSeekable) {
+		struct file_clone_range cloneRange;
+		off_t blockSize = inStat.st_blksize ? inStat.st_blksize : 4096;
+		
+		/* a clone must start on a block boundary, and end on one unless it ends at EOF */
+		cloneRange.src_fd      = inFD;
+		cloneRange.src_offset  = inOffset;
+		cloneRange.dest_offset = outOffset;
+		cloneRange.src_length  = (inOffset + numBytes == inStat.st_size) ? numBytes : numBytes - (numBytes % blockSize);
+		
+		if ((inOffset % blockSize) == 0 && (outOffset % blockSize) == 0 && cloneRange.src_length > 0 &&
+			ioctl(outFD, FICLONERANGE, &cloneRange) == 0) {
+			dprintf("Cloned %lld bytes with a reflink\n", (long long) cloneRange.src_length);
+			bytesCopied = cloneRange.src_length;
+		}
+	}
+#endif
+	
+#ifdef __NR_copy_file_range
+	if (outSeekable) {
+		loff_t copyInOffset  = inOffset + bytesCopied;
+		loff_t copyOutOffset = outOffset + bytesCopied;
+		
+		/* copy_file_range may copy less than requested, or fail (eg. across file systems) */
+		while (bytesCopied < numBytes) {
+			bytesSent = syscall(__NR_copy_file_range, inFD, &copyInOffset, outFD, &copyOutOffset,
+								(size_t) (numBytes - bytesCopied), 0);
+			if (bytesSent <= 0) {
+				break;
+			}
+			bytesCopied += bytesSent;
+		}
+	}
+#endif
+	
+	/* sendfile writes at the output file offset */
+	if (bytesCopied < numBytes && (!outSeekable || lseek(outFD, outOffset + bytesCopied, SEEK_SET) >= 0)) {
+		off_t sendOffset = inOffset + bytesCopied;
+		
+		while (bytesCopied < numBytes) {
+			bytesSent = sendfile(outFD, inFD, &sendOffset, (size_t) (numBytes - bytesCopied));
+			if (bytesSent <= 0) {
+				break;
+			}
+			bytesCopied += bytesSent;
+		}
+	}
+	
+	/* resync stdio with the data the kernel moved */
+	fseeko(audioInFP,  inOffset  + bytesCopied, SEEK_SET);
+	if (outSeekable) {
+		fseeko(audioOutFP, outOffset + bytesCopied, SEEK_SET);
+	}
+#endif
+	
+	return (bytesCopied);
+}
+
+/*
+ *	Function: uitsAudioCanEmbedInPlace
+ *	Purpose:  Check if the payload can be embedded into an audio file type without
+ *			  rewriting the file
+ *	Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsAudioCanEmbedInPlace (int audioFileType)
+{
+	return ((audioFileType == FLAC) || (audioFileType == AIFF) || (audioFileType == WAV));
+}
+
+/*
+ *	Function: uitsAudioCloneFile
+ *	Purpose:  Make the output file an exact copy of the input file so that formats which
+ *			  only patch a header and append a chunk can embed in place on the copy.
+ *			  The whole file is copied with uitsAudioBufferedCopy, so on Linux it is a
+ *			  reflink (which shares the data blocks) where the file system supports it.
+ *			  If the input and output file names are the same there is nothing to do.
+ *	Returns:  OK or exit on error
  *
  */
 
-void SetBigEndianFlag (int flag) {
-	bigEndianFlag = flag;
+int uitsAudioCloneFile (char *audioFileName, char *audioOutFileName)
+{
+	FILE	*audioInFP, *audioOutFP;
+	off_t	audioInFileSize;
+	
+	if (strcmp(audioFileName, audioOutFileName) == 0) {
+		return (OK);
+	}
+	
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(audioModuleName, "uitsAudioCloneFile", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+	
+	audioOutFP = uitsIOOpen(audioOutFileName, "wb");
+	uitsHandleErrorPTR(audioModuleName, "uitsAudioCloneFile", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
+	
+	audioInFileSize = uitsGetFileSize(audioInFP);
+	
+	uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize);
+	
+	fclose(audioInFP);
+	err = fclose(audioOutFP);
+	uitsHandleErrorINT(audioModuleName, "uitsAudioCloneFile", err, OK, ERR_FILE, "Couldn't write audio output file\n");
+	
+	return (OK);
 }
 
-int wswap(short *word)
+/*
+ *
+ * Function: uitsAudioEmbedPayloadStream
+ * Purpose:	 Embed the UITS payload while copying a non-seekable input (eg. stdin) to a
+ *			 non-seekable output (eg. stdout). The input is read once and the output is
+ *			 written once. Only the headers that have to change are buffered, so the
+ *			 payload must already be complete (media hash passed in and signed) before
+ *			 this is called. Supported for MP3, FLAC, AIFF and WAV.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsAudioEmbedPayloadStream (FILE *audioInFP, 
+								 FILE *audioOutFP, 
+								 char *uitsPayloadXML,
+								 int  numPadBytes)
 {
-	short w1, w2;
+	UITS_AUDIO_STREAM	 stream;
+	UITS_AUDIO_CALLBACKS *currAudioCB = uitsAudioCB;
+	int					 audioFileType;
 	
+	memset(&stream, 0, sizeof(UITS_AUDIO_STREAM));
+	stream.audioInFP = audioInFP;
 	
-	if (bigEndianFlag) {
-		w1 = w2 = *word;
-		*word = (w1 << 8) & 0xff00;
-		*word |= ((w2 >> 8) & 0x00ff);
+	audioFileType = uitsAudioGetStreamType(&stream);
+	
+	while (currAudioCB->uitsAudioIsValidFile && currAudioCB->uitsAudioFileType != audioFileType) {
+		currAudioCB++;
+	}
+	
+	if (!currAudioCB->uitsAudioEmbedPayloadStream) {
+		uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedPayloadStream", ERROR, OK, ERR_EMBED, 
+						   "Streaming embed is only supported for MP3, FLAC, AIFF and WAV files\n");
+	}
+	
+	err = currAudioCB->uitsAudioEmbedPayloadStream (&stream, audioOutFP, uitsPayloadXML, numPadBytes);
+	uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedPayloadStream", err, OK, ERR_EMBED, "Couldn't embed UITS payload into audio stream\n");
+	
+	err = fflush(audioOutFP);
+	uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedPayloadStream", err, OK, ERR_FILE, "Couldn't write audio output stream\n");
+	
+	free(stream.prefix);
+	
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsAudioGetStreamType
+ * Purpose:	 Identify the format of a stream from its first bytes. An ID3v2 tag is read
+ *			 ahead to see whether it is in front of MP3 audio or a FLAC stream marker.
+ *			 Everything read is left in the stream prefix.
+ * Returns:  Audio file type, or ERROR if it isn't recognized
+ *
+ */
+
+int uitsAudioGetStreamType (UITS_AUDIO_STREAM *stream)
+{
+	unsigned char *magic;
+	
+	err = uitsAudioStreamFill(stream, AUDIO_STREAM_MAGIC_SIZE);
+	uitsHandleErrorINT(audioModuleName, "uitsAudioGetStreamType", err, OK, ERR_FILE, "Couldn't read audio input stream\n");
+	
+	magic = stream->prefix;
+	
+	if (strncmp((char *) magic, "fLaC", 4) == 0) {
+		return (FLAC);
+	}
+	if ((strncmp((char *) magic, "RIFF", 4) == 0 || strncmp((char *) magic, "RF64", 4) == 0 ||
+		 strncmp((char *) magic, "BW64", 4) == 0) && strncmp((char *) &magic[8], "WAVE", 4) == 0) {
+		return (WAV);
+	}
+	if (strncmp((char *) magic, "FORM", 4) == 0 &&
+		(strncmp((char *) &magic[8], "AIFF", 4) == 0 || strncmp((char *) &magic[8], "AIFC", 4) == 0)) {
+		return (AIFF);
+	}
+	if (strncmp((char *) magic, "ID3", 3) == 0) {
+		/* the tag size is a 28-bit syncsafe integer, not including the header or footer */
+		stream->id3TagSize = MP3_HEADER_SIZE + (((magic[6] & 0x7f) << 21) | ((magic[7] & 0x7f) << 14) |
+												((magic[8] & 0x7f) << 7)  |  (magic[9] & 0x7f));
+		if (magic[5] & 0x10) {
+			stream->id3TagSize += MP3_HEADER_SIZE;
+		}
+		
+		err = uitsAudioStreamFill(stream, stream->id3TagSize + 4);
+		uitsHandleErrorINT(audioModuleName, "uitsAudioGetStreamType", err, OK, ERR_FILE, "Couldn't read ID3 tag from audio input stream\n");
+		
+		if (strncmp((char *) &stream->prefix[stream->id3TagSize], "fLaC", 4) == 0) {
+			return (FLAC);
+		}
+		return (MP3);
 	}
-	return(0);
+	
+	return (ERROR);
 }
 
 /*
- *  4-byte version...
+ *
+ * Function: uitsAudioStreamFill
+ * Purpose:	 Make sure the first length bytes of the stream are in the prefix buffer.
+ *			 The prefix is limited to AUDIO_STREAM_MAX_PREFIX bytes.
+ * Returns:  OK, or ERROR if the stream ends first
  *
  */
 
-int lswap(long *lword)
+int uitsAudioStreamFill (UITS_AUDIO_STREAM *stream, size_t length)
 {
-	union {
-		long ul;
-		struct {
-			char b1, b2, b3, b4;
-		} bytes ;
-	} *pu, lu;
-	
-	if (bigEndianFlag) {
-		dprintf("lswap intel_cpu defined\n");
-		lu.ul = *lword;
-		pu  = lword;
-		pu->bytes.b4 = lu.bytes.b1;
-		pu->bytes.b3 = lu.bytes.b2;
-		pu->bytes.b2 = lu.bytes.b3;
-		pu->bytes.b1 = lu.bytes.b4;
+	size_t bytesRead;
+	
+	if (length <= stream->prefixLength) {
+		return (OK);
+	}
+	
+	if (length > AUDIO_STREAM_MAX_PREFIX) {
+		uitsHandleErrorINT(audioModuleName, "uitsAudioStreamFill", ERROR, OK, ERR_EMBED, 
+						   "Audio stream headers are too large to buffer\n");
+	}
+	
+	if (length > stream->prefixCapacity) {
+		stream->prefixCapacity = (length > 2 * stream->prefixCapacity) ? length : 2 * stream->prefixCapacity;
+		stream->prefix = realloc(stream->prefix, stream->prefixCapacity);
+		uitsHandleErrorPTR(audioModuleName, "uitsAudioStreamFill", stream->prefix, ERR_FILE, "Couldn't allocate stream buffer\n");
 	}
 	
-	return(0);
+	bytesRead = fread(stream->prefix + stream->prefixLength, 1, length - stream->prefixLength, stream->audioInFP);
+	stream->prefixLength += bytesRead;
+	
+	return ((stream->prefixLength == length) ? OK : ERROR);
 }
 
 /*
- *  8-byte version...
+ *
+ * Function: uitsAudioStreamRead
+ * Purpose:	 Read from the stream, taking bytes from the prefix buffer first
+ * Returns:  Number of bytes read (less than length only at the end of the stream)
  *
  */
 
-int llswap(unsigned long long *llword)
+size_t uitsAudioStreamRead (UITS_AUDIO_STREAM *stream, unsigned char *buffer, size_t length)
 {
-	unsigned long long ll1;
-	union {
-		unsigned long long ul;
-		struct {
-			char b1, b2, b3, b4, b5, b6, b7,b8;
-		} bytes ;
-	} *pu, lu;
-	
-	
-	if (bigEndianFlag) {
-		lu.ul = *llword;
-		pu = llword;
-		pu->bytes.b8 = lu.bytes.b1;
-		pu->bytes.b7 = lu.bytes.b2;
-		pu->bytes.b6 = lu.bytes.b3;
-		pu->bytes.b5 = lu.bytes.b4;
-		pu->bytes.b4 = lu.bytes.b5;
-		pu->bytes.b3 = lu.bytes.b6;
-		pu->bytes.b2 = lu.bytes.b7;
-		pu->bytes.b1 = lu.bytes.b8;
+	size_t prefixBytes = stream->prefixLength - stream->position;
+	
+	if (prefixBytes > length) {
+		prefixBytes = length;
 	}
 	
-	return(0);
+	memcpy(buffer, stream->prefix + stream->position, prefixBytes);
+	stream->position += prefixBytes;
+	
+	if (prefixBytes == length) {
+		return (length);
+	}
+	
+	return (prefixBytes + fread(buffer + prefixBytes, 1, length - prefixBytes, stream->audioInFP));
+}
+
+/*
+ *
+ * Function: uitsAudioStreamCopy
+ * Purpose:	 Copy bytes from the stream to the output through a bounded buffer
+ * Passed:   Stream, output file, number of bytes to copy (-1 to copy to the end of the stream)
+ * Returns:  Number of bytes copied (less than numBytes only at the end of the stream)
+ *
+ */
+
+off_t uitsAudioStreamCopy (UITS_AUDIO_STREAM *stream, FILE *audioOutFP, off_t numBytes)
+{
+	unsigned char *ioBuffer = malloc(AUDIO_IO_BUFFER_SIZE);
+	size_t		   bufferSize;
+	size_t		   bytesRead;
+	size_t		   bytesWritten;
+	off_t		   totalBytesWritten = 0;
+	
+	uitsHandleErrorPTR(audioModuleName, "uitsAudioStreamCopy", ioBuffer, ERR_FILE, "Couldn't allocate copy buffer\n");
+	
+	while (numBytes < 0 || totalBytesWritten < numBytes) {
+		bufferSize = AUDIO_IO_BUFFER_SIZE;
+		if (numBytes >= 0 && numBytes - totalBytesWritten < (off_t) bufferSize) {
+			bufferSize = numBytes - totalBytesWritten;
+		}
+		
+		bytesRead = uitsAudioStreamRead(stream, ioBuffer, bufferSize);
+		if (!bytesRead) {
+			break;
+		}
+		
+		bytesWritten = fwrite(ioBuffer, 1, bytesRead, audioOutFP);
+		uitsHandleErrorINT(audioModuleName, "uitsAudioStreamCopy", bytesWritten, bytesRead, ERR_FILE, 
+						   "Couldn't write audio output stream\n");
+		totalBytesWritten += bytesWritten;
+	}
+	
+	if (ferror(stream->audioInFP)) {
+		uitsHandleErrorINT(audioModuleName, "uitsAudioStreamCopy", ERROR, OK, ERR_FILE, "Couldn't read audio input stream\n");
+	}
+	
+	free(ioBuffer);
+	
+	return (totalBytesWritten);
+}
+
+/*
+ *
+ * Function: uitsAudioEmbedStreamPrefix
+ * Purpose:	 For formats that only change their headers: run the regular embed callback
+ *			 on the buffered prefix (held in memory with uitsIORegisterBuffer), write the
+ *			 result, then copy the rest of the stream unchanged. The prefix must hold all
+ *			 of the headers that the callback reads.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsAudioEmbedStreamPrefix (UITS_AUDIO_STREAM *stream, 
+								FILE *audioOutFP, 
+								embedPayloadCB *embedPayload,
+								char *uitsPayloadXML,
+								int  numPadBytes)
+{
+	char		  *prefixInName  = "uits-stream-prefix-in";
+	char		  *prefixOutName = "uits-stream-prefix-out";
+	unsigned char *outData;
+	size_t		  outLength;
+	
+	uitsIORegisterBuffer(prefixInName, stream->prefix, stream->prefixLength);
+	uitsIORegisterBuffer(prefixOutName, NULL, 0);
+	
+	err = embedPayload(prefixInName, prefixOutName, uitsPayloadXML, numPadBytes);
+	uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedStreamPrefix", err, OK, ERR_EMBED, "Couldn't embed UITS payload into audio stream\n");
+	
+	outData = uitsIOGetBuffer(prefixOutName, &outLength);
+	if (outLength && fwrite(outData, 1, outLength, audioOutFP) != outLength) {
+		uitsHandleErrorINT(audioModuleName, "uitsAudioEmbedStreamPrefix", ERROR, OK, ERR_FILE, "Couldn't write audio output stream\n");
+	}
+	
+	uitsIOUnregister(prefixInName);
+	uitsIOUnregister(prefixOutName);
+	uitsContainerIndexInvalidate();
+	
+	/* the whole prefix has been used, pass the rest of the stream through */
+	stream->position = stream->prefixLength;
+	uitsAudioStreamCopy(stream, audioOutFP, -1);
+	
+	return (OK);
 }
 
 // EOF
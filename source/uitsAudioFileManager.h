@@ -19,6 +19,10 @@
 #  define _uitsaudiofileManager_h
 
 #define AUDIO_IO_BUFFER_SIZE 500000
+#define AUDIO_KERNEL_COPY_MIN_SIZE 65536	/* smaller copies aren't worth the extra system calls */
+#define AUDIO_STREAM_MAGIC_SIZE	12			/* bytes read from a stream to identify the format */
+#define AUDIO_STREAM_MAX_PREFIX	16777216	/* most header bytes buffered before the payload is written */
+#define AUDIO_STREAM_NAME		"-"			/* file name for stdin/stdout */
 
 
 
@@ -35,12 +39,30 @@ enum uitsAudioFileTypes {
 	GENERIC
 };
 
+/*
+ * A non-seekable input stream. Header bytes that have to be looked at before
+ * any output is written are read ahead into the prefix buffer.
+ */
+
+typedef struct {
+	FILE			*audioInFP;
+	unsigned char	*prefix;			/* bytes read ahead from the input */
+	size_t			prefixLength;
+	size_t			prefixCapacity;
+	size_t			position;			/* bytes of the prefix already consumed */
+	size_t			id3TagSize;			/* size of a leading ID3v2 tag including header and footer, or 0 */
+} UITS_AUDIO_STREAM;
+
+typedef struct UITS_EMBED_PLAN UITS_EMBED_PLAN;	/* see uitsEmbedPlan.h */
+
 /* The audio callbacks */
 
 typedef int  isValidFileCB		(char*);
 typedef char *getMediaHashCB	(char *);
 typedef int  embedPayloadCB		(char *, char *, char *, int);
 typedef char *extractPaylaodCB	(char *);
+typedef int  embedPayloadStreamCB	(UITS_AUDIO_STREAM *, FILE *, char *, int);
+typedef int  getEmbedPlanCB		(char *, UITS_EMBED_PLAN *);
 
 typedef struct {
 	int					uitsAudioFileType;
@@ -48,6 +70,8 @@ typedef struct {
 	getMediaHashCB		*uitsAudioGetMediaHash;
 	embedPayloadCB		*uitsAudioEmbedPayload;
 	extractPaylaodCB	*uitsAudioExtractPayload;
+	embedPayloadStreamCB *uitsAudioEmbedPayloadStream;	/* NULL if the format can't be embedded in one pass */
+	getEmbedPlanCB		*uitsAudioGetEmbedPlan;			/* NULL if the format has no embed plan */
 } UITS_AUDIO_CALLBACKS;
 
 /*
@@ -56,6 +80,7 @@ typedef struct {
  */
 
 char	*uitsAudioExtractPayload	(char *audioFileName);
+char	*uitsAudioReadPayload		(char *audioFileName);
 
 int		uitsAudioEmbedPayload		(char *audioFileName, 
 									 char *audioOutFileName, 
@@ -64,20 +89,36 @@ int		uitsAudioEmbedPayload		(char *audioFileName,
 
 char	*uitsAudioGetMediaHash		(char *audioFileName); 
 
+int		uitsAudioEmbedPayloadStream	(FILE *audioInFP,
+									 FILE *audioOutFP,
+									 char *uitsPayloadXML,
+									 int  numPadBytes);
+
 UITS_AUDIO_CALLBACKS *uitsAudioGetCB (char *audioFileName);
-int uitsAudioBufferedCopy			(FILE *audioInFP, 
+off_t uitsAudioBufferedCopy			(FILE *audioInFP, 
 									 FILE *audioOutFP, 
-									 unsigned long numBytes);
-
-/*
- *  Housekeeping functions - to convert endian-ness of 2, 4, and 8-byte integers, when necessary...
- *
- */
-
-int wswap(short *word);
-int lswap(long *lword);
-int llswap(unsigned long long *llword);
-void SetBigEndianFlag (int flag);
+									 off_t numBytes);
+off_t uitsAudioKernelCopy			(FILE *audioInFP, 
+									 FILE *audioOutFP, 
+									 off_t numBytes);
+int	  uitsAudioCanEmbedInPlace	(int audioFileType);
+int	  uitsAudioCloneFile			(char *audioFileName, 
+									 char *audioOutFileName);
+
+int	  uitsAudioGetStreamType		(UITS_AUDIO_STREAM *stream);
+int	  uitsAudioStreamFill			(UITS_AUDIO_STREAM *stream, 
+									 size_t length);
+size_t uitsAudioStreamRead			(UITS_AUDIO_STREAM *stream, 
+									 unsigned char *buffer, 
+									 size_t length);
+off_t uitsAudioStreamCopy			(UITS_AUDIO_STREAM *stream, 
+									 FILE *audioOutFP, 
+									 off_t numBytes);
+int	  uitsAudioEmbedStreamPrefix	(UITS_AUDIO_STREAM *stream, 
+									 FILE *audioOutFP, 
+									 embedPayloadCB *embedPayload,
+									 char *uitsPayloadXML,
+									 int  numPadBytes);
 
 #endif
 
@@ -0,0 +1,373 @@
+/*
+ *  uitsBase64.c
+ *  UITS_Tool
+ *
+ *  Table-driven base 64 codec for signatures and media hashes. It writes into buffers
+ *  that the caller provides, so encoding or decoding a value needs no BIO chain and
+ *  no allocations, and it only reads constant tables, so threads can use it at once.
+ *
+ *  Encoding with line feeds matches the OpenSSL base 64 BIO (the --ml option): a line
+ *  feed after every 64 characters, without the one the BIO writes at the end, which
+ *  the tool has always removed. Decoding skips white space, so values with and without
+ *  line feeds decode the same way.
+ *
+ *  With AVX2, 24 bytes are encoded into 32 characters at a time, and 32 characters
+ *  are decoded at a time until a line feed, the padding or an invalid character is
+ *  reached. The rest is done with the tables.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+#ifdef UITS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+char *base64ModuleName = "uitsBase64.c";
+
+const char base64EncodeTable [] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* value of each character, or BASE64_SPACE or BASE64_INVALID */
+const unsigned char base64DecodeTable [256] = {
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 254, 254, 255, 255, 254, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+	 52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+	255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	 15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+	255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	 41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+/*
+ *
+ * Function: uitsBase64EncodedLength
+ * Purpose:	 Get the length of the encoding of a message
+ * Returns:  Number of characters, not counting the terminator
+ *
+ */
+
+size_t uitsBase64EncodedLength (size_t length, int b64LFFlag)
+{
+	size_t encodedLength = (length + 2) / 3 * 4;
+
+	if (b64LFFlag && encodedLength) {
+		encodedLength += (encodedLength - 1) / BASE64_LINE_SIZE;
+	}
+
+	return (encodedLength);
+}
+
+/*
+ *
+ * Function: uitsBase64EncodeBuffer
+ * Purpose:	 Base 64 encode a message into a buffer, which must have room for
+ *			 uitsBase64EncodedLength characters and a terminator
+ * Returns:  Number of characters written, not counting the terminator
+ *
+ */
+
+size_t uitsBase64EncodeBuffer (const unsigned char *message, size_t length, char *encoded, int b64LFFlag)
+{
+	char			*out = encoded;
+	size_t			lineLength = 0;
+	size_t			i;
+	unsigned long	bits;
+
+	i = 0;
+#ifdef UITS_X86_SIMD
+	if (__builtin_cpu_supports("avx2")) {
+		i = uitsBase64EncodeAVX2(message, length, &out, b64LFFlag);
+		if (b64LFFlag && i) {
+			lineLength = BASE64_LINE_SIZE;
+		}
+	}
+#endif
+
+	for (; i + 3 <= length; i += 3) {
+		if (b64LFFlag && lineLength == BASE64_LINE_SIZE) {
+			*out++ = '\n';
+			lineLength = 0;
+		}
+		bits = ((unsigned long) message[i] << 16) | ((unsigned long) message[i + 1] << 8) | message[i + 2];
+		out[0] = base64EncodeTable[bits >> 18];
+		out[1] = base64EncodeTable[(bits >> 12) & 0x3f];
+		out[2] = base64EncodeTable[(bits >> 6) & 0x3f];
+		out[3] = base64EncodeTable[bits & 0x3f];
+		out += 4;
+		lineLength += 4;
+	}
+
+	if (i < length) {
+		if (b64LFFlag && lineLength == BASE64_LINE_SIZE) {
+			*out++ = '\n';
+		}
+		bits = (unsigned long) message[i] << 16;
+		if (i + 1 < length) {
+			bits |= (unsigned long) message[i + 1] << 8;
+		}
+		out[0] = base64EncodeTable[bits >> 18];
+		out[1] = base64EncodeTable[(bits >> 12) & 0x3f];
+		out[2] = (i + 1 < length) ? base64EncodeTable[(bits >> 6) & 0x3f] : '=';
+		out[3] = '=';
+		out += 4;
+	}
+
+	*out = '\0';
+
+	return (out - encoded);
+}
+
+/*
+ *
+ * Function: uitsBase64DecodeBuffer
+ * Purpose:	 Decode a base 64 message, with or without line feeds, into a buffer of
+ *			 messageSize bytes. The padding may be left out.
+ * Returns:  OK, or ERROR if the message isn't base 64 or doesn't fit
+ *
+ */
+
+int uitsBase64DecodeBuffer (const char *encoded, size_t length, unsigned char *message,
+							size_t messageSize, size_t *messageLength)
+{
+	unsigned char	*out	= message;
+	unsigned char	*outEnd = message + messageSize;
+	unsigned long	bits	= 0;
+	int				numChars = 0;
+	int				value;
+	size_t			i;
+#ifdef UITS_X86_SIMD
+	int				avx2Flag = __builtin_cpu_supports("avx2");
+#endif
+
+	*messageLength = 0;
+
+	for (i = 0; i < length; i++) {
+#ifdef UITS_X86_SIMD
+		while (avx2Flag && numChars == 0 && i + 32 <= length && out + 24 <= outEnd &&
+			   uitsBase64DecodeGroupAVX2(encoded + i, out)) {
+			i	+= 32;
+			out += 24;
+		}
+		if (i == length) {
+			break;
+		}
+#endif
+		value = base64DecodeTable[(unsigned char) encoded[i]];
+		if (value == BASE64_SPACE) {
+			continue;
+		}
+		if (value == BASE64_INVALID) {
+			break;
+		}
+
+		bits = (bits << 6) | value;
+		if (++numChars == 4) {
+			if (out + 3 > outEnd) {
+				return (ERROR);
+			}
+			out[0] = (unsigned char) (bits >> 16);
+			out[1] = (unsigned char) (bits >> 8);
+			out[2] = (unsigned char) bits;
+			out += 3;
+			bits = 0;
+			numChars = 0;
+		}
+	}
+
+	/* only padding and white space can follow the characters */
+	for (; i < length; i++) {
+		if (encoded[i] != '=' && base64DecodeTable[(unsigned char) encoded[i]] != BASE64_SPACE) {
+			return (ERROR);
+		}
+	}
+
+	switch (numChars) {
+
+		case 0:
+			break;
+
+		case 2:
+			if (out + 1 > outEnd) {
+				return (ERROR);
+			}
+			*out++ = (unsigned char) (bits >> 4);
+			break;
+
+		case 3:
+			if (out + 2 > outEnd) {
+				return (ERROR);
+			}
+			*out++ = (unsigned char) (bits >> 10);
+			*out++ = (unsigned char) (bits >> 2);
+			break;
+
+		default:
+			return (ERROR);
+	}
+
+	*messageLength = out - message;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsBase64CharValue
+ * Purpose:	 Look up the value of a base 64 character
+ * Returns:  0 to 63, BASE64_SPACE for white space, or BASE64_INVALID
+ *
+ */
+
+int uitsBase64CharValue (unsigned char encodedChar)
+{
+	return (base64DecodeTable[encodedChar]);
+}
+
+#ifdef UITS_X86_SIMD
+
+/*
+ *
+ * Function: uitsBase64EncodeAVX2
+ * Purpose:	 Encode the whole 24 byte groups of a message (whole 48 byte lines with line
+ *			 feeds) and advance the output pointer. The loads of the last group read 4 bytes
+ *			 past it, so those must be in the message.
+ * Returns:  Number of message bytes encoded
+ *
+ */
+
+__attribute__((target("avx2")))
+size_t uitsBase64EncodeAVX2 (const unsigned char *message, size_t length, char **out, int b64LFFlag)
+{
+	size_t i = 0;
+
+	if (b64LFFlag) {
+		for (; i + 52 <= length; i += 48) {
+			if (i) {
+				*(*out)++ = '\n';
+			}
+			uitsBase64EncodeGroupAVX2(message + i, *out);
+			uitsBase64EncodeGroupAVX2(message + i + 24, *out + 32);
+			*out += BASE64_LINE_SIZE;
+		}
+	} else {
+		for (; i + 28 <= length; i += 24) {
+			uitsBase64EncodeGroupAVX2(message + i, *out);
+			*out += 32;
+		}
+	}
+
+	return (i);
+}
+
+/*
+ *
+ * Function: uitsBase64EncodeGroupAVX2
+ * Purpose:	 Encode 24 bytes into 32 characters (Mula's method). Each 128-bit half gets 12
+ *			 bytes, and each group of 3 bytes is spread over a 32-bit element, split into
+ *			 four 6-bit values with two multiplies, and turned into characters by adding
+ *			 the offset of the value's range, looked up with a shuffle.
+ *
+ */
+
+__attribute__((target("avx2")))
+void uitsBase64EncodeGroupAVX2 (const unsigned char *message, char *encoded)
+{
+	__m256i in, values, ranges;
+
+	in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) message)),
+								 _mm_loadu_si128((const __m128i *) (message + 12)), 1);
+	in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+												  1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+	values = _mm256_or_si256(
+		_mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040)),
+		_mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010)));
+
+	/* 0 for A-Z, 1 for a-z, 2 to 11 for 0-9, 12 for '+' and 13 for '/' */
+	ranges = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+	ranges = _mm256_or_si256(ranges, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), values),
+													  _mm256_set1_epi8(13)));
+	ranges = _mm256_shuffle_epi8(_mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+												  '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+												  '/' - 63, 'A', 0, 0,
+												  'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+												  '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+												  '/' - 63, 'A', 0, 0), ranges);
+
+	_mm256_storeu_si256((__m256i *) encoded, _mm256_add_epi8(values, ranges));
+}
+
+/*
+ *
+ * Function: uitsBase64DecodeGroupAVX2
+ * Purpose:	 Decode 32 characters into 24 bytes. A character is valid if the bit for its
+ *			 high nibble is set in the mask looked up with its low nibble, and its value
+ *			 is found by adding an offset looked up with its high nibble. The values are
+ *			 packed with two multiply-adds and two shuffles.
+ * Returns:  TRUE, or FALSE with nothing written if any of the characters isn't one of
+ *			 the 64 (white space and padding included)
+ *
+ */
+
+__attribute__((target("avx2")))
+int uitsBase64DecodeGroupAVX2 (const char *encoded, unsigned char *message)
+{
+	__m256i in, highNibbles, lowNibbles, valid, offsets, values;
+
+	in			= _mm256_loadu_si256((const __m256i *) encoded);
+	highNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+	lowNibbles	= _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+
+	/* the high nibbles that are valid with each low nibble: bit n for n = 2 to 7 */
+	valid = _mm256_and_si256(
+		_mm256_shuffle_epi8(_mm256_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+											 (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+											 (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+											 (char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+											 (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+											 (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54), lowNibbles),
+		_mm256_shuffle_epi8(_mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+											 0, 0, 0, 0, 0, 0, 0, 0,
+											 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+											 0, 0, 0, 0, 0, 0, 0, 0), highNibbles));
+	if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(valid, _mm256_setzero_si256()))) {
+		return (FALSE);
+	}
+
+	/* '+' and '/' have the same high nibble, so '/' is picked out on its own */
+	offsets = _mm256_shuffle_epi8(_mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+												   0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+								  highNibbles);
+	offsets = _mm256_blendv_epi8(offsets, _mm256_set1_epi8(16), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')));
+	values	= _mm256_add_epi8(in, offsets);
+
+	/* four 6-bit values to a 24-bit value in each 32-bit element, then 12 bytes in each half */
+	values = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+	values = _mm256_madd_epi16(values, _mm256_set1_epi32(0x00011000));
+	values = _mm256_shuffle_epi8(values, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+														  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	values = _mm256_permutevar8x32_epi32(values, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+	_mm_storeu_si128((__m128i *) message, _mm256_castsi256_si128(values));
+	_mm_storel_epi64((__m128i *) (message + 16), _mm256_extracti128_si256(values, 1));
+
+	return (TRUE);
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,49 @@
+/*
+ *  uitsBase64.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsbase64_h_
+#  define _uitsbase64_h_
+
+#define BASE64_LINE_SIZE			64			/* characters per line when encoding with line feeds */
+#define BASE64_SIGNATURE_SIZE		1024		/* largest decoded signature, RSA with an 8192 bit key */
+#define BASE64_BUFFER_SIZE			256			/* encoded media hashes and other short values */
+
+/*
+ * Values in the decoding table that aren't base 64 characters
+ */
+
+#define BASE64_SPACE				254			/* white space, which is skipped */
+#define BASE64_INVALID				255
+
+/*
+ * PUBLIC Functions
+ */
+
+size_t	uitsBase64EncodedLength		(size_t length, int b64LFFlag);
+size_t	uitsBase64EncodeBuffer		(const unsigned char *message, size_t length, char *encoded, int b64LFFlag);
+int		uitsBase64DecodeBuffer		(const char *encoded, size_t length, unsigned char *message,
+									 size_t messageSize, size_t *messageLength);
+int		uitsBase64CharValue			(unsigned char encodedChar);
+
+#ifdef UITS_X86_SIMD
+size_t	uitsBase64EncodeAVX2		(const unsigned char *message, size_t length, char **out, int b64LFFlag);
+void	uitsBase64EncodeGroupAVX2	(const unsigned char *message, char *encoded);
+int		uitsBase64DecodeGroupAVX2	(const char *encoded, unsigned char *message);
+#endif
+
+#endif
+
+// EOF
@@ -0,0 +1,117 @@
+/*
+ *  uitsByteOrder.h
+ *  UITS_Tool
+ *
+ *  Fixed-width big-endian and little-endian loads and stores for header fields.
+ *  The values are assembled a byte at a time, so the results are the same on any
+ *  host and for any width of long. The compiler turns these into a single load
+ *  or store plus a byte swap (bswap/movbe) where the host byte order differs.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsbyteorder_h_
+#  define _uitsbyteorder_h_
+
+#include <stdint.h>
+
+/*
+ * Big-endian (AIFF, MP4, MP3, FLAC) loads
+ */
+
+static inline uint16_t uitsReadBE16 (const unsigned char *bytes)
+{
+	return ((uint16_t) ((bytes[0] << 8) | bytes[1]));
+}
+
+static inline uint32_t uitsReadBE32 (const unsigned char *bytes)
+{
+	return (((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) |
+			((uint32_t) bytes[2] << 8)  |  (uint32_t) bytes[3]);
+}
+
+static inline uint64_t uitsReadBE64 (const unsigned char *bytes)
+{
+	return (((uint64_t) uitsReadBE32(bytes) << 32) | (uint64_t) uitsReadBE32(&bytes[4]));
+}
+
+/*
+ * Little-endian (WAV) loads
+ */
+
+static inline uint16_t uitsReadLE16 (const unsigned char *bytes)
+{
+	return ((uint16_t) (bytes[0] | (bytes[1] << 8)));
+}
+
+static inline uint32_t uitsReadLE32 (const unsigned char *bytes)
+{
+	return ((uint32_t) bytes[0]         | ((uint32_t) bytes[1] << 8) |
+			((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24));
+}
+
+static inline uint64_t uitsReadLE64 (const unsigned char *bytes)
+{
+	return ((uint64_t) uitsReadLE32(bytes) | ((uint64_t) uitsReadLE32(&bytes[4]) << 32));
+}
+
+/*
+ * Big-endian stores
+ */
+
+static inline void uitsWriteBE16 (unsigned char *bytes, uint16_t value)
+{
+	bytes[0] = (unsigned char) (value >> 8);
+	bytes[1] = (unsigned char) value;
+}
+
+static inline void uitsWriteBE32 (unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = (unsigned char) (value >> 24);
+	bytes[1] = (unsigned char) (value >> 16);
+	bytes[2] = (unsigned char) (value >> 8);
+	bytes[3] = (unsigned char) value;
+}
+
+static inline void uitsWriteBE64 (unsigned char *bytes, uint64_t value)
+{
+	uitsWriteBE32(bytes, (uint32_t) (value >> 32));
+	uitsWriteBE32(&bytes[4], (uint32_t) value);
+}
+
+/*
+ * Little-endian stores
+ */
+
+static inline void uitsWriteLE16 (unsigned char *bytes, uint16_t value)
+{
+	bytes[0] = (unsigned char) value;
+	bytes[1] = (unsigned char) (value >> 8);
+}
+
+static inline void uitsWriteLE32 (unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = (unsigned char) value;
+	bytes[1] = (unsigned char) (value >> 8);
+	bytes[2] = (unsigned char) (value >> 16);
+	bytes[3] = (unsigned char) (value >> 24);
+}
+
+static inline void uitsWriteLE64 (unsigned char *bytes, uint64_t value)
+{
+	uitsWriteLE32(bytes, (uint32_t) value);
+	uitsWriteLE32(&bytes[4], (uint32_t) (value >> 32));
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,358 @@
+/*
+ *  uitsContainerIndex.c
+ *  UITS_Tool
+ *
+ *  Builds an in-memory index of the chunks (RIFF, AIFF) or atoms (MP4) in an
+ *  audio file in a single forward pass over the file. The format managers
+ *  look chunks up in the index instead of walking the file for every search.
+ *
+ *  The most recently built index is kept, so looking up several chunks in the
+ *  same file (for example, the payload and then the audio data during verify)
+ *  only reads the chunk headers once.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *containerModuleName = "uitsContainerIndex.c";
+
+UITS_CONTAINER_INDEX *currContainerIndex = NULL;	/* most recently built index */
+
+/*
+ * MP4 atoms that contain other atoms. Only these are descended into.
+ */
+
+char *mp4ParentAtomTypes [] = {
+	"moov", "trak", "mdia", "minf", "stbl", "udta", "edts", "dinf", "mvex", "moof", "traf", "mfra",
+	NULL	// end of list
+};
+
+/*
+ *
+ * Function: uitsContainerIndexGet
+ * Purpose:	 Return the chunk index for a file, building it if necessary.
+ *			 The previous index is reused if it is for the same container type and the
+ *			 file has the same device, inode, size and modification time. Anything that
+ *			 modifies a file after it has been indexed should call uitsContainerIndexInvalidate.
+ *           The file pointer is returned to it's original position
+ * Passed:   File pointer, container type
+ * Returns:  Pointer to the index. The index is owned by this module.
+ */
+
+UITS_CONTAINER_INDEX *uitsContainerIndexGet (FILE *fpin, int containerType)
+{
+	struct stat fileStat;
+	off_t		saveSeek;
+
+	err = uitsIOStat(fpin, &fileStat);
+	uitsHandleErrorINT(containerModuleName, "uitsContainerIndexGet", err, OK, ERR_FILE, "Couldn't get audio file status\n");
+
+	if (currContainerIndex &&
+		(currContainerIndex->containerType == containerType) &&
+		(currContainerIndex->fileDevice    == fileStat.st_dev) &&
+		(currContainerIndex->fileInode     == fileStat.st_ino) &&
+		(currContainerIndex->fileSize      == fileStat.st_size) &&
+		(currContainerIndex->fileModTime   == fileStat.st_mtime)) {
+		return (currContainerIndex);
+	}
+
+	uitsContainerIndexInvalidate();
+
+	saveSeek = ftello(fpin);
+	currContainerIndex = uitsContainerIndexBuild(fpin, containerType, fileStat.st_size);
+	fseeko(fpin, saveSeek, SEEK_SET);
+
+	currContainerIndex->fileDevice  = fileStat.st_dev;
+	currContainerIndex->fileInode   = fileStat.st_ino;
+	currContainerIndex->fileModTime = fileStat.st_mtime;
+
+	return (currContainerIndex);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexInvalidate
+ * Purpose:	 Discard the saved index
+ *
+ */
+
+void uitsContainerIndexInvalidate (void)
+{
+	uitsContainerIndexFree(currContainerIndex);
+	currContainerIndex = NULL;
+}
+
+/*
+ *
+ * Function: uitsContainerIndexFindChild
+ * Purpose:	 Find the first child of a chunk with the requested type (and sub-type)
+ * Passed:   Index
+ *			 Parent entry (NULL to search the top-level chunks)
+ *			 Type of chunk to find
+ *			 Sub-type of chunk to find (NULL if don't care)
+ * Returns:  Pointer to the entry or NULL if not found
+ */
+
+UITS_CONTAINER_ENTRY *uitsContainerIndexFindChild (UITS_CONTAINER_INDEX *index,
+												   UITS_CONTAINER_ENTRY *parent,
+												   char *type,
+												   char *subType)
+{
+	UITS_CONTAINER_ENTRY *entry;
+	UITS_CONTAINER_ENTRY *endEntry = index->entries + index->numEntries;
+	int depth;
+
+	if (parent) {
+		entry = parent + 1;
+		depth = parent->depth + 1;
+	} else {
+		entry = index->entries;
+		depth = 0;
+	}
+
+	/* children follow their parent until the next entry at the parent's depth */
+	for ( ; (entry < endEntry) && (entry->depth >= depth); entry++) {
+		if ((entry->depth == depth) &&
+			(strncmp(entry->type, type, 4) == 0) &&
+			(!subType || (strncmp(entry->subType, subType, 4) == 0))) {
+			return (entry);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexFindSibling
+ * Purpose:	 Find the next chunk after an entry with the same parent and the requested
+ *			 type (and sub-type)
+ * Passed:   Index
+ *			 Entry to start searching after
+ *			 Type of chunk to find
+ *			 Sub-type of chunk to find (NULL if don't care)
+ * Returns:  Pointer to the entry or NULL if not found
+ */
+
+UITS_CONTAINER_ENTRY *uitsContainerIndexFindSibling (UITS_CONTAINER_INDEX *index,
+													 UITS_CONTAINER_ENTRY *entry,
+													 char *type,
+													 char *subType)
+{
+	UITS_CONTAINER_ENTRY *currEntry;
+	UITS_CONTAINER_ENTRY *endEntry = index->entries + index->numEntries;
+
+	for (currEntry = entry + 1; (currEntry < endEntry) && (currEntry->depth >= entry->depth); currEntry++) {
+		if ((currEntry->depth == entry->depth) &&
+			(strncmp(currEntry->type, type, 4) == 0) &&
+			(!subType || (strncmp(currEntry->subType, subType, 4) == 0))) {
+			return (currEntry);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexBuild
+ * Purpose:	 Build the index for a file
+ *			 RIFF and AIFF files start with a 12-byte header ('RIFF'/'RF64'/'FORM', size, form type)
+ *			 and the chunks follow it. MP4 files are a list of atoms starting at the beginning of
+ *			 the file.
+ * Passed:   File pointer, container type, file size
+ * Returns:  Pointer to the new index
+ */
+
+UITS_CONTAINER_INDEX *uitsContainerIndexBuild (FILE *fpin, int containerType, off_t fileSize)
+{
+	UITS_CONTAINER_INDEX *index = calloc(sizeof(UITS_CONTAINER_INDEX), 1);
+	uitsHandleErrorPTR(containerModuleName, "uitsContainerIndexBuild", index, ERR_UITS, "Couldn't allocate container index\n");
+
+	index->containerType = containerType;
+	index->fileSize		 = fileSize;
+
+	if (containerType == CONTAINER_MP4) {
+		uitsContainerIndexWalk(fpin, index, 0, fileSize, 0);
+	} else {
+		uitsContainerIndexWalk(fpin, index, CONTAINER_HEADER_SIZE + 4, fileSize, 0);
+	}
+
+	return (index);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexWalk
+ * Purpose:	 Add the chunks between two file offsets to the index, descending into MP4
+ *			 parent atoms. A truncated or malformed chunk ends the walk, just like the
+ *			 format managers' chunk searches did.
+ *			 In RF64 files, 32-bit sizes of 0xFFFFFFFF are replaced with the 64-bit
+ *			 sizes from the 'ds64' chunk.
+ * Passed:   File pointer, index, start and end of the chunk list, depth of the chunks
+ * Returns:  OK
+ */
+
+int uitsContainerIndexWalk (FILE *fpin,
+							UITS_CONTAINER_INDEX *index,
+							off_t startSeek,
+							off_t endSeek,
+							int depth)
+{
+	UITS_CONTAINER_ENTRY *entry;
+	WAV_DS64_CHUNK	ds64Chunk;
+	unsigned char	header[CONTAINER_HEADER_SIZE];
+	unsigned char	extendedSize[8];
+	unsigned long long atomSize;
+	off_t			currSeek = startSeek;
+	int				foundDS64 = FALSE;
+
+	while (currSeek + CONTAINER_HEADER_SIZE <= endSeek) {
+		fseeko(fpin, currSeek, SEEK_SET);
+		if (fread(header, 1, CONTAINER_HEADER_SIZE, fpin) != CONTAINER_HEADER_SIZE) {
+			break;
+		}
+
+		entry = uitsContainerIndexAddEntry(index);
+		entry->offset	  = currSeek;
+		entry->depth	  = depth;
+		entry->headerSize = CONTAINER_HEADER_SIZE;
+
+		switch (index->containerType) {
+			case CONTAINER_RIFF:
+				memcpy(entry->type, &header[0], 4);
+				entry->size = uitsReadLE32(&header[4]);
+
+				if ((currSeek == startSeek) && (strncmp(entry->type, "ds64", 4) == 0)) {
+					foundDS64 = wavReadDS64Chunk(fpin, &ds64Chunk);
+				}
+				if (foundDS64 && (entry->size == WAV_RF64_SIZE_MARKER)) {
+					entry->size = wavGetDS64ChunkSize(&ds64Chunk, entry->type);
+				}
+
+				/* skip the data and the pad byte (if necessary) */
+				currSeek += CONTAINER_HEADER_SIZE + entry->size + (entry->size & 0x01);
+				break;
+
+			case CONTAINER_AIFF:
+				memcpy(entry->type, &header[0], 4);
+				entry->size = uitsReadBE32(&header[4]);
+
+				/* 'APPL' chunks start with a 4-byte OSType that identifies the application */
+				if ((strncmp(entry->type, "APPL", 4) == 0) && (entry->size >= 4)) {
+					if (fread(entry->subType, 1, 4, fpin) != 4) {
+						memset(entry->subType, 0, sizeof(entry->subType));
+					}
+				}
+
+				currSeek += CONTAINER_HEADER_SIZE + entry->size + (entry->size & 0x01);
+				break;
+
+			case CONTAINER_MP4:
+				memcpy(entry->type, &header[4], 4);
+				atomSize = uitsReadBE32(&header[0]);
+
+				if (atomSize == 1) {	/* extended (64 bit) atom size follows the type */
+					if (fread(extendedSize, 1, 8, fpin) != 8) {
+						index->numEntries--;
+						return (OK);
+					}
+					atomSize = uitsReadBE64(extendedSize);
+					entry->headerSize = CONTAINER_EXTENDED_HEADER_SIZE;
+				} else if (atomSize == 0) {	/* size of 0 means atom lasts until the end */
+					atomSize = endSeek - currSeek;
+				}
+
+				if (atomSize < (unsigned long long) entry->headerSize) {	/* malformed atom, stop here */
+					index->numEntries--;
+					return (OK);
+				}
+				entry->size = atomSize - entry->headerSize;
+
+				if (uitsContainerIndexIsMP4Parent(entry->type)) {
+					uitsContainerIndexWalk(fpin, index, currSeek + entry->headerSize, currSeek + atomSize, depth + 1);
+				}
+
+				currSeek += atomSize;
+				break;
+
+			default:
+				snprintf(errStr, ERRSTR_LEN, "Error uitsContainerIndexWalk: Invalid containerType value=%d\n",
+						 index->containerType);
+				uitsHandleErrorINT(containerModuleName, "uitsContainerIndexWalk", ERROR, OK, ERR_VALUE, errStr);
+		}
+	}
+
+	if (foundDS64) {
+		wavFreeDS64Chunk(&ds64Chunk);
+	}
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexIsMP4Parent
+ * Purpose:	 Check if an MP4 atom type contains other atoms
+ * Returns:  TRUE or FALSE
+ */
+
+int uitsContainerIndexIsMP4Parent (unsigned char *type)
+{
+	char **parentType = mp4ParentAtomTypes;
+
+	while (*parentType) {
+		if (strncmp(type, *parentType, 4) == 0) {
+			return (TRUE);
+		}
+		parentType++;
+	}
+
+	return (FALSE);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexAddEntry
+ * Purpose:	 Add an empty entry to the end of the index, growing the entry table if necessary
+ * Returns:  Pointer to the new entry. Pointers to entries are only valid until the next entry is added.
+ */
+
+UITS_CONTAINER_ENTRY *uitsContainerIndexAddEntry (UITS_CONTAINER_INDEX *index)
+{
+	UITS_CONTAINER_ENTRY *entry;
+
+	if (index->numEntries == index->maxEntries) {
+		index->maxEntries = index->maxEntries ? (index->maxEntries * 2) : CONTAINER_MIN_ENTRIES;
+		index->entries = realloc(index->entries, index->maxEntries * sizeof(UITS_CONTAINER_ENTRY));
+		uitsHandleErrorPTR(containerModuleName, "uitsContainerIndexAddEntry", index->entries, ERR_UITS,
+						   "Couldn't allocate container index entries\n");
+	}
+
+	entry = &index->entries[index->numEntries++];
+	memset(entry, 0, sizeof(UITS_CONTAINER_ENTRY));
+
+	return (entry);
+}
+
+/*
+ *
+ * Function: uitsContainerIndexFree
+ * Purpose:	 Free an index
+ *
+ */
+
+void uitsContainerIndexFree (UITS_CONTAINER_INDEX *index)
+{
+	if (index) {
+		free(index->entries);
+		free(index);
+	}
+}
+
+// EOF
@@ -0,0 +1,88 @@
+/*
+ *  uitsContainerIndex.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitscontainerindex_h_
+#  define _uitscontainerindex_h_
+
+#define CONTAINER_HEADER_SIZE			8
+#define CONTAINER_EXTENDED_HEADER_SIZE	16		/* MP4 size of 1 is followed by a 64-bit size */
+#define CONTAINER_MIN_ENTRIES			32		/* initial size of the entry table */
+
+/*
+ * Chunk/atom based file formats that can be indexed
+ */
+enum uitsContainerTypes {
+	CONTAINER_RIFF,			/* WAV: little-endian sizes, data padded to even size */
+	CONTAINER_AIFF,			/* AIFF: big-endian sizes, data padded to even size */
+	CONTAINER_MP4			/* ISO-BMFF: big-endian sizes including the header, nested atoms */
+};
+
+/*
+ * Structures
+ */
+
+typedef struct {
+	unsigned char		type[5];		/* 4-character chunk ID or atom type, null-terminated */
+	unsigned char		subType[5];		/* AIFF 'APPL' OSType, null-terminated (empty for other chunks) */
+	off_t				offset;			/* file offset of the chunk header */
+	unsigned long long	size;			/* size of the chunk data, NOT including the header */
+	int					headerSize;		/* 8, or 16 for an extended (64-bit) size MP4 atom */
+	int					depth;			/* 0 for top-level chunks, 1 for their children, etc. */
+} UITS_CONTAINER_ENTRY;
+
+typedef struct {
+	int					containerType;
+	dev_t				fileDevice;		/* identifies the indexed file (see uitsContainerIndexGet) */
+	ino_t				fileInode;
+	off_t				fileSize;
+	time_t				fileModTime;
+	int					numEntries;
+	int					maxEntries;
+	UITS_CONTAINER_ENTRY *entries;		/* chunks/atoms in file order, children follow their parent */
+} UITS_CONTAINER_INDEX;
+
+/*
+ * PUBLIC Functions
+ */
+
+UITS_CONTAINER_INDEX *uitsContainerIndexGet			(FILE *fpin, int containerType);
+void				 uitsContainerIndexInvalidate	(void);
+UITS_CONTAINER_ENTRY *uitsContainerIndexFindChild	(UITS_CONTAINER_INDEX *index,
+													 UITS_CONTAINER_ENTRY *parent,
+													 char *type,
+													 char *subType);
+UITS_CONTAINER_ENTRY *uitsContainerIndexFindSibling	(UITS_CONTAINER_INDEX *index,
+													 UITS_CONTAINER_ENTRY *entry,
+													 char *type,
+													 char *subType);
+
+/*
+ * PRIVATE Functions
+ */
+
+UITS_CONTAINER_INDEX *uitsContainerIndexBuild		(FILE *fpin, int containerType, off_t fileSize);
+int					 uitsContainerIndexWalk			(FILE *fpin,
+													 UITS_CONTAINER_INDEX *index,
+													 off_t startSeek,
+													 off_t endSeek,
+													 int depth);
+int					 uitsContainerIndexIsMP4Parent	(unsigned char *type);
+UITS_CONTAINER_ENTRY *uitsContainerIndexAddEntry	(UITS_CONTAINER_INDEX *index);
+void				 uitsContainerIndexFree			(UITS_CONTAINER_INDEX *index);
+
+#endif
+
+// EOF
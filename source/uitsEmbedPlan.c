@@ -0,0 +1,367 @@
+/*
+ *  uitsEmbedPlan.c
+ *  UITS_Tool
+ *
+ *  An embed plan records, once per source file, where a payload goes: the header
+ *  bytes that change, the size fields to patch and the byte range that is copied
+ *  unchanged. The payload goes after the ID3v2 frames in MP3 and in a metadata block
+ *  in FLAC (the header is rebuilt by the format's embed callback), and in a trailing
+ *  uuid atom or chunk in MP4, WAV and AIFF (only size fields change). Each output is
+ *  then written as header + payload + the unchanged range, which is copied inside
+ *  the kernel (see uitsAudioKernelCopy), so the source is not re-parsed and the audio
+ *  is not read into user space.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *planModuleName = "uitsEmbedPlan.c";
+
+/*
+ *
+ * Function: uitsEmbedPlanCreate
+ * Purpose:	 Work out where the payload goes in an audio file
+ * Returns:  Pointer to the plan, NULL if the format has no plan or the file's layout
+ *			 can't be planned (the regular embed has to be used) or exit on error
+ *
+ */
+
+UITS_EMBED_PLAN *uitsEmbedPlanCreate (char *audioFileName)
+{
+	UITS_AUDIO_CALLBACKS *currAudioCB;
+	UITS_EMBED_PLAN		 *plan;
+	FILE				 *audioInFP;
+
+	currAudioCB = uitsAudioGetCB(audioFileName);
+	if (!currAudioCB->uitsAudioGetEmbedPlan) {
+		return (NULL);
+	}
+
+	plan = calloc(1, sizeof(UITS_EMBED_PLAN));
+	uitsHandleErrorPTR(planModuleName, "uitsEmbedPlanCreate", plan, ERR_EMBED, "Couldn't allocate embed plan\n");
+
+	plan->audioFileName = strdup(audioFileName);
+	plan->audioFileType = currAudioCB->uitsAudioFileType;
+
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(planModuleName, "uitsEmbedPlanCreate", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+
+	plan->audioFileSize = uitsGetFileSize(audioInFP);
+	err = uitsIOStat(audioInFP, &plan->audioFileStat);
+	uitsHandleErrorINT(planModuleName, "uitsEmbedPlanCreate", err, OK, ERR_FILE, "Couldn't stat audio file\n");
+	fclose(audioInFP);
+
+	if (currAudioCB->uitsAudioGetEmbedPlan(audioFileName, plan) != OK) {
+		dprintf("No embed plan for %s\n", audioFileName);
+		uitsEmbedPlanFree(plan);
+		return (NULL);
+	}
+
+	dprintf("Embed plan for %s: %lu header bytes, %d size fields, %s\n", audioFileName,
+			(unsigned long) plan->headerLength, plan->numPatches, plan->trailerFlag ? "trailing payload" : "payload in header");
+
+	return (plan);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanWrite
+ * Purpose:	 Write a copy of the planned file with the payload embedded. The output can
+ *			 be a file, a pipe or a socket; it is written from start to end without seeking.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsEmbedPlanWrite (UITS_EMBED_PLAN *plan,
+						FILE *audioOutFP,
+						char *uitsPayloadXML,
+						int  numPadBytes)
+{
+	FILE			*audioInFP;
+	unsigned char	trailer[EMBED_PLAN_MAX_TRAILER];
+	unsigned long	payloadXMLSize = strlen(uitsPayloadXML);
+	off_t			suffixLength = plan->audioFileSize - plan->headerLength;
+
+	audioInFP = uitsIOOpen(plan->audioFileName, "rb");
+	uitsHandleErrorPTR(planModuleName, "uitsEmbedPlanWrite", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+
+	/* the plan is only good for the file it was made from */
+	if (!uitsEmbedPlanMatchesFile(plan, audioInFP)) {
+		uitsHandleErrorINT(planModuleName, "uitsEmbedPlanWrite", ERROR, OK, ERR_EMBED,
+						   "Audio file has changed since the embed plan was made\n");
+	}
+
+	err = uitsEmbedPlanWriteHeader(plan, audioOutFP, uitsPayloadXML, numPadBytes);
+	uitsHandleErrorINT(planModuleName, "uitsEmbedPlanWrite", err, OK, ERR_EMBED, "Couldn't write audio header\n");
+
+	fseeko(audioInFP, plan->headerLength, SEEK_SET);
+	if (uitsAudioBufferedCopy(audioInFP, audioOutFP, suffixLength) != suffixLength) {
+		uitsHandleErrorINT(planModuleName, "uitsEmbedPlanWrite", ERROR, OK, ERR_FILE, "Couldn't copy audio data\n");
+	}
+	fclose(audioInFP);
+
+	if (plan->trailerFlag) {
+		memcpy(trailer, plan->trailer, plan->trailerLength);
+		err = uitsEmbedPlanWriteField(&trailer[plan->trailerPatch.offset], &plan->trailerPatch, payloadXMLSize);
+		uitsHandleErrorINT(planModuleName, "uitsEmbedPlanWrite", err, OK, ERR_EMBED, "Payload is too large for the container\n");
+
+		if (fwrite(trailer, 1, plan->trailerLength, audioOutFP) != plan->trailerLength ||
+			fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP) != payloadXMLSize ||
+			(plan->trailerPadFlag && (payloadXMLSize & 1) && fwrite("\0", 1, 1, audioOutFP) != 1)) {
+			uitsHandleErrorINT(planModuleName, "uitsEmbedPlanWrite", ERROR, OK, ERR_FILE, "Couldn't write UITS payload\n");
+		}
+	}
+
+	err = fflush(audioOutFP);
+	uitsHandleErrorINT(planModuleName, "uitsEmbedPlanWrite", err, OK, ERR_FILE, "Couldn't write audio output file\n");
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanWriteHeader
+ * Purpose:	 Write the header of the output: the source header with its size fields
+ *			 patched, or the source header run through the embed callback in memory
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsEmbedPlanWriteHeader (UITS_EMBED_PLAN *plan,
+							  FILE *audioOutFP,
+							  char *uitsPayloadXML,
+							  int  numPadBytes)
+{
+	char		  *headerInName  = "uits-plan-header-in";
+	char		  *headerOutName = "uits-plan-header-out";
+	unsigned char *header;
+	size_t		  headerLength;
+	int			  i;
+
+	if (plan->rebuildHeader) {
+		uitsIORegisterBuffer(headerInName, plan->header, plan->headerLength);
+		uitsIORegisterBuffer(headerOutName, NULL, 0);
+
+		err = plan->rebuildHeader(headerInName, headerOutName, uitsPayloadXML, numPadBytes);
+
+		header = uitsIOGetBuffer(headerOutName, &headerLength);
+		if (err == OK && headerLength && fwrite(header, 1, headerLength, audioOutFP) != headerLength) {
+			err = ERROR;
+		}
+
+		uitsIOUnregister(headerInName);
+		uitsIOUnregister(headerOutName);
+		uitsContainerIndexInvalidate();
+
+		return (err);
+	}
+
+	if (!plan->headerLength) {
+		return (OK);
+	}
+
+	header = malloc(plan->headerLength);
+	if (!header) {
+		return (ERROR);
+	}
+	memcpy(header, plan->header, plan->headerLength);
+
+	for (i = 0; i < plan->numPatches; i++) {
+		if (uitsEmbedPlanWriteField(&header[plan->patches[i].offset], &plan->patches[i], strlen(uitsPayloadXML)) != OK) {
+			vprintf("Payload would make the %s container larger than its size fields allow\n", plan->audioFileName);
+			free(header);
+			return (ERROR);
+		}
+	}
+
+	err = (fwrite(header, 1, plan->headerLength, audioOutFP) == plan->headerLength) ? OK : ERROR;
+	free(header);
+
+	return (err);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanIsCurrent
+ * Purpose:	 Check that the source file hasn't changed since the plan was made
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsEmbedPlanIsCurrent (UITS_EMBED_PLAN *plan)
+{
+	FILE *audioInFP;
+	int	 isCurrent;
+
+	audioInFP = uitsIOOpen(plan->audioFileName, "rb");
+	if (!audioInFP) {
+		return (FALSE);
+	}
+
+	isCurrent = uitsEmbedPlanMatchesFile(plan, audioInFP);
+	fclose(audioInFP);
+
+	return (isCurrent);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanMatchesFile
+ * Purpose:	 Compare an open source file with the file the plan was made from
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsEmbedPlanMatchesFile (UITS_EMBED_PLAN *plan, FILE *audioInFP)
+{
+	struct stat audioFileStat;
+
+	if (uitsIOStat(audioInFP, &audioFileStat) != OK) {
+		return (FALSE);
+	}
+
+	return (audioFileStat.st_dev   == plan->audioFileStat.st_dev &&
+			audioFileStat.st_ino   == plan->audioFileStat.st_ino &&
+			audioFileStat.st_size  == plan->audioFileStat.st_size &&
+			audioFileStat.st_mtime == plan->audioFileStat.st_mtime);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanFree
+ * Purpose:	 Free an embed plan
+ *
+ */
+
+void uitsEmbedPlanFree (UITS_EMBED_PLAN *plan)
+{
+	free(plan->audioFileName);
+	free(plan->header);
+	free(plan);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanReadHeader
+ * Purpose:	 Keep a copy of the first headerLength bytes of the source file in the plan
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsEmbedPlanReadHeader (UITS_EMBED_PLAN *plan, FILE *audioInFP, size_t headerLength)
+{
+	if ((off_t) headerLength > plan->audioFileSize) {
+		return (ERROR);
+	}
+
+	plan->header = malloc(headerLength ? headerLength : 1);
+	if (!plan->header) {
+		return (ERROR);
+	}
+
+	fseeko(audioInFP, 0, SEEK_SET);
+	if (fread(plan->header, 1, headerLength, audioInFP) != headerLength) {
+		return (ERROR);
+	}
+
+	plan->headerLength = headerLength;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanAddPatch
+ * Purpose:	 Add a size field in the header that grows with the payload. The header must
+ *			 already have been read.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsEmbedPlanAddPatch (UITS_EMBED_PLAN *plan,
+						   size_t offset,
+						   int  fieldType,
+						   long sizeAdjust,
+						   int  padFlag)
+{
+	UITS_EMBED_PATCH *patch;
+	size_t			 fieldSize = (fieldType == PLAN_FIELD_LE64) ? 8 : 4;
+
+	if (plan->numPatches == EMBED_PLAN_MAX_PATCHES || offset + fieldSize > plan->headerLength) {
+		return (ERROR);
+	}
+
+	patch = &plan->patches[plan->numPatches++];
+	patch->offset	  = offset;
+	patch->fieldType  = fieldType;
+	patch->baseValue  = uitsEmbedPlanReadField(&plan->header[offset], fieldType);
+	patch->sizeAdjust = sizeAdjust;
+	patch->padFlag	  = padFlag;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanReadField
+ * Purpose:	 Read a size field
+ * Returns:  The field value
+ *
+ */
+
+unsigned long long uitsEmbedPlanReadField (unsigned char *bytes, int fieldType)
+{
+	switch (fieldType) {
+		case PLAN_FIELD_LE32:
+			return (uitsReadLE32(bytes));
+		case PLAN_FIELD_BE32:
+			return (uitsReadBE32(bytes));
+		default:
+			return (uitsReadLE64(bytes));
+	}
+}
+
+/*
+ *
+ * Function: uitsEmbedPlanWriteField
+ * Purpose:	 Write the value of a size field for a payload
+ * Returns:  OK or ERROR if the value doesn't fit in the field
+ *
+ */
+
+int uitsEmbedPlanWriteField (unsigned char *bytes, UITS_EMBED_PATCH *patch, unsigned long payloadXMLSize)
+{
+	unsigned long long value;
+
+	value = patch->baseValue + payloadXMLSize + patch->sizeAdjust;
+	if (patch->padFlag) {
+		value += payloadXMLSize & 1;
+	}
+
+	switch (patch->fieldType) {
+		case PLAN_FIELD_LE32:
+			if (value > 0xffffffffULL) {
+				return (ERROR);
+			}
+			uitsWriteLE32(bytes, (uint32_t) value);
+			break;
+		case PLAN_FIELD_BE32:
+			if (value > 0xffffffffULL) {
+				return (ERROR);
+			}
+			uitsWriteBE32(bytes, (uint32_t) value);
+			break;
+		default:
+			uitsWriteLE64(bytes, value);
+			break;
+	}
+
+	return (OK);
+}
+
+// EOF
@@ -0,0 +1,112 @@
+/*
+ *  uitsEmbedPlan.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsembedplan_h_
+#  define _uitsembedplan_h_
+
+#define EMBED_PLAN_MAX_PATCHES	2
+#define EMBED_PLAN_MAX_TRAILER	32		/* bytes of container header in front of an appended payload */
+
+/*
+ * Size fields that are updated for each payload
+ */
+enum uitsEmbedPlanFieldTypes {
+	PLAN_FIELD_LE32,
+	PLAN_FIELD_BE32,
+	PLAN_FIELD_LE64
+};
+
+/*
+ * A size field in the header (or trailer) of the output. The new value is
+ *	baseValue + payload size + sizeAdjust (+ 1 if padFlag is set and the payload size is odd)
+ */
+
+typedef struct {
+	size_t				offset;
+	int					fieldType;
+	unsigned long long	baseValue;		/* value in the source file */
+	long				sizeAdjust;
+	int					padFlag;
+} UITS_EMBED_PATCH;
+
+/*
+ * Where the payload goes in one source file. The output is
+ *	header + source bytes [headerLength, audioFileSize) + trailer + payload + pad byte
+ * The header is either the source header with its size fields patched, or, if
+ * rebuildHeader is set, the result of running the format's embed callback on the
+ * source header (the payload is then written inside the header and there is no trailer).
+ */
+
+struct UITS_EMBED_PLAN {
+	char				*audioFileName;
+	int					audioFileType;
+	off_t				audioFileSize;
+	struct stat			audioFileStat;		/* used to detect a source file that changed after planning */
+
+	unsigned char		*header;			/* source bytes [0, headerLength) */
+	size_t				headerLength;
+	embedPayloadCB		*rebuildHeader;
+	UITS_EMBED_PATCH	patches[EMBED_PLAN_MAX_PATCHES];
+	int					numPatches;
+
+	int					trailerFlag;		/* TRUE if the payload is appended to the end of the file */
+	unsigned char		trailer[EMBED_PLAN_MAX_TRAILER];
+	size_t				trailerLength;
+	UITS_EMBED_PATCH	trailerPatch;		/* size field in the trailer, baseValue is 0 */
+	int					trailerPadFlag;		/* TRUE if an odd-sized payload is followed by a pad byte */
+};
+
+/*
+ * PUBLIC Functions
+ */
+
+UITS_EMBED_PLAN	*uitsEmbedPlanCreate		(char *audioFileName);
+int				uitsEmbedPlanWrite			(UITS_EMBED_PLAN *plan,
+											 FILE *audioOutFP,
+											 char *uitsPayloadXML,
+											 int  numPadBytes);
+int				uitsEmbedPlanIsCurrent		(UITS_EMBED_PLAN *plan);
+void			uitsEmbedPlanFree			(UITS_EMBED_PLAN *plan);
+
+/* used by the format managers to fill in a plan */
+
+int				uitsEmbedPlanReadHeader		(UITS_EMBED_PLAN *plan,
+											 FILE *audioInFP,
+											 size_t headerLength);
+int				uitsEmbedPlanAddPatch		(UITS_EMBED_PLAN *plan,
+											 size_t offset,
+											 int  fieldType,
+											 long sizeAdjust,
+											 int  padFlag);
+
+/*
+ * PRIVATE Functions
+ */
+
+unsigned long long	uitsEmbedPlanReadField	(unsigned char *bytes, int fieldType);
+int					uitsEmbedPlanWriteField	(unsigned char *bytes,
+											 UITS_EMBED_PATCH *patch,
+											 unsigned long payloadXMLSize);
+int					uitsEmbedPlanMatchesFile(UITS_EMBED_PLAN *plan,
+											 FILE *audioInFP);
+int					uitsEmbedPlanWriteHeader(UITS_EMBED_PLAN *plan,
+											 FILE *audioOutFP,
+											 char *uitsPayloadXML,
+											 int  numPadBytes);
+
+#endif
+
+// EOF
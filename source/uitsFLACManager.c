@@ -5,8 +5,9 @@
  *  Created by Chris Angelli on 4/19/10.
  *  Copyright 2010 Universal Music Group. All rights reserved.
  *
- *  This module uses the libFLAC C API to read and write FLAC
- *  files. 
+ *  This module reads and writes the FLAC metadata block headers
+ *  directly. The libFLAC headers are only used for the metadata
+ *  block type definitions.
  *
  *  $Date$
  *  $Revision$
@@ -29,18 +30,26 @@ char *flacModuleName = "uitsFLACManager.c";
 
 int flacIsValidFile (char *audioFileName) 
 {
-	FLAC__StreamMetadata *streamMetadata = calloc(sizeof(FLAC__StreamMetadata),1);
-
-	/* All FLAC files must have a stream info metadata block. */ 
-	/* FLAC_metadata_get_streaminfo will return true if metadata read, false if not */
-	err = FLAC__metadata_get_streaminfo(audioFileName, streamMetadata);
-	
-	if (err == TRUE) {
+	FILE						*audioFP;
+	FLAC_METADATA_BLOCK_HEADER	blockHeader;
+	int							isValid = FALSE;
+	
+	/* read through uitsIOOpen rather than libFLAC so that registered buffers and descriptors are recognized */
+	audioFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(flacModuleName, "flacIsValidFile", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
+	
+	/* All FLAC files must start with a stream info metadata block. */ 
+	if (flacSeekFirstMetadataBlock(audioFP) == OK &&
+		flacReadMetadataBlockHeader(audioFP, &blockHeader) == OK &&
+		blockHeader.blockType == FLAC__METADATA_TYPE_STREAMINFO &&
+		blockHeader.blockLength == FLAC__STREAM_METADATA_STREAMINFO_LENGTH) {
 		vprintf("Audio file is FLAC\n");
+		isValid = TRUE;
 	}
-
-	return (err);
 	
+	fclose(audioFP);
+	
+	return (isValid);
 	
 }
 
@@ -49,10 +58,10 @@ int flacIsValidFile (char *audioFileName)
  * Function: flacGetMediaHash
  * Purpose:	 Calcluate the media hash for a FLAC file
  *			 The FLAC file is parsed using the following algorithm:
- *			  1. Use the FLAC stream decoder to seek to the start of the first audio frame
- *			  2. Use the FLAC stream decoder to decode all of the audio frames, which leaves
- *				 the audio file pointer at the end of the audio data
- *			  3. Has the raw audio data between the first frame and last frame
+ *			  1. Walk the metadata block headers to find the start of the first audio frame
+ *			  2. Hash the raw audio data from the first frame to the end of the file
+ *
+ *			 No audio is decoded; only the 4-byte metadata block headers are read.
  *
  * Returns:   Pointer to the hashed frame data
  */
@@ -60,51 +69,29 @@ int flacIsValidFile (char *audioFileName)
 char *flacGetMediaHash (char *audioFileName) 
 {
 	FILE				*audioFP;
-	FLAC__StreamDecoder *decoder = NULL;
-	unsigned long		audioFrameStart, audioFrameEnd, audioFrameLength;
+	off_t				audioFrameStart, audioFrameEnd, audioFrameLength;
 	UITS_digest			*mediaHash;
 	char				*mediaHashString;
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(flacModuleName, "flacGetMediaHash", audioFP, ERR_FILE, "Couldn't open FLAC audio file for reading\n");
 	
-	decoder = FLAC__stream_decoder_new();
-	uitsHandleErrorPTR(flacModuleName, "flacGetMediaHash", decoder, ERR_FLAC, "Couldn't create FLAC stream decoder\n");
-
-		
-	err	= FLAC__stream_decoder_init_FILE (decoder, audioFP, flacWriteCallback, flacMetadataCallback, flacErrorCallback, NULL);
-	uitsHandleErrorINT(flacModuleName, "flacGetMediaHash", err, FLAC__STREAM_DECODER_INIT_STATUS_OK, ERR_FLAC,
-					   "Couldn't initialize decoder for file\n");
+	audioFrameStart = flacFindFirstAudioFrame(audioFP);
 	
-	err = FLAC__stream_decoder_seek_absolute(decoder, 1);
-	uitsHandleErrorINT(flacModuleName, "flacGetMediaHash", err, TRUE, ERR_FLAC,
-					   "FLAC stream seek to first audio frame failed\n");
-
-	// audioFP is at start of audio frame data
-	audioFrameStart  = ftello(audioFP);
-
-	err = FLAC__stream_decoder_process_until_end_of_stream (decoder);
-	uitsHandleErrorINT(flacModuleName, "flacGetMediaHash", err, TRUE, ERR_FLAC,
-					   "FLAC process to end of stream failed\n");
+	fseeko(audioFP, 0L, SEEK_SET);
+	audioFrameEnd = uitsGetFileSize(audioFP);
 	
-	// audioFP is at end of audio frame data
-	audioFrameEnd  = ftello(audioFP);
+	uitsHandleErrorINT(flacModuleName, "flacGetMediaHash", (audioFrameEnd > audioFrameStart), TRUE, ERR_FLAC,
+					   "FLAC file contains no audio frames\n");
 
 	audioFrameLength = audioFrameEnd - audioFrameStart;
 	
-	/* cleanup */
-	FLAC__stream_decoder_delete(decoder);
-	fclose(audioFP);
-
-//	vprintf("Audio Frame Start: %d, audioFrameEnd: %d, audioFrameLength: %d\n", audioFrameStart, audioFrameEnd, audioFrameLength);
+	dprintf("Audio Frame Start: %lld, audioFrameEnd: %lld, audioFrameLength: %lld\n", 
+			(long long) audioFrameStart, (long long) audioFrameEnd, (long long) audioFrameLength);
 	
-	// now reopen and read the raw audio data
-	audioFP = fopen(audioFileName, "rb");
-	uitsHandleErrorPTR(flacModuleName, "flacGetMediaHash", audioFP, ERR_FILE, 
-					   "Couldn't open FLAC audio file for reading\n");
-
+	/* fp is at start of audio frame data */
 	fseeko(audioFP, audioFrameStart, SEEK_SET);
-	mediaHash = uitsCreateDigestBuffered (audioFP, audioFrameLength, "SHA256") ;
+	mediaHash = uitsCreateMediaDigest (audioFP, audioFrameLength) ;
 	mediaHashString = uitsDigestToString(mediaHash);
 	
 	fclose(audioFP);
@@ -118,13 +105,16 @@ char *flacGetMediaHash (char *audioFileName)
  * Function: flacEmbedPayload
  * Purpose:	 Embed the UITS payload into an FLAC file
  *			 The following algorithm is used to embed the payload:
- *				1. Clone the input audio file to the output file.
- *				2. Create a new application metadata object for the UITS payload
- *				3. Populate the metadata object
- *				4. Read the existing metadata chain from the file
- *				5. Consolidate any padding in the metadata
- *				6. Add the UITS metadata object to the chain
- *				7. Write the updated metadata chain
+ *				1. Make sure there isn't already a UITS block (flacFindApplicationBlock), then
+ *				   walk the metadata block headers of the input file looking for a PADDING block
+ *				   big enough to hold the UITS APPLICATION block
+ *				2. If there is room in a PADDING block, the UITS block is carved out of it:
+ *				   the UITS block header and data overwrite the start of the padding and the
+ *				   remainder, if any, becomes a smaller PADDING block. The size of the metadata
+ *				   is unchanged, so if the output file is the input file it is updated in place.
+ *				3. Otherwise the UITS block is added after the last metadata block.
+ *				4. The output file is written in a single pass: the bytes in front of the
+ *				   UITS block, the UITS block, then the rest of the metadata and the audio frames.
  *
  *
  * Returns:   OK or ERROR
@@ -135,235 +125,496 @@ int flacEmbedPayload  (char *audioFileName,
 					  char *uitsPayloadXML,
 					  int  numPadBytes) 
 {
-	FLAC__StreamMetadata    *uitsFlacMetadata = NULL;
-	FLAC__StreamMetadata    *flacMetadata = NULL;
-	FLAC__Metadata_Chain    *flacMetadataChain = NULL;
-	FLAC__Metadata_Iterator *flacMetadataIterator = NULL;
-	
-	FLAC__byte			 *uitsMetadata;
-	unsigned long		 payloadSize;
-	int					 stillWalking;
+	FILE						*audioInFP, *audioOutFP;
+	FLAC_METADATA_BLOCK_HEADER	blockHeader;
+	FLAC_METADATA_BLOCK_HEADER	paddingBlock;
+	FLAC_METADATA_BLOCK_HEADER	lastBlock;
+	unsigned long				payloadSize;
+	unsigned long				uitsBlockLength;
+	off_t						audioInFileSize;
+	int							foundPadding = FALSE;
+	int							inPlaceFlag;
 
 	if (numPadBytes) {
 		vprintf("WARNING: Tried to add pad bytes to FLAC file. This is not supported.\n");
 	}
 	
-	/* clone the input file to the output file */
-	err = flacCloneAudioFile (audioFileName, audioFileNameOut);
-	uitsHandleErrorINT(flacModuleName, "flacEMbedPayload", err, OK, ERR_FLAC, 
-					   "Couldn't copy input FLAC audio file to output file\n");
-	
-	/* create the new FLAC metadata block */
-	uitsFlacMetadata = FLAC__metadata_object_new (FLAC__METADATA_TYPE_APPLICATION);
-	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", uitsFlacMetadata, ERR_FLAC, 
-					   "Couldn't create FLAC metadata object\n");
-	
-	
-	/* add the UITS payload to the metadata object */
-	
+	inPlaceFlag = (strcmp(audioFileName, audioFileNameOut) == 0);
+
 	/* the payload size must be a multiple of 8, so pad with 0 bytes if necessary */
 	payloadSize = strlen(uitsPayloadXML);
-	payloadSize	+= (payloadSize % 8);
+	payloadSize	+= (8 - (payloadSize % 8)) % 8;
 	
-	uitsMetadata = calloc(payloadSize, sizeof(FLAC__byte));
-	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", uitsMetadata, ERR_FLAC,
-					   "Couldn't allocate uitsMetadata\n");	
+	/* the UITS block data is the 4-byte application ID followed by the payload */
+	uitsBlockLength = FLAC_APPLICATION_ID_SIZE + payloadSize;
+	
+	if (uitsBlockLength > FLAC_MAX_BLOCK_LENGTH) {
+		uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", ERROR, OK, ERR_FLAC,
+						   "UITS payload is too large for a FLAC metadata block\n");
+	}
 	
-	uitsMetadata = strcpy (uitsMetadata, uitsPayloadXML);
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+
+	if (flacFindApplicationBlock(audioInFP, "UITS", &blockHeader)) {
+		uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", ERROR, OK, ERR_FLAC,
+						   "Audio input file already contains a UITS payload \n");
+	}
+
+	err = flacSeekFirstMetadataBlock(audioInFP);
+	uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, OK, ERR_FLAC,
+					   "Couldn't find FLAC stream marker\n");
+
+	/* walk the metadata block headers */
+	do {
+		err = flacReadMetadataBlockHeader(audioInFP, &blockHeader);
+		uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, OK, ERR_FLAC,
+						   "Couldn't read FLAC metadata block header\n");
 		
+		/* the UITS block either fills the padding exactly or leaves room for a smaller padding block */
+		if ((blockHeader.blockType == FLAC__METADATA_TYPE_PADDING) && !foundPadding) {
+			if ((blockHeader.blockLength == uitsBlockLength) ||
+				(blockHeader.blockLength >= uitsBlockLength + FLAC_BLOCK_HEADER_SIZE)) {
+				paddingBlock = blockHeader;
+				foundPadding = TRUE;
+			}
+		}
+		
+		fseeko(audioInFP, blockHeader.blockLength, SEEK_CUR);
+	} while (!blockHeader.isLast);
 	
-	/* Set the Application block application ID */
+	lastBlock = blockHeader;
 	
-	uitsFlacMetadata->data.application.id[0] = 'U';
-	uitsFlacMetadata->data.application.id[1] = 'I';
-	uitsFlacMetadata->data.application.id[2] = 'T';
-	uitsFlacMetadata->data.application.id[3] = 'S';
+	if (foundPadding) {
+		vprintf("Carving UITS block out of %lu bytes of FLAC padding\n", paddingBlock.blockLength);
+	}
 	
-	err = FLAC__metadata_object_application_set_data (uitsFlacMetadata, uitsMetadata, payloadSize, FALSE);
-  	uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, TRUE, ERR_FLAC,
-					   "Couldn't add UITS payload data to FLAC metadata object\n");
+	/* update the existing file: the UITS block must fit in the padding */
+	if (inPlaceFlag) {
+		fclose(audioInFP);
+		
+		uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", foundPadding, TRUE, ERR_FLAC,
+						   "Not enough padding in FLAC file to embed UITS payload in place\n");
+		
+		audioOutFP = uitsIOOpen(audioFileNameOut, "r+b");
+		uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for update\n");
 
-	/* now read the metadata chain from the existing FLAC file */
-	
-	flacMetadataChain = FLAC__metadata_chain_new ();
-	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", flacMetadataChain, ERR_FLAC,
-					   "Couldn't create FLAC metadata chain\n");	
-	
-	err = FLAC__metadata_chain_read(flacMetadataChain, audioFileNameOut);
-	uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, TRUE, ERR_FLAC,
-					   "Couldn't read FLAC metadata chain\n");
+		fseeko(audioOutFP, paddingBlock.saveSeek, SEEK_SET);
+		flacWriteUITSBlock(audioOutFP, &paddingBlock, uitsPayloadXML, payloadSize);
+		
+		fclose(audioOutFP);
+		
+		return (OK);
+	}
 	
-	/* move all of the padding blocks, if any, to the end of the chain */
-	FLAC__metadata_chain_sort_padding (flacMetadataChain);
+	audioOutFP = uitsIOOpen(audioFileNameOut, "wb");
+	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
 
-	flacMetadataIterator = FLAC__metadata_iterator_new ();
-	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", flacMetadataChain, ERR_FLAC,
-					   "Couldn't create FLAC metadata iterator\n");	
+	fseeko(audioInFP, 0L, SEEK_SET);
+	audioInFileSize = uitsGetFileSize(audioInFP);
 
-	/* point the iterator at the chain */
-	FLAC__metadata_iterator_init (flacMetadataIterator,flacMetadataChain);
-	
-	/* walk the iterator to the end of the chain and make sure there isn't already a UITS block */
-	while (FLAC__metadata_iterator_next(flacMetadataIterator)) {
-		if (FLAC__metadata_iterator_get_block_type(flacMetadataIterator) == FLAC__METADATA_TYPE_APPLICATION) {
-			flacMetadata = FLAC__metadata_iterator_get_block (flacMetadataIterator);
-			if ((flacMetadata->data.application.id[0] == 'U') &&
-				(flacMetadata->data.application.id[1] == 'I') &&
-				(flacMetadata->data.application.id[2] == 'T') &&
-				(flacMetadata->data.application.id[3] == 'S')) {
-				
-				uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, 0, ERR_FLAC,
-								   "Audio input file already contains a UITS payload \n");
+	if (foundPadding) {
+		/* copy everything in front of the padding block and carve the UITS block out of it */
+		uitsAudioBufferedCopy(audioInFP, audioOutFP, paddingBlock.saveSeek);
+		
+		flacWriteUITSBlock(audioOutFP, &paddingBlock, uitsPayloadXML, payloadSize);
+		
+		/* nothing has moved, so copy the rest of the padding and the audio frames from the same offset */
+		fseeko(audioInFP, ftello(audioOutFP), SEEK_SET);
+		uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize - ftello(audioInFP));
+	} else {
+		/* copy everything in front of the last block header, clear its last-block flag and copy its data */
+		uitsAudioBufferedCopy(audioInFP, audioOutFP, lastBlock.saveSeek);
 
-			}
-		}
+		flacWriteMetadataBlockHeader(audioOutFP, FALSE, lastBlock.blockType, lastBlock.blockLength);
+		fseeko(audioInFP, FLAC_BLOCK_HEADER_SIZE, SEEK_CUR);
+		uitsAudioBufferedCopy(audioInFP, audioOutFP, lastBlock.blockLength);
+		
+		/* the UITS block is the new last block, followed by the audio frames */
+		flacWriteMetadataBlockHeader(audioOutFP, TRUE, FLAC__METADATA_TYPE_APPLICATION, uitsBlockLength);
+		flacWriteUITSBlockData(audioOutFP, uitsPayloadXML, payloadSize);
+		
+		uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize - ftello(audioInFP));
 	}
 
-	/* add the new block */
-	err = FLAC__metadata_iterator_insert_block_after (flacMetadataIterator, uitsFlacMetadata);
-  	uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, TRUE, ERR_FLAC,
-					   "Couldn't add UITS payload block to iterator\n");
+	fclose(audioInFP);
+	fclose(audioOutFP);
+
+	return(OK);
+}
+
+/*
+ *
+ * Function: flacEmbedPayloadStream
+ * Purpose:	 Embed the UITS payload into a FLAC stream. The metadata blocks are buffered
+ *			 and run through flacEmbedPayload, then the audio frames are copied through.
+ * Returns:  OK or exit on error
+ *
+ */
 
+int flacEmbedPayloadStream (UITS_AUDIO_STREAM *stream,
+							FILE *audioOutFP,
+							char *uitsPayloadXML,
+							int  numPadBytes)
+{
+	flacGetStreamAudioFrameStart(stream);
 	
-	/* write the new chain */
-	err = FLAC__metadata_chain_write (flacMetadataChain, TRUE, FALSE);
-  	uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, TRUE, ERR_FLAC,
-					   "Couldn't write new metadata chain\n");
+	return (uitsAudioEmbedStreamPrefix(stream, audioOutFP, flacEmbedPayload, uitsPayloadXML, numPadBytes));
+}
 
-	/* cleanup */
-	FLAC__metadata_chain_delete (flacMetadataChain);
+/*
+ *
+ * Function: flacGetStreamAudioFrameStart
+ * Purpose:	 Read the metadata blocks of a FLAC stream into the stream prefix
+ * Returns:  Offset of the first audio frame or exit on error
+ *
+ */
+
+size_t flacGetStreamAudioFrameStart (UITS_AUDIO_STREAM *stream)
+{
+	size_t	blockStart = stream->id3TagSize + FLAC_MARKER_SIZE;
+	int		isLast;
+	
+	/* walk the metadata block headers, reading each block into the buffer */
+	do {
+		err = uitsAudioStreamFill(stream, blockStart + FLAC_BLOCK_HEADER_SIZE);
+		uitsHandleErrorINT(flacModuleName, "flacGetStreamAudioFrameStart", err, OK, ERR_FLAC,
+						   "Couldn't read FLAC metadata block header\n");
+		
+		isLast = stream->prefix[blockStart] & 0x80;
+		blockStart += FLAC_BLOCK_HEADER_SIZE + (uitsReadBE32(&stream->prefix[blockStart]) & FLAC_MAX_BLOCK_LENGTH);
+	} while (!isLast);
 	
-	return(OK);
+	err = uitsAudioStreamFill(stream, blockStart);
+	uitsHandleErrorINT(flacModuleName, "flacGetStreamAudioFrameStart", err, OK, ERR_FLAC,
+					   "Couldn't read FLAC metadata block\n");
+	
+	return (blockStart);
 }
 
 /*
  *
  * Function: flacExtractPayload
  * Purpose:	 Extract the UITS payload from an FLAC file
+ *			 Only the metadata block headers are read until the UITS application block is found,
+ *			 then only that block's data is read.
  *
- * Returns: pointer to payload or exit if error
+ * Returns: pointer to payload (caller owns the buffer), NULL if there is no UITS block or exit if error
  */
 
 char *flacExtractPayload (char *audioFileName) 
 {
-	FLAC__StreamMetadata    *uitsFlacMetadata = NULL;
-	FLAC__Metadata_Chain    *flacMetadataChain = NULL;
-	FLAC__Metadata_Iterator *flacMetadataIterator = NULL;
-		
+	FILE						*audioFP;
+	FLAC_METADATA_BLOCK_HEADER	uitsBlock;
+	unsigned long				payloadSize;
+	char						*uitsPayloadXML = NULL;
 	
-	/* read the metadata chain from the existing FLAC file */
-	flacMetadataChain = FLAC__metadata_chain_new ();
-	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", flacMetadataChain, ERR_FLAC,
-					   "Couldn't create FLAC metadata chain\n");	
-	
-	err = FLAC__metadata_chain_read(flacMetadataChain, audioFileName);
-	uitsHandleErrorINT(flacModuleName, "flacEmbedPayload", err, TRUE, ERR_FLAC,
-					   "Couldn't read FLAC metadata chain\n");
-	
-	/* create an iterator to walk the chain */
-	flacMetadataIterator = FLAC__metadata_iterator_new ();
-	uitsHandleErrorPTR(flacModuleName, "flacEmbedPayload", flacMetadataChain, ERR_FLAC,
-					   "Couldn't create FLAC metadata iterator\n");	
-	
-	/* point the iterator at the chain */
-	FLAC__metadata_iterator_init (flacMetadataIterator,flacMetadataChain);
-	
-	/* walk the iterator to the end of the chain */
-	while (FLAC__metadata_iterator_next(flacMetadataIterator)) { 
-		if (FLAC__metadata_iterator_get_block_type(flacMetadataIterator) == FLAC__METADATA_TYPE_APPLICATION) {
-			uitsFlacMetadata = FLAC__metadata_iterator_get_block (flacMetadataIterator);
-			if ((uitsFlacMetadata->data.application.id[0] == 'U') &&
-				(uitsFlacMetadata->data.application.id[1] == 'I') &&
-				(uitsFlacMetadata->data.application.id[2] == 'T') &&
-				(uitsFlacMetadata->data.application.id[3] == 'S')) {
-
-				return ((char *) uitsFlacMetadata->data.application.data);
-			}
-		}
-	}
+	audioFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(flacModuleName, "flacExtractPayload", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
+	
+	if (flacFindApplicationBlock(audioFP, "UITS", &uitsBlock)) {
+		/* fp is at the payload, just past the application ID */
+		payloadSize = uitsBlock.blockLength - FLAC_APPLICATION_ID_SIZE;
+		
+		uitsPayloadXML = calloc(payloadSize + 1, 1);
+		uitsHandleErrorPTR(flacModuleName, "flacExtractPayload", uitsPayloadXML, ERR_FLAC,
+						   "Couldn't allocate UITS payload buffer\n");
 		
-	/* cleanup */
-	FLAC__metadata_chain_delete (flacMetadataChain);
+		err = fread(uitsPayloadXML, 1, payloadSize, audioFP);
+		uitsHandleErrorINT(flacModuleName, "flacExtractPayload", err, payloadSize, ERR_FLAC,
+						   "Couldn't read UITS payload from FLAC application block\n");
+	}
+	
+	fclose(audioFP);
 	
-	/* didn't find the UITS application metadata block */
-	return (NULL);
+	/* NULL if we didn't find the UITS application metadata block */
+	return (uitsPayloadXML);
 	
 }
 
-FLAC__StreamDecoderWriteStatus flacWriteCallback(const FLAC__StreamDecoder *decoder, 
-												 const FLAC__Frame *frame, 
-												 const FLAC__int32 * const buffer[], 
-												 void *client_data)
+/*
+ *
+ * Function: flacSeekFirstMetadataBlock
+ * Purpose:	 Position the file pointer at the header of the first FLAC metadata block
+ *			 (the STREAMINFO block). An ID3v2 tag at the start of the file, if any, is skipped
+ *			 the same way libFLAC skips it, then the 'fLaC' stream marker is checked.
+ *
+ * Returns:   OK or ERROR if the file does not contain a FLAC stream marker
+ */
+
+int flacSeekFirstMetadataBlock (FILE *audioFP)
 {
+	unsigned char	id3Header[FLAC_ID3_HEADER_SIZE];
+	unsigned long	id3TagSize;
+	char			streamMarker[FLAC_MARKER_SIZE];
+	
+	fseeko(audioFP, 0L, SEEK_SET);
+	
+	err = fread(id3Header, 1, FLAC_ID3_HEADER_SIZE, audioFP);
+	if (err != FLAC_ID3_HEADER_SIZE) {
+		return (ERROR);
+	}
+	
+	if (strncmp((char *)id3Header, "ID3", 3) == 0) {
+		/* ID3v2 tag size is a 28-bit syncsafe integer, not including the 10-byte header */
+		id3TagSize = ((id3Header[6] & 0x7f) << 21) | 
+					 ((id3Header[7] & 0x7f) << 14) |
+					 ((id3Header[8] & 0x7f) << 7)  |
+					  (id3Header[9] & 0x7f);
+		
+		/* footer present flag adds another 10 bytes */
+		if (id3Header[5] & 0x10) {
+			id3TagSize += FLAC_ID3_HEADER_SIZE;
+		}
+		fseeko(audioFP, FLAC_ID3_HEADER_SIZE + id3TagSize, SEEK_SET);
+	} else {
+		fseeko(audioFP, 0L, SEEK_SET);
+	}
 
-//	vprintf("flacWriteCallback\n");
-	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	err = fread(streamMarker, 1, FLAC_MARKER_SIZE, audioFP);
+	if ((err != FLAC_MARKER_SIZE) || (strncmp(streamMarker, "fLaC", FLAC_MARKER_SIZE) != 0)) {
+		return (ERROR);
+	}
+	
+	return (OK);
 }
 
-void flacMetadataCallback(const FLAC__StreamDecoder *decoder, 
-						  const FLAC__StreamMetadata *metadata, 
-						  void *client_data)
+/*
+ *
+ * Function: flacReadMetadataBlockHeader
+ * Purpose:	 Read a 4-byte FLAC metadata block header at the current file location:
+ *				1 bit   last-metadata-block flag
+ *				7 bits  block type
+ *				24 bits length of the block data (big-endian), not including the header
+ *			 The file pointer is left at the start of the block data.
+ *
+ * Returns:   OK or ERROR
+ */
+
+int flacReadMetadataBlockHeader (FILE *audioFP, FLAC_METADATA_BLOCK_HEADER *blockHeader)
 {
-	(void)decoder, (void)client_data;
+	unsigned char	headerBytes[FLAC_BLOCK_HEADER_SIZE];
 	
-	/* print some stats */
-	if(metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
-		vprintf("Got FLAC_METADATA_TYPE_STREAMINFO\n");
-	} else {
-		vprintf("Got flac metadata type: %d\n", metadata->type);
+	blockHeader->saveSeek = ftello(audioFP);
+	
+	err = fread(headerBytes, 1, FLAC_BLOCK_HEADER_SIZE, audioFP);
+	if (err != FLAC_BLOCK_HEADER_SIZE) {
+		return (ERROR);
 	}
 	
-	fflush(stdout);
-					
+	blockHeader->isLast      = (headerBytes[0] & 0x80) ? TRUE : FALSE;
+	blockHeader->blockType   = headerBytes[0] & 0x7f;
+	blockHeader->blockLength = uitsReadBE32(headerBytes) & FLAC_MAX_BLOCK_LENGTH;	/* 24-bit length after the type byte */
+	
+	return (OK);
 }
 
-void flacErrorCallback(const FLAC__StreamDecoder *decoder, 
-					   FLAC__StreamDecoderErrorStatus status, 
-					   void *client_data)
+/*
+ *
+ * Function: flacFindFirstAudioFrame
+ * Purpose:	 Walk the FLAC metadata block headers, seeking past each block's data, until the
+ *			 last metadata block has been skipped. The first audio frame follows immediately.
+ *
+ * Returns:   File offset of the first audio frame or exit if error
+ */
+
+off_t flacFindFirstAudioFrame (FILE *audioFP)
 {
-	(void)decoder, (void)client_data;
-	char *flacErrStr;
+	FLAC_METADATA_BLOCK_HEADER	blockHeader;
+	off_t						fileSize;
+	
+	err = flacSeekFirstMetadataBlock(audioFP);
+	uitsHandleErrorINT(flacModuleName, "flacFindFirstAudioFrame", err, OK, ERR_FLAC,
+					   "Couldn't find FLAC stream marker\n");
 	
-	uitsHandleErrorINT(flacModuleName, "flacErrorCallback", ERROR, OK, ERR_FLAC,
-					   FLAC__StreamDecoderErrorStatusString[status]);
+	fileSize = uitsGetFileSize(audioFP);
+
+	do {
+		err = flacReadMetadataBlockHeader(audioFP, &blockHeader);
+		uitsHandleErrorINT(flacModuleName, "flacFindFirstAudioFrame", err, OK, ERR_FLAC,
+						   "Couldn't read FLAC metadata block header\n");
+		
+		dprintf("FLAC metadata block type: %d, length: %lu\n", blockHeader.blockType, blockHeader.blockLength);
+		
+		if ((off_t) (blockHeader.saveSeek + FLAC_BLOCK_HEADER_SIZE + blockHeader.blockLength) > fileSize) {
+			uitsHandleErrorINT(flacModuleName, "flacFindFirstAudioFrame", ERROR, OK, ERR_FLAC,
+							   "FLAC metadata block extends past end of file\n");
+		}
+		
+		fseeko(audioFP, blockHeader.blockLength, SEEK_CUR);
+	} while (!blockHeader.isLast);
+	
+	return (ftello(audioFP));
 }
 
 /*
  *
- * Function: flacCloneAudioFile
- * Purpose:	 Clone the audio input file to the audio output file
- *           This is required because the FLAC metdata api does reads and writes
- *           to the same file. We want to write our modified metdata to a new file.
+ * Function: flacFindApplicationBlock
+ * Purpose:	 Walk the FLAC metadata block headers looking for an APPLICATION block with the
+ *			 given 4-byte application ID. The data of all other blocks is skipped, not read.
+ *			 If found, the file pointer is left just past the application ID.
  *
- * Returns: OK or ERROR
+ * Returns:   TRUE if found, FALSE otherwise or exit if error
  */
 
-int flacCloneAudioFile (char *audioFileName,
-						char *audioFileNameOut)
+int flacFindApplicationBlock (FILE							*audioFP,
+							  char							*applicationID,
+							  FLAC_METADATA_BLOCK_HEADER	*blockHeader)
 {
-	FILE			*audioInFP, *audioOutFP;
-	unsigned long	audioInFileSize;
+	char	blockApplicationID[FLAC_APPLICATION_ID_SIZE];
+	
+	err = flacSeekFirstMetadataBlock(audioFP);
+	uitsHandleErrorINT(flacModuleName, "flacFindApplicationBlock", err, OK, ERR_FLAC,
+					   "Couldn't find FLAC stream marker\n");
+	
+	do {
+		err = flacReadMetadataBlockHeader(audioFP, blockHeader);
+		uitsHandleErrorINT(flacModuleName, "flacFindApplicationBlock", err, OK, ERR_FLAC,
+						   "Couldn't read FLAC metadata block header\n");
+		
+		if ((blockHeader->blockType == FLAC__METADATA_TYPE_APPLICATION) && 
+			(blockHeader->blockLength >= FLAC_APPLICATION_ID_SIZE)) {
+			err = fread(blockApplicationID, 1, FLAC_APPLICATION_ID_SIZE, audioFP);
+			uitsHandleErrorINT(flacModuleName, "flacFindApplicationBlock", err, FLAC_APPLICATION_ID_SIZE, ERR_FLAC,
+							   "Couldn't read FLAC application ID\n");
+			
+			if (strncmp(blockApplicationID, applicationID, FLAC_APPLICATION_ID_SIZE) == 0) {
+				return (TRUE);
+			}
+			fseeko(audioFP, blockHeader->blockLength - FLAC_APPLICATION_ID_SIZE, SEEK_CUR);
+		} else {
+			fseeko(audioFP, blockHeader->blockLength, SEEK_CUR);
+		}
+	} while (!blockHeader->isLast);
+	
+	return (FALSE);
+}
 
+/*
+ *
+ * Function: flacWriteMetadataBlockHeader
+ * Purpose:	 Write a 4-byte FLAC metadata block header at the current file location
+ *
+ * Returns: OK or exit if error
+ */
 
-	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
-	uitsHandleErrorPTR(flacModuleName, "flacCloneAudioFile", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+int flacWriteMetadataBlockHeader (FILE			*audioOutFP,
+								  int			isLast,
+								  int			blockType,
+								  unsigned long	blockLength)
+{
+	unsigned char	headerBytes[FLAC_BLOCK_HEADER_SIZE];
+	
+	uitsWriteBE32(headerBytes, blockLength & FLAC_MAX_BLOCK_LENGTH);	/* 24-bit length after the type byte */
+	headerBytes[0] = (isLast ? 0x80 : 0x00) | (blockType & 0x7f);
+	
+	err = fwrite(headerBytes, 1, FLAC_BLOCK_HEADER_SIZE, audioOutFP);
+	uitsHandleErrorINT(flacModuleName, "flacWriteMetadataBlockHeader", err, FLAC_BLOCK_HEADER_SIZE, ERR_FILE,
+					   "Couldn't write FLAC metadata block header\n");
+	
+	return (OK);
+}
 
-	audioOutFP = fopen(audioFileNameOut, "wb");
-	uitsHandleErrorPTR(flacModuleName, "flacCloneAudioFile", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
+/*
+ *
+ * Function: flacWriteUITSBlockData
+ * Purpose:	 Write the data of the UITS application block: the 'UITS' application ID followed
+ *			 by the payload, zero-filled to payloadSize bytes
+ *
+ * Returns: OK or exit if error
+ */
 
-	/* calculate how long the input audio file is by seeking to EOF and saving size  */
-	audioInFileSize = uitsGetFileSize(audioInFP);
+int flacWriteUITSBlockData (FILE			*audioOutFP,
+							char			*uitsPayloadXML,
+							unsigned long	payloadSize)
+{
+	unsigned long	payloadXMLSize = strlen(uitsPayloadXML);
+	
+	err = fwrite("UITS", 1, FLAC_APPLICATION_ID_SIZE, audioOutFP);
+	uitsHandleErrorINT(flacModuleName, "flacWriteUITSBlockData", err, FLAC_APPLICATION_ID_SIZE, ERR_FILE,
+					   "Couldn't write FLAC application ID\n");
 
-	/* clone the input file to the output file */
-	/* this is required because the FLAC metadata API will only read and write metadata to the same file */
-	uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize);
+	err = fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP);
+	uitsHandleErrorINT(flacModuleName, "flacWriteUITSBlockData", err, payloadXMLSize, ERR_FILE,
+					   "Couldn't write UITS payload\n");
 
-	fclose(audioInFP);
-	fclose(audioOutFP);
+	for (; payloadXMLSize < payloadSize; payloadXMLSize++) {
+		fputc(0, audioOutFP);
+	}
+	
+	return (OK);
+}
+
+/*
+ *
+ * Function: flacWriteUITSBlock
+ * Purpose:	 Overwrite a PADDING block with the UITS application block. If the padding is bigger
+ *			 than the UITS block, the remainder is written as a smaller PADDING block. Either way
+ *			 the total size of the metadata doesn't change and the last block flag is preserved.
+ *			 The file pointer must be at the header of the PADDING block.
+ *
+ * Returns: OK or exit if error
+ */
+
+int flacWriteUITSBlock (FILE						*audioOutFP,
+						FLAC_METADATA_BLOCK_HEADER	*paddingBlock,
+						char						*uitsPayloadXML,
+						unsigned long				payloadSize)
+{
+	unsigned long	uitsBlockLength = FLAC_APPLICATION_ID_SIZE + payloadSize;
+	int				exactFitFlag    = (paddingBlock->blockLength == uitsBlockLength);
+	
+	flacWriteMetadataBlockHeader(audioOutFP, (exactFitFlag && paddingBlock->isLast), 
+								 FLAC__METADATA_TYPE_APPLICATION, uitsBlockLength);
+	flacWriteUITSBlockData(audioOutFP, uitsPayloadXML, payloadSize);
+
+	if (!exactFitFlag) {
+		/* the rest of the padding is left as is; padding bytes are already zero */
+		flacWriteMetadataBlockHeader(audioOutFP, paddingBlock->isLast, FLAC__METADATA_TYPE_PADDING,
+									 paddingBlock->blockLength - uitsBlockLength - FLAC_BLOCK_HEADER_SIZE);
+	}
 	
 	return (OK);
+}
 
+/*
+ *
+ * Function: flacGetEmbedPlan
+ * Purpose:	 Plan the payload embedding for a FLAC file. The UITS application block goes
+ *			 in the metadata, so the metadata blocks are rebuilt by flacEmbedPayload for
+ *			 each payload. The audio frames are copied unchanged.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int flacGetEmbedPlan (char *audioFileName, UITS_EMBED_PLAN *plan)
+{
+	UITS_AUDIO_STREAM	stream;
+	FILE				*audioInFP;
+	size_t				headerLength;
+	
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(flacModuleName, "flacGetEmbedPlan", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+	
+	memset(&stream, 0, sizeof(UITS_AUDIO_STREAM));
+	stream.audioInFP = audioInFP;
+	
+	/* anything else is left to the regular embed */
+	if (uitsAudioGetStreamType(&stream) != FLAC) {
+		free(stream.prefix);
+		fclose(audioInFP);
+		return (ERROR);
+	}
+	
+	headerLength = flacGetStreamAudioFrameStart(&stream);
+	free(stream.prefix);
+	
+	err = uitsEmbedPlanReadHeader(plan, audioInFP, headerLength);
+	fclose(audioInFP);
+	
+	plan->rebuildHeader = flacEmbedPayload;
+	
+	return (err);
 }
 
 // EOF
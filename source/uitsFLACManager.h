@@ -19,7 +19,19 @@
 #  define _uitsflacmanager_h_
 
 #include <metadata.h>
-#include <stream_decoder.h>
+
+#define FLAC_MARKER_SIZE		4	/* 'fLaC' stream marker */
+#define FLAC_BLOCK_HEADER_SIZE	4	/* metadata block header: last flag, type, 24-bit length */
+#define FLAC_ID3_HEADER_SIZE	10	/* optional ID3v2 tag header in front of the stream marker */
+#define FLAC_APPLICATION_ID_SIZE 4	/* registered application ID at the start of an APPLICATION block */
+#define FLAC_MAX_BLOCK_LENGTH	0xffffff	/* metadata block length is a 24-bit field */
+
+typedef struct {
+	int				isLast;			/* last-metadata-block flag */
+	int				blockType;		/* FLAC__METADATA_TYPE_xxx */
+	unsigned long	blockLength;	/* length of block data, not including the header */
+	off_t			saveSeek;		/* file offset of the block header */
+} FLAC_METADATA_BLOCK_HEADER;
 
 
 /* 
@@ -33,31 +45,50 @@ int flacEmbedPayload	(char *audioFileName,
 						 char *uitsPayloadXML,
 						 int  numPadBytes);
 
+int flacEmbedPayloadStream	(UITS_AUDIO_STREAM *stream,
+							 FILE *audioOutFP,
+							 char *uitsPayloadXML,
+							 int  numPadBytes);
+
 char *flacExtractPayload (char *audioFileName); 
 
 char *flacGetMediaHash	(char *audioFileName);
 
+int flacGetEmbedPlan	(char *audioFileName, 
+						 UITS_EMBED_PLAN *plan);
+
 
 /*
  * PRIVATE Functions
  */
 
 
-FLAC__StreamDecoderWriteStatus flacWriteCallback(const FLAC__StreamDecoder *decoder, 
-												 const FLAC__Frame *frame, 
-												 const FLAC__int32 * const buffer[], 
-												 void *client_data);
+int flacSeekFirstMetadataBlock	(FILE *audioFP);
+
+size_t flacGetStreamAudioFrameStart	(UITS_AUDIO_STREAM *stream);
+
+int flacReadMetadataBlockHeader	(FILE *audioFP, 
+								 FLAC_METADATA_BLOCK_HEADER *blockHeader);
+
+off_t flacFindFirstAudioFrame	(FILE *audioFP);
+
+int flacFindApplicationBlock	(FILE						*audioFP,
+								 char						*applicationID,
+								 FLAC_METADATA_BLOCK_HEADER	*blockHeader);
 
-void flacMetadataCallback(const FLAC__StreamDecoder *decoder, 
-						  const FLAC__StreamMetadata *metadata, 
-						  void *client_data);
+int flacWriteMetadataBlockHeader	(FILE			*audioOutFP,
+									 int			isLast,
+									 int			blockType,
+									 unsigned long	blockLength);
 
-void flacErrorCallback(const FLAC__StreamDecoder *decoder, 
-					   FLAC__StreamDecoderErrorStatus status, 
-					   void *client_data);
+int flacWriteUITSBlockData	(FILE			*audioOutFP,
+							 char			*uitsPayloadXML,
+							 unsigned long	payloadSize);
 
-int flacCloneAudioFile (char *audioFileName,
-						char *audioFileNameOut);
+int flacWriteUITSBlock		(FILE						*audioOutFP,
+							 FLAC_METADATA_BLOCK_HEADER	*paddingBlock,
+							 char						*uitsPayloadXML,
+							 unsigned long				payloadSize);
 #endif
 
 // EOF
@@ -48,15 +48,15 @@ char *genericGetMediaHash (char *inputFileName)
 	UITS_digest			*mediaHash = NULL;
 	char				*mediaHashString = NULL;
 	
-	unsigned long	fileLength;
+	off_t			fileLength;
 		
-	inputFP = fopen(inputFileName, "rb");
+	inputFP = uitsIOOpen(inputFileName, "rb");
 	uitsHandleErrorPTR(genericModuleName, "genericGetMediaHash", inputFP, ERR_FILE, "Couldn't open input file for reading\n");
 		
 	/* get file size */
 	fileLength = uitsGetFileSize(inputFP);
 		
-	mediaHash = uitsCreateDigestBuffered (inputFP, fileLength, "SHA256") ;
+	mediaHash = uitsCreateMediaDigest (inputFP, fileLength) ;
 	mediaHashString = uitsDigestToString(mediaHash);
 	
 	fclose(inputFP);
@@ -83,7 +83,7 @@ int genericEmbedPayload  (char *inputFileName,
 	
 	vprintf("Cannot embed UITS payload into unknown file type. Writing standalone UITS paylaod file to %s\n", outputFileName)
 	
-	outputFP = fopen(outputFileName, "wb");
+	outputFP = uitsIOOpen(outputFileName, "wb");
 	uitsHandleErrorPTR(genericModuleName, "genericEmbedPayload", outputFP, ERR_FILE, "Couldn't open output file for writing\n");
 	
 	payloadXMLSize = strlen(uitsPayloadXML);
@@ -31,7 +31,7 @@ int htmlIsValidFile (char *inputFileName)
 	FILE		*inputFP;
 	mxml_node_t	*topNode;
 	
-	inputFP = fopen(inputFileName, "rb");
+	inputFP = uitsIOOpen(inputFileName, "rb");
 	uitsHandleErrorPTR(htmlModuleName, "htmlIsValidFile", inputFP, ERR_FILE, "Couldn't open input file for reading\n");
 	
 	topNode = mxmlLoadFile(NULL, inputFP, MXML_OPAQUE_CALLBACK);
@@ -135,7 +135,7 @@ int htmlEmbedPayload  (char *inputFileName,
 	payloadXMLSize = strlen(strippedPayloadXML);
 	
 	
-	outputFP = fopen(outputFileName, "wb");
+	outputFP = uitsIOOpen(outputFileName, "wb");
 	uitsHandleErrorPTR(htmlModuleName, "htmlEmbedPayload", outputFP, ERR_FILE, "Couldn't open output file for writing\n");
 		
 	inputHTMLString = uitsReadFile(inputFileName);
@@ -188,12 +188,15 @@ char *htmlExtractPayload (char *inputFileName)
 		uitsPayloadEnd = strcasestr (inputHTMLString, "</head>");
 		uitsHandleErrorPTR(htmlModuleName, "htmlExtractPayload", uitsPayloadEnd, ERR_FILE, "Couldn't find end of UITS payload in input file\n");
 		
-		/* make the payload string end at the start of the header end tag */
+		/* make the payload string end at the start of the header end tag, and move it
+		   to the start of the buffer so the caller can free it */
 		*uitsPayloadEnd = '\0';
-		return (uitsPayloadStart);
+		memmove(inputHTMLString, uitsPayloadStart, strlen(uitsPayloadStart) + 1);
+		return (inputHTMLString);
 	}
 	
 	/* no uits payload in file */
+	free(inputHTMLString);
 	return (NULL);
 }
 
@@ -0,0 +1,267 @@
+/*
+ *  uitsHashCache.c
+ *  UITS_Tool
+ *
+ *  Optional on-disk cache of media hashes, so that verifying an unchanged file
+ *  again doesn't read all of its audio. A cached hash is used only if the file has
+ *  the same device, inode, size, modification time (to the nanosecond where the
+ *  platform has it) and format, and the same fingerprint of its first
+ *  HASH_CACHE_PREFIX_SIZE bytes.
+ *
+ *  The cache file is an append-only log with one line per hash:
+ *		device inode size mtime mtime-nsec format fingerprint media-hash
+ *  It is read into a hash table when it is opened. A hash that is calculated for a
+ *  new or changed file is appended, and later lines take precedence over earlier ones.
+ *  Stale lines are never removed; delete the cache file to start again.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *hashCacheModuleName = "uitsHashCache.c";
+
+char				  *hashCacheFileName = NULL;					/* NULL if the cache isn't enabled */
+UITS_HASH_CACHE_ENTRY *hashCacheTable [HASH_CACHE_BUCKETS];
+UITS_HASH_CACHE_KEY	  hashCachePendingKey;						/* key of the last lookup that missed */
+int					  hashCachePendingFlag = FALSE;
+
+/*
+ *
+ * Function: uitsHashCacheOpen
+ * Purpose:	 Enable the media hash cache and load the cache file. The file is created
+ *			 if it doesn't exist.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsHashCacheOpen (char *cacheFileName)
+{
+	FILE *cacheFP;
+
+	hashCacheFileName = cacheFileName;
+
+	cacheFP = uitsIOOpen(hashCacheFileName, "r");
+	if (cacheFP) {
+		fclose(cacheFP);
+		return (uitsHashCacheLoad());
+	}
+
+	cacheFP = uitsIOOpen(hashCacheFileName, "w");
+	uitsHandleErrorPTR(hashCacheModuleName, "uitsHashCacheOpen", cacheFP, ERR_FILE, "Couldn't create media hash cache file\n");
+
+	fprintf(cacheFP, "%s\n", HASH_CACHE_HEADER);
+	err = fclose(cacheFP);
+	uitsHandleErrorINT(hashCacheModuleName, "uitsHashCacheOpen", err, OK, ERR_FILE, "Couldn't write media hash cache file\n");
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsHashCacheLookup
+ * Purpose:	 Find the cached media hash for an audio file
+ * Returns:  Copy of the media hash, or NULL if the cache isn't enabled, the file can't
+ *			 be cached or there is no hash for this version of the file
+ *
+ */
+
+char *uitsHashCacheLookup (char *audioFileName, int audioFileType)
+{
+	UITS_HASH_CACHE_ENTRY *entry;
+	UITS_HASH_CACHE_KEY	  key;
+
+	hashCachePendingFlag = FALSE;
+
+	if (!hashCacheFileName || uitsHashCacheGetKey(audioFileName, audioFileType, &key) != OK) {
+		return (NULL);
+	}
+
+	for (entry = hashCacheTable[key.fileInode % HASH_CACHE_BUCKETS]; entry; entry = entry->next) {
+		if (uitsHashCacheKeysMatch(&entry->key, &key)) {
+			vprintf("\tUsing cached media hash for %s\n", audioFileName);
+			return (strdup(entry->mediaHashValue));
+		}
+	}
+
+	/* remember the file as it was before hashing, for uitsHashCacheAdd */
+	hashCachePendingKey	 = key;
+	hashCachePendingFlag = TRUE;
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsHashCacheAdd
+ * Purpose:	 Add the media hash calculated after a lookup missed to the cache. The hash
+ *			 isn't cached if the file changed while it was being hashed.
+ *
+ */
+
+void uitsHashCacheAdd (char *audioFileName, int audioFileType, char *mediaHashValue)
+{
+	UITS_HASH_CACHE_KEY key;
+	FILE				*cacheFP;
+
+	if (!hashCachePendingFlag || !mediaHashValue) {
+		return;
+	}
+	hashCachePendingFlag = FALSE;
+
+	if (uitsHashCacheGetKey(audioFileName, audioFileType, &key) != OK ||
+		!uitsHashCacheKeysMatch(&key, &hashCachePendingKey)) {
+		dprintf("%s changed while it was hashed, not caching the media hash\n", audioFileName);
+		return;
+	}
+
+	uitsHashCacheInsert(&key, mediaHashValue);
+
+	cacheFP = uitsIOOpen(hashCacheFileName, "a");
+	uitsHandleErrorPTR(hashCacheModuleName, "uitsHashCacheAdd", cacheFP, ERR_FILE, "Couldn't open media hash cache file\n");
+
+	fprintf(cacheFP, "%llu %llu %lld %lld %ld %d %s %s\n",
+			key.fileDevice, key.fileInode, key.fileSize, key.fileModTime, key.fileModTimeNsec,
+			key.audioFileType, key.fingerprint, mediaHashValue);
+
+	err = fclose(cacheFP);
+	uitsHandleErrorINT(hashCacheModuleName, "uitsHashCacheAdd", err, OK, ERR_FILE, "Couldn't write media hash cache file\n");
+}
+
+/*
+ *
+ * Function: uitsHashCacheLoad
+ * Purpose:	 Read the cache file into the hash table. Lines that can't be parsed are skipped.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsHashCacheLoad (void)
+{
+	FILE				*cacheFP;
+	char				line[HASH_CACHE_LINE_SIZE];
+	char				mediaHashValue[HASH_CACHE_LINE_SIZE];
+	UITS_HASH_CACHE_KEY key;
+	int					numEntries = 0;
+
+	cacheFP = uitsIOOpen(hashCacheFileName, "r");
+	uitsHandleErrorPTR(hashCacheModuleName, "uitsHashCacheLoad", cacheFP, ERR_FILE, "Couldn't open media hash cache file\n");
+
+	while (fgets(line, HASH_CACHE_LINE_SIZE, cacheFP)) {
+		if (line[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%llu %llu %lld %lld %ld %d %64s %1023s",
+				   &key.fileDevice, &key.fileInode, &key.fileSize, &key.fileModTime, &key.fileModTimeNsec,
+				   &key.audioFileType, key.fingerprint, mediaHashValue) != 8) {
+			continue;
+		}
+		uitsHashCacheInsert(&key, mediaHashValue);
+		numEntries++;
+	}
+
+	fclose(cacheFP);
+
+	dprintf("Loaded %d cached media hashes from %s\n", numEntries, hashCacheFileName);
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsHashCacheGetKey
+ * Purpose:	 Get the identity and fingerprint of an audio file. Only regular files opened
+ *			 from the file system can be cached (not standard input, memory buffers or
+ *			 other uitsIOOpen backends, whose identity doesn't outlast the process).
+ * Returns:  OK or ERROR if the file can't be cached
+ *
+ */
+
+int uitsHashCacheGetKey (char *audioFileName, int audioFileType, UITS_HASH_CACHE_KEY *key)
+{
+	FILE		*audioFP;
+	struct stat fileStat;
+	UITS_digest *fingerprint;
+	char		*fingerprintString;
+	off_t		fingerprintLength;
+
+	if (strcmp(audioFileName, "-") == 0) {
+		return (ERROR);
+	}
+
+	audioFP = uitsIOOpen(audioFileName, "rb");
+	if (!audioFP) {
+		return (ERROR);
+	}
+
+	if (uitsIOGetStream(audioFP) || fstat(fileno(audioFP), &fileStat) != OK || !S_ISREG(fileStat.st_mode)) {
+		fclose(audioFP);
+		return (ERROR);
+	}
+
+	memset(key, 0, sizeof(UITS_HASH_CACHE_KEY));
+	key->fileDevice		 = fileStat.st_dev;
+	key->fileInode		 = fileStat.st_ino;
+	key->fileSize		 = fileStat.st_size;
+	key->fileModTime	 = fileStat.st_mtime;
+	key->fileModTimeNsec = UITS_STAT_MTIME_NSEC(&fileStat);
+	key->audioFileType	 = audioFileType;
+
+	fingerprintLength = (fileStat.st_size < HASH_CACHE_PREFIX_SIZE) ? fileStat.st_size : HASH_CACHE_PREFIX_SIZE;
+	fingerprint = uitsCreateDigestBuffered(audioFP, fingerprintLength, "SHA256");
+	fingerprintString = uitsDigestToString(fingerprint);
+	strncpy(key->fingerprint, fingerprintString, sizeof(key->fingerprint) - 1);
+
+	free(fingerprintString);
+	free(fingerprint->value);
+	free(fingerprint);
+	fclose(audioFP);
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsHashCacheKeysMatch
+ * Purpose:	 Compare two cache keys
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsHashCacheKeysMatch (UITS_HASH_CACHE_KEY *key1, UITS_HASH_CACHE_KEY *key2)
+{
+	return (key1->fileDevice	  == key2->fileDevice &&
+			key1->fileInode		  == key2->fileInode &&
+			key1->fileSize		  == key2->fileSize &&
+			key1->fileModTime	  == key2->fileModTime &&
+			key1->fileModTimeNsec == key2->fileModTimeNsec &&
+			key1->audioFileType	  == key2->audioFileType &&
+			strcmp(key1->fingerprint, key2->fingerprint) == 0);
+}
+
+/*
+ *
+ * Function: uitsHashCacheInsert
+ * Purpose:	 Add an entry to the hash table. The newest entry for a key is found first.
+ *
+ */
+
+void uitsHashCacheInsert (UITS_HASH_CACHE_KEY *key, char *mediaHashValue)
+{
+	UITS_HASH_CACHE_ENTRY *entry;
+	int					  bucket = key->fileInode % HASH_CACHE_BUCKETS;
+
+	entry = calloc(1, sizeof(UITS_HASH_CACHE_ENTRY));
+	uitsHandleErrorPTR(hashCacheModuleName, "uitsHashCacheInsert", entry, ERR_HASH, "Couldn't allocate media hash cache entry\n");
+
+	entry->key			  = *key;
+	entry->mediaHashValue = strdup(mediaHashValue);
+	entry->next			  = hashCacheTable[bucket];
+	hashCacheTable[bucket] = entry;
+}
+
+// EOF
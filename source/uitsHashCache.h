@@ -0,0 +1,76 @@
+/*
+ *  uitsHashCache.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitshashcache_h_
+#  define _uitshashcache_h_
+
+#define HASH_CACHE_BUCKETS		4096
+#define HASH_CACHE_PREFIX_SIZE	65536		/* bytes at the start of the file that are fingerprinted */
+#define HASH_CACHE_LINE_SIZE	1024
+#define HASH_CACHE_HEADER		"# UITS media hash cache 1"
+
+/*
+ * Nanoseconds of the modification time, where the platform has them
+ */
+
+#if defined(__APPLE__)
+#  define UITS_STAT_MTIME_NSEC(fileStat)	((fileStat)->st_mtimespec.tv_nsec)
+#elif defined(__linux__)
+#  define UITS_STAT_MTIME_NSEC(fileStat)	((fileStat)->st_mtim.tv_nsec)
+#else
+#  define UITS_STAT_MTIME_NSEC(fileStat)	0
+#endif
+
+/*
+ * Identifies one version of one audio file
+ */
+
+typedef struct {
+	unsigned long long	fileDevice;
+	unsigned long long	fileInode;
+	long long			fileSize;
+	long long			fileModTime;		/* seconds */
+	long				fileModTimeNsec;
+	int					audioFileType;
+	char				fingerprint[65];	/* hex SHA256 of the first HASH_CACHE_PREFIX_SIZE bytes */
+} UITS_HASH_CACHE_KEY;
+
+typedef struct UITS_HASH_CACHE_ENTRY {
+	UITS_HASH_CACHE_KEY				key;
+	char							*mediaHashValue;
+	struct UITS_HASH_CACHE_ENTRY	*next;
+} UITS_HASH_CACHE_ENTRY;
+
+/*
+ * PUBLIC Functions
+ */
+
+int		uitsHashCacheOpen		(char *hashCacheFileName);
+char	*uitsHashCacheLookup	(char *audioFileName, int audioFileType);
+void	uitsHashCacheAdd		(char *audioFileName, int audioFileType, char *mediaHashValue);
+
+/*
+ * PRIVATE Functions
+ */
+
+int		uitsHashCacheLoad		(void);
+int		uitsHashCacheGetKey		(char *audioFileName, int audioFileType, UITS_HASH_CACHE_KEY *key);
+int		uitsHashCacheKeysMatch	(UITS_HASH_CACHE_KEY *key1, UITS_HASH_CACHE_KEY *key2);
+void	uitsHashCacheInsert		(UITS_HASH_CACHE_KEY *key, char *mediaHashValue);
+
+#endif
+
+// EOF
@@ -0,0 +1,813 @@
+/*
+ *  uitsIOManager.c
+ *  UITS_Tool
+ *
+ *  Pluggable I/O backends under the format managers. The managers open their
+ *  files with uitsIOOpen instead of fopen. A name that has been registered with
+ *  uitsIORegisterBuffer is read and written through the memory buffer instead of
+ *  the file system, so a caller can create, embed, extract and verify payloads on
+ *  audio that is already in RAM without writing a temporary file. Unregistered
+ *  names are opened with stdio as before, or with a read-only memory mapping if
+ *  uitsIOSetMmapFlag has been called (the --mmap option of hash and verify).
+ *
+ *  Each backend is a table of positional callbacks (read at, write at, size, map,
+ *  close). uitsIOOpen wraps the backend in a stdio stream with fopencookie/funopen
+ *  so that the existing fread/fseeko based parsing code is unchanged.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *ioModuleName = "uitsIOManager.c";
+
+UITS_IO_SOURCE	*ioSources		= NULL;		/* registered names */
+UITS_IO			*ioOpenStreams	= NULL;		/* streams opened through a backend */
+unsigned long	ioNextSerial	= 1;
+int				ioMmapFlag		= FALSE;	/* map unregistered files that are opened read-only */
+
+UITS_IO_CALLBACKS ioMemoryCallbacks = {
+	IO_MEMORY, "memory",
+	uitsIOMemoryReadAt, uitsIOMemoryWriteAt, uitsIOMemorySize, uitsIOMemoryMap, uitsIOMemoryClose
+};
+
+#ifdef UITS_IO_COOKIE_STREAMS
+
+UITS_IO_CALLBACKS ioMmapCallbacks = {
+	IO_MMAP, "mmap",
+	uitsIOMmapReadAt, NULL, uitsIOMmapSize, uitsIOMmapMap, uitsIOMmapClose
+};
+
+#endif
+
+/*
+ *
+ * Function: uitsIORegisterBuffer
+ * Purpose:	 Register a memory buffer under a name. Opening the name with uitsIOOpen reads
+ *			 the buffer. The buffer is not copied: it is owned by the caller and must not
+ *			 be freed until the name is unregistered. If the name is opened for writing
+ *			 the data is copied into a buffer owned by this module first; use
+ *			 uitsIOGetBuffer to get the result. Re-registering a name replaces it.
+ * Passed:   Name, pointer to data (may be NULL for an empty output buffer), length of data
+ * Returns:  OK or ERROR
+ */
+
+int uitsIORegisterBuffer (char *name, unsigned char *data, size_t length)
+{
+	UITS_IO_SOURCE *source;
+
+	source = uitsIOAddSource(name);
+	if (!source) {
+		return (ERROR);
+	}
+
+	source->data   = data;
+	source->length = data ? length : 0;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsIOUnregister
+ * Purpose:	 Remove a registered name. A buffer owned by this module is freed, a buffer
+ *			 owned by the caller is left alone. Any streams opened on the
+ *			 name must have been closed.
+ * Passed:   Name
+ *
+ */
+
+void uitsIOUnregister (char *name)
+{
+	UITS_IO_SOURCE **sourcePtr = &ioSources;
+	UITS_IO_SOURCE *source;
+
+	while ((source = *sourcePtr)) {
+		if (strcmp(source->name, name) == 0) {
+			*sourcePtr = source->next;
+			if (source->ownsData) {
+				free(source->data);
+			}
+			if (source->tempName) {
+				remove(source->tempName);
+				free(source->tempName);
+			}
+			free(source->name);
+			free(source);
+			return;
+		}
+		sourcePtr = &source->next;
+	}
+}
+
+/*
+ *
+ * Function: uitsIOGetBuffer
+ * Purpose:	 Get the current contents of a registered memory buffer
+ * Passed:   Name, pointer to returned length
+ * Returns:  Pointer to the data (owned by this module if the name has been written,
+ *			 otherwise the caller's buffer) or NULL if the name isn't a memory buffer
+ */
+
+unsigned char *uitsIOGetBuffer (char *name, size_t *length)
+{
+	UITS_IO_SOURCE *source = uitsIOFindSource(name);
+
+	if (!source) {
+		return (NULL);
+	}
+
+#ifndef UITS_IO_COOKIE_STREAMS
+	if (source->tempName && uitsIOLoadTempFile(source) != OK) {
+		return (NULL);
+	}
+#endif
+
+	*length = source->length;
+	return (source->data);
+}
+
+/*
+ *
+ * Function: uitsIOSetMmapFlag
+ * Purpose:	 Turn memory mapping of unregistered files that are opened read-only on or off.
+ *			 Mapped files are hashed directly from the mapping (see uitsIOMap).
+ *
+ */
+
+void uitsIOSetMmapFlag (int flag)
+{
+	ioMmapFlag = flag;
+}
+
+/*
+ *
+ * Function: uitsIOOpen
+ * Purpose:	 Open a file or registered memory buffer.
+ *			 Drop-in replacement for fopen.
+ * Passed:   Name, stdio mode string
+ * Returns:  File pointer or NULL if the name couldn't be opened
+ */
+
+FILE *uitsIOOpen (char *name, char *mode)
+{
+	UITS_IO_SOURCE	*source;
+	int				writable = (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+'));
+#ifdef UITS_IO_COOKIE_STREAMS
+	UITS_IO			*io;
+	FILE			*fp;
+#endif
+
+	source = name ? uitsIOFindSource(name) : NULL;
+
+	if (!source) {
+#ifdef UITS_IO_COOKIE_STREAMS
+		if (ioMmapFlag && !writable) {
+			fp = uitsIOOpenMmap(name);
+			if (fp) {
+				return (fp);
+			}
+		}
+#endif
+		return (fopen(name, mode));
+	}
+
+#ifdef UITS_IO_COOKIE_STREAMS
+	io = calloc(sizeof(UITS_IO), 1);
+	io->source   = source;
+	io->writable = writable;
+	io->fd       = -1;
+	io->callbacks = &ioMemoryCallbacks;
+
+	if (strchr(mode, 'w')) {
+		if (!source->ownsData) {
+			source->data     = NULL;
+			source->capacity = 0;
+			source->ownsData = TRUE;
+		}
+		source->length = 0;
+		source->generation++;
+	}
+
+	if (strchr(mode, 'a')) {
+		io->position = io->callbacks->ioSize(io);
+	}
+
+	return (uitsIOOpenStream(io, mode));
+#else
+	if (writable || source->tempName) {
+		return (uitsIOOpenTempFile(source, mode));
+	}
+
+	return (uitsIOOpenTempCopy(source));
+#endif
+}
+
+/*
+ *
+ * Function: uitsIOGetStream
+ * Purpose:	 Find the backend of a stream opened with uitsIOOpen
+ * Passed:   File pointer
+ * Returns:  Pointer to the stream or NULL if the file was opened with stdio
+ */
+
+UITS_IO *uitsIOGetStream (FILE *fp)
+{
+	UITS_IO *io;
+
+	for (io = ioOpenStreams; io; io = io->next) {
+		if (io->fp == fp) {
+			return (io);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsIOMap
+ * Purpose:	 Get a pointer to the whole contents of a stream if the backend keeps it in
+ *			 memory (memory buffers and mapped files), so callers can skip the read into
+ *			 their own buffer. Pending writes are flushed first.
+ * Passed:   File pointer, pointer to returned size
+ * Returns:  Pointer to the data or NULL if the stream can't be mapped
+ */
+
+unsigned char *uitsIOMap (FILE *fp, off_t *mapSize)
+{
+	UITS_IO *io = uitsIOGetStream(fp);
+
+	if (!io || !io->callbacks->ioMap) {
+		return (NULL);
+	}
+
+	fflush(fp);
+	*mapSize = io->callbacks->ioSize(io);
+
+	return (io->callbacks->ioMap(io));
+}
+
+/*
+ *
+ * Function: uitsIOStat
+ * Purpose:	 fstat for a stream opened with uitsIOOpen. A memory buffer reports its serial
+ *			 number as the inode and its write generation as the modification time, so
+ *			 the result can be used to tell if the contents have changed.
+ * Passed:   File pointer, pointer to returned status
+ * Returns:  OK or ERROR
+ */
+
+int uitsIOStat (FILE *fp, struct stat *fileStat)
+{
+	UITS_IO *io = uitsIOGetStream(fp);
+
+	if (!io) {
+		return (fstat(fileno(fp), fileStat));
+	}
+
+	if (io->fd >= 0) {
+		return (fstat(io->fd, fileStat));
+	}
+
+	fflush(fp);
+	memset(fileStat, 0, sizeof(struct stat));
+	fileStat->st_mode  = S_IFREG;
+	fileStat->st_ino   = (ino_t) io->source->serial;
+	fileStat->st_size  = io->source->length;
+	fileStat->st_mtime = (time_t) io->source->generation;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsIOFindSource
+ * Purpose:	 Look up a registered name
+ * Returns:  Pointer to the source or NULL if the name isn't registered
+ */
+
+UITS_IO_SOURCE *uitsIOFindSource (char *name)
+{
+	UITS_IO_SOURCE *source;
+
+	for (source = ioSources; source; source = source->next) {
+		if (strcmp(source->name, name) == 0) {
+			return (source);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsIOAddSource
+ * Purpose:	 Register a new name, replacing any previous registration
+ * Returns:  Pointer to the new source
+ */
+
+UITS_IO_SOURCE *uitsIOAddSource (char *name)
+{
+	UITS_IO_SOURCE *source;
+
+	if (!name) {
+		return (NULL);
+	}
+
+	uitsIOUnregister(name);
+
+	source = calloc(sizeof(UITS_IO_SOURCE), 1);
+	uitsHandleErrorPTR(ioModuleName, "uitsIOAddSource", source, ERR_FILE,
+					   "Error: Couldn't allocate I/O source\n");
+
+	source->name   = strdup(name);
+	source->serial = ioNextSerial++;
+	source->next   = ioSources;
+	ioSources      = source;
+
+	return (source);
+}
+
+/*
+ *
+ * Function: uitsIOReserveBuffer
+ * Purpose:	 Make sure a memory buffer is owned by this module and can hold length bytes.
+ *			 The buffer grows by doubling.
+ * Returns:  OK or ERROR
+ */
+
+int uitsIOReserveBuffer (UITS_IO_SOURCE *source, size_t length)
+{
+	unsigned char	*data;
+	size_t			capacity;
+
+	if (source->ownsData && length <= source->capacity) {
+		return (OK);
+	}
+
+	if (length < source->length) {
+		length = source->length;
+	}
+
+	capacity = source->ownsData ? source->capacity : 0;
+	if (capacity < IO_MIN_BUFFER_SIZE) {
+		capacity = IO_MIN_BUFFER_SIZE;
+	}
+	while (capacity < length) {
+		capacity *= 2;
+	}
+
+	if (source->ownsData) {
+		data = realloc(source->data, capacity);
+	} else {
+		/* copy on first write, the caller's buffer is never modified */
+		data = malloc(capacity);
+		if (data && source->length) {
+			memcpy(data, source->data, source->length);
+		}
+	}
+
+	if (!data) {
+		return (ERROR);
+	}
+
+	source->data     = data;
+	source->capacity = capacity;
+	source->ownsData = TRUE;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsIOOpenTempCopy
+ * Purpose:	 Fallback for platforms without cookie streams: copy a memory buffer to an
+ *			 anonymous temporary file
+ * Returns:  File pointer or NULL on error
+ */
+
+FILE *uitsIOOpenTempCopy (UITS_IO_SOURCE *source)
+{
+	FILE *fp = tmpfile();
+
+	if (!fp) {
+		return (NULL);
+	}
+
+	if (source->length && fwrite(source->data, 1, source->length, fp) != source->length) {
+		fclose(fp);
+		return (NULL);
+	}
+
+	rewind(fp);
+
+	return (fp);
+}
+
+#ifndef UITS_IO_COOKIE_STREAMS
+
+/*
+ *
+ * Function: uitsIOOpenTempFile
+ * Purpose:	 Fallback for platforms without cookie streams: a memory buffer that is opened
+ *			 for writing is kept in a named temporary file instead. The file starts with
+ *			 the buffer contents, later opens of the name reopen the file and
+ *			 uitsIOGetBuffer reads it back.
+ * Passed:   Source, stdio mode string
+ * Returns:  File pointer or NULL on error
+ */
+
+FILE *uitsIOOpenTempFile (UITS_IO_SOURCE *source, char *mode)
+{
+	FILE *fp;
+
+	if (!source->tempName) {
+#ifdef _WIN32
+		source->tempName = _tempnam(NULL, "uits");
+#else
+		source->tempName = tempnam(NULL, "uits");
+#endif
+		if (!source->tempName) {
+			return (NULL);
+		}
+
+		fp = fopen(source->tempName, "wb");
+		if (!fp) {
+			free(source->tempName);
+			source->tempName = NULL;
+			return (NULL);
+		}
+		if (source->length && fwrite(source->data, 1, source->length, fp) != source->length) {
+			fclose(fp);
+			return (NULL);
+		}
+		fclose(fp);
+	}
+
+	if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+')) {
+		source->generation++;
+	}
+
+	return (fopen(source->tempName, mode));
+}
+
+/*
+ *
+ * Function: uitsIOLoadTempFile
+ * Purpose:	 Read the temporary file of a memory buffer (see uitsIOOpenTempFile) back
+ *			 into a buffer owned by this module
+ * Returns:  OK or ERROR
+ */
+
+int uitsIOLoadTempFile (UITS_IO_SOURCE *source)
+{
+	FILE			*fp;
+	off_t			fileSize;
+	unsigned char	*data;
+
+	fp = fopen(source->tempName, "rb");
+	if (!fp) {
+		return (ERROR);
+	}
+
+	fileSize = uitsGetFileSize(fp);
+	data = malloc(fileSize ? (size_t) fileSize : 1);
+	if (!data || fread(data, 1, (size_t) fileSize, fp) != (size_t) fileSize) {
+		free(data);
+		fclose(fp);
+		return (ERROR);
+	}
+	fclose(fp);
+
+	if (source->ownsData) {
+		free(source->data);
+	}
+	source->data     = data;
+	source->length   = (size_t) fileSize;
+	source->capacity = (size_t) fileSize;
+	source->ownsData = TRUE;
+
+	return (OK);
+}
+
+#endif
+
+/*
+ * Memory buffer backend
+ */
+
+long uitsIOMemoryReadAt (UITS_IO *io, unsigned char *buffer, size_t length, off_t offset)
+{
+	UITS_IO_SOURCE *source = io->source;
+
+	if (offset >= (off_t) source->length) {
+		return (0);
+	}
+
+	if (length > source->length - offset) {
+		length = source->length - offset;
+	}
+
+	memcpy(buffer, source->data + offset, length);
+
+	return ((long) length);
+}
+
+long uitsIOMemoryWriteAt (UITS_IO *io, const unsigned char *buffer, size_t length, off_t offset)
+{
+	UITS_IO_SOURCE *source = io->source;
+	size_t			endOffset = offset + length;
+
+	if (uitsIOReserveBuffer(source, endOffset) != OK) {
+		return (ERROR);
+	}
+
+	/* writing past the end leaves a hole, fill it with zeros like a file would */
+	if (offset > (off_t) source->length) {
+		memset(source->data + source->length, 0, offset - source->length);
+	}
+
+	memcpy(source->data + offset, buffer, length);
+
+	if (endOffset > source->length) {
+		source->length = endOffset;
+	}
+	source->generation++;
+
+	return ((long) length);
+}
+
+off_t uitsIOMemorySize (UITS_IO *io)
+{
+	return ((off_t) io->source->length);
+}
+
+unsigned char *uitsIOMemoryMap (UITS_IO *io)
+{
+	return (io->source->data);
+}
+
+int uitsIOMemoryClose (UITS_IO *io)
+{
+	(void) io;	/* the buffer belongs to its source, nothing to release */
+	return (OK);
+}
+
+#ifdef UITS_IO_COOKIE_STREAMS
+
+/*
+ * Memory mapped file backend (read-only)
+ */
+
+long uitsIOMmapReadAt (UITS_IO *io, unsigned char *buffer, size_t length, off_t offset)
+{
+	if (offset >= io->mapSize) {
+		return (0);
+	}
+
+	if ((off_t) length > io->mapSize - offset) {
+		length = io->mapSize - offset;
+	}
+
+	memcpy(buffer, io->mapData + offset, length);
+
+	return ((long) length);
+}
+
+off_t uitsIOMmapSize (UITS_IO *io)
+{
+	return (io->mapSize);
+}
+
+unsigned char *uitsIOMmapMap (UITS_IO *io)
+{
+	return (io->mapData);
+}
+
+int uitsIOMmapClose (UITS_IO *io)
+{
+	munmap(io->mapData, io->mapSize);
+	return (close(io->fd));
+}
+
+/*
+ *
+ * Function: uitsIOOpenMmap
+ * Purpose:	 Open a file read-only through a memory mapping
+ * Passed:   File name
+ * Returns:  File pointer or NULL if the file can't be mapped (the caller falls back to stdio)
+ */
+
+FILE *uitsIOOpenMmap (char *name)
+{
+	UITS_IO		*io;
+	struct stat fileStat;
+	int			fd;
+	void		*mapData;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		return (NULL);
+	}
+
+	/* empty files can't be mapped, and files larger than the address space shouldn't be */
+	if (fstat(fd, &fileStat) != OK || !S_ISREG(fileStat.st_mode) || fileStat.st_size == 0 ||
+		(off_t) (size_t) fileStat.st_size != fileStat.st_size) {
+		close(fd);
+		return (NULL);
+	}
+
+	mapData = mmap(NULL, (size_t) fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapData == MAP_FAILED) {
+		close(fd);
+		return (NULL);
+	}
+	madvise(mapData, (size_t) fileStat.st_size, MADV_SEQUENTIAL);
+
+	io = calloc(sizeof(UITS_IO), 1);
+	io->callbacks = &ioMmapCallbacks;
+	io->fd        = fd;
+	io->mapData   = mapData;
+	io->mapSize   = fileStat.st_size;
+
+	return (uitsIOOpenStream(io, "rb"));
+}
+
+/*
+ * stdio adapter. The cookie is the UITS_IO, which keeps its own position so that
+ * the backends only need positional reads and writes.
+ */
+
+long uitsIOCookieRead (UITS_IO *io, char *buffer, size_t length)
+{
+	long bytesRead = io->callbacks->ioReadAt(io, (unsigned char *) buffer, length, io->position);
+
+	if (bytesRead > 0) {
+		io->position += bytesRead;
+	}
+
+	return (bytesRead);
+}
+
+long uitsIOCookieWrite (UITS_IO *io, const char *buffer, size_t length)
+{
+	long bytesWritten;
+
+	if (!io->writable || !io->callbacks->ioWriteAt) {
+		return (ERROR);
+	}
+
+	bytesWritten = io->callbacks->ioWriteAt(io, (const unsigned char *) buffer, length, io->position);
+	if (bytesWritten > 0) {
+		io->position += bytesWritten;
+	}
+
+	return (bytesWritten);
+}
+
+off_t uitsIOCookieSeek (UITS_IO *io, off_t offset, int whence)
+{
+	off_t newPosition;
+
+	switch (whence) {
+		case SEEK_SET:
+			newPosition = offset;
+			break;
+		case SEEK_CUR:
+			newPosition = io->position + offset;
+			break;
+		case SEEK_END:
+			newPosition = io->callbacks->ioSize(io) + offset;
+			break;
+		default:
+			return (ERROR);
+	}
+
+	if (newPosition < 0) {
+		return (ERROR);
+	}
+
+	io->position = newPosition;
+
+	return (newPosition);
+}
+
+int uitsIOCookieClose (UITS_IO *io)
+{
+	UITS_IO **ioPtr = &ioOpenStreams;
+	int		closeErr;
+
+	while (*ioPtr) {
+		if (*ioPtr == io) {
+			*ioPtr = io->next;
+			break;
+		}
+		ioPtr = &(*ioPtr)->next;
+	}
+
+	closeErr = io->callbacks->ioClose(io);
+	free(io);
+
+	return (closeErr);
+}
+
+#ifdef __linux__
+
+ssize_t uitsIOGlibcRead (void *cookie, char *buffer, size_t length)
+{
+	return ((ssize_t) uitsIOCookieRead((UITS_IO *) cookie, buffer, length));
+}
+
+ssize_t uitsIOGlibcWrite (void *cookie, const char *buffer, size_t length)
+{
+	/* glibc treats a short write as an error, so a failure is reported as 0 bytes */
+	long bytesWritten = uitsIOCookieWrite((UITS_IO *) cookie, buffer, length);
+
+	return ((ssize_t) (bytesWritten < 0 ? 0 : bytesWritten));
+}
+
+int uitsIOGlibcSeek (void *cookie, off64_t *offset, int whence)
+{
+	off_t newPosition = uitsIOCookieSeek((UITS_IO *) cookie, (off_t) *offset, whence);
+
+	if (newPosition < 0) {
+		return (ERROR);
+	}
+
+	*offset = newPosition;
+
+	return (OK);
+}
+
+int uitsIOGlibcClose (void *cookie)
+{
+	return (uitsIOCookieClose((UITS_IO *) cookie));
+}
+
+#else
+
+int uitsIOBSDRead (void *cookie, char *buffer, int length)
+{
+	return ((int) uitsIOCookieRead((UITS_IO *) cookie, buffer, (size_t) length));
+}
+
+int uitsIOBSDWrite (void *cookie, const char *buffer, int length)
+{
+	return ((int) uitsIOCookieWrite((UITS_IO *) cookie, buffer, (size_t) length));
+}
+
+fpos_t uitsIOBSDSeek (void *cookie, fpos_t offset, int whence)
+{
+	return ((fpos_t) uitsIOCookieSeek((UITS_IO *) cookie, (off_t) offset, whence));
+}
+
+int uitsIOBSDClose (void *cookie)
+{
+	return (uitsIOCookieClose((UITS_IO *) cookie));
+}
+
+#endif
+
+/*
+ *
+ * Function: uitsIOOpenStream
+ * Purpose:	 Wrap a backend in a stdio stream and add it to the list of open streams
+ * Passed:   Stream, stdio mode string
+ * Returns:  File pointer or NULL on error (the stream is closed and freed)
+ */
+
+FILE *uitsIOOpenStream (UITS_IO *io, char *mode)
+{
+	FILE *fp;
+
+#ifdef __linux__
+	cookie_io_functions_t cookieFunctions = {
+		uitsIOGlibcRead, uitsIOGlibcWrite, uitsIOGlibcSeek, uitsIOGlibcClose
+	};
+
+	fp = fopencookie(io, mode, cookieFunctions);
+#else
+	fp = funopen(io, uitsIOBSDRead, io->writable ? uitsIOBSDWrite : NULL, uitsIOBSDSeek, uitsIOBSDClose);
+#endif
+
+	if (!fp) {
+		io->callbacks->ioClose(io);
+		free(io);
+		return (NULL);
+	}
+
+	io->fp        = fp;
+	io->next      = ioOpenStreams;
+	ioOpenStreams = io;
+
+	return (fp);
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,137 @@
+/*
+ *  uitsIOManager.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsiomanager_h_
+#  define _uitsiomanager_h_
+
+/*
+ * Platforms that can build a stdio stream on top of our own read/write/seek functions
+ * (fopencookie on glibc, funopen on the BSDs and OS X). Elsewhere memory buffers are
+ * copied to a temporary file and files are not mapped.
+ */
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define UITS_IO_COOKIE_STREAMS
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#define IO_MIN_BUFFER_SIZE	65536		/* initial size of a memory buffer opened for writing */
+
+/*
+ * I/O backends
+ */
+enum uitsIOTypes {
+	IO_MEMORY,			/* registered memory buffer */
+	IO_MMAP				/* read-only memory mapping of a named file */
+};
+
+typedef struct UITS_IO UITS_IO;
+
+/* The I/O callbacks */
+
+typedef long			ioReadAtCB		(UITS_IO *, unsigned char *, size_t, off_t);
+typedef long			ioWriteAtCB		(UITS_IO *, const unsigned char *, size_t, off_t);
+typedef off_t			ioSizeCB		(UITS_IO *);
+typedef unsigned char	*ioMapCB		(UITS_IO *);
+typedef int				ioCloseCB		(UITS_IO *);
+
+typedef struct {
+	int					ioType;
+	char				*ioTypeName;
+	ioReadAtCB			*ioReadAt;
+	ioWriteAtCB			*ioWriteAt;		/* NULL if the backend is read-only */
+	ioSizeCB			*ioSize;
+	ioMapCB				*ioMap;			/* NULL if the backend can't expose the data in memory */
+	ioCloseCB			*ioClose;
+} UITS_IO_CALLBACKS;
+
+/*
+ * Structures
+ */
+
+/* A name registered with uitsIORegisterBuffer */
+
+typedef struct UITS_IO_SOURCE {
+	char					*name;
+	unsigned char			*data;
+	size_t					length;			/* bytes of valid data in a memory buffer */
+	size_t					capacity;		/* allocated size if the buffer is owned by this module */
+	int						ownsData;		/* TRUE once the buffer has been copied or written */
+	unsigned long			serial;			/* unique id, used in place of an inode */
+	unsigned long			generation;		/* bumped on every write, used in place of mtime */
+	char					*tempName;		/* file holding a written buffer (no cookie streams) */
+	struct UITS_IO_SOURCE	*next;
+} UITS_IO_SOURCE;
+
+/* An open stream */
+
+struct UITS_IO {
+	UITS_IO_CALLBACKS	*callbacks;
+	UITS_IO_SOURCE		*source;		/* NULL for a mapped file */
+	int					fd;				/* IO_MMAP only, -1 otherwise */
+	unsigned char		*mapData;		/* IO_MMAP only */
+	off_t				mapSize;
+	int					writable;
+	off_t				position;		/* stream position for the stdio adapter */
+	FILE				*fp;
+	UITS_IO				*next;
+};
+
+/*
+ * PUBLIC Functions
+ */
+
+int				uitsIORegisterBuffer	(char *name, unsigned char *data, size_t length);
+void			uitsIOUnregister		(char *name);
+unsigned char	*uitsIOGetBuffer		(char *name, size_t *length);
+void			uitsIOSetMmapFlag		(int flag);
+FILE			*uitsIOOpen				(char *name, char *mode);
+UITS_IO			*uitsIOGetStream		(FILE *fp);
+unsigned char	*uitsIOMap				(FILE *fp, off_t *mapSize);
+int				uitsIOStat				(FILE *fp, struct stat *fileStat);
+
+/*
+ * PRIVATE Functions
+ */
+
+UITS_IO_SOURCE	*uitsIOFindSource		(char *name);
+UITS_IO_SOURCE	*uitsIOAddSource		(char *name);
+FILE			*uitsIOOpenStream		(UITS_IO *io, char *mode);
+FILE			*uitsIOOpenTempCopy		(UITS_IO_SOURCE *source);
+#ifndef UITS_IO_COOKIE_STREAMS
+FILE			*uitsIOOpenTempFile		(UITS_IO_SOURCE *source, char *mode);
+int				uitsIOLoadTempFile		(UITS_IO_SOURCE *source);
+#endif
+int				uitsIOReserveBuffer		(UITS_IO_SOURCE *source, size_t length);
+
+long			uitsIOMemoryReadAt		(UITS_IO *io, unsigned char *buffer, size_t length, off_t offset);
+long			uitsIOMemoryWriteAt		(UITS_IO *io, const unsigned char *buffer, size_t length, off_t offset);
+off_t			uitsIOMemorySize		(UITS_IO *io);
+unsigned char	*uitsIOMemoryMap		(UITS_IO *io);
+int				uitsIOMemoryClose		(UITS_IO *io);
+
+#ifdef UITS_IO_COOKIE_STREAMS
+long			uitsIOMmapReadAt		(UITS_IO *io, unsigned char *buffer, size_t length, off_t offset);
+off_t			uitsIOMmapSize			(UITS_IO *io);
+unsigned char	*uitsIOMmapMap			(UITS_IO *io);
+int				uitsIOMmapClose			(UITS_IO *io);
+FILE			*uitsIOOpenMmap			(char *name);
+#endif
+
+#endif
+
+// EOF
@@ -75,7 +75,7 @@ int mp3IsValidFile (char *audioFileName)
 	FILE *audioFP;
 	MP3_ID3_HEADER		   *mp3ID3Header;
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp3ModuleName, "mp3IsValidFile", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
 	/* If this is an MP3 file, it will start with an ID3 tag header */
@@ -111,14 +111,14 @@ char *mp3GetMediaHash (char *audioFileName)
 	FILE *audioFP;
 	MP3_ID3_HEADER		   *mp3ID3Header;
 	MP3_AUDIO_FRAME_HEADER *mp3AudioFrameHeader;
-	int audioFrameStart, audioFrameEnd, audioFrameLength, digestStart;
+	off_t audioFrameStart, audioFrameEnd, audioFrameLength, digestStart;
 	UITS_digest *mediaHash;
 	char *mediaHashString;
-	int foundPadBytes;
+	off_t foundPadBytes;
 	int id3v1TagCount;
 	
 
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp3ModuleName, "mp3GetMediaHash", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
 	/* The file should start with an ID3 tag header */
@@ -179,7 +179,7 @@ char *mp3GetMediaHash (char *audioFileName)
   audioFrameLength = audioFrameEnd - digestStart;
   fseeko(audioFP, digestStart, SEEK_SET);
 	
-	mediaHash = uitsCreateDigestBuffered (audioFP, audioFrameLength, "SHA256") ;
+	mediaHash = uitsCreateMediaDigest (audioFP, audioFrameLength) ;
 	
 	mediaHashString = uitsDigestToString(mediaHash);
 	
@@ -214,18 +214,18 @@ int mp3EmbedPayload  (char *audioFileName,
 {
 	FILE			*audioInFP, *audioOutFP;
 	int				frameType;
-	unsigned long	id3TagSize;
+	off_t			id3TagSize;
 	MP3_ID3_HEADER	*id3Header;
-	unsigned long	audioFrameStart, audioFrameEnd, audioFrameLength;
+	off_t			audioFrameStart, audioFrameEnd, audioFrameLength;
 
 	
 	vprintf("About to embed payload for %s into %s\n", audioFileName, audioFileNameOut);
 	
 	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp3ModuleName, "mp3EmbedPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 
-	audioOutFP = fopen(audioFileNameOut, "wb");
+	audioOutFP = uitsIOOpen(audioFileNameOut, "wb");
 	uitsHandleErrorPTR(mp3ModuleName, "mp3EmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
 	
 	/* read the original ID3 header for use later */
@@ -257,7 +257,7 @@ int mp3EmbedPayload  (char *audioFileName,
 				break;
 				
 			default:
-				vprintf("Unidentified frame at %ld\n", (ftello(audioInFP) - 4));
+				vprintf("Unidentified frame at %lld\n", (long long) (ftello(audioInFP) - 4));
 				break;
 		}
 		
@@ -301,6 +301,58 @@ int mp3EmbedPayload  (char *audioFileName,
 	return(OK);
 }
 
+/*
+ *
+ * Function: mp3EmbedPayloadStream
+ * Purpose:	 Embed the UITS payload into an MP3 stream. The ID3 tag, and any zero padding
+ *			 after it, is buffered up to the first audio frame and run through
+ *			 mp3EmbedPayload. The audio frames are then copied through unchanged.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int mp3EmbedPayloadStream (UITS_AUDIO_STREAM *stream,
+						   FILE *audioOutFP,
+						   char *uitsPayloadXML,
+						   int  numPadBytes)
+{
+	mp3GetStreamAudioFrameStart(stream);
+	
+	return (uitsAudioEmbedStreamPrefix(stream, audioOutFP, mp3EmbedPayload, uitsPayloadXML, numPadBytes));
+}
+
+/*
+ *
+ * Function: mp3GetStreamAudioFrameStart
+ * Purpose:	 Read the ID3 tag, and any zero padding after it, into the stream prefix up to
+ *			 and including the header of the first audio frame
+ * Returns:  Offset of the first audio frame or exit on error
+ *
+ */
+
+size_t mp3GetStreamAudioFrameStart (UITS_AUDIO_STREAM *stream)
+{
+	size_t audioFrameStart = stream->id3TagSize;
+	
+	if (!audioFrameStart) {
+		uitsHandleErrorINT(mp3ModuleName, "mp3GetStreamAudioFrameStart", ERROR, OK, ERR_MP3, 
+						   "Error: MP3 stream doesn't start with an ID3 tag\n");
+	}
+	
+	while ((uitsAudioStreamFill(stream, audioFrameStart + MP3_FRAME_HEADER_SIZE) == OK) && !stream->prefix[audioFrameStart]) {
+		audioFrameStart++;
+	}
+	
+	/* anything other than padding between the tag and the audio would have to be read ahead without limit */
+	if ((stream->prefixLength < audioFrameStart + MP3_FRAME_HEADER_SIZE) ||
+		!((stream->prefix[audioFrameStart] == 0xff) && ((stream->prefix[audioFrameStart + 1] & 0xe0) == 0xe0))) {
+		uitsHandleErrorINT(mp3ModuleName, "mp3GetStreamAudioFrameStart", ERROR, OK, ERR_MP3, 
+						   "Error: Couldn't find first audio frame after ID3 tag in MP3 stream\n");
+	}
+	
+	return (audioFrameStart);
+}
+
 /*
  *
  * Function: mp3ExtractPayload
@@ -310,7 +362,7 @@ int mp3EmbedPayload  (char *audioFileName,
  *				3. Seek to <xml> data in PRIV frame
  *				4. return pointer to payload XML
  *
- * Returns: pointer to payload or exit if error
+ * Returns: pointer to payload, NULL if payload not found or exit if error
  */
 
 char *mp3ExtractPayload (char *audioFileName) 
@@ -324,7 +376,7 @@ char *mp3ExtractPayload (char *audioFileName)
 	vprintf("\tAbout to extract payload from %s\n", audioFileName);
 	
 	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp3ModuleName, "mp3ExtractUITSPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
 
@@ -344,23 +396,21 @@ char *mp3ExtractPayload (char *audioFileName)
 				mp3SkipPadBytes (audioInFP);
 				break;
 				
-			case AUDIOFRAME:		// We should not encounter an Audio frame. UITS payload should be found before this.
-				uitsHandleErrorINT(mp3ModuleName, "mp3ExtractPayload", AUDIOFRAME, 0, ERR_MP3,  
-								"Error: Did not find UITS payload in audio file\n");
-				break;
-				
-			case ID3V1TAG:		// We should not encounter an ID3 V1 tag. UITS payload should be found before this
-				uitsHandleErrorINT(mp3ModuleName, "mp3ExtractPayload", ID3V1TAG, 0, ERR_MP3,  
-								"Error: Did not find UITS payload in audio file\n");
-				break;
+			case AUDIOFRAME:		// The UITS payload is found before the first Audio frame
+			case ID3V1TAG:			// and the ID3 V1 tag, so there isn't one in this file
+				vprintf("Did not find UITS payload in audio file\n");
+				fclose(audioInFP);
+				return (NULL);
 				
 			default:
-				vprintf("Unidentified frame at %ld\n", (ftello(audioInFP) - 4));
+				vprintf("Unidentified frame at %lld\n", (long long) (ftello(audioInFP) - 4));
 				break;
 		}
 		
 	}
 	
+	fclose(audioInFP);
+	
 	return (uitsPayloadXML);
 	
 }
@@ -380,7 +430,7 @@ int mp3CheckFileVersion (char *audioFileName)
 	FILE *audioInFP;
 	
 	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp3ModuleName, "mp3ExtractUITSPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 
 	/* read the original ID3 header for use later */
@@ -650,7 +700,7 @@ int mp3WritePRIVFrame (FILE *audioOutFP, char *uitsPayloadXML)
  *	Function: mp3FindUITSPayload
  *	Purpose:  Read an ID3 frame and check to see if it is PRIV frame containing the UITS payload
  *			  Leaves input file pointers at end of frame
- *  Returns:  pointer to payload XML if found or NULL
+ *  Returns:  pointer to payload XML (caller owns the buffer) if found or NULL
  *
  */
 
@@ -692,8 +742,10 @@ char *mp3FindUITSPayload (FILE *audioInFP)
 		/* is it a UITS payload? */
 		/* look for the the uits:UITS open tag string in the priv frame data */
 		if (strstr(strPtr, ":UITS")) {
+			/* move the payload to the start of the buffer, so the caller can free it */
 			uitsPayloadXML = strstr(strPtr, "<?xml");
-			return (uitsPayloadXML);
+			memmove(privFrameData, uitsPayloadXML, strlen(uitsPayloadXML) + 1);
+			return (privFrameData);
 		}
 		
 	}
@@ -785,8 +837,7 @@ MP3_ID3_HEADER *mp3ReadID3Header(FILE *fpin)
 		
 		// The next 4 bytes have the size in sync-safe format. Need to convert to integer.
 		
-		memcpy(&tagsize, &header[6], 4);
-		lswap(&tagsize);
+		tagsize = uitsReadBE32(&header[6]);
 		uitsMake28From32(&tagsize); // we have to remove the high bit of each byte in size - moronic.
 		mp3Header->size = tagsize;
 		// dprintf("Greater Tag size: %ld\n", tagsize);
@@ -840,8 +891,7 @@ int	mp3WriteID3Header(FILE *audioOutFP, MP3_ID3_HEADER *mp3Header)
 	// The next 4 bytes have the size in sync-safe format. Need to convert from integer and handle endianness. 
 
 	uitsMake32From28(&mp3Header->size); // we have to remove the high bit of each byte in size - moronic.
-	lswap(&mp3Header->size);
-	memcpy(&header[6] ,&mp3Header->size,  4);
+	uitsWriteBE32(&header[6], mp3Header->size);
 
 	err = fwrite(header, 1, MP3_HEADER_SIZE, audioOutFP);
 	uitsHandleErrorINT(mp3ModuleName, "mp3WriteID3Header", err, MP3_HEADER_SIZE, ERR_FILE, 
@@ -869,7 +919,7 @@ MP3_AUDIO_FRAME_HEADER *mp3ReadAudioFrameHeader (FILE *fpin)
 	MP3_AUDIO_FRAME_HEADER *frameHeader = calloc(sizeof(MP3_AUDIO_FRAME_HEADER), 1);
 	int saveSeek;		// always leave the file pointer where it was when the function was called
   int pad;
-	unsigned char header[3];
+	unsigned char header[4];
 	unsigned char bytebuf;
 
 //	unsigned long next_frame, save_seek, aindex = 0L;
@@ -1086,6 +1136,47 @@ void uitsMake32From28 (long *length)
 	*length = l4;	
 	return;
 }
+/*
+ *
+ * Function: mp3GetEmbedPlan
+ * Purpose:	 Plan the payload embedding for an MP3 file. The PRIV frame goes inside the
+ *			 ID3 tag, so the tag is rebuilt by mp3EmbedPayload for each payload. The header
+ *			 of the first audio frame is kept with the tag because mp3EmbedPayload reads it.
+ *			 The audio frames are copied unchanged.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int mp3GetEmbedPlan (char *audioFileName, UITS_EMBED_PLAN *plan)
+{
+	UITS_AUDIO_STREAM	stream;
+	FILE				*audioInFP;
+	size_t				headerLength;
+	
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(mp3ModuleName, "mp3GetEmbedPlan", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
+	
+	memset(&stream, 0, sizeof(UITS_AUDIO_STREAM));
+	stream.audioInFP = audioInFP;
+	
+	/* anything else is left to the regular embed */
+	if (uitsAudioGetStreamType(&stream) != MP3) {
+		free(stream.prefix);
+		fclose(audioInFP);
+		return (ERROR);
+	}
+	
+	headerLength = mp3GetStreamAudioFrameStart(&stream) + MP3_FRAME_HEADER_SIZE;
+	free(stream.prefix);
+	
+	err = uitsEmbedPlanReadHeader(plan, audioInFP, headerLength);
+	fclose(audioInFP);
+	
+	plan->rebuildHeader = mp3EmbedPayload;
+	
+	return (err);
+}
+
 // EOF
 
 
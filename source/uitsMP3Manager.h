@@ -52,6 +52,7 @@
  */
 
 #define MP3_HEADER_SIZE 10
+#define MP3_FRAME_HEADER_SIZE 4		/* audio frame sync word and header */
 
 /* 
  * Structures
@@ -106,10 +107,18 @@ int mp3EmbedPayload		    (char *audioFileName,
 							 char *uitsPayloadXML,
 							 int  numPadBytes);
 
+int mp3EmbedPayloadStream	(UITS_AUDIO_STREAM *stream,
+							 FILE *audioOutFP,
+							 char *uitsPayloadXML,
+							 int  numPadBytes);
+
 char *mp3ExtractPayload		(char *audioFileName); 
 
 char *mp3GetMediaHash		(char *audioFileName);
 
+int mp3GetEmbedPlan			(char *audioFileName, 
+							 UITS_EMBED_PLAN *plan);
+
 // int mp3ValidateMediaHash	(char *audioFileName, 
 //							 char *mediaHashValue);
 
@@ -119,6 +128,8 @@ char *mp3GetMediaHash		(char *audioFileName);
 
 int mp3CheckFileVersion		(char *audioFileName);
 
+size_t mp3GetStreamAudioFrameStart	(UITS_AUDIO_STREAM *stream);
+
 int mp3IdentifyFrame		(FILE *fpin);
 int mp3GetID3V1TagCount		(FILE *fpin);
 int mp3IsVBRFrame			(FILE *fpin, 
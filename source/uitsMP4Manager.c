@@ -49,7 +49,7 @@ int mp4IsValidFile (char *audioFileName)
 		{NULL,			NULL}
 	};
 
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4IsValidFile", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
 	/* Read the first 8 bytes of the file and check to see if they represent a MP4 'ftyp' atom */
@@ -101,41 +101,21 @@ int mp4IsValidFile (char *audioFileName)
 char *mp4GetMediaHash (char *audioFileName) 
 {
 	FILE			*audioFP;
-	MP4_ATOM_HEADER *atomHeader = calloc(sizeof(MP4_ATOM_HEADER), 1);
-	unsigned long	fileLength;
-	unsigned long	audioFrameStart, audioFrameEnd, audioFrameLength;
+	UITS_CONTAINER_ENTRY *atomHeader;
 	UITS_digest		*mediaHash;
 	char			*mediaHashString;
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4GetMediaHash", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	/* get file size */
-	fileLength = uitsGetFileSize(audioFP);
-
-	atomHeader = mp4FindAtomHeader(audioFP, "mdat", fileLength);
+	atomHeader = mp4FindAtomHeader(audioFP, NULL, "mdat");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4GetMediaHash", atomHeader, ERR_FILE, "Couldn't find 'mdat' atom in audio file\n");
 	
-	/* move fp to start of mdat atom */
-	fseeko(audioFP, atomHeader->saveSeek, SEEK_SET);
-
-	/*skip past size and type */
-	fseeko(audioFP, 8L, SEEK_CUR);
+	/* move fp to start of mdat atom data, past size and type (and extended size, if any) */
+	fseeko(audioFP, atomHeader->offset + atomHeader->headerSize, SEEK_SET);
 		
-	/* fp is (hopefully) at start of audio frame data */
-	audioFrameStart = ftello(audioFP);
-	
-	/* if size is 0, need to calculate how long the audio frame data is by seeking to EOF and saving size  */
-	if (atomHeader->size == 0) {
-		fseeko(audioFP, 0L, SEEK_END);
-		audioFrameEnd = ftello(audioFP);	
-		fseeko(audioFP, audioFrameStart, SEEK_SET);
-		audioFrameLength = audioFrameEnd - audioFrameStart;
-	} else {
-		audioFrameLength = atomHeader->size - 8;
-	}
-	
-	mediaHash = uitsCreateDigestBuffered (audioFP, audioFrameLength, "SHA256") ;
+	/* fp is (hopefully) at start of audio frame data. an atom size of 0 (atom goes to EOF) is resolved by the index */
+	mediaHash = uitsCreateMediaDigest (audioFP, atomHeader->size) ;
 	
 	mediaHashString = uitsDigestToString(mediaHash);
 	
@@ -169,9 +149,9 @@ int mp4EmbedPayload  (char *audioFileName,
 					  int  numPadBytes) 
 {
 	FILE			*audioInFP, *audioOutFP;
-	unsigned long	audioInFileSize;
+	off_t			audioInFileSize;
 	unsigned long   payloadXMLSize;
-	unsigned long	atomSize;
+	unsigned char	sizeBytes[4];
 	uuid_t uuid;
 	char *strPtr, *strPtr2;
 	int i;
@@ -186,10 +166,10 @@ int mp4EmbedPayload  (char *audioFileName,
 	payloadXMLSize = strlen(uitsPayloadXML);
 	
 	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4EmbedPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioOutFP = fopen(audioFileNameOut, "w+b");
+	audioOutFP = uitsIOOpen(audioFileNameOut, "w+b");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4EmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
 	
 	/* calculate how long the input audio file is by seeking to EOF and saving size  */
@@ -201,9 +181,8 @@ int mp4EmbedPayload  (char *audioFileName,
 	uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize);
 		
 	/* write the UITS payload in a uuid atom */
-	atomSize = payloadXMLSize + 8 + UUID_SIZE;
-	lswap(&atomSize);
-	fwrite(&atomSize, 1, 4, audioOutFP);					/* 4-bytes size */
+	uitsWriteBE32(sizeBytes, payloadXMLSize + 8 + UUID_SIZE);
+	fwrite(sizeBytes, 1, 4, audioOutFP);					/* 4-bytes size */
 
 	fwrite("uuid",    1, 4, audioOutFP);					/* 4-bytes 'uuid' */
 
@@ -250,17 +229,17 @@ int mp4EmbedPayload  (char *audioFileName,
  *							Atom UITS @ 38 size: 1244 ends @ 1282
  *					Atom mdat @ 51232 of size: 5466860, ends @ 5518092
  *
- * Returns: pointer to payload or exit if error
+ * Returns: pointer to payload, NULL if payload not found or exit if error
  */
 
 char *mp4ExtractPayload (char *audioFileName) 
 
 {
 	FILE			*audioFP;
-	unsigned long	fileLength;
 	char			*payloadXML;
 	unsigned long	atomSize;
-	MP4_ATOM_HEADER *atomHeader;
+	UITS_CONTAINER_INDEX *index;
+	UITS_CONTAINER_ENTRY *atomHeader;
 
 	uuid_t  fileUUID;
 	uuid_t	uitsUUID;
@@ -271,22 +250,17 @@ char *mp4ExtractPayload (char *audioFileName)
 	uitsHandleErrorINT(mp4ModuleName, "mp4ExtractPayload", err, 0, ERR_MP4, "Couldn't convert UITS uuid to hex\n");
 	
 	/* open the audio input file */
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4ExtractPayload", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 		
-	/* get file size */
-	fileLength = uitsGetFileSize(audioFP);
-	
-	atomHeader = mp4FindAtomHeader(audioFP, "uuid", fileLength);
+	index = uitsContainerIndexGet(audioFP, CONTAINER_MP4);
+	atomHeader = uitsContainerIndexFindChild(index, NULL, "uuid", NULL);
 	
 	/* there could be multiple uuid's so keep searching until no more */
 	
 	while (atomHeader) {	// found uuid root atom, check uuid value, extract UITS data and return
-		/* move fp to start of UITS atom */
-		fseeko(audioFP, atomHeader->saveSeek, SEEK_SET);
-	
-		/*skip past size and type */
-		fseeko(audioFP, 8L, SEEK_CUR);
+		/* move fp to start of UITS atom, past size and type */
+		fseeko(audioFP, atomHeader->offset + atomHeader->headerSize, SEEK_SET);
 		
 		/* read the uuid value */
 		fread(fileUUID, 1, UUID_SIZE, audioFP);
@@ -301,22 +275,25 @@ char *mp4ExtractPayload (char *audioFileName)
 		}
 	
 		
-		if (err == 0) {	/* found the UITS uuid atom */
-			/* this is a cheat. calloc 8 + UUID_SIZE bytes more than we're going to read so that the payload XML */
-			/* will be null-terminated when it's read from the file */
-			payloadXML = calloc(atomHeader->size, 1);	
-			atomSize = atomHeader->size - 8 - UUID_SIZE;
+		if ((err == 0) && (atomHeader->size >= UUID_SIZE)) {	/* found the UITS uuid atom */
+			/* alloc space with an extra null-terminator byte */
+			atomSize = atomHeader->size - UUID_SIZE;
+			payloadXML = calloc(atomSize + 1, 1);	
 	
 			err = fread(payloadXML, 1L, atomSize, audioFP);
 			uitsHandleErrorINT(mp4ModuleName, "mp4ExtractPayload", err, atomSize, ERR_MP4, "Couldn't read UITS atom data\n");
 	
+			fclose(audioFP);
 			return (payloadXML);
 		}
 		
-		atomHeader = mp4FindAtomHeader(audioFP, "uuid", fileLength);
+		/* not the UITS uuid, continue the search after this atom */
+		atomHeader = uitsContainerIndexFindSibling(index, atomHeader, "uuid", NULL);
 
 	} 
 	
+	fclose(audioFP);
+	
 	// See if there's a UITS 1.0 payload
 	payloadXML = mp4ExtractPayload_UITS1(audioFileName);
 	
@@ -327,7 +304,9 @@ char *mp4ExtractPayload (char *audioFileName)
 	
 	// no payload found
 	
-	uitsHandleErrorPTR(mp4ModuleName, "mp4ExtractPayload", NULL, ERR_MP4, "Couldn't find UITS payload in file\n");
+	vprintf("Couldn't find UITS payload in file\n");
+	
+	return (NULL);
 
 }
 
@@ -338,33 +317,24 @@ char *mp4ExtractPayload (char *audioFileName)
  * Purpose:	 Find an set of nested atoms
  
  *           
- * Passed:   File pointer (should point to file location to start search)
+ * Passed:   File pointer
  *				The file pointer is returned to it's original position
  *			 NULL-terminted Array containing nested list of atoms
- * Returns:  Pointer to header structure or NULL if error
+ * Returns:  Pointer to the array, with the index entry for each atom filled in
  */
 
 
-MP4_ATOM_HEADER *mp4FindAtomHeaderNested (FILE *fpin, MP4_NESTED_ATOM *nestedAtoms)
+MP4_NESTED_ATOM *mp4FindAtomHeaderNested (FILE *fpin, MP4_NESTED_ATOM *nestedAtoms)
 {
 	MP4_NESTED_ATOM *currAtom = nestedAtoms;
-	unsigned int saveSeek;
-	unsigned int atomSize;
-	unsigned int filesize;
-		
-	saveSeek = ftello(fpin);
-	rewind(fpin);
-	
-	atomSize = uitsGetFileSize(fpin);
+	UITS_CONTAINER_ENTRY *parentAtom = NULL;
 	
 	while (*currAtom->atomType) {
-		currAtom->atomHeader = mp4FindAtomHeader(fpin, currAtom->atomType, atomSize);
-		uitsHandleErrorPTR(mp4ModuleName, "mp4FindAtomHeaderNested", currAtom->atomHeader, ERR_MP4,
+		/* search the children of the previous atom only */
+		currAtom->atomEntry = mp4FindAtomHeader(fpin, parentAtom, currAtom->atomType);
+		uitsHandleErrorPTR(mp4ModuleName, "mp4FindAtomHeaderNested", currAtom->atomEntry, ERR_MP4,
 						   "Couldn't find nested atom\n");
-		/* move file pointer to just past current atom header*/
-		fseeko(fpin, currAtom->atomHeader->saveSeek, SEEK_SET);
-		fseeko(fpin, 8, SEEK_CUR);
-		atomSize = currAtom->atomHeader->size - 8;
+		parentAtom = currAtom->atomEntry;
 		currAtom++;
 	}
 	
@@ -375,45 +345,28 @@ MP4_ATOM_HEADER *mp4FindAtomHeaderNested (FILE *fpin, MP4_NESTED_ATOM *nestedAto
 /*
  *
  * Function: mp4FindAtomHeader
- * Purpose:	 Find an MP4 atom header within an MP4 file
+ * Purpose:	 Find an MP4 atom within an MP4 file or within a parent atom
  *           Atom header format is :
  *               size: 4-bytes (0=to EOF, 1=extended (64-bit) size)
  *               type: 4-bytes
  *
+ *			 The atoms are looked up in the file's container index, so the file is only
+ *			 walked once no matter how many atoms are searched for.
  *           The file pointer is returned to it's original position
- * Passed:   File pointer (should point to file location to start search)
+ * Passed:   File pointer
+ *			 Parent atom to search (NULL to search the top-level atoms)
  *			 Type of atom to find
- *			 Location to end searching
- * Returns:  Pointer to header structure or NULL if error
+ * Returns:  Pointer to the index entry (owned by the index) or NULL if not found
  */
 
 
-MP4_ATOM_HEADER *mp4FindAtomHeader (FILE *fpin, char *atomType, unsigned long endSeek)
+UITS_CONTAINER_ENTRY *mp4FindAtomHeader (FILE *fpin, UITS_CONTAINER_ENTRY *parentAtom, char *atomType)
 {
-	MP4_ATOM_HEADER *atomHeader = calloc(sizeof(MP4_ATOM_HEADER), 1);
-	unsigned long	saveSeek, bytesLeft;			
-
-	saveSeek = ftello(fpin);
+	UITS_CONTAINER_INDEX *index;
 	
-	bytesLeft = endSeek - saveSeek;
-	
-	/* read atoms until finding the atom type or end of search */
-	atomHeader = mp4ReadAtomHeader(fpin);
-	while (strncmp(atomHeader->type, atomType, 4) != 0) {
-		if ( bytesLeft && (atomHeader->size)) {					
-			bytesLeft -= atomHeader->size;
-			fseeko(fpin, atomHeader->size, SEEK_CUR);
-		} else {				// size of 0 means atom lasts until EOF, so we didn't find atom type
-			/* return file pointer to original position */
-			fseeko(fpin, saveSeek, SEEK_SET);
-			return (NULL);		
-		}
-		atomHeader = mp4ReadAtomHeader(fpin);
-	}
-		
-	fseeko(fpin, saveSeek, SEEK_SET);
-    return (atomHeader);
+	index = uitsContainerIndexGet(fpin, CONTAINER_MP4);
 	
+	return (uitsContainerIndexFindChild(index, parentAtom, atomType, NULL));
 }
 
 /*
@@ -434,7 +387,8 @@ MP4_ATOM_HEADER *mp4ReadAtomHeader (FILE *fpin)
 {
 	MP4_ATOM_HEADER *atomHeader = calloc(sizeof(MP4_ATOM_HEADER), 1);
 	unsigned char	header[MP4_HEADER_SIZE];
-	unsigned long   atomSize;
+	unsigned long   atomSize = 0;
+	unsigned char	extendedSize[8];
 
  
 	atomHeader->saveSeek = ftello(fpin);
@@ -446,15 +400,18 @@ MP4_ATOM_HEADER *mp4ReadAtomHeader (FILE *fpin)
 	
 	memcpy (atomHeader->type, &header[4], 4); 
 
-	memcpy(&atomSize, &header[0], 4);
-	lswap(&atomSize);
+	atomSize = uitsReadBE32(&header[0]);
 	atomHeader->size = atomSize;
+	atomHeader->headerSize = MP4_HEADER_SIZE;
 
-    /* check for extended (64 bit) atom size */
+    /* check for extended (64 bit) atom size, which follows the type */
     if (atomSize == 1)
     {
-		uitsHandleErrorINT(mp4ModuleName, "mp4ReadAtomHeader", err, 1, ERR_MP4, "Unsupported extended size atom found in file\n");
+		err = fread(extendedSize, 1L, 8, fpin);
+		uitsHandleErrorINT(mp4ModuleName, "mp4ReadAtomHeader", err, 8, ERR_MP4, "Couldn't read mp4 extended atom size\n");
 
+		atomHeader->size = uitsReadBE64(extendedSize);
+		atomHeader->headerSize = MP4_EXTENDED_HEADER_SIZE;
 	}
 	
 	/* return file pointer to original position */
@@ -493,17 +450,14 @@ int mp4UpdateChunkOffsetTable(FILE *fpout, int uitsAtomSize)
 		{ NULL, 0}
 	};
 	MP4_NESTED_ATOM *chunkTable = NULL;
-	unsigned int saveSeek;
-	unsigned int atomSize;
-	unsigned int audioOutFileSize;
+	off_t saveSeek;
 	unsigned long numChunkEntries;
 	unsigned long chunkOffset;
+	unsigned char offsetBytes[4];
 	int i;
 	
 	saveSeek = ftello(fpout);
-	rewind(fpout);
-
-	audioOutFileSize = uitsGetFileSize(fpout);
+	fflush(fpout);		/* the index is built from the file, not the stdio buffer */
 	
 	/* populate the nested atom pointers */
 	chunkTable = mp4FindAtomHeaderNested(fpout, nestedAtoms);
@@ -513,21 +467,20 @@ int mp4UpdateChunkOffsetTable(FILE *fpout, int uitsAtomSize)
 		chunkTable++;
 	}
 	/* seek to the beginning of the chunk offset table */
-	fseeko(fpout, chunkTable->atomHeader->saveSeek, SEEK_SET);
-	fseeko(fpout, 8, SEEK_CUR); /* seek past the atom size and type */
+	fseeko(fpout, chunkTable->atomEntry->offset, SEEK_SET);
+	fseeko(fpout, chunkTable->atomEntry->headerSize, SEEK_CUR); /* seek past the atom size and type */
 	fseeko(fpout, 1, SEEK_CUR); /* seek past the version */
 	fseeko(fpout, 3, SEEK_CUR);	/* seek past the flags bytes */
-	fread(&numChunkEntries, 1, 4, fpout);
-	lswap(&numChunkEntries);
+	fread(offsetBytes, 1, 4, fpout);
+	numChunkEntries = uitsReadBE32(offsetBytes);
 
 	/* now, read each of the chunk sizes, add uits chunk size, and rewrite */
 	for (i=0; i<numChunkEntries; i++) {
-		fread(&chunkOffset, 1, 4, fpout);
-		lswap(&chunkOffset);
-		chunkOffset += uitsAtomSize;
-		lswap(&chunkOffset);
+		fread(offsetBytes, 1, 4, fpout);
+		chunkOffset = uitsReadBE32(offsetBytes) + uitsAtomSize;
+		uitsWriteBE32(offsetBytes, chunkOffset);
 		fseeko(fpout, -4, SEEK_CUR);	/* seek back to overwrite*/
-		fwrite(&chunkOffset, 1, 4, fpout);
+		fwrite(offsetBytes, 1, 4, fpout);
 		fseeko(fpout, 0, SEEK_CUR);  /* must do a seek after write and before read */
 	}
 	
@@ -553,6 +506,7 @@ int mp4CopyAtom (FILE *fpin, FILE *fpout)
 	MP4_ATOM_HEADER *atomHeader = NULL;
 	unsigned int saveSeek;
 	unsigned int atomSize;
+	unsigned char sizeBytes[4];
 
 	atomHeader = mp4ReadAtomHeader(fpin);
 	atomSize = atomHeader->size;
@@ -565,8 +519,8 @@ int mp4CopyAtom (FILE *fpin, FILE *fpout)
 		fseeko(fpin, saveSeek, SEEK_SET); /* Back to start of atom */
 		/* since there's a good chance we're going to be appending a */
 		/* udta atom, write the actual size instead of copying the 0 size */
-		lswap(&atomSize);
-		fwrite(&atomSize, 1, 4, fpout);
+		uitsWriteBE32(sizeBytes, atomSize);
+		fwrite(sizeBytes, 1, 4, fpout);
 		fseeko(fpin, 4, SEEK_CUR);		/* seek past the old size */
 		uitsAudioBufferedCopy(fpin, fpout, (atomSize - 4));
 	} else {
@@ -602,10 +556,11 @@ int mp4EmbedPayload_UITS1  (char *audioFileName,
 	unsigned long   payloadXMLSize;
 	unsigned long	bytesLeftInFile, bytesCopied;
 	
-	MP4_ATOM_HEADER *moovAtomHeader = NULL;
-	MP4_ATOM_HEADER *udtaAtomHeader = NULL;
+	UITS_CONTAINER_ENTRY *moovAtomHeader = NULL;
+	UITS_CONTAINER_ENTRY *udtaAtomHeader = NULL;
 	unsigned long	endSeek;
 	unsigned long	atomSize;
+	unsigned char	sizeBytes[4];
 	
 	
 	vprintf("About to embed payload for %s into %s\n", audioFileName, audioFileNameOut);
@@ -617,62 +572,53 @@ int mp4EmbedPayload_UITS1  (char *audioFileName,
 	payloadXMLSize = strlen(uitsPayloadXML);
 	
 	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4EmbedPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioOutFP = fopen(audioFileNameOut, "w+b");
+	audioOutFP = uitsIOOpen(audioFileNameOut, "w+b");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4EmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
 	
 	/* calculate how long the input audio file is by seeking to EOF and saving size  */
 	audioInFileSize = uitsGetFileSize(audioInFP);
 	
 	/* find the 'moov' atom header */	
-	moovAtomHeader = mp4FindAtomHeader(audioInFP, "moov", audioInFileSize);
+	moovAtomHeader = mp4FindAtomHeader(audioInFP, NULL, "moov");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4EmbedPayload", moovAtomHeader, ERR_MP4, "Coudln't find 'moov' atom header\n");
 	
-	/* seek past the moov atom header */
-	fseeko(audioInFP, moovAtomHeader->saveSeek, SEEK_SET);
-	fseeko(audioInFP, 8, SEEK_CUR);
-	
-	atomSize = moovAtomHeader->size - 8;
-	
 	/* find the 'udta' atom header that is a child the 'moov' atom container */
-	udtaAtomHeader = mp4FindAtomHeader(audioInFP, "udta", atomSize);
+	udtaAtomHeader = mp4FindAtomHeader(audioInFP, moovAtomHeader, "udta");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4EmbedPayload", udtaAtomHeader, ERR_MP4, "Coudln't find 'udta' atom header\n");
 	
 	/* now do the data copy and modification */
 	rewind(audioInFP);
 	
 	/* copy from beginning of file to beginning of 'moov' atom */
-	uitsAudioBufferedCopy(audioInFP, audioOutFP, moovAtomHeader->saveSeek);
+	uitsAudioBufferedCopy(audioInFP, audioOutFP, moovAtomHeader->offset);
 	
-	atomSize = moovAtomHeader->size + payloadXMLSize + 8;
-	lswap(&atomSize);
+	uitsWriteBE32(sizeBytes, moovAtomHeader->headerSize + moovAtomHeader->size + payloadXMLSize + 8);
 	
 	/* write the moov atom header */
-	fwrite(&atomSize, 1, 4, audioOutFP);   /* 4-bytes size */
+	fwrite(sizeBytes, 1, 4, audioOutFP);   /* 4-bytes size */
 	fwrite("moov",    1, 4, audioOutFP);   /* 4-bytes ID */
 	
 	/* seek past the moov atom header */
-	fseeko(audioInFP, moovAtomHeader->saveSeek, SEEK_SET);
+	fseeko(audioInFP, moovAtomHeader->offset, SEEK_SET);
 	fseeko(audioInFP, 8, SEEK_CUR);
 	
 	/* write the moov atom until the start of the 'udta' atom */
-	atomSize = udtaAtomHeader->saveSeek - ftello(audioInFP);
+	atomSize = udtaAtomHeader->offset - ftello(audioInFP);
 	uitsAudioBufferedCopy(audioInFP, audioOutFP, atomSize);
 	
 	/* write the udta atom header */
-	atomSize = udtaAtomHeader->size + payloadXMLSize + 8;
-	lswap(&atomSize);
+	uitsWriteBE32(sizeBytes, udtaAtomHeader->headerSize + udtaAtomHeader->size + payloadXMLSize + 8);
 	
-	fwrite(&atomSize, 1, 4, audioOutFP);   /* 4-bytes size */
+	fwrite(sizeBytes, 1, 4, audioOutFP);   /* 4-bytes size */
 	fwrite("udta",    1, 4, audioOutFP);   /* 4-bytes ID */
 	fseeko(audioInFP, 8, SEEK_CUR);
 	
 	/* write the UITS atom */
-	atomSize = payloadXMLSize + 8;
-	lswap(&atomSize);
-	fwrite(&atomSize, 1, 4, audioOutFP);					/* 4-bytes size */
+	uitsWriteBE32(sizeBytes, payloadXMLSize + 8);
+	fwrite(sizeBytes, 1, 4, audioOutFP);					/* 4-bytes size */
 	fwrite("UITS",    1, 4, audioOutFP);					/* 4-bytes ID */
 	fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP);	/* UITS payload */
 	
@@ -691,6 +637,7 @@ int mp4EmbedPayload_UITS1  (char *audioFileName,
 	/* cleanup */
 	fclose(audioInFP);
 	fclose(audioOutFP);
+	uitsContainerIndexInvalidate();
 	
 	return(OK);
 }
@@ -706,39 +653,40 @@ char *mp4ExtractPayload_UITS1 (char *audioFileName)
 	};
 	
 	FILE			*audioInFP;
-	unsigned long	audioInFileSize;
 	char			*payloadXML;
 	unsigned long	atomSize;
 	MP4_NESTED_ATOM *foundNestedAtoms = NULL;
+	UITS_CONTAINER_ENTRY *parentAtom = NULL;
 	
 	/* open the audio input file */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(mp4ModuleName, "mp4ExtractPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioInFileSize = uitsGetFileSize(audioInFP);
-	
-	/* populate the nested atom pointers */
-	foundNestedAtoms = mp4FindAtomHeaderNested(audioInFP, nestedAtoms);
-	
-	/* find the chunk offset table within the nested atoms */
-	while (	strcmp(foundNestedAtoms->atomType, "UITS") != 0) {
-		foundNestedAtoms++;
+	/* populate the nested atom pointers, a file without a UITS 1.0 payload won't have all of them */
+	for (foundNestedAtoms = nestedAtoms; *foundNestedAtoms->atomType; foundNestedAtoms++) {
+		foundNestedAtoms->atomEntry = mp4FindAtomHeader(audioInFP, parentAtom, (char *) foundNestedAtoms->atomType);
+		if (!foundNestedAtoms->atomEntry) {
+			fclose(audioInFP);
+			return (NULL);
+		}
+		parentAtom = foundNestedAtoms->atomEntry;
 	}
 	
-	/* seek past the udta atom header */
-	fseeko(audioInFP, foundNestedAtoms->atomHeader->saveSeek, SEEK_SET);
-	fseeko(audioInFP, 8, SEEK_CUR);
+	/* the UITS atom is the last of the nested atoms */
+	foundNestedAtoms--;
 	
-	atomSize = foundNestedAtoms->atomHeader->size - 8;
+	/* seek past the UITS atom header */
+	fseeko(audioInFP, foundNestedAtoms->atomEntry->offset + foundNestedAtoms->atomEntry->headerSize, SEEK_SET);
 	
-	/* this is a cheat. calloc 8 bytes more than we're going to read so that the payload XML */
-	/* will be null-terminated when it's read from the file */
-	payloadXML = calloc(foundNestedAtoms->atomHeader->size, 1);	
-	atomSize = foundNestedAtoms->atomHeader->size - 8;
+	/* alloc space with an extra null-terminator byte */
+	atomSize = foundNestedAtoms->atomEntry->size;
+	payloadXML = calloc(atomSize + 1, 1);
 	
 	err = fread(payloadXML, 1L, atomSize, audioInFP);
 	uitsHandleErrorINT(mp4ModuleName, "mp4ExtractPayload", err, atomSize, ERR_MP4, "Couldn't read UITS atom data\n");
 	
+	fclose(audioInFP);
+	
 	return (payloadXML);
 	
 }
@@ -746,4 +694,34 @@ char *mp4ExtractPayload_UITS1 (char *audioFileName)
 
 
 
+/*
+ *
+ * Function: mp4GetEmbedPlan
+ * Purpose:	 Plan the payload embedding for an MP4 file. The uuid atom is appended and
+ *			 nothing in the source changes.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int mp4GetEmbedPlan (char *audioFileName, UITS_EMBED_PLAN *plan)
+{
+	uuid_t uuid;
+	
+	(void) audioFileName;	/* the uuid atom is appended, the file isn't read */
+	
+	err = uuid_parse(uitsUUIDString, uuid);
+	uitsHandleErrorINT(mp4ModuleName, "mp4GetEmbedPlan", err, 0, ERR_MP4, "Couldn't convert uuid to hex\n");
+	
+	/* size, 'uuid', uuid, payload */
+	plan->trailerFlag	= TRUE;
+	plan->trailerLength	= 8 + UUID_SIZE;
+	memcpy(&plan->trailer[4], "uuid", 4);
+	memcpy(&plan->trailer[8], uuid, UUID_SIZE);
+	plan->trailerPatch.offset	  = 0;
+	plan->trailerPatch.fieldType  = PLAN_FIELD_BE32;
+	plan->trailerPatch.sizeAdjust = 8 + UUID_SIZE;
+	
+	return (OK);
+}
+
 // EOF
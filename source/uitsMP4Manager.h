@@ -33,15 +33,18 @@
 
 #define MP4_HEADER_SIZE 8
 
+#define MP4_EXTENDED_HEADER_SIZE 16	/* size of 1 is followed by a 64-bit size */
+
 typedef struct {
-	unsigned long size;		
+	unsigned long long size;			/* atom size, including the header */
 	unsigned char type[5];			/* 4-character type, null-terminated */
-	unsigned long saveSeek;	/* saved seek location for the header start */
+	off_t		  saveSeek;			/* saved seek location for the header start */
+	int			  headerSize;		/* 8, or 16 for an extended (64-bit) size atom */
 } MP4_ATOM_HEADER;
 
 typedef struct {
 	unsigned char atomType[5];	
-	MP4_ATOM_HEADER *atomHeader;
+	UITS_CONTAINER_ENTRY *atomEntry;
 } MP4_NESTED_ATOM;
 
 #define MAX_MP4_SUBTYPES 20
@@ -67,15 +70,18 @@ char *mp4ExtractPayload_UITS1 (char *audioFileName);
 
 char *mp4GetMediaHash		(char *audioFileName);
 
+int mp4GetEmbedPlan			(char *audioFileName, 
+							 UITS_EMBED_PLAN *plan);
+
 int mp4UpdateChunkOffsetTable(FILE *audioOutFP, int uitsAtomSize);
 
-MP4_ATOM_HEADER *mp4FindAtomHeaderNested (FILE *fpin, MP4_NESTED_ATOM *nestedAtoms);
+MP4_NESTED_ATOM *mp4FindAtomHeaderNested (FILE *fpin, MP4_NESTED_ATOM *nestedAtoms);
 
 /*
  * PRIVATE Functions
  */
 
-MP4_ATOM_HEADER *mp4FindAtomHeader (FILE *fpin,  char *atomType, unsigned long endSeek);
+UITS_CONTAINER_ENTRY *mp4FindAtomHeader (FILE *fpin, UITS_CONTAINER_ENTRY *parentAtom, char *atomType);
 MP4_ATOM_HEADER *mp4ReadAtomHeader  (FILE *fpin);
 int   mp4CopyAtom			(FILE *fpin, FILE *fpout);
 #endif
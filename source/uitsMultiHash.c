@@ -0,0 +1,615 @@
+/*
+ *  uitsMultiHash.c
+ *  UITS_Tool
+ *
+ *  Multi-buffer SHA256 for hashing many audio files in one run. The part of each
+ *  file that is hashed is found by the format's media hash callback, with
+ *  uitsCreateMediaDigest recording the region instead of hashing it (see
+ *  uitsMultiHashCaptureRegion). The regions are then hashed MULTI_HASH_LANES at a
+ *  time: each lane reads its own file, and one block from every lane is run through
+ *  the SHA256 compression function together. With AVX-512, the sixteen lanes are
+ *  the sixteen 32-bit elements of the vector registers; with AVX2 they are run as
+ *  two groups of eight. When a lane's file is done, the next file is started in
+ *  that lane.
+ *
+ *  One SHA256 stream can't use the vector unit, and OpenSSL already uses the SHA
+ *  extensions where the CPU has them. Those are faster than the lanes, so on those
+ *  CPUs (and CPUs without AVX2) each file is hashed by OpenSSL instead.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+#ifdef UITS_X86_SIMD
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+char *multiHashModuleName = "uitsMultiHash.c";
+
+int				multiHashMode = MULTI_HASH_AUTO;
+int				multiHashCaptureFlag = FALSE;	/* TRUE while regions are being captured */
+int				multiHashCapturedFlag;			/* TRUE if the last media hash callback captured a region */
+off_t			multiHashCaptureOffset;
+off_t			multiHashCaptureLength;
+
+const uint32_t sha256K [64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t sha256InitialState [8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/*
+ *
+ * Function: uitsMultiHashFiles
+ * Purpose:	 Calculate the media hash of each file in a list
+ * Returns:  List of hex media hashes, in the same order as the files, or exit on error
+ *
+ */
+
+char **uitsMultiHashFiles (char **audioFileNames, int numFiles)
+{
+	UITS_AUDIO_CALLBACKS *currAudioCB;
+	UITS_HASH_REGION	 *regions;
+	UITS_digest			 digest;
+	int					 *regionIndex;
+	char				 **mediaHashValues;
+	char				 *mediaHashValue;
+	int					 numRegions = 0;
+	int					 i;
+
+	mediaHashValues = calloc(numFiles + 1, sizeof(char *));
+	regions			= calloc(numFiles + 1, sizeof(UITS_HASH_REGION));
+	regionIndex		= calloc(numFiles + 1, sizeof(int));
+	if (!mediaHashValues || !regions || !regionIndex) {
+		uitsHandleErrorPTR(multiHashModuleName, "uitsMultiHashFiles", NULL, ERR_HASH, "Couldn't allocate media hash list\n");
+	}
+
+	if (!uitsMultiHashUseLanes()) {
+		for (i = 0; i < numFiles; i++) {
+			mediaHashValues[i] = uitsAudioGetMediaHash(audioFileNames[i]);
+		}
+		free(regions);
+		free(regionIndex);
+		return (mediaHashValues);
+	}
+
+	/* find the region to hash in each file. standard input, which can't be opened again by a
+	   lane, and formats that hash from memory (HTML) are hashed right away */
+	for (i = 0; i < numFiles; i++) {
+		if (strcmp(audioFileNames[i], "-") == 0) {
+			mediaHashValues[i] = uitsAudioGetMediaHash(audioFileNames[i]);
+			regionIndex[i] = -1;
+			continue;
+		}
+
+		currAudioCB = uitsAudioGetCB(audioFileNames[i]);
+
+		multiHashCaptureFlag  = TRUE;
+		multiHashCapturedFlag = FALSE;
+		mediaHashValue = currAudioCB->uitsAudioGetMediaHash(audioFileNames[i]);
+		multiHashCaptureFlag  = FALSE;
+
+		if (!multiHashCapturedFlag) {
+			mediaHashValues[i] = mediaHashValue;
+			regionIndex[i] = -1;
+			continue;
+		}
+
+		free(mediaHashValue);
+		regions[numRegions].audioFileName = audioFileNames[i];
+		regions[numRegions].offset		  = multiHashCaptureOffset;
+		regions[numRegions].length		  = multiHashCaptureLength;
+		regionIndex[i] = numRegions++;
+	}
+
+	uitsMultiHashRegions(regions, numRegions);
+
+	digest.length = SHA256_DIGEST_SIZE;
+	for (i = 0; i < numFiles; i++) {
+		if (regionIndex[i] >= 0) {
+			digest.value = regions[regionIndex[i]].digest;
+			mediaHashValues[i] = uitsDigestToString(&digest);
+		}
+	}
+
+	free(regions);
+	free(regionIndex);
+
+	return (mediaHashValues);
+}
+
+/*
+ *
+ * Function: uitsMultiHashSetMode
+ * Purpose:	 Choose between the lanes and OpenSSL for uitsMultiHashFiles
+ *
+ */
+
+void uitsMultiHashSetMode (int mode)
+{
+	multiHashMode = mode;
+}
+
+/*
+ *
+ * Function: uitsMultiHashIsCapturing
+ * Purpose:	 Check if uitsCreateMediaDigest should record the region instead of hashing it
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsMultiHashIsCapturing (void)
+{
+	return (multiHashCaptureFlag);
+}
+
+/*
+ *
+ * Function: uitsMultiHashCaptureRegion
+ * Purpose:	 Record the region a media hash callback would hash. The file pointer is at
+ *			 the start of the region.
+ * Returns:  A placeholder digest (all zeros), which the callback converts to a string
+ *
+ */
+
+UITS_digest *uitsMultiHashCaptureRegion (FILE *audioFP, off_t audioLength)
+{
+	UITS_digest *digest;
+
+	multiHashCaptureOffset = ftello(audioFP);
+	multiHashCaptureLength = audioLength;
+	multiHashCapturedFlag  = TRUE;
+
+	digest = calloc(1, sizeof(UITS_digest));
+	uitsHandleErrorPTR(multiHashModuleName, "uitsMultiHashCaptureRegion", digest, ERR_HASH, "Couldn't allocate digest\n");
+
+	digest->length = SHA256_DIGEST_SIZE;
+	digest->value  = calloc(SHA256_DIGEST_SIZE, 1);
+
+	return (digest);
+}
+
+/*
+ *
+ * Function: uitsMultiHashUseLanes
+ * Purpose:	 Decide whether the lanes are faster than OpenSSL on this CPU
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsMultiHashUseLanes (void)
+{
+#ifdef UITS_X86_SIMD
+	unsigned int eax, ebx, ecx, edx;
+	int			 shaFlag = FALSE;
+#endif
+
+	if (multiHashMode != MULTI_HASH_AUTO) {
+		return (multiHashMode == MULTI_HASH_LANES_ONLY);
+	}
+
+	/* the other digests are created by OpenSSL in the same pass as the media hash */
+	if (uitsGetMediaDigestNames()) {
+		return (FALSE);
+	}
+
+#ifdef UITS_X86_SIMD
+	if (__get_cpuid_max(0, NULL) >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		shaFlag = (ebx >> 29) & 1;
+	}
+	return (!shaFlag && __builtin_cpu_supports("avx2"));
+#else
+	return (FALSE);
+#endif
+}
+
+/*
+ *
+ * Function: uitsMultiHashRegions
+ * Purpose:	 Hash a list of file regions, MULTI_HASH_LANES at a time
+ *
+ */
+
+void uitsMultiHashRegions (UITS_HASH_REGION *regions, int numRegions)
+{
+	UITS_HASH_LANE		lanes[MULTI_HASH_LANES];
+	uint32_t			state[MULTI_HASH_LANES][8];
+	const unsigned char *blocks[MULTI_HASH_LANES];
+	unsigned char		idleBlock[SHA256_BLOCK_SIZE];
+	int					activeLanes[MULTI_HASH_LANES];
+	int					nextRegion = 0;
+	int					numActive;
+	int					i;
+
+	memset(idleBlock, 0, SHA256_BLOCK_SIZE);
+
+	for (i = 0; i < MULTI_HASH_LANES; i++) {
+		lanes[i].buffer = malloc(MULTI_HASH_BUFFER_SIZE);
+		uitsHandleErrorPTR(multiHashModuleName, "uitsMultiHashRegions", lanes[i].buffer, ERR_HASH, "Couldn't allocate hash buffer\n");
+		lanes[i].regionIndex = -1;
+		if (nextRegion < numRegions) {
+			uitsMultiHashStartLane(&lanes[i], state[i], regions, nextRegion++);
+		}
+	}
+
+	while (1) {
+		numActive = 0;
+
+		/* get a block for every lane. a lane whose file is done starts the next file */
+		for (i = 0; i < MULTI_HASH_LANES; i++) {
+			while (lanes[i].regionIndex >= 0 && !uitsMultiHashFillLane(&lanes[i], regions)) {
+				uitsMultiHashFinishLane(&lanes[i], state[i], regions);
+				if (nextRegion < numRegions) {
+					uitsMultiHashStartLane(&lanes[i], state[i], regions, nextRegion++);
+				}
+			}
+
+			activeLanes[i] = (lanes[i].regionIndex >= 0);
+			if (activeLanes[i]) {
+				blocks[i] = lanes[i].buffer + lanes[i].bufferPos;
+				lanes[i].bufferPos += SHA256_BLOCK_SIZE;
+				lanes[i].messageLength += SHA256_BLOCK_SIZE;
+				numActive++;
+			} else {
+				blocks[i] = idleBlock;
+			}
+		}
+
+		if (!numActive) {
+			break;
+		}
+
+		uitsSHA256CompressLanes(state, blocks, activeLanes);
+	}
+
+	for (i = 0; i < MULTI_HASH_LANES; i++) {
+		free(lanes[i].buffer);
+	}
+}
+
+/*
+ *
+ * Function: uitsMultiHashStartLane
+ * Purpose:	 Open a region and start hashing it in a lane
+ *
+ */
+
+void uitsMultiHashStartLane (UITS_HASH_LANE *lane, uint32_t *state, UITS_HASH_REGION *regions, int regionIndex)
+{
+	UITS_HASH_REGION *region = &regions[regionIndex];
+
+	lane->audioFP = uitsIOOpen(region->audioFileName, "rb");
+	uitsHandleErrorPTR(multiHashModuleName, "uitsMultiHashStartLane", lane->audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
+
+	fseeko(lane->audioFP, region->offset, SEEK_SET);
+
+	lane->regionIndex	= regionIndex;
+	lane->bytesLeft		= region->length;
+	lane->messageLength = 0;
+	lane->bufferLength	= 0;
+	lane->bufferPos		= 0;
+
+	memcpy(state, sha256InitialState, sizeof(sha256InitialState));
+}
+
+/*
+ *
+ * Function: uitsMultiHashFillLane
+ * Purpose:	 Make sure a lane has a whole block to hash, reading more of its file if needed
+ * Returns:  TRUE if there is a block, FALSE if the rest of the region is less than a block
+ *
+ */
+
+int uitsMultiHashFillLane (UITS_HASH_LANE *lane, UITS_HASH_REGION *regions)
+{
+	size_t bytesHeld = lane->bufferLength - lane->bufferPos;
+	size_t bytesToRead;
+
+	if (bytesHeld >= SHA256_BLOCK_SIZE) {
+		return (TRUE);
+	}
+	if (!lane->bytesLeft) {
+		return (FALSE);
+	}
+
+	memmove(lane->buffer, lane->buffer + lane->bufferPos, bytesHeld);
+	lane->bufferPos	   = 0;
+	lane->bufferLength = bytesHeld;
+
+	bytesToRead = MULTI_HASH_BUFFER_SIZE - bytesHeld;
+	if ((off_t) bytesToRead > lane->bytesLeft) {
+		bytesToRead = lane->bytesLeft;
+	}
+
+	if (fread(lane->buffer + bytesHeld, 1, bytesToRead, lane->audioFP) != bytesToRead) {
+		snprintf(errStr, ERRSTR_LEN, "Error: Couldn't read audio data from %s\n", regions[lane->regionIndex].audioFileName);
+		uitsHandleErrorINT(multiHashModuleName, "uitsMultiHashFillLane", ERROR, OK, ERR_FILE, errStr);
+	}
+
+	lane->bufferLength += bytesToRead;
+	lane->bytesLeft	   -= bytesToRead;
+
+	return (lane->bufferLength >= SHA256_BLOCK_SIZE);
+}
+
+/*
+ *
+ * Function: uitsMultiHashFinishLane
+ * Purpose:	 Hash the last partial block and the padding of a lane's region and save the digest
+ *
+ */
+
+void uitsMultiHashFinishLane (UITS_HASH_LANE *lane, uint32_t *state, UITS_HASH_REGION *regions)
+{
+	unsigned char tail[2 * SHA256_BLOCK_SIZE];
+	size_t		  bytesHeld = lane->bufferLength - lane->bufferPos;
+	size_t		  tailLength;
+	int			  i;
+
+	lane->messageLength += bytesHeld;
+
+	/* the message, 0x80, zeros, and the message length in bits */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, lane->buffer + lane->bufferPos, bytesHeld);
+	tail[bytesHeld] = 0x80;
+	tailLength = (bytesHeld < SHA256_BLOCK_SIZE - 8) ? SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+	uitsWriteBE64(&tail[tailLength - 8], lane->messageLength * 8);
+
+	uitsSHA256Compress(state, tail);
+	if (tailLength > SHA256_BLOCK_SIZE) {
+		uitsSHA256Compress(state, &tail[SHA256_BLOCK_SIZE]);
+	}
+
+	for (i = 0; i < 8; i++) {
+		uitsWriteBE32(&regions[lane->regionIndex].digest[i * 4], state[i]);
+	}
+
+	fclose(lane->audioFP);
+	lane->audioFP	  = NULL;
+	lane->regionIndex = -1;
+}
+
+/*
+ *
+ * Function: uitsSHA256CompressLanes
+ * Purpose:	 Run one block of each active lane through the SHA256 compression function
+ *
+ */
+
+void uitsSHA256CompressLanes (uint32_t state[][8], const unsigned char **blocks, int *activeLanes)
+{
+	uint32_t idleState[8];
+	int		 i;
+
+#ifdef UITS_X86_SIMD
+	if (__builtin_cpu_supports("avx2")) {
+		/* idle lanes hash a block of zeros into a state that is thrown away */
+		for (i = 0; i < MULTI_HASH_LANES; i++) {
+			if (!activeLanes[i]) {
+				memcpy(state[i], sha256InitialState, sizeof(idleState));
+			}
+		}
+		if (__builtin_cpu_supports("avx512f")) {
+			uitsSHA256CompressAVX512(state, blocks);
+		} else {
+			uitsSHA256CompressAVX2(state, blocks);
+			uitsSHA256CompressAVX2(&state[8], &blocks[8]);
+		}
+		return;
+	}
+#endif
+
+	for (i = 0; i < MULTI_HASH_LANES; i++) {
+		if (activeLanes[i]) {
+			uitsSHA256Compress(state[i], blocks[i]);
+		}
+	}
+}
+
+/*
+ * SHA256 functions (FIPS 180-4)
+ */
+
+#define SHA256_ROTR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_S0(x)		(SHA256_ROTR(x, 2)  ^ SHA256_ROTR(x, 13) ^ SHA256_ROTR(x, 22))
+#define SHA256_S1(x)		(SHA256_ROTR(x, 6)  ^ SHA256_ROTR(x, 11) ^ SHA256_ROTR(x, 25))
+#define SHA256_s0(x)		(SHA256_ROTR(x, 7)  ^ SHA256_ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x)		(SHA256_ROTR(x, 17) ^ SHA256_ROTR(x, 19) ^ ((x) >> 10))
+
+/*
+ *
+ * Function: uitsSHA256Compress
+ * Purpose:	 Run one block through the SHA256 compression function
+ *
+ */
+
+void uitsSHA256Compress (uint32_t *state, const unsigned char *block)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int		 t;
+
+	for (t = 0; t < 16; t++) {
+		w[t] = uitsReadBE32(&block[t * 4]);
+	}
+	for (t = 16; t < 64; t++) {
+		w[t] = SHA256_s1(w[t - 2]) + w[t - 7] + SHA256_s0(w[t - 15]) + w[t - 16];
+	}
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+	for (t = 0; t < 64; t++) {
+		t1 = h + SHA256_S1(e) + ((e & f) ^ (~e & g)) + sha256K[t] + w[t];
+		t2 = SHA256_S0(a) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#ifdef UITS_X86_SIMD
+
+/*
+ * The same functions on eight 32-bit lanes
+ */
+
+#define SHA256_ROTR8(x, n)	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SHA256_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define SHA256_S0_8(x)		SHA256_XOR3(SHA256_ROTR8(x, 2),  SHA256_ROTR8(x, 13), SHA256_ROTR8(x, 22))
+#define SHA256_S1_8(x)		SHA256_XOR3(SHA256_ROTR8(x, 6),  SHA256_ROTR8(x, 11), SHA256_ROTR8(x, 25))
+#define SHA256_s0_8(x)		SHA256_XOR3(SHA256_ROTR8(x, 7),  SHA256_ROTR8(x, 18), _mm256_srli_epi32(x, 3))
+#define SHA256_s1_8(x)		SHA256_XOR3(SHA256_ROTR8(x, 17), SHA256_ROTR8(x, 19), _mm256_srli_epi32(x, 10))
+#define SHA256_ADD3(x, y, z) _mm256_add_epi32(_mm256_add_epi32(x, y), z)
+
+/*
+ *
+ * Function: uitsSHA256CompressAVX2
+ * Purpose:	 Run one block from each of eight lanes through the SHA256 compression function,
+ *			 with lane i in element i of each vector
+ *
+ */
+
+__attribute__((target("avx2")))
+void uitsSHA256CompressAVX2 (uint32_t state[][8], const unsigned char **blocks)
+{
+	__m256i	 w[64];
+	__m256i	 s[8];
+	__m256i	 a, b, c, d, e, f, g, h, t1, t2;
+	uint32_t lanes[8];
+	int		 t, i;
+
+	for (t = 0; t < 16; t++) {
+		for (i = 0; i < 8; i++) {
+			lanes[i] = uitsReadBE32(&blocks[i][t * 4]);
+		}
+		w[t] = _mm256_loadu_si256((__m256i *) lanes);
+	}
+	for (t = 16; t < 64; t++) {
+		w[t] = _mm256_add_epi32(SHA256_ADD3(SHA256_s1_8(w[t - 2]), w[t - 7], SHA256_s0_8(w[t - 15])), w[t - 16]);
+	}
+
+	for (t = 0; t < 8; t++) {
+		for (i = 0; i < 8; i++) {
+			lanes[i] = state[i][t];
+		}
+		s[t] = _mm256_loadu_si256((__m256i *) lanes);
+	}
+
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+	for (t = 0; t < 64; t++) {
+		t1 = SHA256_ADD3(h, SHA256_S1_8(e), _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)));
+		t1 = SHA256_ADD3(t1, _mm256_set1_epi32((int) sha256K[t]), w[t]);
+		t2 = _mm256_add_epi32(SHA256_S0_8(a),
+							  SHA256_XOR3(_mm256_and_si256(a, b), _mm256_and_si256(a, c), _mm256_and_si256(b, c)));
+		h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+		d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+	}
+
+	s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+	s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+	s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+	s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+
+	for (t = 0; t < 8; t++) {
+		_mm256_storeu_si256((__m256i *) lanes, s[t]);
+		for (i = 0; i < 8; i++) {
+			state[i][t] = lanes[i];
+		}
+	}
+}
+
+
+/*
+ * The same functions on sixteen 32-bit lanes. The AVX-512 ternary logic instruction
+ * does the three-input xor (0x96), choose (0xca) and majority (0xe8) in one step.
+ */
+
+#define SHA256_XOR3_16(x, y, z)	_mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define SHA256_S0_16(x)		SHA256_XOR3_16(_mm512_ror_epi32(x, 2),  _mm512_ror_epi32(x, 13), _mm512_ror_epi32(x, 22))
+#define SHA256_S1_16(x)		SHA256_XOR3_16(_mm512_ror_epi32(x, 6),  _mm512_ror_epi32(x, 11), _mm512_ror_epi32(x, 25))
+#define SHA256_s0_16(x)		SHA256_XOR3_16(_mm512_ror_epi32(x, 7),  _mm512_ror_epi32(x, 18), _mm512_srli_epi32(x, 3))
+#define SHA256_s1_16(x)		SHA256_XOR3_16(_mm512_ror_epi32(x, 17), _mm512_ror_epi32(x, 19), _mm512_srli_epi32(x, 10))
+#define SHA256_ADD3_16(x, y, z)	_mm512_add_epi32(_mm512_add_epi32(x, y), z)
+
+/*
+ *
+ * Function: uitsSHA256CompressAVX512
+ * Purpose:	 Run one block from each of sixteen lanes through the SHA256 compression
+ *			 function, with lane i in element i of each vector
+ *
+ */
+
+__attribute__((target("avx512f")))
+void uitsSHA256CompressAVX512 (uint32_t state[][8], const unsigned char **blocks)
+{
+	__m512i	 w[64];
+	__m512i	 s[8];
+	__m512i	 a, b, c, d, e, f, g, h, t1, t2;
+	uint32_t lanes[16];
+	int		 t, i;
+
+	for (t = 0; t < 16; t++) {
+		for (i = 0; i < 16; i++) {
+			lanes[i] = uitsReadBE32(&blocks[i][t * 4]);
+		}
+		w[t] = _mm512_loadu_si512(lanes);
+	}
+	for (t = 16; t < 64; t++) {
+		w[t] = _mm512_add_epi32(SHA256_ADD3_16(SHA256_s1_16(w[t - 2]), w[t - 7], SHA256_s0_16(w[t - 15])), w[t - 16]);
+	}
+
+	for (t = 0; t < 8; t++) {
+		for (i = 0; i < 16; i++) {
+			lanes[i] = state[i][t];
+		}
+		s[t] = _mm512_loadu_si512(lanes);
+	}
+
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+	for (t = 0; t < 64; t++) {
+		t1 = SHA256_ADD3_16(h, SHA256_S1_16(e), _mm512_ternarylogic_epi32(e, f, g, 0xca));
+		t1 = SHA256_ADD3_16(t1, _mm512_set1_epi32((int) sha256K[t]), w[t]);
+		t2 = _mm512_add_epi32(SHA256_S0_16(a), _mm512_ternarylogic_epi32(a, b, c, 0xe8));
+		h = g; g = f; f = e; e = _mm512_add_epi32(d, t1);
+		d = c; c = b; b = a; a = _mm512_add_epi32(t1, t2);
+	}
+
+	s[0] = _mm512_add_epi32(s[0], a); s[1] = _mm512_add_epi32(s[1], b);
+	s[2] = _mm512_add_epi32(s[2], c); s[3] = _mm512_add_epi32(s[3], d);
+	s[4] = _mm512_add_epi32(s[4], e); s[5] = _mm512_add_epi32(s[5], f);
+	s[6] = _mm512_add_epi32(s[6], g); s[7] = _mm512_add_epi32(s[7], h);
+
+	for (t = 0; t < 8; t++) {
+		_mm512_storeu_si512(lanes, s[t]);
+		for (i = 0; i < 16; i++) {
+			state[i][t] = lanes[i];
+		}
+	}
+}
+
+#endif
+
+// EOF
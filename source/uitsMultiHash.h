@@ -0,0 +1,87 @@
+/*
+ *  uitsMultiHash.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsmultihash_h_
+#  define _uitsmultihash_h_
+
+#define MULTI_HASH_LANES		16			/* streams hashed together */
+#define MULTI_HASH_BUFFER_SIZE	65536		/* read buffer for each lane */
+#define SHA256_BLOCK_SIZE		64
+#define SHA256_DIGEST_SIZE		32
+
+/*
+ * How a batch of media hashes is calculated
+ */
+enum uitsMultiHashModes {
+	MULTI_HASH_AUTO,		/* lanes if the CPU has AVX2 but not the SHA extensions, otherwise OpenSSL */
+	MULTI_HASH_LANES_ONLY,	/* always use the lanes */
+	MULTI_HASH_OPENSSL		/* one file at a time through OpenSSL */
+};
+
+/*
+ * The part of one file that is hashed, found by the format's media hash callback
+ */
+
+typedef struct {
+	char			*audioFileName;
+	off_t			offset;
+	off_t			length;
+	unsigned char	digest[SHA256_DIGEST_SIZE];
+} UITS_HASH_REGION;
+
+/*
+ * One SHA256 stream in the multi-buffer engine
+ */
+
+typedef struct {
+	int					regionIndex;		/* -1 if the lane is idle */
+	FILE				*audioFP;
+	off_t				bytesLeft;			/* bytes of the region not read yet */
+	unsigned long long	messageLength;
+	unsigned char		*buffer;
+	size_t				bufferLength;
+	size_t				bufferPos;
+} UITS_HASH_LANE;
+
+/*
+ * PUBLIC Functions
+ */
+
+char		**uitsMultiHashFiles			(char **audioFileNames, int numFiles);
+void		uitsMultiHashSetMode			(int mode);
+UITS_digest	*uitsMultiHashCaptureRegion		(FILE *audioFP, off_t audioLength);
+int			uitsMultiHashIsCapturing		(void);
+
+/*
+ * PRIVATE Functions
+ */
+
+int		uitsMultiHashUseLanes			(void);
+void	uitsMultiHashRegions			(UITS_HASH_REGION *regions, int numRegions);
+int		uitsMultiHashFillLane			(UITS_HASH_LANE *lane, UITS_HASH_REGION *regions);
+void	uitsMultiHashStartLane			(UITS_HASH_LANE *lane, uint32_t *state, UITS_HASH_REGION *regions, int regionIndex);
+void	uitsMultiHashFinishLane			(UITS_HASH_LANE *lane, uint32_t *state, UITS_HASH_REGION *regions);
+void	uitsSHA256Compress				(uint32_t *state, const unsigned char *block);
+void	uitsSHA256CompressLanes			(uint32_t state[][8], const unsigned char **blocks, int *activeLanes);
+
+#ifdef UITS_X86_SIMD
+void	uitsSHA256CompressAVX2			(uint32_t state[][8], const unsigned char **blocks);
+void	uitsSHA256CompressAVX512		(uint32_t state[][8], const unsigned char **blocks);
+#endif
+
+#endif
+
+// EOF
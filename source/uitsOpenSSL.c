@@ -49,6 +49,15 @@
  *		2. very the decrypted signature
  *			openssl dgst -sha224 -verify pubDSA2048.pem -signature DSAsig.bin metadata.xml
  *
+ *	ECDSA-P256 keys are signed and verified like RSA, with SHA256:
+ *			openssl ecparam -name prime256v1 -genkey -noout -out privateECDSAP256.pem
+ *			openssl ec -in privateECDSAP256.pem -pubout -out pubECDSAP256.pem
+ *
+ *	Ed25519 signs the metadata itself, without a separate digest, and needs OpenSSL 1.1.1:
+ *			openssl genpkey -algorithm ed25519 -out privateEd25519.pem
+ *			openssl pkey -in privateEd25519.pem -pubout -out pubEd25519.pem
+ *			openssl pkeyutl -sign -rawin -inkey privateEd25519.pem -in metadata.xml -out sig.bin
+ *
  */	
 
 
@@ -57,6 +66,18 @@
 
 char *openSSLmoduleName = "uitsOpenSSL.c";	// Global variable used for error reporting
 
+char		*mediaDigestNames [MAX_DIGESTS + 1];	// digests created with the media hash, SHA256 first
+UITS_digest	**mediaDigests = NULL;					// digests from the last media hash, in the same order
+
+/* values of the signature algorithm attribute, and the digest signed for each */
+UITS_signature_algorithm signatureAlgorithms [] = {
+	{"RSA2048",		"SHA256"},
+	{"DSA2048",		"SHA224"},
+	{"ECDSA-P256",	"SHA256"},
+	{"Ed25519",		NULL},			/* signs the message itself */
+	{NULL, NULL}
+};
+
 /* 
  * Function: uitsOpenSSLInit
  * Purpose:  Initialize openSSL operations and structures if necessary
@@ -163,60 +184,229 @@ UITS_digest *uitsCreateDigest (unsigned char *message,
  *
  */
 UITS_digest *uitsCreateDigestBuffered (FILE *messageFile,
-									   int   messageLength,
+									   off_t messageLength,
 									   char *digestName) 
 {
-	EVP_MD_CTX	  *mdctx = calloc(sizeof(EVP_MD_CTX), 1);
+	char		*digestNames[2];
+	UITS_digest	**uitsDigests;
+	UITS_digest	*uitsDigest;
+	
+	digestNames[0] = digestName;
+	digestNames[1] = NULL;
+	
+	uitsDigests = uitsCreateDigestsBuffered(messageFile, messageLength, digestNames);
+	uitsDigest	= uitsDigests[0];
+	free(uitsDigests);
+	
+	return (uitsDigest);
+}
+
+/* 
+ * Function: uitsCreateDigestsBuffered
+ * Purpose:  Create several message digests of the same message using buffered I/O.
+ *			 The message is read once and every digest is updated from the same buffer.
+ * Passed:   Message file, message length, NULL-terminated list of digest names
+ * Returns:  NULL-terminated list of digests, in the same order as the names, or exit on error
+ *
+ */
+UITS_digest **uitsCreateDigestsBuffered (FILE *messageFile,
+										 off_t messageLength,
+										 char **digestNames) 
+{
+	EVP_MD_CTX	  *mdctx[MAX_DIGESTS];
 	const EVP_MD  *md;
-	unsigned char *mdValue = calloc((EVP_MAX_MD_SIZE * sizeof(unsigned char)), 1);
 	int			  mdLen;
-	UITS_digest	  *uitsDigest = calloc(sizeof(UITS_digest), 1);
+	UITS_digest	  **uitsDigests;
+	int			  numDigests = 0;
 	
-	int			  messageBufferSize = 1024;
-	int			  messageBytesLeft = messageLength;
+	int			  messageBufferSize = 65536;
+	off_t		  messageBytesLeft = messageLength;
 	int			  bytesRead;
-	unsigned char *messageBuffer = calloc(messageBufferSize, 1);
+	unsigned char *messageBuffer;
+	unsigned char *mapData;
+	off_t		  mapSize;
+	off_t		  mapOffset;
 	int i;
 	
+	while (digestNames[numDigests]) {
+		numDigests++;
+	}
+	if (numDigests > MAX_DIGESTS) {
+		uitsHandleErrorINT(openSSLmoduleName, "uitsCreateDigestsBuffered", ERROR, OK, ERR_SSL,
+						"Error: Too many message digests requested\n");
+	}
 	
-	//	OpenSSL_add_all_digests();	
-	md = EVP_get_digestbyname(digestName);
-	uitsHandleErrorPTR(openSSLmoduleName, "EVP_DigestInit_ex", md, ERR_SSL,
-					"Error: Couldn't initialize message digest\n");
-	
+	uitsDigests = calloc(numDigests + 1, sizeof(UITS_digest *));
+	uitsHandleErrorPTR(openSSLmoduleName, "uitsCreateDigestsBuffered", uitsDigests, ERR_SSL,
+					"Error: Couldn't allocate message digests\n");
 	
-	EVP_MD_CTX_init(mdctx);	
-	err = EVP_DigestInit_ex(mdctx, md, NULL);
-	uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestInit_ex", err, 1, ERR_SSL,NULL);
+	for (i = 0; i < numDigests; i++) {
+		md = EVP_get_digestbyname(digestNames[i]);
+		uitsHandleErrorPTR(openSSLmoduleName, "EVP_DigestInit_ex", md, ERR_SSL,
+						"Error: Couldn't initialize message digest\n");
 		
+		mdctx[i] = calloc(sizeof(EVP_MD_CTX), 1);
+		EVP_MD_CTX_init(mdctx[i]);	
+		err = EVP_DigestInit_ex(mdctx[i], md, NULL);
+		uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestInit_ex", err, 1, ERR_SSL,NULL);
+	}
 	
-	// read and process the data in the file in 1024K chunks for length of message
+	// a memory buffer or mapped file is digested in place, without the copy into messageBuffer
+	mapData = uitsIOMap(messageFile, &mapSize);
+	if (mapData) {
+		mapOffset = ftello(messageFile);
+		if (mapOffset < 0 || messageLength > mapSize - mapOffset) {
+			uitsHandleErrorINT(openSSLmoduleName, "uitsCreateDigestsBuffered", ERROR, OK, ERR_FILE,
+							"Incorrect number of bytes read from message file\n");
+		}
+		for (i = 0; i < numDigests; i++) {
+			err = EVP_DigestUpdate(mdctx[i], mapData + mapOffset, messageLength);
+			uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestUpdate",  err, 1, ERR_SSL, "Error updating digest\n");
+		}
+		fseeko(messageFile, mapOffset + messageLength, SEEK_SET);
+		messageBytesLeft = 0;
+	}
+
+	// read the data in the file in 64K chunks for length of message, and update every digest from each chunk
+	messageBuffer = calloc(messageBufferSize, 1);
 	while (messageBytesLeft) {
 		messageBufferSize = (messageBytesLeft > messageBufferSize) ? messageBufferSize : messageBytesLeft;
 		bytesRead = fread(messageBuffer, 1, messageBufferSize, messageFile);
 		if (bytesRead != messageBufferSize) {
-			uitsHandleErrorINT(openSSLmoduleName, "uitsCreateDigestBuffered", ERROR, OK, ERR_FILE,
+			uitsHandleErrorINT(openSSLmoduleName, "uitsCreateDigestsBuffered", ERROR, OK, ERR_FILE,
 							"Incorrect number of bytes read from message file\n");
 		}
-		err = EVP_DigestUpdate(mdctx, messageBuffer, bytesRead);
-		uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestUpdate",  err, 1, ERR_SSL, "Error updating digest\n");
+		for (i = 0; i < numDigests; i++) {
+			err = EVP_DigestUpdate(mdctx[i], messageBuffer, bytesRead);
+			uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestUpdate",  err, 1, ERR_SSL, "Error updating digest\n");
+		}
 		messageBytesLeft -= messageBufferSize;
 	}
+	free(messageBuffer);
+	
+	for (i = 0; i < numDigests; i++) {
+		uitsDigests[i] = calloc(sizeof(UITS_digest), 1);
+		uitsDigests[i]->value = calloc((EVP_MAX_MD_SIZE * sizeof(unsigned char)), 1);
 		
-	err = EVP_DigestFinal_ex(mdctx, mdValue, &mdLen);
-	uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestFinal_ex",err, 1, ERR_SSL, "Error finalizing digest\n");
+		err = EVP_DigestFinal_ex(mdctx[i], uitsDigests[i]->value, &mdLen);
+		uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestFinal_ex",err, 1, ERR_SSL, "Error finalizing digest\n");
+		
+		EVP_MD_CTX_cleanup(mdctx[i]);
+		free(mdctx[i]);
+		uitsDigests[i]->length = mdLen;
+	}
 	
-	EVP_MD_CTX_cleanup(mdctx);
-	uitsDigest->length = mdLen;
-	uitsDigest->value  = mdValue;
+	return (uitsDigests);
+}
+
+/* 
+ * Function: uitsSetMediaDigestNames
+ * Purpose:  Set the digests that are created along with the SHA256 media hash, from a
+ *			 comma-delimited list of digest names (eg. "SHA1,SHA512")
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsSetMediaDigestNames (char *digestNameList)
+{
+	char *digestName;
+	int	 numDigests = 1;
 	
-//	vprintf("Digest Length is: %d\n", uitsDigest->length);
-//		vprintf("Digest is: ");
-//		for(i = 0; i < uitsDigest->length; i++) printf("%02x", uitsDigest->value[i]);
-//		vprintf("\n");
+	mediaDigestNames[0] = MEDIA_HASH_DIGEST;
 	
+	for (digestName = strtok(strdup(digestNameList), ","); digestName; digestName = strtok(NULL, ",")) {
+		if (!EVP_get_digestbyname(digestName)) {
+			snprintf(errStr, ERRSTR_LEN, "Error: Unknown digest name: %s\n", digestName);
+			uitsHandleErrorINT(openSSLmoduleName, "uitsSetMediaDigestNames", ERROR, OK, ERR_VALUE, errStr);
+		}
+		if (strcasecmp(digestName, MEDIA_HASH_DIGEST) == 0) {	// always created
+			continue;
+		}
+		if (numDigests == MAX_DIGESTS) {
+			uitsHandleErrorINT(openSSLmoduleName, "uitsSetMediaDigestNames", ERROR, OK, ERR_VALUE,
+							   "Error: Too many digest names\n");
+		}
+		mediaDigestNames[numDigests++] = digestName;
+	}
+	mediaDigestNames[numDigests] = NULL;
 	
-	return (uitsDigest);
+	return (OK);
+}
+
+/* 
+ * Function: uitsCreateMediaDigest
+ * Purpose:  Create the SHA256 media hash of the audio data, and in the same pass any other
+ *			 digests set with uitsSetMediaDigestNames. The other digests are kept until the
+ *			 next media hash and can be read with uitsGetMediaDigest.
+ * Returns:  Pointer to the SHA256 digest or exit on error
+ *
+ */
+
+UITS_digest *uitsCreateMediaDigest (FILE *audioFP, off_t audioLength)
+{
+	if (uitsMultiHashIsCapturing()) {
+		return (uitsMultiHashCaptureRegion(audioFP, audioLength));
+	}
+	
+	if (!mediaDigestNames[0]) {
+		return (uitsCreateDigestBuffered(audioFP, audioLength, MEDIA_HASH_DIGEST));
+	}
+	
+	uitsClearMediaDigests();
+	mediaDigests = uitsCreateDigestsBuffered(audioFP, audioLength, mediaDigestNames);
+	
+	return (mediaDigests[0]);
+}
+
+/* 
+ * Function: uitsGetMediaDigestNames
+ * Purpose:  Get the digests that are created with the media hash
+ * Returns:  NULL-terminated list of digest names starting with SHA256, or NULL if
+ *			 uitsSetMediaDigestNames hasn't been called
+ *
+ */
+
+char **uitsGetMediaDigestNames (void)
+{
+	return (mediaDigestNames[0] ? mediaDigestNames : NULL);
+}
+
+/* 
+ * Function: uitsGetMediaDigest
+ * Purpose:  Look up one of the other digests created with the last media hash
+ * Returns:  Pointer to the digest, or NULL if it wasn't created
+ *
+ */
+
+UITS_digest *uitsGetMediaDigest (char *digestName)
+{
+	int i;
+	
+	for (i = 1; mediaDigests && mediaDigests[i]; i++) {
+		if (strcasecmp(mediaDigestNames[i], digestName) == 0) {
+			return (mediaDigests[i]);
+		}
+	}
+	
+	return (NULL);
+}
+
+/* 
+ * Function: uitsClearMediaDigests
+ * Purpose:  Forget the digests from the last media hash (the SHA256 digest is owned by the caller)
+ *
+ */
+
+void uitsClearMediaDigests (void)
+{
+	int i;
+	
+	for (i = 1; mediaDigests && mediaDigests[i]; i++) {
+		free(mediaDigests[i]->value);
+		free(mediaDigests[i]);
+	}
+	free(mediaDigests);
+	mediaDigests = NULL;
 }
 
 
@@ -247,9 +437,33 @@ UITS_digest *uitsCreateDigestBuffered (FILE *messageFile,
 	return (digestStringValue);
 }
 
+/* 
+ * Function: uitsGetSignatureAlgorithm
+ * Purpose:  Look up a value of the signature element's algorithm attribute
+ * Returns:  Pointer to the algorithm description or exit on error
+ *
+ */
+
+UITS_signature_algorithm *uitsGetSignatureAlgorithm (char *algorithm)
+{
+	UITS_signature_algorithm *signatureAlgorithm;
+	
+	for (signatureAlgorithm = signatureAlgorithms; signatureAlgorithm->algorithm; signatureAlgorithm++) {
+		if (!strcmp(signatureAlgorithm->algorithm, algorithm)) {
+			return (signatureAlgorithm);
+		}
+	}
+	
+	snprintf(errStr, ERRSTR_LEN, "ERROR: Unknown signature algorithm %s\n", algorithm);
+	uitsHandleErrorINT(openSSLmoduleName, "uitsGetSignatureAlgorithm", ERROR, OK, ERR_SSL, errStr);
+	
+	return (NULL);
+}
+
 /* 
  * Function: uitsCreateSignature
- * Purpose:  Sign a message using a private key 
+ * Purpose:  Sign a message using a private key. A NULL digest name signs the message
+ *           itself, which is how Ed25519 works.
  * Returns:  A base-64 encoded signature or exit on error
  *
  */
@@ -260,73 +474,158 @@ unsigned char *uitsCreateSignature(unsigned char *message,
 								   int b64LFFlag)
 {
 	
-	FILE		  *fp;
 	EVP_PKEY	  *evpPrivateKey;
-	int			  dataLen;
-	unsigned char *sig;
-	int			  sigLen;	
 	EVP_MD_CTX	  *ctx;
-	EVP_MD		  *mdType;
 	unsigned char *b64Sig;
 	
 	/* Read private key */
 	
-	fp = fopen (privateKeyFileName, "r");
-	if (!fp) {
-		snprintf(errStr, ERRSTR_LEN, "ERROR: Couldn't open private key file %s\n", privateKeyFileName);
-		uitsHandleErrorINT(openSSLmoduleName, "uitsCreateSignature", ERROR, OK, ERR_FILE, errStr);
-	}
+	evpPrivateKey = uitsGetPrivateKey (privateKeyFileName);
 	
-	evpPrivateKey = PEM_read_PrivateKey(fp, NULL, NULL, NULL);
-	fclose (fp);
+	ctx = EVP_MD_CTX_create();
 	
-	if (!evpPrivateKey) {
-		uitsHandleErrorINT(openSSLmoduleName, "uitsCreateSignature", ERROR, OK, ERR_SSL, 
-						   "ERROR: Couldn't read private key from file\n");
-	}
+	b64Sig = uitsSignMessage(ctx, evpPrivateKey, uitsGetSignatureDigest(digestName), message, strlen(message), b64LFFlag);
+	
+	EVP_MD_CTX_destroy(ctx);
+	
+	return (b64Sig);
 	
-	/* sign the message using either RSA/SHA256 or DSA/SHA224 digest */
-	if (!strcmp(digestName, "SHA256")) {
-		mdType = EVP_sha256();
+}
+
+/* 
+ * Function: uitsGetSignatureDigest
+ * Purpose:  Get the digest to sign for a digest name
+ * Returns:  The digest, NULL for a NULL name (sign the message itself), or exit on error
+ *
+ */
+
+const EVP_MD *uitsGetSignatureDigest (char *digestName)
+{
+	/* sign the message using either a SHA256 or SHA224 digest, or no digest for Ed25519 */
+	if (!digestName) {
+		return (NULL);
+	} else if (!strcmp(digestName, "SHA256")) {
+		return (EVP_sha256());
 	} else if (!strcmp(digestName, "SHA224")) {
-		mdType = EVP_sha224();
-	} else {
-		snprintf(errStr, ERRSTR_LEN, 
-				 "ERROR: Couldn't assign digest type for signing. Unrecognized digest name: %s\n", digestName);
-		uitsHandleErrorINT(openSSLmoduleName, "uitsCreateSignature", ERROR, OK, ERR_SSL, errStr);
+		return (EVP_sha224());
 	}
 	
-	ctx = EVP_MD_CTX_create();
+	snprintf(errStr, ERRSTR_LEN, 
+			 "ERROR: Couldn't assign digest type for signing. Unrecognized digest name: %s\n", digestName);
+	uitsHandleErrorINT(openSSLmoduleName, "uitsGetSignatureDigest", ERROR, OK, ERR_SSL, errStr);
+	
+	return (NULL);
+}
+
+/* 
+ * Function: uitsSignMessage
+ * Purpose:  Sign a message with a loaded key, using the passed context. The context is
+ *           cleaned up afterwards so it can be used again. Doesn't touch any globals, so
+ *           threads with their own context and key can sign at the same time.
+ * Returns:  A base-64 encoded signature or exit on error
+ *
+ */
+
+unsigned char *uitsSignMessage (EVP_MD_CTX			*ctx,
+								EVP_PKEY			*evpPrivateKey,
+								const EVP_MD		*mdType,
+								const unsigned char *message,
+								size_t				messageLength,
+								int					b64LFFlag)
+{
+	unsigned char *sig;
+	size_t		  sigLen;	
+	int			  result;
+	unsigned char *b64Sig;
 	
 	sigLen = EVP_PKEY_size(evpPrivateKey);
 	sig = calloc(sigLen, 1);
+	uitsHandleErrorPTR(openSSLmoduleName, "uitsSignMessage", sig, ERR_SSL, "Couldn't allocate signature\n");
 	
-	err = EVP_SignInit_ex(ctx, mdType, NULL);
-	uitsHandleErrorINT(openSSLmoduleName, "EVP_SignInit_ex", err, 1, ERR_SSL, "Couldn't initialize signing\n");
+	result = EVP_DigestSignInit(ctx, NULL, mdType, NULL, evpPrivateKey);
+	uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestSignInit", result, 1, ERR_SSL, "Couldn't initialize signing\n");
 	
-	dataLen	= strlen(message);
-	err = EVP_SignUpdate(ctx, message, dataLen);
-	uitsHandleErrorINT(openSSLmoduleName, "EVP_SignUpdate", err, 1, ERR_SSL, "Couldn't update signature\n");
+	if (mdType) {
+		result = EVP_DigestSignUpdate(ctx, message, messageLength);
+		uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestSignUpdate", result, 1, ERR_SSL, "Couldn't update signature\n");
+		
+		result = EVP_DigestSignFinal(ctx, sig, &sigLen);
+		uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestSignFinal", result, 1, ERR_SSL, "Couldn't finalize signature\n");
+	} else {
+#ifdef UITS_ONE_SHOT_SIGNATURES
+		result = EVP_DigestSign(ctx, sig, &sigLen, message, messageLength);
+		uitsHandleErrorINT(openSSLmoduleName, "EVP_DigestSign", result, 1, ERR_SSL, "Couldn't create signature\n");
+#else
+		uitsHandleErrorINT(openSSLmoduleName, "uitsSignMessage", ERROR, OK, ERR_SSL,
+						   "ERROR: Signing without a digest needs OpenSSL 1.1.1 or later\n");
+#endif
+	}
 	
-	err = EVP_SignFinal(ctx, sig, &sigLen,  evpPrivateKey);
-	uitsHandleErrorINT(openSSLmoduleName, "EVP_SignFinal", err, 1, ERR_SSL, "Couldn't finalize signature\n");
+	EVP_MD_CTX_cleanup(ctx);
 	
+	b64Sig = uitsBase64Encode(sig, sigLen, b64LFFlag);
+	free(sig);
 	
-//	fp = fopen ("testsig.bin", "w");
-//	if (!fp) {
-//		vprintf("ERROR: Couldn't open testsig.bin\n");
-//		exit (1);
-//	}
-//	fwrite(sig, sigLen, 1, fp);
-//	fclose(fp);
+	return (b64Sig);
+}
+
+/* 
+ * Function: uitsGetPrivateKey
+ * Purpose:  Read a private key from a PEM file. The last key read is kept, so signing
+ *           many payloads with the same key only reads and parses the file once.
+ * Returns:  Pointer to the key or exit on error
+ *
+ */
+
+EVP_PKEY *uitsGetPrivateKey (char *privateKeyFileName)
+{
+	static char		*cachedKeyFileName = NULL;
+	static EVP_PKEY	*cachedPrivateKey  = NULL;
+	EVP_PKEY		*evpPrivateKey;
 	
+	if (cachedPrivateKey && strcmp(cachedKeyFileName, privateKeyFileName) == 0) {
+		return (cachedPrivateKey);
+	}
 	
-	EVP_MD_CTX_destroy(ctx);
+	evpPrivateKey = uitsReadPrivateKey(privateKeyFileName);
 	
-	b64Sig = uitsBase64Encode(sig, sigLen, b64LFFlag);
+	if (cachedPrivateKey) {
+		EVP_PKEY_free(cachedPrivateKey);
+		free(cachedKeyFileName);
+	}
+	cachedPrivateKey  = evpPrivateKey;
+	cachedKeyFileName = strdup(privateKeyFileName);
 	
-	return (b64Sig);
+	return (evpPrivateKey);
+}
+
+/* 
+ * Function: uitsReadPrivateKey
+ * Purpose:  Read a private key from a PEM file into a new key, which the caller frees
+ * Returns:  Pointer to the key or exit on error
+ *
+ */
+
+EVP_PKEY *uitsReadPrivateKey (char *privateKeyFileName)
+{
+	FILE			*fp;
+	EVP_PKEY		*evpPrivateKey;
+	
+	fp = fopen (privateKeyFileName, "r");
+	if (!fp) {
+		snprintf(errStr, ERRSTR_LEN, "ERROR: Couldn't open private key file %s\n", privateKeyFileName);
+		uitsHandleErrorINT(openSSLmoduleName, "uitsGetPrivateKey", ERROR, OK, ERR_FILE, errStr);
+	}
+	
+	evpPrivateKey = PEM_read_PrivateKey(fp, NULL, NULL, NULL);
+	fclose (fp);
+	
+	if (!evpPrivateKey) {
+		uitsHandleErrorINT(openSSLmoduleName, "uitsGetPrivateKey", ERROR, OK, ERR_SSL, 
+						   "ERROR: Couldn't read private key from file\n");
+	}
 	
+	return (evpPrivateKey);
 }
 
 /* 
@@ -343,102 +642,216 @@ int uitsVerifySignature (char			*pubKeyFileName,
 						 char			*b64Sig,
 						 char			*digestName)
 {
-//	BIO			*pubKeyBio;
-	FILE		*fp;
-	EVP_PKEY	*pubKey;
-	UITS_digest	*sig;
-	int			dataLen;
-	const EVP_MD *md;
-	EVP_MD_CTX   *ctx;
-	int			result;
-		
+	UITS_SIGNATURE_VERIFIER *verifier;
+	
+	verifier = uitsVerifySignatureStart(pubKeyFileName, digestName);
+	
+	uitsVerifySignatureUpdate(verifier, data, strlen(data));
+	
+	return (uitsVerifySignatureFinish(verifier, b64Sig));
+}
+
+/* 
+ * Function: uitsVerifySignatureStart
+ * Purpose:  Start verifying a signature whose message is passed in pieces with
+ *           uitsVerifySignatureUpdate, so that the message can be digested as it is read
+ * Returns:  Pointer to the verifier or exit on error
+ *
+ */
+
+UITS_SIGNATURE_VERIFIER *uitsVerifySignatureStart (char *pubKeyFileName, char *digestName)
+{
+	UITS_SIGNATURE_VERIFIER *verifier;
+	FILE					*fp;
+	const EVP_MD			*md = NULL;
+	
+	verifier = calloc(1, sizeof(UITS_SIGNATURE_VERIFIER));
+	uitsHandleErrorPTR(openSSLmoduleName, "uitsVerifySignatureStart", verifier, ERR_SSL,
+					   "Error: Couldn't allocate signature verifier\n");
 	
 	// read the public key from a file
 	fp = fopen(pubKeyFileName, "r");	
 	uitsHandleErrorPTR(openSSLmoduleName, "EVP_VerifyInit_ex", fp, ERR_FILE,
 					"Error: Coudln't open public key file\n");
 
-	pubKey = PEM_read_PUBKEY(fp, NULL, NULL, NULL);
+	verifier->pubKey = PEM_read_PUBKEY(fp, NULL, NULL, NULL);
 	
 	fclose(fp);
 
-	// this code will read the public key from memory instead of a file
-	// get the public key from a file
-//	pubKeyData = uitsReadFile(pubKeyFileName);
-//	pubKeyBio = BIO_new(BIO_s_mem());
-//	BIO_write(pubKeyBio, pubKeyData, strlen(pubKeyData));
-//	pubKey = PEM_read_bio_PUBKEY(pubKeyBio, NULL, NULL, NULL);
+	verifier->ctx = EVP_MD_CTX_create();
+	
+	/* without a digest, the message is kept and checked in one call by uitsVerifySignatureFinish */
+	if (digestName) {
+		md = EVP_get_digestbyname(digestName);
+		uitsHandleErrorPTR(openSSLmoduleName, "uitsVerifySignature", md, ERR_SSL,
+						"Error creating message digest object, unknown name?\n");
+	} else {
+		verifier->messageFlag = TRUE;
+	}
+	
+	err = EVP_DigestVerifyInit(verifier->ctx, NULL, md, NULL, verifier->pubKey);
+	uitsHandleErrorINT(openSSLmoduleName, "uitsVerifySignature", err, 1, ERR_SSL, "Couldn't initialize verification\n");
+	
+	return (verifier);
+}
+
+/* 
+ * Function: uitsVerifySignatureUpdate
+ * Purpose:  Add the next piece of the message to a signature verification
+ *
+ */
+
+void uitsVerifySignatureUpdate (UITS_SIGNATURE_VERIFIER *verifier, const unsigned char *data, size_t dataLength)
+{
+	if (!verifier->messageFlag) {
+		EVP_DigestVerifyUpdate(verifier->ctx, data, dataLength);
+		return;
+	}
+	
+	if (verifier->messageLength + dataLength > verifier->messageSize) {
+		verifier->messageSize = (verifier->messageLength + dataLength) * 2;
+		verifier->message = realloc(verifier->message, verifier->messageSize);
+		uitsHandleErrorPTR(openSSLmoduleName, "uitsVerifySignatureUpdate", verifier->message, ERR_SSL,
+						   "Error: Couldn't allocate signature message\n");
+	}
+	memcpy(verifier->message + verifier->messageLength, data, dataLength);
+	verifier->messageLength += dataLength;
+}
+
+/* 
+ * Function: uitsVerifySignatureFinish
+ * Purpose:  Check the signature against the message passed so far, and free the verifier
+ * Returns:  1 if the signature is good or exit on error
+ *
+ */
+
+int uitsVerifySignatureFinish (UITS_SIGNATURE_VERIFIER *verifier, char *b64Sig)
+{
+	unsigned char	sig [BASE64_SIGNATURE_SIZE];
+	size_t			sigLength;
+	int				result = 0;
 	
 	// decode the signature
-	sig = uitsBase64Decode (b64Sig, strlen(b64Sig));
-	uitsHandleErrorPTR(openSSLmoduleName, "uitsVerifySignature", sig, ERR_SSL,
+	err = uitsBase64DecodeBuffer(b64Sig, strlen(b64Sig), sig, BASE64_SIGNATURE_SIZE, &sigLength);
+	uitsHandleErrorINT(openSSLmoduleName, "uitsVerifySignature", err, OK, ERR_SSL,
 					"Error decoding Base 64 signature\n");
+	vprintf("base64decode buffer length: %d\n", (int) sigLength);
 
-
-	ctx = EVP_MD_CTX_create();
+	if (!verifier->messageFlag) {
+		result = EVP_DigestVerifyFinal(verifier->ctx, sig, sigLength);
+	} else {
+#ifdef UITS_ONE_SHOT_SIGNATURES
+		result = EVP_DigestVerify(verifier->ctx, sig, sigLength, verifier->message, verifier->messageLength);
+#else
+		uitsHandleErrorINT(openSSLmoduleName, "uitsVerifySignatureFinish", ERROR, OK, ERR_SSL,
+						   "ERROR: Verifying without a digest needs OpenSSL 1.1.1 or later\n");
+#endif
+	}
+	uitsHandleErrorINT (openSSLmoduleName, "uitsVerifySignature", result, 1, ERR_SSL, "Couldn't finalize verification\n");
 	
-	md = EVP_get_digestbyname(digestName);
-	uitsHandleErrorPTR(openSSLmoduleName, "uitsVerifySignature", md, ERR_SSL,
-					"Error creating message digest object, unknown name?\n");
+	EVP_MD_CTX_destroy(verifier->ctx);
+
+	EVP_PKEY_free(verifier->pubKey);
 	
+	free(verifier->message);
+	free(verifier);
 
-	err = EVP_VerifyInit_ex(ctx, md, NULL);
-	uitsHandleErrorINT(openSSLmoduleName, "uitsVerifySignature", err, 1, ERR_SSL, "Couldn't initialize verification\n");
+	return result;
+}
+
+/* 
+ * Function: uitsReadPublicKey
+ * Purpose:  Read a public key from a PEM file into a new key, which the caller frees
+ * Returns:  Pointer to the key or exit on error
+ *
+ */
+
+EVP_PKEY *uitsReadPublicKey (char *pubKeyFileName)
+{
+	FILE			*fp;
+	EVP_PKEY		*evpPubKey;
 	
-	//	data = calloc(EVP_MD_size(md), 1);
-	//	data_len = fread(data, 1, EVP_MD_size(md), data_file);
-	dataLen	= strlen(data);
+	fp = fopen (pubKeyFileName, "r");
+	if (!fp) {
+		snprintf(errStr, ERRSTR_LEN, "ERROR: Couldn't open public key file %s\n", pubKeyFileName);
+		uitsHandleErrorINT(openSSLmoduleName, "uitsReadPublicKey", ERROR, OK, ERR_FILE, errStr);
+	}
 	
-	EVP_VerifyUpdate(ctx, data, dataLen);
+	evpPubKey = PEM_read_PUBKEY(fp, NULL, NULL, NULL);
+	fclose (fp);
 	
-	result = EVP_VerifyFinal(ctx, sig->value, sig->length, pubKey);
-	uitsHandleErrorINT (openSSLmoduleName, "uitsVerifySignature", result, 1, ERR_SSL, "Couldn't finalize verification\n");
+	if (!evpPubKey) {
+		uitsHandleErrorINT(openSSLmoduleName, "uitsReadPublicKey", ERROR, OK, ERR_SSL, 
+						   "ERROR: Couldn't read public key from file\n");
+	}
 	
-	EVP_MD_CTX_destroy(ctx);
+	return (evpPubKey);
+}
 
-	EVP_PKEY_free(pubKey);
+/* 
+ * Function: uitsVerifyMessage
+ * Purpose:  Check a base-64 encoded signature of a message with a loaded key, using the
+ *           passed context. Like uitsSignMessage, the context is cleaned up afterwards
+ *           and no globals are touched, so threads with their own context can check
+ *           signatures with the same key at the same time.
+ * Returns:  1 if the signature is good, 0 if it isn't
+ *
+ */
 
-	return result;
+int uitsVerifyMessage (EVP_MD_CTX			*ctx,
+					   EVP_PKEY				*evpPubKey,
+					   const EVP_MD			*mdType,
+					   const unsigned char	*message,
+					   size_t				messageLength,
+					   char					*b64Sig)
+{
+	unsigned char	sig [BASE64_SIGNATURE_SIZE];
+	size_t			sigLength;
+	int				result = 0;
+	
+	/* a signature too long for the buffer can't be good */
+	if (uitsBase64DecodeBuffer(b64Sig, strlen(b64Sig), sig, BASE64_SIGNATURE_SIZE, &sigLength) == OK &&
+		sigLength > 0 && EVP_DigestVerifyInit(ctx, NULL, mdType, NULL, evpPubKey) == 1) {
+		if (mdType) {
+			result = EVP_DigestVerifyUpdate(ctx, message, messageLength) == 1 &&
+					 EVP_DigestVerifyFinal(ctx, sig, sigLength) == 1;
+		} else {
+#ifdef UITS_ONE_SHOT_SIGNATURES
+			result = EVP_DigestVerify(ctx, sig, sigLength, message, messageLength) == 1;
+#endif
+		}
+	}
+	
+	if (!result) {
+		ERR_clear_error();	/* a bad signature is a result, not an error to report later */
+	}
+	EVP_MD_CTX_cleanup(ctx);
+	
+	return (result);
 }
 
 /* 
  * Function: uitsBase64Encode
- * Purpose:  Base 64 encode a message
- * Returns:  pointer to encoded message or exit on error
+ * Purpose:  Base 64 encode a message, with a line feed after every 64 characters if
+ *			 b64LFFlag is set
+ * Returns:  pointer to encoded message, which the caller frees, or exit on error
  *
  */
 unsigned char *uitsBase64Encode	(unsigned char *message, 
 								 int messageLength,
 								 int b64LFFlag)
 {
-	//	vprintf("Base64Encode message: %s\n", message);
-	
-	BIO *bmem, *b64;
-	BUF_MEM *bptr;
+	char *buff;
 	
-	b64 = BIO_new(BIO_f_base64());
 	if (!b64LFFlag) {
 		vprintf("\tCreating base64 signature with no newlines\n");
-		BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
 	}
-	bmem = BIO_new(BIO_s_mem());
-	b64 = BIO_push(b64, bmem);
-	BIO_write(b64, message, messageLength);
-	BIO_flush(b64);
-	BIO_get_mem_ptr(b64, &bptr);
 	
-	char *buff = (char *)calloc((bptr->length+1), 1);
+	buff = malloc(uitsBase64EncodedLength(messageLength, b64LFFlag) + 1);
+	uitsHandleErrorPTR(openSSLmoduleName, "uitsBase64Encode", buff, ERR_SSL,
+					   "Error: Couldn't allocate base 64 buffer\n");
 	
-	memcpy(buff, bptr->data, bptr->length);
-	
-	/* need to null-terminate the string */
-	if (b64LFFlag) {
-		buff[bptr->length-1] = 0;	/* if newlines are included, length includes the newline, so replace it */
-
-	} else {
-		buff[bptr->length] = 0;		/* if no newlines, terminate after last character */
-	}
-	BIO_free_all(b64);
+	uitsBase64EncodeBuffer(message, messageLength, buff, b64LFFlag);
 	
 	return (buff);
 }
@@ -447,39 +860,33 @@ unsigned char *uitsBase64Encode	(unsigned char *message,
  * Function: uitsBase64Decode
  * Purpose:  Decode a message that was base64 encoded. Will decode
  *			 messages with and without newlines.
- * Returns:  Pointer to digest structure or exit if error
+ * Returns:  Pointer to digest structure, with a length of 0 if the message
+ *			 isn't base 64, or exit if error
  *
  */
 
 UITS_digest *uitsBase64Decode (unsigned char *message, 
 							   int messageLength)
 {
-	BIO_METHOD	*bioMethod;
-	BIO			*b64, *bmem;
-	UITS_digest *decodedMessage = calloc(sizeof(UITS_digest), 1);
+	UITS_digest *decodedMessage;
+	size_t		decodedLength;
 	
-	char *buffer = (char *)calloc(messageLength, 1); // the decoded buffer will always be smaller than the encoded one?
-	memset(buffer, 0, messageLength);
-		
-	bioMethod = BIO_f_base64();	
-	b64 = BIO_new(bioMethod);	
-
-	/* if the message doesn't have newlines, set the appropriate flag for decoding */
-	if (strchr(message, '\n') == NULL) {
-		vprintf("\tDecoding base64 signature with no newlines\n");
-		BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-	} 
+	decodedMessage = calloc(sizeof(UITS_digest), 1);
+	uitsHandleErrorPTR(openSSLmoduleName, "uitsBase64Decode", decodedMessage, ERR_SSL,
+					   "Error: Couldn't allocate base 64 buffer\n");
 	
-	bmem = BIO_new_mem_buf(message, messageLength);
-	bmem = BIO_push(b64, bmem);
+	/* the decoded message is always shorter than the encoded one */
+	decodedMessage->value = malloc(messageLength / 4 * 3 + 3);
+	uitsHandleErrorPTR(openSSLmoduleName, "uitsBase64Decode", decodedMessage->value, ERR_SSL,
+					   "Error: Couldn't allocate base 64 buffer\n");
 	
-	decodedMessage->length = BIO_read(bmem, buffer, messageLength);
-	
-	BIO_free_all(bmem);
+	if (uitsBase64DecodeBuffer(message, messageLength, decodedMessage->value, messageLength / 4 * 3 + 3,
+							   &decodedLength) == OK) {
+		decodedMessage->length = decodedLength;
+	}
 	
 	vprintf("base64decode buffer length: %d\n", decodedMessage->length);
 	
-	decodedMessage->value = buffer;
 	return (decodedMessage);
 }
 
@@ -27,11 +27,41 @@
 #include <openssl/evp.h>
 #include <openssl/err.h>
 
+/* Ed25519 and the one-shot EVP_DigestSign and EVP_DigestVerify came with OpenSSL 1.1.1 */
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#  define UITS_ONE_SHOT_SIGNATURES
+#endif
+
 typedef struct {
 	int length;
 	unsigned char *value;
 } UITS_digest;
 
+/*
+ * A value of the signature algorithm attribute
+ */
+
+typedef struct {
+	char *algorithm;
+	char *digestName;		/* NULL if the message is signed without a separate digest */
+} UITS_signature_algorithm;
+
+/*
+ * A signature check whose message is passed in pieces
+ */
+
+typedef struct {
+	EVP_MD_CTX		*ctx;
+	EVP_PKEY		*pubKey;
+	int				messageFlag;		/* TRUE if the message is kept for a one-shot check */
+	unsigned char	*message;
+	size_t			messageLength;
+	size_t			messageSize;
+} UITS_SIGNATURE_VERIFIER;
+
+#define MAX_DIGESTS			8			/* digests that can be created in one pass */
+#define MEDIA_HASH_DIGEST	"SHA256"
+
 
 /*
  * Function Declarations
@@ -43,10 +73,28 @@ UITS_digest		*uitsGetPubKeyID (char *pubKeyFileName);
 
 int				uitsValidatePubKeyID (char *pubKeyFileName, char *pubKeyFromPayload);
 UITS_digest		*uitsCreateDigest (unsigned char *message, char *digestName);
-UITS_digest		*uitsCreateDigestBuffered (FILE *messageFile, int messageLength, char *digestName); 
+UITS_digest		*uitsCreateDigestBuffered (FILE *messageFile, off_t messageLength, char *digestName); 
+UITS_digest		**uitsCreateDigestsBuffered (FILE *messageFile, off_t messageLength, char **digestNames);
+int				uitsSetMediaDigestNames (char *digestNameList);
+UITS_digest		*uitsCreateMediaDigest (FILE *audioFP, off_t audioLength);
+char			**uitsGetMediaDigestNames (void);
+UITS_digest		*uitsGetMediaDigest (char *digestName);
+void			uitsClearMediaDigests (void);
 char			*uitsDigestToString (UITS_digest *uitsDigest);
+UITS_signature_algorithm *uitsGetSignatureAlgorithm (char *algorithm);
 unsigned char	*uitsCreateSignature (unsigned char *message,  char *privateKeyFileName,  char *digestName, int b64LFFlag);
+const EVP_MD	*uitsGetSignatureDigest (char *digestName);
+unsigned char	*uitsSignMessage (EVP_MD_CTX *ctx, EVP_PKEY *evpPrivateKey, const EVP_MD *mdType,
+								  const unsigned char *message, size_t messageLength, int b64LFFlag);
+EVP_PKEY		*uitsGetPrivateKey (char *privateKeyFileName);
+EVP_PKEY		*uitsReadPrivateKey (char *privateKeyFileName);
 int				uitsVerifySignature (char *pubKeyFileName,  unsigned char *data, char *b64Sig, char *digestName);
+UITS_SIGNATURE_VERIFIER *uitsVerifySignatureStart (char *pubKeyFileName, char *digestName);
+void			uitsVerifySignatureUpdate (UITS_SIGNATURE_VERIFIER *verifier, const unsigned char *data, size_t dataLength);
+int				uitsVerifySignatureFinish (UITS_SIGNATURE_VERIFIER *verifier, char *b64Sig);
+EVP_PKEY		*uitsReadPublicKey (char *pubKeyFileName);
+int				uitsVerifyMessage (EVP_MD_CTX *ctx, EVP_PKEY *evpPubKey, const EVP_MD *mdType,
+								   const unsigned char *message, size_t messageLength, char *b64Sig);
 unsigned char	*uitsBase64Encode (unsigned char *message, int messageLength, int b64LFFlag);
 UITS_digest		*uitsBase64Decode (unsigned char *message, int messageLength);
 
@@ -24,30 +24,48 @@ char *audioFileName;				// audio file name
 char *metadataFileName;				// metadata file name 
 char *payloadFileName;				// UITS payload file name 
 char *outputFileName;				// Output file name 
+char *stampListFileName;			// list of output files and TID/UID values to stamp the audio with
+char *hashListFileName;				// list of audio files to generate media hashes for
+char *verifyListFileName;			// list of media files whose payloads are verified together
 
 int	 embedFlag;						// set if payload should be embedded into audio fle
+int	 inPlaceFlag;					// set if payload should be embedded into the input audio file itself
 int	 verifyFlag;					// set if extracted payload should be verified
 int  numPadBytes;					// number of bytes of padding to insert into MP3 ID3 tag (optional)
+int  numThreads;					// number of threads signing stamp list payloads or verifying a verify list, 0 for one per CPU (optional)
 int  gpMediaHashFlag;				// genparam: Media_Hash
 int  gpB64MediaHashFlag;			// genparam: Base64 Media_Hash
 int  gpPubKeyIDFlag;				// genparam: Public Key ID 
 int  mediaHashNoVerifyFlag;			// set if media hash should not be verified
+int  verifyLevel;					// how far to verify a payload, one of uitsVerifyLevels
 
 char *clMediaHashValue;				// media hash value passed from the command-line
 char *mediaHashFileName;			// file containing pre-computed media hash
 
 UITS_command_line_params clParams [] = {
 	{"embed",		   &embedFlag},
+	{"inplace",		   &inPlaceFlag},
 	{"verify",         &verifyFlag},
 	{"pad",            &numPadBytes},
+	{"threads",        &numThreads},
 	{"media_hash",     &gpMediaHashFlag},
 	{"b64_media_hash", &gpB64MediaHashFlag},
 	{"public_key_ID",  &gpPubKeyIDFlag},
 	{"nohash",		   &mediaHashNoVerifyFlag},
+	{"level",		   &verifyLevel},
 	
 	{0,	0}	// end of list	
 };
 
+UITS_verify_level verifyLevels [] = {
+	{VERIFY_LEVEL_STRUCTURE,	"structure"},
+	{VERIFY_LEVEL_SIGNATURE,	"signature"},
+	{VERIFY_LEVEL_SCHEMA,		"schema"},
+	{VERIFY_LEVEL_FULL,			"full"},
+	
+	{0, NULL}	// end of list
+};
+
 
 
 /*
@@ -142,15 +160,21 @@ int uitsPayloadManagerInit (void)
 	payloadFileName		= NULL;
 	mediaHashFileName	= NULL;
 	outputFileName		= NULL;
+	stampListFileName	= NULL;
+	hashListFileName	= NULL;
+	verifyListFileName	= NULL;
 	embedFlag			= FALSE;
+	inPlaceFlag			= FALSE;
 	verifyFlag			= FALSE;
 	numPadBytes			= 0;
+	numThreads			= 1;
 	gpMediaHashFlag     = FALSE;			// genparam: Media_Hash
 	gpB64MediaHashFlag  = FALSE;			// genparam: Base64 Media_Hash
 	gpPubKeyIDFlag      = FALSE;			// genparam: Public Key ID 
 	clMediaHashValue	= NULL;				// media hash value passed from the command-line
 	mediaHashFileName	= NULL;				// file containing pre-computed media hash
 	mediaHashNoVerifyFlag = 0;
+	verifyLevel			= VERIFY_LEVEL_FULL;
 	return (OK);
 }
 
@@ -167,11 +191,17 @@ int uitsPayloadManagerInit (void)
 int uitsCreate () 
 {
 	
-	mxml_node_t *xml = NULL;
+	UITS_PAYLOAD_WRITER *payloadWriter;
 	FILE		*payloadFP;
 	char		*payloadXMLString;
 	
 	char *mediaHashValue = NULL;
+	UITS_STAMP_ASSET *stampAsset;
+
+	/* the audio is being streamed to stdout, so messages would corrupt it */
+	if (payloadFileName && strcmp(payloadFileName, AUDIO_STREAM_NAME) == 0) {
+		silentFlag = TRUE;
+	}
 
 	vprintf("Create UITS payload ...\n");
 
@@ -180,6 +210,18 @@ int uitsCreate ()
 	
 	vprintf("Creating UITS payload from comand-line options ... \n");		
 	
+	if (stampListFileName) {	// stamp a copy of the audio for each line in the list
+		stampAsset = uitsStampPrepareAsset(audioFileName, clMediaHashValue, gpB64MediaHashFlag, XSDFileName);
+		
+		err = uitsStampList(stampAsset, stampListFileName, uitsSignatureDesc, numPadBytes, numThreads);
+		uitsHandleErrorINT(payloadModuleName, "uitsCreate", err, OK, ERR_PAYLOAD, "Couldn't stamp audio file\n");
+		
+		uitsStampFreeAsset(stampAsset);
+		
+		vprintf("Success\n");
+		return (OK);
+	}
+	
 	if (clMediaHashValue) {	// if media hash value passed on command line, set it
 		mediaHashValue = clMediaHashValue;
 	} else {
@@ -204,14 +246,10 @@ int uitsCreate ()
 	uitsHandleErrorINT(payloadModuleName, "uitsCreateMediaHashElement", err, OK, ERR_PAYLOAD,
 					"Couldn't set metadata value for Media hash\n");
 	
-	/* create the XML in an mxml data structure from the metadata array */
+	/* write the payload XML from the metadata array */
 	
-	xml = uitsCreatePayloadXML (UITS_XML, uitsMetadataDesc, uitsSignatureDesc);
-	uitsHandleErrorPTR(payloadModuleName, "uitsCreate", xml, ERR_PAYLOAD,
-					"Error: Couldn't create XML payload\n");
-
-	/* convert the mxml data structure into a string containing the XML */
-	payloadXMLString = uitsMXMLToXMLString(xml);
+	payloadWriter = uitsPayloadWriterCreate();
+	payloadXMLString = uitsPayloadWrite (payloadWriter, UITS_XML, uitsMetadataDesc, uitsSignatureDesc);
 	
 	// TO BE IMPLEMENTED: if no metadata file specified and no command-line options specified, try to read from standard in
 	
@@ -221,11 +259,10 @@ int uitsCreate ()
 	
 	mediaHashNoVerifyFlag = TRUE;	// dont' verify the media hash on create
 	
-	err =  uitsVerifyPayloadXML (xml, 
-								 payloadXMLString, 
-								 XSDFileName, 
-								 mediaHashNoVerifyFlag,
-								 uitsSignatureDesc);
+	err =  uitsVerifyPayloadString (payloadXMLString, 
+									XSDFileName, 
+									VERIFY_LEVEL_SCHEMA,
+									uitsSignatureDesc);
 	uitsHandleErrorINT(payloadModuleName, "uitsCreate", err, OK, ERR_PAYLOAD, 
 					"Error: Couldn't validate XML payload\n");
 	
@@ -233,7 +270,31 @@ int uitsCreate ()
 	
 	// write the output to a separate payload file or insert it into the audio file
 	
-	if (embedFlag) {
+	if (embedFlag && strcmp(audioFileName, AUDIO_STREAM_NAME) == 0) {
+		vprintf("Embedding payload into audio from standard input and writing audio file: %s ...\n", payloadFileName);
+		
+		if (strcmp(payloadFileName, AUDIO_STREAM_NAME) == 0) {
+			payloadFP = stdout;
+		} else {
+			payloadFP = uitsIOOpen(payloadFileName, "wb");
+			uitsHandleErrorPTR(payloadModuleName, "uitsCreate", payloadFP, ERR_FILE,
+							   "Error: Couldn't open payload file\n");
+		}
+		
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(payloadFP), _O_BINARY);
+#endif
+		
+		/* read the audio once from stdin, embed the XML on the way through */
+		err = uitsAudioEmbedPayloadStream (stdin, payloadFP, payloadXMLString, numPadBytes);
+		uitsHandleErrorINT(payloadModuleName, "uitsCreate", err, OK, ERR_PAYLOAD, "Couldn't embed payload into audio stream\n");
+		
+		if (payloadFP != stdout) {
+			err = fclose(payloadFP);
+			uitsHandleErrorINT(payloadModuleName, "uitsCreate", err, OK, ERR_FILE, "Error: Couldn't write payload file\n");
+		}
+	} else if (embedFlag) {
 		vprintf("Embedding payload and writing audio file: %s ...\n", payloadFileName);
 		
 
@@ -243,17 +304,19 @@ int uitsCreate ()
 	} else {
 		vprintf("Writing standalone UITS payload to file: %s ...\n", payloadFileName);
 		
-		payloadFP = fopen(payloadFileName, "wb");
+		payloadFP = uitsIOOpen(payloadFileName, "wb");
 		uitsHandleErrorPTR(payloadModuleName, "uitsCreate", payloadFP, ERR_FILE,
 						"Error: Couldn't open payload file\n");
 		
-		err = mxmlSaveFile(xml, payloadFP, MXML_NO_CALLBACK);
-		uitsHandleErrorINT(payloadModuleName, "uitsCreate", err, 0, ERR_FILE,
+		err = fprintf(payloadFP, "%s\n", payloadXMLString);	// mxmlSaveFile ended the file with a new line
+		uitsHandleErrorINT(payloadModuleName, "uitsCreate", (err < 0) ? ERROR : OK, OK, ERR_FILE,
 						"Error: Couldn't open save xml to file\n");
 		
 		fclose(payloadFP);
 	}
 	
+	uitsPayloadWriterFree(payloadWriter);
+	
 	vprintf("Success\n");
 	return (OK);
 	
@@ -268,15 +331,23 @@ int uitsCreate ()
 
 int uitsVerify (void) 
 {
-	FILE *payloadFP;
 	char *uitsPayloadXMLString;
-	mxml_node_t *xml;
 	
 	vprintf("Verify UITS payload ...\n");
 	
+	/* --nohash is the full level without the media hash */
+	if (mediaHashNoVerifyFlag && verifyLevel == VERIFY_LEVEL_FULL) {
+		verifyLevel = VERIFY_LEVEL_SCHEMA;
+	}
+	
 	/* make sure that all required parameters are non-null */
 	uitsCheckRequiredParams("verify");
 	
+	if (verifyListFileName) {	/* audit the payloads of every file in the list */
+		return (uitsVerifyList(verifyListFileName, XSDFileName, verifyLevel, uitsSignatureDesc,
+							   numThreads, outputFileName));
+	}
+	
 	/* initialize the payload xml by either reading it from a standalone payload or
 	 * extracting from an audio file. If both standalone and audio file are specified,
 	 * standalone takes precedence.
@@ -295,16 +366,10 @@ int uitsVerify (void)
 		
 	}
 	
-	/*	convert the XML string to an mxml tree */
-	xml = mxmlLoadString (NULL, uitsPayloadXMLString, MXML_OPAQUE_CALLBACK);
-	uitsHandleErrorPTR(payloadModuleName, "uitsVerify", xml, ERR_PAYLOAD,
-					   "Couldn't convert payload XML to  xml tree\n");
-	
-	err =  uitsVerifyPayloadXML (xml, 
-								 uitsPayloadXMLString, 
-								 XSDFileName, 
-								 mediaHashNoVerifyFlag,
-								 uitsSignatureDesc);
+	err =  uitsVerifyPayloadString (uitsPayloadXMLString, 
+									XSDFileName, 
+									verifyLevel,
+									uitsSignatureDesc);
 	uitsHandleErrorINT(payloadModuleName, "uitsVerifyPayloadFile", err, 0, ERR_VERIFY,
 					   "Error: Payload failed validation\n");
 	
@@ -346,7 +411,7 @@ int uitsExtract ()
 	vprintf("Writing payload to %s ...\n", payloadFileName);
 	payloadLength = strlen(uitsPayloadXML);
 	
-	payloadFP = fopen(payloadFileName, "wb");
+	payloadFP = uitsIOOpen(payloadFileName, "wb");
 	uitsHandleErrorPTR(payloadModuleName, "uitsExtract", payloadFP, ERR_FILE,
 					   "Couldn't open payload file for output\n");
 	
@@ -399,7 +464,7 @@ int uitsGenKey ()
 
 	if (outputFileName) {
 		vprintf("Writing public Key ID to file %s\n", outputFileName);
-		outFP = fopen(outputFileName, "w");
+		outFP = uitsIOOpen(outputFileName, "w");
 		uitsHandleErrorPTR(outputFileName, "uitsGenKey", outFP, ERR_FILE, "Couldn't open output file\n");
 		
 		len = strlen(pubKeyIDValue);
@@ -425,6 +490,8 @@ int uitsGenHash ()
 	unsigned char *mediaHash = NULL;
 	unsigned char *b64MediaHash = NULL;
 	unsigned char *outputMediaHash = NULL;
+	char **digestNames;
+	char *outputDigests = NULL;
 	FILE *outFP;
 	int len;
 	
@@ -432,6 +499,10 @@ int uitsGenHash ()
 	
 	uitsCheckRequiredParams("genhash");
 	
+	if (hashListFileName) {	// hash every file in the list together
+		return (uitsGenHashList(hashListFileName));
+	}
+	
 	mediaHash = uitsAudioGetMediaHash(audioFileName);
 	vprintf("Media Hash for file %s is: \n\t%s\n", audioFileName, mediaHash);
 	outputMediaHash = mediaHash;
@@ -442,9 +513,17 @@ int uitsGenHash ()
 		vprintf("Base 64 Encoded Media Hash for file %s is:\n\t %s\n", audioFileName, b64MediaHash);
 	}
 
+	/* the other digests were created in the same pass as the media hash */
+	digestNames = uitsGetMediaDigestNames();
+	if (digestNames) {
+		outputDigests = uitsGenHashDigestLines(digestNames, outputMediaHash);
+		vprintf("Digests for file %s are:\n%s", audioFileName, outputDigests);
+		outputMediaHash = outputDigests;
+	}
+	
 	if (outputFileName) {
 		vprintf("Writing media hash to file %s\n", outputFileName);
-		outFP = fopen(outputFileName, "w");
+		outFP = uitsIOOpen(outputFileName, "w");
 		uitsHandleErrorPTR(outputFileName, "uitsGenHash", outFP, ERR_FILE, "Couldn't open output file\n");
 		
 		len = strlen(outputMediaHash);
@@ -454,10 +533,170 @@ int uitsGenHash ()
 		fclose(outFP);
 	}
 	
+	free(outputDigests);
+	
+	return (OK);
+	
+	
+}
+
+/*
+ * Function: uitsGenHashList ()
+ * Purpose:	 Generate the media hashes of the audio files in a list, one file name per
+ *			 line. Blank lines and lines starting with # are skipped. The files are hashed
+ *			 together (see uitsMultiHash.c) and each hash is output on its own line as
+ *				media-hash file-name
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsGenHashList (char *listFileName)
+{
+	FILE *listFP;
+	FILE *outFP;
+	char line[HASH_LIST_LINE_SIZE];
+	char **listAudioFileNames = NULL;
+	char **mediaHashValues;
+	char *outputMediaHash;
+	char *fileName;
+	int	 numFiles = 0;
+	int	 maxFiles = 0;
+	int	 i;
+	
+	listFP = uitsIOOpen(listFileName, "r");
+	uitsHandleErrorPTR(payloadModuleName, "uitsGenHashList", listFP, ERR_FILE, "Couldn't open hash list file\n");
+	
+	while (fgets(line, HASH_LIST_LINE_SIZE, listFP)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!line[0] || line[0] == '#') {
+			continue;
+		}
+		if (numFiles == maxFiles) {
+			maxFiles = maxFiles ? maxFiles * 2 : 64;
+			listAudioFileNames = realloc(listAudioFileNames, maxFiles * sizeof(char *));
+			uitsHandleErrorPTR(payloadModuleName, "uitsGenHashList", listAudioFileNames, ERR_HASH,
+							   "Couldn't allocate hash list\n");
+		}
+		listAudioFileNames[numFiles++] = strdup(line);
+	}
+	fclose(listFP);
+	
+	vprintf("Generating media hashes for %d files ...\n", numFiles);
+	
+	mediaHashValues = uitsMultiHashFiles(listAudioFileNames, numFiles);
+	
+	if (outputFileName) {
+		vprintf("Writing media hashes to file %s\n", outputFileName);
+		outFP = uitsIOOpen(outputFileName, "w");
+		uitsHandleErrorPTR(outputFileName, "uitsGenHashList", outFP, ERR_FILE, "Couldn't open output file\n");
+	} else {
+		outFP = stdout;
+	}
+	
+	for (i = 0; i < numFiles; i++) {
+		fileName		= listAudioFileNames[i];
+		outputMediaHash = mediaHashValues[i];
+		uitsHandleErrorPTR(payloadModuleName, "uitsGenHashList", outputMediaHash, ERR_HASH, "Couldn't calculate media hash\n");
+		
+		if (gpB64MediaHashFlag) {
+			outputMediaHash = uitsBase64Encode(mediaHashValues[i], strlen(mediaHashValues[i]), FALSE);	// one line per file
+		}
+		
+		err = fprintf(outFP, "%s %s\n", outputMediaHash, fileName);
+		uitsHandleErrorINT(payloadModuleName, "uitsGenHashList", (err < 0) ? ERROR : OK, OK, ERR_FILE,
+						   "Couldn't write media hash\n");
+		
+		if (outputMediaHash != mediaHashValues[i]) {
+			free(outputMediaHash);
+		}
+		free(mediaHashValues[i]);
+		free(fileName);
+	}
+	
+	if (outFP != stdout) {
+		err = fclose(outFP);
+		uitsHandleErrorINT(payloadModuleName, "uitsGenHashList", err, OK, ERR_FILE, "Couldn't write media hashes to file\n");
+	}
+	
+	free(mediaHashValues);
+	free(listAudioFileNames);
 	
 	return (OK);
+}
+
+/*
+ * Function: uitsGenHashDigestLines ()
+ * Purpose:	 Format the media hash and the other digests created with it, one per line as
+ *			 name value. The digests are base 64 encoded in the same way as the media hash.
+ * Returns:  The lines or exit on error
+ *
+ */
+
+char *uitsGenHashDigestLines (char **digestNames, char *mediaHash)
+{
+	UITS_digest *digest;
+	char		*digestValue;
+	char		*hexDigestValue;
+	char		*digestLines;
+	size_t		linesLength = 0;
+	int			i;
+	
+	digestLines = calloc(1, 1);
+	
+	for (i = 0; digestNames[i]; i++) {
+		if (i == 0) {
+			digestValue = strdup(mediaHash);	// the media hash, already encoded
+		} else {
+			digest = uitsGetMediaDigest(digestNames[i]);
+			if (!digest) {
+				snprintf(errStr, ERRSTR_LEN, "Error: Couldn't create %s digest for %s\n", digestNames[i], audioFileName);
+				uitsHandleErrorPTR(payloadModuleName, "uitsGenHashDigestLines", NULL, ERR_HASH, errStr);
+			}
+			digestValue = uitsDigestToString(digest);
+			if (gpB64MediaHashFlag) {
+				hexDigestValue = digestValue;
+				digestValue = uitsBase64Encode(hexDigestValue, strlen(hexDigestValue), TRUE);
+				free(hexDigestValue);
+			}
+		}
+		
+		linesLength += strlen(digestNames[i]) + strlen(digestValue) + 2;
+		digestLines = realloc(digestLines, linesLength + 1);
+		uitsHandleErrorPTR(payloadModuleName, "uitsGenHashDigestLines", digestLines, ERR_HASH, "Couldn't allocate digest list\n");
+		
+		strcat(digestLines, digestNames[i]);
+		strcat(digestLines, " ");
+		strcat(digestLines, digestValue);
+		strcat(digestLines, "\n");
+		free(digestValue);
+	}
 	
+	/* the other digests have been written out, free them */
+	uitsClearMediaDigests();
 	
+	return (digestLines);
+}
+
+/*
+ * Function: uitsCheckSignatureAlgorithm
+ * Purpose:	 Make sure this build can sign and verify with the algorithm from the command line.
+ *			 Ed25519 needs OpenSSL 1.1.1, so older builds reject it here instead of failing
+ *			 after the audio has been read.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsCheckSignatureAlgorithm (char *algorithm)
+{
+#ifndef UITS_ONE_SHOT_SIGNATURES
+	if (!strcmp(algorithm, "Ed25519")) {
+		snprintf(errStr, ERRSTR_LEN, "Error: The Ed25519 algorithm needs OpenSSL 1.1.1 or later, this build uses %s\n",
+				 OPENSSL_VERSION_TEXT);
+		uitsHandleErrorINT(payloadModuleName, "uitsCheckSignatureAlgorithm", ERROR, OK, ERR_PARAM, errStr);
+	}
+#endif
+	
+	return (OK);
 }
 
 /*
@@ -474,10 +713,48 @@ void uitsCheckRequiredParams (char *command)
 
 	if (strcmp(command, "create") == 0) {
 		
-		if (!payloadFileName) {
+		if (inPlaceFlag) {
+			if (!embedFlag || !audioFileName) {
+				snprintf(errStr, ERRSTR_LEN, 
+						 "Error: Can't %s UITS payload. In place option requires embed option and an audio file.\n", command);
+				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			}
+			if (payloadFileName && (strcmp(audioFileName, payloadFileName) != 0)) {
+				snprintf(errStr, ERRSTR_LEN, 
+						 "Error: Can't %s UITS payload. In place option selected and payload file is not the audio file.\n", command);
+				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			}
+			payloadFileName = audioFileName;	/* the audio file is updated in place */
+		}
+		if (stampListFileName) {
+			// each line of the stamp list names its own output file
+			if (!embedFlag || inPlaceFlag || !audioFileName || (strcmp(audioFileName, AUDIO_STREAM_NAME) == 0)) {
+				snprintf(errStr, ERRSTR_LEN, 
+						 "Error: Can't %s UITS payload. Stamp list requires embed option and an audio file, and can't be used in place.\n", command);
+				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			}
+			if (payloadFileName) {
+				snprintf(errStr, ERRSTR_LEN, 
+						 "Error: Can't %s UITS payload. Payload file and stamp list can't both be specified.\n", command);
+				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			}
+		} else if (!payloadFileName) {
 			snprintf(errStr, ERRSTR_LEN, "Error: Can't %s UITS payload. No payload file specified.\n", command);
 			uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
 		}
+		if (audioFileName && (strcmp(audioFileName, AUDIO_STREAM_NAME) == 0)) {
+			// the audio can only be read once, so the payload has to be complete before it is read
+			if (!embedFlag || inPlaceFlag) {
+				snprintf(errStr, ERRSTR_LEN, 
+						 "Error: Can't %s UITS payload. Audio from standard input requires embed option and can't be updated in place.\n", command);
+				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			}
+			if (!clMediaHashValue) {
+				snprintf(errStr, ERRSTR_LEN, 
+						 "Error: Can't %s UITS payload. Audio from standard input requires the media hash value (--hash).\n", command);
+				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			}
+		}
 		if (!audioFileName) {
 			// if there is no audio file we cannot embed the hash
 			if (embedFlag) {
@@ -493,7 +770,7 @@ void uitsCheckRequiredParams (char *command)
 				
 			}
 		} else {
-			if (strcmp(audioFileName, payloadFileName) == 0) {
+			if (!inPlaceFlag && payloadFileName && (strcmp(audioFileName, payloadFileName) == 0) && (strcmp(audioFileName, AUDIO_STREAM_NAME) != 0)) {
 				snprintf(errStr, ERRSTR_LEN, 
 						 "Error: Can't %s UITS payload. Payload file must have different name than audio file.\n", command);
 				uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
@@ -527,7 +804,7 @@ void uitsCheckRequiredParams (char *command)
 					 "Error: Can't %s UITS payload. No algorithm specified.\n", command);
 			uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
 		}
-		if (!uitsSignatureDesc->pubKeyFileName) {
+		if (verifyLevel >= VERIFY_LEVEL_SIGNATURE && !uitsSignatureDesc->pubKeyFileName) {
 			snprintf(errStr, ERRSTR_LEN, 
 					 "Error: Can't %s UITS payload. No public key file specified.\n", command);
 			uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
@@ -542,20 +819,27 @@ void uitsCheckRequiredParams (char *command)
 		 * the command line
 		 */
 		 
-		 if (!audioFileName) {
+		 if (verifyListFileName) {
+			 /* each file in the list is verified against its own payload and media hash */
+			 if (audioFileName || payloadFileName || clMediaHashValue || mediaHashFileName) {
+				 snprintf(errStr, ERRSTR_LEN, 
+						  "Error: Can't %s UITS payload. A verify list can't be used with an input, payload or reference media hash.\n", command);
+				 uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
+			 }
+		 } else if (!audioFileName) {
 			 if (!payloadFileName) { /* no audio file and no payload file. nothing to verify */
 				 snprintf(errStr, ERRSTR_LEN, 
 						  "Error: Can't %s UITS payload.  No payload or audio file specified for verification.\n", command);
 				 uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
 			 }
-			 if (!mediaHashNoVerifyFlag && !clMediaHashValue && !mediaHashFileName) {
+			 if (verifyLevel == VERIFY_LEVEL_FULL && !clMediaHashValue && !mediaHashFileName) {
 				 snprintf(errStr, ERRSTR_LEN, 
 						  "Error: Can't %s UITS payload. No audio file or media hash specified.\n", command);
 				 uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
 			 }
 		 } else {
 
-			 if (!mediaHashNoVerifyFlag && (clMediaHashValue && mediaHashFileName)) {
+			 if (verifyLevel == VERIFY_LEVEL_FULL && (clMediaHashValue && mediaHashFileName)) {
 				 snprintf(errStr, ERRSTR_LEN, 
 						  "Error: Can't %s UITS payload. Multiple reference media hashes specified. Please provide either command line value or file.", 
 						  command);
@@ -605,7 +889,15 @@ void uitsCheckRequiredParams (char *command)
 	}
 
 	if (strcmp(command, "genhash") == 0) {
-		if (!audioFileName) {
+		if (hashListFileName && audioFileName) {
+			uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM,
+							   "Error: Can't generate media hash, specify an audio file or a list, not both\n");
+		}
+		if (hashListFileName && uitsGetMediaDigestNames()) {
+			uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM,
+							   "Error: Can't create other digests for a list of audio files\n");
+		}
+		if (!audioFileName && !hashListFileName) {
 			snprintf(errStr, ERRSTR_LEN, 
 					 "Error: Can't generate media hash, no audio file specified\n", command);
 			uitsHandleErrorINT(payloadModuleName, "uitsCheckRequiredParams", ERROR, OK, ERR_PARAM, errStr);
@@ -686,23 +978,41 @@ int  uitsVerifyMediaHash (char *mediaHash)
 /*
  *
  * Function: uitsCompareMediaHash ()
+ * Purpose:	 Compare a reference media hash to a payload media hash (see uitsMatchMediaHash)
+ * Returns:  OK or exit on error
+ */
+
+int uitsCompareMediaHash (char *calculatedMediaHashValue, char *mediaHashValue) 
+{
+	err = uitsMatchMediaHash(calculatedMediaHashValue, mediaHashValue);
+	uitsHandleErrorINT(payloadModuleName, "uitsCompareMediaHash", err, OK, ERR_HASH,
+					   "Error: Media hash in payload does not match reference media hash\n");
+	
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsMatchMediaHash ()
  * Purpose:	 Compare a reference media hash to a payload media hash
  *               1. Check if they match exactly (SUCCESS)
  *               2. Check if the payload hash is base-64 encoded (SUCCESS with warning)
  *               3. Check if they only differ in case (SUCCESS with warning)
- * Returns:  OK or exit on error
+ *			 Neither value is changed, so verification threads can call this.
+ * Returns:  OK or ERROR if they don't match
  */
 
-int uitsCompareMediaHash (char *calculatedMediaHashValue, char *mediaHashValue) 
+int uitsMatchMediaHash (char *calculatedMediaHashValue, char *mediaHashValue) 
 {
-	unsigned char *b64CalculatedMediaHashValue;
-	char *lowerCaseMediaHashValue;
-	int b64HasNewlines;
-	int i;
+	char	b64Buffer [BASE64_BUFFER_SIZE];
+	char	*b64CalculatedMediaHashValue = b64Buffer;
+	size_t	calculatedLength;
+	size_t	b64Length;
+	int		b64HasNewlines;
+	int		result;
 	
 	// compare the strings
-	err = strcmp(mediaHashValue, calculatedMediaHashValue);
-	if (err == OK) {
+	if (strcmp(mediaHashValue, calculatedMediaHashValue) == 0) {
 		return(OK);
 	}
 	
@@ -714,38 +1024,37 @@ int uitsCompareMediaHash (char *calculatedMediaHashValue, char *mediaHashValue)
 		b64HasNewlines = TRUE;
 	}		
 	
-	b64CalculatedMediaHashValue = uitsBase64Encode(calculatedMediaHashValue, strlen(calculatedMediaHashValue), b64HasNewlines);
-	
-	err = strcmp(mediaHashValue, b64CalculatedMediaHashValue);
-	if (err == OK) {
+	calculatedLength = strlen(calculatedMediaHashValue);
+	b64Length		 = uitsBase64EncodedLength(calculatedLength, b64HasNewlines);
+	if (b64Length != strlen(mediaHashValue)) {
+		result = ERROR;
+	} else {
+		if (b64Length >= BASE64_BUFFER_SIZE) {
+			b64CalculatedMediaHashValue = malloc(b64Length + 1);
+			uitsHandleErrorPTR(payloadModuleName, "uitsMatchMediaHash", b64CalculatedMediaHashValue, ERR_HASH,
+							   "Error: Couldn't allocate base 64 buffer\n");
+		}
+		uitsBase64EncodeBuffer((unsigned char *) calculatedMediaHashValue, calculatedLength,
+							   b64CalculatedMediaHashValue, b64HasNewlines);
+		
+		result = strcmp(mediaHashValue, b64CalculatedMediaHashValue);
+		if (b64CalculatedMediaHashValue != b64Buffer) {
+			free(b64CalculatedMediaHashValue);
+		}
+	}
+	if (result == OK) {
 		vprintf ("Warning: Media hash in payload is base 64 encoded\n");
 		return(OK);
 	}
 	
 	// not base64, see if the values only differ in case
 	
-	lowerCaseMediaHashValue = strdup(mediaHashValue);
-	for (i=0; lowerCaseMediaHashValue[i] != '\0'; i++) { 
-		lowerCaseMediaHashValue[i] = tolower(lowerCaseMediaHashValue[i]);
-	}
-	
-	for (i=0; calculatedMediaHashValue[i] != '\0'; i++) {
-		calculatedMediaHashValue[i] =  tolower(calculatedMediaHashValue[i]);
-	}
-	
-	err = strcmp(lowerCaseMediaHashValue, calculatedMediaHashValue);
-	if (err == OK) {
+	if (strcasecmp(mediaHashValue, calculatedMediaHashValue) == 0) {
 		vprintf ("Warning: Media hash in payload has different case than calculated media hash.\n");
 		return(OK);
 	}
 	
-	// couldn't match error out
-	
-	uitsHandleErrorINT(payloadModuleName, "uitsCompareMediaHash", err, OK, ERR_HASH,
-					   "Error: Media hash in payload does not match reference media hash\n");
-	
-	/* The next line will never get executed, but include it to get rid of compiler warning */
-	return (err);
+	return (ERROR);
 }
 
 
@@ -882,6 +1191,26 @@ int	 uitsSetIOFileName (int fileType, char *name)
 			outputFileName= name;
 			break;
 			
+		case STAMPLIST:
+			stampListFileName = name;
+			break;
+			
+		case HASHCACHE:
+			uitsHashCacheOpen(name);
+			break;
+			
+		case HASHLIST:
+			hashListFileName = name;
+			break;
+			
+		case VERIFYLIST:
+			verifyListFileName = name;
+			break;
+			
+		case VERIFYCACHE:
+			uitsVerifyCacheOpen(name);
+			break;
+			
 		default:
 			snprintf(errStr, ERRSTR_LEN, "Error uitsSetIOFileName: Invalid fileType value=%d\n", fileType);
 			uitsHandleErrorINT(payloadModuleName, "uitsSetIOFileName", ERROR, OK, ERR_VALUE, errStr);
@@ -915,6 +1244,29 @@ void uitsSetCommandLineParam (char *paramName, int paramValue)
 	vprintf("Warning: tried to set non-existent parameter: %s value %d\n", paramName, paramValue);
 }
 
+/*
+ *
+ *  Function: uitsGetVerifyLevel
+ *  Purpose:  Look up the value of a verification level name
+ *  Returns:  One of uitsVerifyLevels or exit on error
+ */
+
+int uitsGetVerifyLevel (char *levelName) 
+{
+	UITS_verify_level *verifyLevelPtr;
+	
+	for (verifyLevelPtr = verifyLevels; verifyLevelPtr->name; verifyLevelPtr++) {
+		if (strcmp(verifyLevelPtr->name, levelName) == 0) {
+			return (verifyLevelPtr->level);
+		}
+	}
+	
+	snprintf(errStr, ERRSTR_LEN, "Error: Unknown verification level %s. Use structure, signature, schema or full\n", levelName);
+	uitsHandleErrorINT(payloadModuleName, "uitsGetVerifyLevel", ERROR, OK, ERR_PARAM, errStr);
+	
+	return (ERROR);
+}
+
 /*
  *
  *  Function: uitsSetCLMediaHashValue
@@ -928,24 +1280,38 @@ void uitsSetCLMediaHashValue (char *mediaHashValue)
 }
 
 char *uitsGetUTCTime() 
+{
+	char *utcTime;
+	
+	utcTime = calloc(UITS_UTC_TIME_SIZE, 1);
+	
+	uitsFormatUTCTime(utcTime);
+	
+	return	(utcTime);
+}
+
+/*
+ *
+ * Function: uitsFormatUTCTime
+ * Purpose:	 Format the current time as a UTC xs:dateTime value
+ *			 utcTime must hold UITS_UTC_TIME_SIZE bytes
+ *
+ */
+
+void uitsFormatUTCTime(char *utcTime) 
 {
 	struct tm *tm_utcTime = NULL;
 	time_t t;
-	char *utcTime;
 	
 	t = time(NULL);
 	
 	/* convert to UTC */
 	tm_utcTime = gmtime(&t);
 	
-	utcTime = calloc(UITS_UTC_TIME_SIZE, 1);
-	
 	/* format the time */
 	strftime(utcTime, UITS_UTC_TIME_SIZE, "%FT%TZ", tm_utcTime);
 	
 	dprintf("UTC time and date: %s\n", utcTime);	
-	
-	return	(utcTime);
 }
 	
 // EOF
@@ -18,6 +18,7 @@
 #  define _uitspayloadmanager_h_
 
 #define UITS_UTC_TIME_SIZE 128
+#define HASH_LIST_LINE_SIZE 4096
 
 /*
  * UITS metadata element and attribute structure definition
@@ -49,6 +50,23 @@ typedef struct {
 	int  *paramValue;
 } UITS_command_line_params;
 
+/*
+ * How far to verify a payload. Each level includes the ones before it, which are
+ * the cheaper checks.
+ */
+
+enum uitsVerifyLevels {
+	VERIFY_LEVEL_STRUCTURE = 1,		/* the metadata and signature values can be read */
+	VERIFY_LEVEL_SIGNATURE,			/* the signature is good */
+	VERIFY_LEVEL_SCHEMA,			/* the payload is valid against the schema */
+	VERIFY_LEVEL_FULL				/* the media hash matches the audio */
+};
+
+typedef struct {
+	int  level;
+	char *name;
+} UITS_verify_level;
+
 // UITS Payload IO File Types
 enum uitsIOFileTypes {
 	AUDIO,
@@ -56,7 +74,12 @@ enum uitsIOFileTypes {
 	PAYLOAD,
 	UITS_XSD,
 	MEDIAHASH,
-	OUTPUT
+	OUTPUT,
+	STAMPLIST,
+	HASHCACHE,
+	HASHLIST,
+	VERIFYLIST,
+	VERIFYCACHE
 };
 
 
@@ -71,6 +94,8 @@ int uitsVerify (void);										// verify a UITS payload (standalone file or emb
 int uitsExtract (void);										// extract a UITS payload from an audio file
 int uitsGenKey  (void);										// generate a KeyID from a public key file 
 int uitsGenHash (void);										// generate media hash for an audio file
+int uitsGenHashList (char *listFileName);					// generate media hashes for a list of audio files
+char *uitsGenHashDigestLines (char **digestNames, char *mediaHash);	// format the media hash and other digests for output
 
 UITS_element		*uitsGetMetadataDesc(void);
 UITS_signature_desc *uitsGetSignatureDesc(void);
@@ -82,15 +107,19 @@ int  uitsSetSignatureParamValue (char *name, char *value);
 int	 uitsSetIOFileName (int fileType, char *name);				// set the name of one of the IO files for the payload
 																// possible types in uitsIOFileTypes enum
 void uitsSetCommandLineParam (char *paramName, int paramValue); 
+int  uitsGetVerifyLevel (char *levelName);					// look up the value of the --level option
 
 int uitsVerifyPayloadFile (void); 
 
 void uitsCheckRequiredParams (char *command);
+int  uitsCheckSignatureAlgorithm (char *algorithm);
 
 void uitsSetCLMediaHashValue (char *mediaHashValue);
 int  uitsCompareMediaHash (char *calculatedMediaHashValue, char *mediaHashValue); 
+int  uitsMatchMediaHash (char *calculatedMediaHashValue, char *mediaHashValue);
 int  uitsVerifyMediaHash (char *mediaHash);
 char *uitsGetUTCTime(void);
+void uitsFormatUTCTime(char *utcTime);
 
 
 #endif
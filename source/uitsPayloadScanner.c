@@ -0,0 +1,532 @@
+/*
+ *  uitsPayloadScanner.c
+ *  UITS_Tool
+ *
+ *  Forward scan of a payload for the values that verification needs: the byte span
+ *  of the signed metadata element, the Media hash and its algorithm, and the
+ *  signature with its algorithm and keyID. The payload can be passed in pieces of
+ *  any size, and the metadata bytes are handed to a callback as soon as they are
+ *  read. No tree is built.
+ *
+ *  The scanner expects well-formed XML and doesn't check it, so the payload should
+ *  also be validated against the schema.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *payloadScannerModuleName = "uitsPayloadScanner.c";
+
+/*
+ *
+ * Function: uitsPayloadScannerCreate
+ * Purpose:	 Create a scanner for one payload
+ * Returns:  Pointer to the scanner or exit on error
+ *
+ */
+
+UITS_PAYLOAD_SCANNER *uitsPayloadScannerCreate (payloadScannerMetadataCB *metadataCB, void *metadataContext)
+{
+	UITS_PAYLOAD_SCANNER *scanner;
+
+	scanner = calloc(1, sizeof(UITS_PAYLOAD_SCANNER));
+	uitsHandleErrorPTR(payloadScannerModuleName, "uitsPayloadScannerCreate", scanner, ERR_PAYLOAD,
+					   "Couldn't allocate payload scanner\n");
+
+	scanner->state			 = SCANNER_TEXT;
+	scanner->captureField	 = SCANNER_CAPTURE_NONE;
+	scanner->metadataState	 = SCANNER_METADATA_BEFORE;
+	scanner->metadataCB		 = metadataCB;
+	scanner->metadataContext = metadataContext;
+
+	return (scanner);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerFeed
+ * Purpose:	 Scan the next piece of the payload. Text is skipped a run at a time, and
+ *			 markup is collected until it is complete, so pieces can end anywhere.
+ * Returns:  OK, or ERROR if the payload isn't shaped like XML
+ *
+ */
+
+int uitsPayloadScannerFeed (UITS_PAYLOAD_SCANNER *scanner, const char *bytes, size_t length)
+{
+	const char	*position = bytes;
+	const char	*end = bytes + length;
+	const char	*textEnd;
+	const char	*runStart = NULL;		/* start of metadata bytes not yet passed to the callback */
+	int			previousMetadataState;
+	char		c;
+
+	if (scanner->metadataState == SCANNER_METADATA_IN) {
+		runStart = bytes;
+	}
+
+	while (position < end) {
+		if (scanner->state == SCANNER_TEXT) {
+			textEnd = memchr(position, '<', end - position);
+			if (!textEnd) {
+				textEnd = end;
+			}
+			if (scanner->captureField != SCANNER_CAPTURE_NONE) {
+				uitsPayloadScannerAppend(&scanner->text, position, textEnd - position);
+			}
+			scanner->offset += textEnd - position;
+			position = textEnd;
+
+			if (position < end) {
+				scanner->state		 = SCANNER_MARKUP;
+				scanner->quote		 = 0;
+				scanner->markupStart = scanner->offset;
+				scanner->markup.length = 0;
+			}
+			continue;
+		}
+
+		c = *position++;
+		scanner->offset++;
+		uitsPayloadScannerAppend(&scanner->markup, &c, 1);
+
+		/* quoted attribute values in tags can hold '>' */
+		if (scanner->quote) {
+			if (c == scanner->quote) {
+				scanner->quote = 0;
+			}
+			continue;
+		}
+		if ((c == '"' || c == '\'') && scanner->markup.bytes[1] != '!' && scanner->markup.bytes[1] != '?') {
+			scanner->quote = c;
+			continue;
+		}
+		if (c != '>' || !uitsPayloadScannerMarkupDone(scanner)) {
+			continue;
+		}
+
+		scanner->state = SCANNER_TEXT;
+		previousMetadataState = scanner->metadataState;
+
+		if (uitsPayloadScannerMarkup(scanner) != OK) {
+			return (ERROR);
+		}
+
+		/* the start tag may have begun in an earlier piece, so pass it from the markup buffer */
+		if (previousMetadataState == SCANNER_METADATA_BEFORE && scanner->metadataState != SCANNER_METADATA_BEFORE) {
+			uitsPayloadScannerPutMetadata(scanner, scanner->markup.bytes, scanner->markup.length);
+			runStart = position;
+		}
+		if (scanner->metadataState == SCANNER_METADATA_DONE && runStart) {
+			if (previousMetadataState == SCANNER_METADATA_IN) {
+				uitsPayloadScannerPutMetadata(scanner, runStart, position - runStart);
+			}
+			runStart = NULL;
+		}
+	}
+
+	if (runStart && position > runStart) {
+		uitsPayloadScannerPutMetadata(scanner, runStart, position - runStart);
+	}
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerFinish
+ * Purpose:	 Check that the whole payload has been scanned
+ * Returns:  OK, or ERROR if markup or elements are still open or there was no metadata element
+ *
+ */
+
+int uitsPayloadScannerFinish (UITS_PAYLOAD_SCANNER *scanner)
+{
+	if (scanner->state != SCANNER_TEXT || scanner->depth != 0) {
+		return (ERROR);
+	}
+
+	if (scanner->metadataState != SCANNER_METADATA_DONE) {
+		return (ERROR);
+	}
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerFree
+ * Purpose:	 Free a scanner and the values it found
+ *
+ */
+
+void uitsPayloadScannerFree (UITS_PAYLOAD_SCANNER *scanner)
+{
+	if (!scanner) {
+		return;
+	}
+
+	free(scanner->markup.bytes);
+	free(scanner->text.bytes);
+	free(scanner->mediaValue);
+	free(scanner->mediaAlgorithm);
+	free(scanner->signatureValue);
+	free(scanner->signatureAlgorithm);
+	free(scanner->signatureKeyID);
+	free(scanner);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerMarkupDone
+ * Purpose:	 Check whether the '>' just read ends the markup. Comments, CDATA sections
+ *			 and processing instructions end with their own delimiters.
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsPayloadScannerMarkupDone (UITS_PAYLOAD_SCANNER *scanner)
+{
+	char	*markup = scanner->markup.bytes;
+	size_t	length = scanner->markup.length;
+
+	if (!strncmp(markup, "<!--", 4)) {
+		return (length >= 7 && !strcmp(markup + length - 3, "-->"));
+	}
+
+	if (!strncmp(markup, "<![CDATA[", 9)) {
+		return (length >= 12 && !strcmp(markup + length - 3, "]]>"));
+	}
+
+	if (!strncmp(markup, "<?", 2)) {
+		return (length >= 4 && markup[length - 2] == '?');
+	}
+
+	return (TRUE);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerMarkup
+ * Purpose:	 Handle a complete piece of markup: track the element depth, the metadata
+ *			 element, and the text of the Media and signature elements
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsPayloadScannerMarkup (UITS_PAYLOAD_SCANNER *scanner)
+{
+	char		*markup = scanner->markup.bytes;
+	size_t		length = scanner->markup.length;
+	size_t		nameLength;
+	const char	*cdata;
+	size_t		cdataLength;
+
+	/* CDATA is part of the text. Escape it so that it survives decoding. */
+	if (!strncmp(markup, "<![CDATA[", 9)) {
+		if (scanner->captureField != SCANNER_CAPTURE_NONE) {
+			cdata = markup + 9;
+			cdataLength = length - 12;
+			while (cdataLength > 0) {
+				nameLength = strcspn(cdata, "&<");
+				if (nameLength > cdataLength) {
+					nameLength = cdataLength;
+				}
+				uitsPayloadScannerAppend(&scanner->text, cdata, nameLength);
+				cdata += nameLength;
+				cdataLength -= nameLength;
+				if (cdataLength > 0) {
+					uitsPayloadScannerAppend(&scanner->text, *cdata == '&' ? "&amp;" : "&lt;", *cdata == '&' ? 5 : 4);
+					cdata++;
+					cdataLength--;
+				}
+			}
+		}
+		return (OK);
+	}
+
+	/* comments, processing instructions and declarations */
+	if (markup[1] == '!' || markup[1] == '?') {
+		return (OK);
+	}
+
+	if (markup[1] == '/') {
+		if (scanner->depth == 0) {
+			return (ERROR);
+		}
+
+		if (scanner->captureField != SCANNER_CAPTURE_NONE && scanner->depth == scanner->captureDepth) {
+			if (scanner->captureField == SCANNER_CAPTURE_MEDIA) {
+				scanner->mediaValue = uitsPayloadScannerDecode(scanner->text.bytes, scanner->text.length);
+			} else {
+				scanner->signatureValue = uitsPayloadScannerDecode(scanner->text.bytes, scanner->text.length);
+			}
+			scanner->captureField = SCANNER_CAPTURE_NONE;
+		}
+
+		if (scanner->metadataState == SCANNER_METADATA_IN && scanner->depth == scanner->metadataDepth) {
+			scanner->metadataState = SCANNER_METADATA_DONE;
+			scanner->metadataEnd   = scanner->offset;
+		}
+
+		scanner->depth--;
+		return (OK);
+	}
+
+	nameLength = strcspn(markup + 1, " \t\r\n/>");
+	if (nameLength == 0) {
+		return (ERROR);
+	}
+
+	return (uitsPayloadScannerStartTag(scanner, markup + 1, nameLength, markup[length - 2] == '/'));
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerStartTag
+ * Purpose:	 Handle a start tag or an empty element tag. Only the first metadata, Media
+ *			 and signature elements are looked at.
+ * Returns:  OK
+ *
+ */
+
+int uitsPayloadScannerStartTag (UITS_PAYLOAD_SCANNER *scanner, const char *name, size_t nameLength, int emptyFlag)
+{
+	int captureField = SCANNER_CAPTURE_NONE;
+
+	if (scanner->metadataState == SCANNER_METADATA_BEFORE && uitsPayloadScannerNameIs(name, nameLength, "metadata")) {
+		scanner->metadataStart = scanner->markupStart;
+		if (emptyFlag) {
+			scanner->metadataState = SCANNER_METADATA_DONE;
+			scanner->metadataEnd   = scanner->offset;
+		} else {
+			scanner->metadataState = SCANNER_METADATA_IN;
+			scanner->metadataDepth = scanner->depth + 1;
+		}
+	}
+
+	if (scanner->captureField == SCANNER_CAPTURE_NONE) {
+		if (!scanner->mediaValue && uitsPayloadScannerNameIs(name, nameLength, "Media")) {
+			scanner->mediaAlgorithm = uitsPayloadScannerGetAttribute(scanner, "algorithm");
+			captureField = SCANNER_CAPTURE_MEDIA;
+		} else if (!scanner->signatureValue && uitsPayloadScannerNameIs(name, nameLength, "signature")) {
+			scanner->signatureAlgorithm = uitsPayloadScannerGetAttribute(scanner, "algorithm");
+			scanner->signatureKeyID		= uitsPayloadScannerGetAttribute(scanner, "keyID");
+			captureField = SCANNER_CAPTURE_SIGNATURE;
+		}
+	}
+
+	if (captureField != SCANNER_CAPTURE_NONE) {
+		if (emptyFlag) {
+			if (captureField == SCANNER_CAPTURE_MEDIA) {
+				scanner->mediaValue = uitsPayloadScannerDecode("", 0);
+			} else {
+				scanner->signatureValue = uitsPayloadScannerDecode("", 0);
+			}
+		} else {
+			scanner->captureField = captureField;
+			scanner->captureDepth = scanner->depth + 1;
+			scanner->text.length  = 0;
+		}
+	}
+
+	if (!emptyFlag) {
+		scanner->depth++;
+	}
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerGetAttribute
+ * Purpose:	 Find an attribute of the start tag in the markup buffer
+ * Returns:  Decoded copy of the value, or NULL if the tag doesn't have the attribute
+ *
+ */
+
+char *uitsPayloadScannerGetAttribute (UITS_PAYLOAD_SCANNER *scanner, const char *name)
+{
+	const char	*position = scanner->markup.bytes + 1;
+	const char	*attributeName;
+	size_t		nameLength;
+	const char	*value;
+	char		quote;
+
+	/* skip the element name */
+	position += strcspn(position, " \t\r\n/>");
+
+	while (*position) {
+		position += strspn(position, " \t\r\n");
+		attributeName = position;
+		nameLength = strcspn(position, " \t\r\n=/>");
+		if (nameLength == 0) {
+			return (NULL);
+		}
+		position += nameLength;
+		position += strspn(position, " \t\r\n");
+		if (*position != '=') {
+			return (NULL);
+		}
+		position++;
+		position += strspn(position, " \t\r\n");
+		quote = *position;
+		if (quote != '"' && quote != '\'') {
+			return (NULL);
+		}
+		value = ++position;
+		position = strchr(value, quote);
+		if (!position) {
+			return (NULL);
+		}
+		if (uitsPayloadScannerNameIs(attributeName, nameLength, name)) {
+			return (uitsPayloadScannerDecode(value, position - value));
+		}
+		position++;
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerPutMetadata
+ * Purpose:	 Pass metadata bytes to the callback
+ *
+ */
+
+void uitsPayloadScannerPutMetadata (UITS_PAYLOAD_SCANNER *scanner, const char *bytes, size_t length)
+{
+	if (scanner->metadataCB && length > 0) {
+		scanner->metadataCB(scanner->metadataContext, bytes, length);
+	}
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerNameIs
+ * Purpose:	 Compare the local part of an element or attribute name
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsPayloadScannerNameIs (const char *name, size_t nameLength, const char *expectedName)
+{
+	const char *colon = memchr(name, ':', nameLength);
+
+	if (colon) {
+		nameLength -= colon + 1 - name;
+		name = colon + 1;
+	}
+
+	return (nameLength == strlen(expectedName) && !strncmp(name, expectedName, nameLength));
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerAppend
+ * Purpose:	 Add bytes to a buffer, which is kept null-terminated
+ *
+ */
+
+void uitsPayloadScannerAppend (UITS_SCANNER_BUFFER *buffer, const char *bytes, size_t length)
+{
+	if (buffer->length + length + 1 > buffer->size) {
+		if (buffer->size == 0) {
+			buffer->size = PAYLOAD_SCANNER_BUFFER_SIZE;
+		}
+		while (buffer->length + length + 1 > buffer->size) {
+			buffer->size *= 2;
+		}
+		buffer->bytes = realloc(buffer->bytes, buffer->size);
+		uitsHandleErrorPTR(payloadScannerModuleName, "uitsPayloadScannerAppend", buffer->bytes, ERR_PAYLOAD,
+						   "Couldn't allocate payload scanner buffer\n");
+	}
+
+	memcpy(buffer->bytes + buffer->length, bytes, length);
+	buffer->length += length;
+	buffer->bytes[buffer->length] = '\0';
+}
+
+/*
+ *
+ * Function: uitsPayloadScannerDecode
+ * Purpose:	 Copy text, replacing the predefined entities and character references.
+ *			 Anything else after a '&' is copied as it is.
+ * Returns:  Pointer to the copy or exit on error
+ *
+ */
+
+char *uitsPayloadScannerDecode (const char *bytes, size_t length)
+{
+	char			*decoded;
+	char			*out;
+	const char		*end = bytes + length;
+	const char		*semicolon;
+	unsigned long	code;
+	char			*codeEnd;
+
+	/* references are never shorter than what they stand for */
+	decoded = calloc(length + 1, 1);
+	uitsHandleErrorPTR(payloadScannerModuleName, "uitsPayloadScannerDecode", decoded, ERR_PAYLOAD,
+					   "Couldn't allocate payload value\n");
+	out = decoded;
+
+	while (bytes < end) {
+		semicolon = (*bytes == '&') ? memchr(bytes, ';', end - bytes) : NULL;
+		if (!semicolon) {
+			*out++ = *bytes++;
+			continue;
+		}
+
+		if (!strncmp(bytes, "&amp;", 5)) {
+			*out++ = '&';
+		} else if (!strncmp(bytes, "&lt;", 4)) {
+			*out++ = '<';
+		} else if (!strncmp(bytes, "&gt;", 4)) {
+			*out++ = '>';
+		} else if (!strncmp(bytes, "&quot;", 6)) {
+			*out++ = '"';
+		} else if (!strncmp(bytes, "&apos;", 6)) {
+			*out++ = '\'';
+		} else if (bytes[1] == '#') {
+			if (bytes[2] == 'x') {
+				code = strtoul(bytes + 3, &codeEnd, 16);
+			} else {
+				code = strtoul(bytes + 2, &codeEnd, 10);
+			}
+			if (codeEnd != semicolon || code > 0x10FFFF) {
+				*out++ = *bytes++;
+				continue;
+			}
+			/* write the character as UTF-8 */
+			if (code < 0x80) {
+				*out++ = (char) code;
+			} else if (code < 0x800) {
+				*out++ = (char) (0xC0 | (code >> 6));
+				*out++ = (char) (0x80 | (code & 0x3F));
+			} else if (code < 0x10000) {
+				*out++ = (char) (0xE0 | (code >> 12));
+				*out++ = (char) (0x80 | ((code >> 6) & 0x3F));
+				*out++ = (char) (0x80 | (code & 0x3F));
+			} else {
+				*out++ = (char) (0xF0 | (code >> 18));
+				*out++ = (char) (0x80 | ((code >> 12) & 0x3F));
+				*out++ = (char) (0x80 | ((code >> 6) & 0x3F));
+				*out++ = (char) (0x80 | (code & 0x3F));
+			}
+		} else {
+			*out++ = *bytes++;
+			continue;
+		}
+		bytes = semicolon + 1;
+	}
+
+	return (decoded);
+}
+
+// EOF
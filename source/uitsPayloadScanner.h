@@ -0,0 +1,114 @@
+/*
+ *  uitsPayloadScanner.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitspayloadscanner_h_
+#  define _uitspayloadscanner_h_
+
+#define PAYLOAD_SCANNER_BUFFER_SIZE		1024	/* first size of the markup and text buffers */
+
+/*
+ * Scanner states
+ */
+enum uitsPayloadScannerStates {
+	SCANNER_TEXT,			/* between markup */
+	SCANNER_MARKUP			/* from a '<' to the '>' that ends the markup */
+};
+
+enum uitsPayloadScannerMetadataStates {
+	SCANNER_METADATA_BEFORE,
+	SCANNER_METADATA_IN,
+	SCANNER_METADATA_DONE
+};
+
+/*
+ * Element whose text is being collected
+ */
+enum uitsPayloadScannerCaptures {
+	SCANNER_CAPTURE_NONE,
+	SCANNER_CAPTURE_MEDIA,
+	SCANNER_CAPTURE_SIGNATURE
+};
+
+/*
+ * Called with each piece of the metadata element as it is read, so that the
+ * signed bytes can be digested without waiting for the rest of the payload
+ */
+
+typedef void payloadScannerMetadataCB (void *context, const char *bytes, size_t length);
+
+/*
+ * Growable buffer, kept null-terminated
+ */
+
+typedef struct {
+	char	*bytes;
+	size_t	length;
+	size_t	size;
+} UITS_SCANNER_BUFFER;
+
+/*
+ * State of a forward pass over a payload, and the values it found. Values are
+ * NULL until they are found, and have their character and entity references replaced.
+ */
+
+typedef struct {
+	int							state;
+	char						quote;				/* quote character of an open attribute value, or 0 */
+	UITS_SCANNER_BUFFER			markup;				/* markup being read */
+	size_t						markupStart;		/* offset of the markup's '<' */
+	UITS_SCANNER_BUFFER			text;				/* text of the captured element */
+	int							captureField;
+	int							captureDepth;
+	int							depth;				/* number of open elements */
+	int							metadataState;
+	int							metadataDepth;
+	size_t						offset;				/* number of bytes read */
+	size_t						metadataStart;		/* byte span of the metadata element */
+	size_t						metadataEnd;
+	char						*mediaValue;
+	char						*mediaAlgorithm;
+	char						*signatureValue;
+	char						*signatureAlgorithm;
+	char						*signatureKeyID;
+	payloadScannerMetadataCB	*metadataCB;		/* may be NULL */
+	void						*metadataContext;
+} UITS_PAYLOAD_SCANNER;
+
+/*
+ * PUBLIC Functions
+ */
+
+UITS_PAYLOAD_SCANNER *uitsPayloadScannerCreate	(payloadScannerMetadataCB *metadataCB, void *metadataContext);
+int		uitsPayloadScannerFeed			(UITS_PAYLOAD_SCANNER *scanner, const char *bytes, size_t length);
+int		uitsPayloadScannerFinish		(UITS_PAYLOAD_SCANNER *scanner);
+void	uitsPayloadScannerFree			(UITS_PAYLOAD_SCANNER *scanner);
+
+/*
+ * PRIVATE Functions
+ */
+
+int		uitsPayloadScannerMarkupDone	(UITS_PAYLOAD_SCANNER *scanner);
+int		uitsPayloadScannerMarkup		(UITS_PAYLOAD_SCANNER *scanner);
+int		uitsPayloadScannerStartTag		(UITS_PAYLOAD_SCANNER *scanner, const char *name, size_t nameLength, int emptyFlag);
+char	*uitsPayloadScannerGetAttribute	(UITS_PAYLOAD_SCANNER *scanner, const char *name);
+void	uitsPayloadScannerPutMetadata	(UITS_PAYLOAD_SCANNER *scanner, const char *bytes, size_t length);
+int		uitsPayloadScannerNameIs		(const char *name, size_t nameLength, const char *expectedName);
+void	uitsPayloadScannerAppend		(UITS_SCANNER_BUFFER *buffer, const char *bytes, size_t length);
+char	*uitsPayloadScannerDecode		(const char *bytes, size_t length);
+
+#endif
+
+// EOF
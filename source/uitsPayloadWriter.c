@@ -0,0 +1,724 @@
+/*
+ *  uitsPayloadWriter.c
+ *  UITS_Tool
+ *
+ *  Writes a payload straight from the metadata description, without building an
+ *  mxml tree. The metadata element is written once, the signature is created from
+ *  those bytes in the buffer, and the signature element and closing tag are then
+ *  added after them. The output is the same as saving the tree made by
+ *  uitsCreatePayloadXML with mxmlSaveAllocString (no whitespace, the same
+ *  attribute order and the same escaping of & < > and ").
+ *
+ *  The writer keeps its buffer and element list between payloads, so stamping
+ *  many payloads doesn't allocate for each one.
+ *
+ *  For bulk creation, a template renders the metadata that is the same for a whole
+ *  release once (see uitsPayloadTemplateCreate). A payload is then the template's
+ *  byte segments copied into the writer's buffer, with the few values that change
+ *  (nonce, Time, AssetID, TID, UID, Media) escaped in between.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *payloadWriterModuleName = "uitsPayloadWriter.c";
+
+/* metadata elements that change for each track or download */
+char *payloadTemplateSlotNames [] = {"nonce", "Time", "AssetID", "TID", "UID", "Media", NULL};
+
+/*
+ *
+ * Function: uitsPayloadWriterCreate
+ * Purpose:	 Create a payload writer
+ * Returns:  Pointer to the writer or exit on error
+ *
+ */
+
+UITS_PAYLOAD_WRITER *uitsPayloadWriterCreate (void)
+{
+	UITS_PAYLOAD_WRITER *writer;
+
+	writer = calloc(1, sizeof(UITS_PAYLOAD_WRITER));
+	uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadWriterCreate", writer, ERR_PAYLOAD, "Couldn't allocate payload writer\n");
+
+	writer->bufferSize = PAYLOAD_WRITER_BUFFER_SIZE;
+	writer->buffer	   = malloc(writer->bufferSize);
+	uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadWriterCreate", writer->buffer, ERR_PAYLOAD,
+					   "Couldn't allocate payload buffer\n");
+
+	writer->maxElements = PAYLOAD_WRITER_NUM_ELEMENTS;
+	writer->elements	= malloc(writer->maxElements * sizeof(UITS_PAYLOAD_ELEMENT));
+	uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadWriterCreate", writer->elements, ERR_PAYLOAD,
+					   "Couldn't allocate payload element list\n");
+
+	return (writer);
+}
+
+/*
+ *
+ * Function: uitsPayloadWrite
+ * Purpose:	 Write and sign a payload for the metadata values
+ * Returns:  The payload XML, which belongs to the writer and is replaced by the next
+ *			 payload, or exit on error
+ *
+ */
+
+char *uitsPayloadWrite (UITS_PAYLOAD_WRITER *writer,
+						int xmlSchemaType,
+						UITS_element *metadataPtr,
+						UITS_signature_desc *uitsSignatureDesc)
+{
+	int i;
+
+	writer->bufferLength = 0;
+	writer->numElements	 = 0;
+
+	uitsPayloadWriterPutHeader(writer, xmlSchemaType);
+
+	/* the metadata element is signed as it is in the buffer */
+	uitsPayloadWriterAddElements(writer, metadataPtr);
+
+	writer->metadataOffset = writer->bufferLength;
+	if (writer->numElements) {
+		uitsPayloadWriterPutString(writer, "<metadata>");
+		for (i = 0; i < writer->numElements; i++) {
+			uitsPayloadWriterPutElement(writer, &writer->elements[i]);
+		}
+		uitsPayloadWriterPutString(writer, "</metadata>");
+	} else {
+		uitsPayloadWriterPutString(writer, "<metadata />");
+	}
+
+	uitsPayloadWriterPutSignature(writer, uitsSignatureDesc);
+
+	return (writer->buffer);
+}
+
+/*
+ *
+ * Function: uitsPayloadTemplateCreate
+ * Purpose:	 Render the metadata values that are the same for every payload of a release.
+ *			 The elements named in payloadTemplateSlotNames change for each payload; the
+ *			 rest of the payload up to the end of the metadata element is rendered and
+ *			 escaped once. The values of the slots in the metadata description are used
+ *			 when a payload doesn't give its own.
+ * Returns:  Pointer to the template or exit on error
+ *
+ */
+
+UITS_PAYLOAD_TEMPLATE *uitsPayloadTemplateCreate (int xmlSchemaType, UITS_element *metadataPtr)
+{
+	UITS_PAYLOAD_TEMPLATE *template;
+	UITS_PAYLOAD_WRITER	  *writer;
+	UITS_PAYLOAD_ELEMENT  *element;
+	UITS_PAYLOAD_SLOT	  *slot;
+	UITS_element		  *placeholderDesc;
+	size_t				  segmentStart;
+	int					  numElements = 0;
+	int					  i, j;
+
+	template = calloc(1, sizeof(UITS_PAYLOAD_TEMPLATE));
+	uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadTemplateCreate", template, ERR_PAYLOAD,
+					   "Couldn't allocate payload template\n");
+
+	/* give every slot a value so that its element is made; the slot elements are rendered empty */
+	while (metadataPtr[numElements].name) {
+		numElements++;
+	}
+	placeholderDesc = calloc(numElements + 1, sizeof(UITS_element));
+	uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadTemplateCreate", placeholderDesc, ERR_PAYLOAD,
+					   "Couldn't allocate payload template\n");
+
+	for (i = 0; i < numElements; i++) {
+		placeholderDesc[i] = metadataPtr[i];
+
+		for (j = 0; payloadTemplateSlotNames[j]; j++) {
+			if (strcmp(metadataPtr[i].name, payloadTemplateSlotNames[j])) {
+				continue;
+			}
+			if (metadataPtr[i].multipleFlag) {
+				snprintf(errStr, ERRSTR_LEN, "Error: Metadata element %s can't be a template slot\n", metadataPtr[i].name);
+				uitsHandleErrorINT(payloadWriterModuleName, "uitsPayloadTemplateCreate", ERROR, OK, ERR_PAYLOAD, errStr);
+			}
+			if (template->numSlots == PAYLOAD_TEMPLATE_MAX_SLOTS) {
+				uitsHandleErrorINT(payloadWriterModuleName, "uitsPayloadTemplateCreate", ERROR, OK, ERR_PAYLOAD,
+								   "Error: Too many payload template slots\n");
+			}
+			slot = &template->slots[template->numSlots++];
+			slot->name		   = metadataPtr[i].name;
+			slot->defaultValue = metadataPtr[i].value;
+			placeholderDesc[i].value = "";
+		}
+	}
+
+	/* render the payload, noting where each slot element starts, where its value goes and where it ends */
+	writer = uitsPayloadWriterCreate();
+	uitsPayloadWriterPutHeader(writer, xmlSchemaType);
+	uitsPayloadWriterAddElements(writer, placeholderDesc);
+
+	template->metadataOffset = writer->bufferLength;
+	uitsPayloadWriterPutString(writer, "<metadata>");
+
+	segmentStart = 0;
+	for (i = 0; i < writer->numElements; i++) {
+		element = &writer->elements[i];
+		slot	= uitsPayloadTemplateFindSlot(template, element->name, element->nameLength);
+
+		if (!slot) {
+			uitsPayloadWriterPutElement(writer, element);
+			continue;
+		}
+
+		template->segments[template->numSegments].offset	= segmentStart;
+		template->segments[template->numSegments].length	= writer->bufferLength - segmentStart;
+		template->segments[template->numSegments].slotIndex = slot - template->slots;
+		template->numSegments++;
+
+		slot->openTagOffset = writer->bufferLength;
+		uitsPayloadWriterPutElement(writer, element);
+		slot->closeTagOffset = writer->bufferLength - element->nameLength - 3;
+		slot->openTagLength	 = slot->closeTagOffset - slot->openTagOffset;
+		slot->closeTagLength = element->nameLength + 3;
+
+		segmentStart = writer->bufferLength;
+	}
+
+	uitsPayloadWriterPutString(writer, "</metadata>");
+	template->segments[template->numSegments].offset	= segmentStart;
+	template->segments[template->numSegments].length	= writer->bufferLength - segmentStart;
+	template->segments[template->numSegments].slotIndex = -1;
+	template->numSegments++;
+
+	/* the rendered bytes are kept, the writer isn't */
+	template->bytes = writer->buffer;
+	free(writer->elements);
+	free(writer);
+	free(placeholderDesc);
+
+	return (template);
+}
+
+/*
+ *
+ * Function: uitsPayloadTemplateGetSlot
+ * Purpose:	 Find the slot for a metadata element
+ * Returns:  Index of the slot, or ERROR if the element isn't a slot
+ *
+ */
+
+int uitsPayloadTemplateGetSlot (UITS_PAYLOAD_TEMPLATE *template, char *name)
+{
+	UITS_PAYLOAD_SLOT *slot = uitsPayloadTemplateFindSlot(template, name, strlen(name));
+
+	return (slot ? (int) (slot - template->slots) : ERROR);
+}
+
+/*
+ *
+ * Function: uitsPayloadTemplateGetValues
+ * Purpose:	 Fill in the values for a payload with the template's default values
+ *
+ */
+
+void uitsPayloadTemplateGetValues (UITS_PAYLOAD_TEMPLATE *template, char **slotValues)
+{
+	int i;
+
+	for (i = 0; i < template->numSlots; i++) {
+		slotValues[i] = template->slots[i].defaultValue;
+	}
+}
+
+/*
+ *
+ * Function: uitsPayloadWriteTemplate
+ * Purpose:	 Write and sign a payload from a template and a value for each slot. The
+ *			 element of a slot without a value is left out, except Time, which is set to
+ *			 the current time.
+ * Returns:  The payload XML, which belongs to the writer and is replaced by the next
+ *			 payload, or exit on error
+ *
+ */
+
+char *uitsPayloadWriteTemplate (UITS_PAYLOAD_WRITER *writer,
+								UITS_PAYLOAD_TEMPLATE *template,
+								char **slotValues,
+								UITS_signature_desc *uitsSignatureDesc)
+{
+	uitsPayloadWriteTemplateMetadata(writer, template, slotValues);
+
+	uitsPayloadWriterPutSignature(writer, uitsSignatureDesc);
+
+	return (writer->buffer);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriteTemplateMetadata
+ * Purpose:	 Write a payload from a template up to the end of the metadata element, so
+ *			 that it can be signed elsewhere. Finish it with uitsPayloadWriterPutSignatureValue.
+ * Returns:  The metadata element to sign, which belongs to the writer
+ *
+ */
+
+char *uitsPayloadWriteTemplateMetadata (UITS_PAYLOAD_WRITER *writer,
+										UITS_PAYLOAD_TEMPLATE *template,
+										char **slotValues)
+{
+	UITS_PAYLOAD_SEGMENT *segment;
+	UITS_PAYLOAD_SLOT	 *slot;
+	char				 *slotValue;
+	int					 i;
+
+	writer->bufferLength = 0;
+
+	for (i = 0; i < template->numSegments; i++) {
+		segment = &template->segments[i];
+		uitsPayloadWriterPut(writer, template->bytes + segment->offset, segment->length);
+
+		if (segment->slotIndex < 0) {
+			continue;
+		}
+
+		slot	  = &template->slots[segment->slotIndex];
+		slotValue = slotValues[segment->slotIndex];
+		if (!slotValue && strcmp(slot->name, "Time") == 0) {
+			uitsFormatUTCTime(writer->timeValue);
+			slotValue = writer->timeValue;
+		}
+		if (!slotValue) {
+			continue;
+		}
+
+		uitsPayloadWriterPut(writer, template->bytes + slot->openTagOffset, slot->openTagLength);
+		uitsPayloadWriterPutText(writer, slotValue, strlen(slotValue));
+		uitsPayloadWriterPut(writer, template->bytes + slot->closeTagOffset, slot->closeTagLength);
+	}
+
+	writer->metadataOffset = template->metadataOffset;
+
+	return (writer->buffer + writer->metadataOffset);
+}
+
+/*
+ *
+ * Function: uitsPayloadTemplateFree
+ * Purpose:	 Free a payload template
+ *
+ */
+
+void uitsPayloadTemplateFree (UITS_PAYLOAD_TEMPLATE *template)
+{
+	free(template->bytes);
+	free(template);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterFree
+ * Purpose:	 Free a payload writer and its buffers
+ *
+ */
+
+void uitsPayloadWriterFree (UITS_PAYLOAD_WRITER *writer)
+{
+	free(writer->buffer);
+	free(writer->elements);
+	free(writer);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutHeader
+ * Purpose:	 Write the XML declaration and the opening root element
+ *
+ */
+
+void uitsPayloadWriterPutHeader (UITS_PAYLOAD_WRITER *writer, int xmlSchemaType)
+{
+	uitsPayloadWriterPutString(writer, PAYLOAD_XML_DECLARATION "<uits:UITS");
+	uitsPayloadWriterPutAttribute(writer, "xmlns:xsi", PAYLOAD_XSI_NAMESPACE, strlen(PAYLOAD_XSI_NAMESPACE));
+
+	switch (xmlSchemaType) {
+
+		case UITS_XML:
+			uitsPayloadWriterPutAttribute(writer, "xmlns:uits", PAYLOAD_UITS_NAMESPACE, strlen(PAYLOAD_UITS_NAMESPACE));
+			break;
+
+		case CME_XML:
+			uitsPayloadWriterPutAttribute(writer, "xmlns:uits", PAYLOAD_CME_NAMESPACE, strlen(PAYLOAD_CME_NAMESPACE));
+			break;
+
+		default:
+			snprintf(errStr, ERRSTR_LEN, "Error uitsPayloadWrite: Invalid xmlSchemaType value=%d\n", xmlSchemaType);
+			uitsHandleErrorINT(payloadWriterModuleName, "uitsPayloadWriterPutHeader", ERROR, OK, ERR_VALUE, errStr);
+			break;
+	}
+	uitsPayloadWriterPutString(writer, ">");
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutSignature
+ * Purpose:	 Sign the metadata element at metadataOffset, which ends the buffer, and
+ *			 write the signature element and the closing root element
+ *
+ */
+
+void uitsPayloadWriterPutSignature (UITS_PAYLOAD_WRITER *writer, UITS_signature_desc *uitsSignatureDesc)
+{
+	unsigned char *encodedSignature;
+	char		  *signatureDigestName;
+
+	signatureDigestName = uitsGetSignatureAlgorithm(uitsSignatureDesc->algorithm)->digestName;
+
+	encodedSignature = uitsCreateSignature(writer->buffer + writer->metadataOffset,
+										   uitsSignatureDesc->privateKeyFileName,
+										   signatureDigestName,
+										   uitsSignatureDesc->b64LFFlag);
+
+	uitsPayloadWriterPutSignatureValue(writer, uitsSignatureDesc, encodedSignature);
+
+	free(encodedSignature);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutSignatureValue
+ * Purpose:	 Write the signature element with an encoded signature of the metadata
+ *			 element, and the closing root element
+ * Returns:  The payload XML, which belongs to the writer
+ *
+ */
+
+char *uitsPayloadWriterPutSignatureValue (UITS_PAYLOAD_WRITER *writer,
+										  UITS_signature_desc *uitsSignatureDesc,
+										  unsigned char *encodedSignature)
+{
+	uitsPayloadWriterPutString(writer, "<signature");
+	uitsPayloadWriterPutAttribute(writer, "algorithm", uitsSignatureDesc->algorithm, strlen(uitsSignatureDesc->algorithm));
+	uitsPayloadWriterPutAttribute(writer, "canonicalization", "none", 4);
+	uitsPayloadWriterPutAttribute(writer, "keyID", uitsSignatureDesc->pubKeyID,
+								  uitsSignatureDesc->pubKeyID ? strlen(uitsSignatureDesc->pubKeyID) : 0);
+	uitsPayloadWriterPutString(writer, ">");
+	uitsPayloadWriterPutText(writer, encodedSignature, strlen(encodedSignature));
+	uitsPayloadWriterPutString(writer, "</signature></uits:UITS>");
+
+	return (writer->buffer);
+}
+
+/*
+ *
+ * Function: uitsPayloadTemplateFindSlot
+ * Purpose:	 Find the slot for an element name
+ * Returns:  Pointer to the slot or NULL
+ *
+ */
+
+UITS_PAYLOAD_SLOT *uitsPayloadTemplateFindSlot (UITS_PAYLOAD_TEMPLATE *template, const char *name, size_t nameLength)
+{
+	int i;
+
+	for (i = 0; i < template->numSlots; i++) {
+		if (strlen(template->slots[i].name) == nameLength && !strncmp(template->slots[i].name, name, nameLength)) {
+			return (&template->slots[i]);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterAddElements
+ * Purpose:	 Make the element list for the metadata values, in the same way as
+ *			 uitsPayloadPopulateMetadata. Elements with multiple values get one element
+ *			 for each value in the comma-delimited list, and the comma-delimited
+ *			 attribute values are given to the first element with that name and the
+ *			 elements after it. The metadata values are not changed, except that Time is
+ *			 set to the current time if it has no value.
+ *
+ */
+
+void uitsPayloadWriterAddElements (UITS_PAYLOAD_WRITER *writer, UITS_element *metadataPtr)
+{
+	UITS_PAYLOAD_ELEMENT *element;
+	UITS_attributes		 *attributePtr;
+	UITS_PAYLOAD_TEXT	 token;
+	UITS_PAYLOAD_TEXT	 attributeValue;
+	const char			 *position;
+	size_t				 nameLength;
+	int					 firstElement;
+	int					 i;
+
+	while (metadataPtr->name) {
+		// TIME is treated specially. If the user hasn't specified, default to the currrent time
+		if ((strcmp(metadataPtr->name, "Time") == 0) && !metadataPtr->value) {
+			metadataPtr->value = uitsGetUTCTime();
+		}
+
+		if (!metadataPtr->value) {
+			metadataPtr++;
+			continue;
+		}
+
+		if (metadataPtr->multipleFlag) {	/* the singular name (URLS becomes URL, Extras becomes Extra) */
+			nameLength = strlen(metadataPtr->name) - 1;
+
+			position = metadataPtr->value;
+			while (uitsPayloadWriterNextToken(&position, &token)) {
+				vprintf ("\t %.*s: %.*s\n", (int) nameLength, metadataPtr->name, (int) token.length, token.start);
+				element = uitsPayloadWriterNewElement(writer, metadataPtr->name, nameLength);
+				element->value = token;
+			}
+
+			attributePtr = metadataPtr->attributes;
+			if (attributePtr) {
+				while (attributePtr->name) {
+					/* the first element with the singular name, which may be from an earlier value */
+					for (firstElement = 0; firstElement < writer->numElements; firstElement++) {
+						element = &writer->elements[firstElement];
+						if (element->nameLength == nameLength && !strncmp(element->name, metadataPtr->name, nameLength)) {
+							break;
+						}
+					}
+
+					i = firstElement;
+					position = attributePtr->value;
+					while (position && uitsPayloadWriterNextToken(&position, &attributeValue)) {
+						vprintf("\t\t %s: %.*s\n", attributePtr->name, (int) attributeValue.length, attributeValue.start);
+						if (i < writer->numElements) {
+							uitsPayloadWriterSetAttribute(&writer->elements[i++], attributePtr->name, &attributeValue);
+						}
+					}
+					attributePtr++;
+				}
+			}
+		} else {
+			vprintf ("\t %s: %s\n", metadataPtr->name, metadataPtr->value);
+			element = uitsPayloadWriterNewElement(writer, metadataPtr->name, strlen(metadataPtr->name));
+			element->value.start  = metadataPtr->value;
+			element->value.length = strlen(metadataPtr->value);
+
+			attributePtr = metadataPtr->attributes;
+			if (attributePtr) {
+				while (attributePtr->name) {
+					vprintf("\t\t %s: %s\n", attributePtr->name, attributePtr->value);
+					attributeValue.start  = attributePtr->value;
+					attributeValue.length = attributePtr->value ? strlen(attributePtr->value) : 0;
+					uitsPayloadWriterSetAttribute(element, attributePtr->name, &attributeValue);
+					attributePtr++;
+				}
+			}
+		}
+		metadataPtr++;
+	}
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterNewElement
+ * Purpose:	 Add an element to the end of the element list
+ * Returns:  Pointer to the element or exit on error
+ *
+ */
+
+UITS_PAYLOAD_ELEMENT *uitsPayloadWriterNewElement (UITS_PAYLOAD_WRITER *writer, const char *name, size_t nameLength)
+{
+	UITS_PAYLOAD_ELEMENT *element;
+
+	if (writer->numElements == writer->maxElements) {
+		writer->maxElements *= 2;
+		writer->elements = realloc(writer->elements, writer->maxElements * sizeof(UITS_PAYLOAD_ELEMENT));
+		uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadWriterNewElement", writer->elements, ERR_PAYLOAD,
+						   "Couldn't allocate payload element list\n");
+	}
+
+	element = &writer->elements[writer->numElements++];
+	element->name		   = name;
+	element->nameLength	   = nameLength;
+	element->numAttributes = 0;
+
+	return (element);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterSetAttribute
+ * Purpose:	 Set an attribute of an element. An attribute that is already set keeps its
+ *			 place and gets the new value.
+ *
+ */
+
+void uitsPayloadWriterSetAttribute (UITS_PAYLOAD_ELEMENT *element, const char *name, UITS_PAYLOAD_TEXT *value)
+{
+	int i;
+
+	for (i = 0; i < element->numAttributes; i++) {
+		if (!strcmp(element->attributeNames[i], name)) {
+			element->attributeValues[i] = *value;
+			return;
+		}
+	}
+
+	if (element->numAttributes == PAYLOAD_WRITER_MAX_ATTRIBUTES) {
+		snprintf(errStr, ERRSTR_LEN, "Error: Too many attributes for metadata element %.*s\n", (int) element->nameLength, element->name);
+		uitsHandleErrorINT(payloadWriterModuleName, "uitsPayloadWriterSetAttribute", ERROR, OK, ERR_PAYLOAD, errStr);
+	}
+
+	element->attributeNames[element->numAttributes]  = name;
+	element->attributeValues[element->numAttributes] = *value;
+	element->numAttributes++;
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterNextToken
+ * Purpose:	 Get the next value from a comma-delimited list. Empty values are skipped,
+ *			 as strtok does.
+ * Returns:  TRUE if there is a value, FALSE at the end of the list
+ *
+ */
+
+int uitsPayloadWriterNextToken (const char **position, UITS_PAYLOAD_TEXT *token)
+{
+	const char *tokenStart = *position;
+
+	while (*tokenStart == ',') {
+		tokenStart++;
+	}
+	if (!*tokenStart) {
+		*position = tokenStart;
+		return (FALSE);
+	}
+
+	token->start  = tokenStart;
+	token->length = strcspn(tokenStart, ",");
+
+	*position = tokenStart + token->length;
+
+	return (TRUE);
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutElement
+ * Purpose:	 Write one metadata element
+ *
+ */
+
+void uitsPayloadWriterPutElement (UITS_PAYLOAD_WRITER *writer, UITS_PAYLOAD_ELEMENT *element)
+{
+	int i;
+
+	uitsPayloadWriterPutString(writer, "<");
+	uitsPayloadWriterPut(writer, element->name, element->nameLength);
+	for (i = 0; i < element->numAttributes; i++) {
+		uitsPayloadWriterPutAttribute(writer, element->attributeNames[i],
+									  element->attributeValues[i].start, element->attributeValues[i].length);
+	}
+	uitsPayloadWriterPutString(writer, ">");
+
+	uitsPayloadWriterPutText(writer, element->value.start, element->value.length);
+
+	uitsPayloadWriterPutString(writer, "</");
+	uitsPayloadWriterPut(writer, element->name, element->nameLength);
+	uitsPayloadWriterPutString(writer, ">");
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutAttribute
+ * Purpose:	 Write an attribute. An attribute without a value is written as its name
+ *			 only, as mxml does.
+ *
+ */
+
+void uitsPayloadWriterPutAttribute (UITS_PAYLOAD_WRITER *writer, const char *name, const char *value, size_t valueLength)
+{
+	uitsPayloadWriterPutString(writer, " ");
+	uitsPayloadWriterPutString(writer, name);
+
+	if (value) {
+		uitsPayloadWriterPutString(writer, "=\"");
+		uitsPayloadWriterPutText(writer, value, valueLength);
+		uitsPayloadWriterPutString(writer, "\"");
+	}
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutText
+ * Purpose:	 Write element or attribute text, escaping the characters that mxml escapes
+ *
+ */
+
+void uitsPayloadWriterPutText (UITS_PAYLOAD_WRITER *writer, const char *text, size_t textLength)
+{
+	size_t runLength;
+
+	while (textLength) {
+		runLength = strcspn(text, "&<>\"");
+		if (runLength > textLength) {
+			runLength = textLength;
+		}
+		uitsPayloadWriterPut(writer, text, runLength);
+		text	   += runLength;
+		textLength -= runLength;
+
+		if (!textLength) {
+			break;
+		}
+
+		switch (*text) {
+			case '&':	uitsPayloadWriterPutString(writer, "&amp;");	break;
+			case '<':	uitsPayloadWriterPutString(writer, "&lt;");	break;
+			case '>':	uitsPayloadWriterPutString(writer, "&gt;");	break;
+			case '"':	uitsPayloadWriterPutString(writer, "&quot;");	break;
+		}
+		text++;
+		textLength--;
+	}
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPutString
+ * Purpose:	 Add a null-terminated string to the output buffer
+ *
+ */
+
+void uitsPayloadWriterPutString (UITS_PAYLOAD_WRITER *writer, const char *string)
+{
+	uitsPayloadWriterPut(writer, string, strlen(string));
+}
+
+/*
+ *
+ * Function: uitsPayloadWriterPut
+ * Purpose:	 Add bytes to the output buffer, which is always null-terminated
+ *
+ */
+
+void uitsPayloadWriterPut (UITS_PAYLOAD_WRITER *writer, const char *bytes, size_t length)
+{
+	if (writer->bufferLength + length + 1 > writer->bufferSize) {
+		while (writer->bufferLength + length + 1 > writer->bufferSize) {
+			writer->bufferSize *= 2;
+		}
+		writer->buffer = realloc(writer->buffer, writer->bufferSize);
+		uitsHandleErrorPTR(payloadWriterModuleName, "uitsPayloadWriterPut", writer->buffer, ERR_PAYLOAD,
+						   "Couldn't allocate payload buffer\n");
+	}
+
+	memcpy(writer->buffer + writer->bufferLength, bytes, length);
+	writer->bufferLength += length;
+	writer->buffer[writer->bufferLength] = '\0';
+}
+
+// EOF
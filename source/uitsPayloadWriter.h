@@ -0,0 +1,152 @@
+/*
+ *  uitsPayloadWriter.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitspayloadwriter_h_
+#  define _uitspayloadwriter_h_
+
+#define PAYLOAD_WRITER_BUFFER_SIZE		4096	/* first size of the output buffer */
+#define PAYLOAD_WRITER_NUM_ELEMENTS		32		/* first size of the element list */
+#define PAYLOAD_WRITER_MAX_ATTRIBUTES	8
+#define PAYLOAD_TEMPLATE_MAX_SLOTS		8
+
+#define PAYLOAD_XML_DECLARATION	"<?xml version=\"1.0\" encoding=\"utf-8\"?>"		/* as written by mxmlNewXML("1.0") */
+#define PAYLOAD_XSI_NAMESPACE	"http://www.w3.org/2001/XMLSchema-instance"
+#define PAYLOAD_UITS_NAMESPACE	"http://www.udirector.net/schemas/2009/uits/1.1"
+#define PAYLOAD_CME_NAMESPACE	"http://www.udirector.net/schemas/2011/cmeuits/1.2"
+
+/*
+ * Part of a metadata value. Values are not copied, comma-delimited lists are
+ * split by pointing into the value.
+ */
+
+typedef struct {
+	const char	*start;			/* NULL for an attribute without a value */
+	size_t		length;
+} UITS_PAYLOAD_TEXT;
+
+/*
+ * One element of the metadata
+ */
+
+typedef struct {
+	const char			*name;
+	size_t				nameLength;
+	UITS_PAYLOAD_TEXT	value;
+	int					numAttributes;
+	const char			*attributeNames [PAYLOAD_WRITER_MAX_ATTRIBUTES];
+	UITS_PAYLOAD_TEXT	attributeValues [PAYLOAD_WRITER_MAX_ATTRIBUTES];
+} UITS_PAYLOAD_ELEMENT;
+
+/*
+ * Output buffer and element list, reused for each payload
+ */
+
+typedef struct {
+	char				 *buffer;
+	size_t				 bufferLength;
+	size_t				 bufferSize;
+	UITS_PAYLOAD_ELEMENT *elements;
+	int					 numElements;
+	int					 maxElements;
+	size_t				 metadataOffset;	/* start of the signed <metadata> element in the buffer */
+	char				 timeValue [UITS_UTC_TIME_SIZE];	/* Time written by uitsPayloadWriteTemplate */
+} UITS_PAYLOAD_WRITER;
+
+/*
+ * A metadata element whose value changes for each payload made from a template.
+ * The open and close tags are rendered in the template's bytes.
+ */
+
+typedef struct {
+	char	*name;
+	char	*defaultValue;		/* value from the metadata description, may be NULL */
+	size_t	openTagOffset;		/* "<name attr=...>" */
+	size_t	openTagLength;
+	size_t	closeTagOffset;		/* "</name>" */
+	size_t	closeTagLength;
+} UITS_PAYLOAD_SLOT;
+
+/*
+ * Static bytes of a template, followed by a slot (or by nothing for the last segment)
+ */
+
+typedef struct {
+	size_t	offset;
+	size_t	length;
+	int		slotIndex;			/* -1 for the last segment */
+} UITS_PAYLOAD_SEGMENT;
+
+/*
+ * The payload up to the end of the metadata element, rendered once for a release
+ */
+
+typedef struct {
+	char				 *bytes;
+	size_t				 metadataOffset;
+	UITS_PAYLOAD_SLOT	 slots [PAYLOAD_TEMPLATE_MAX_SLOTS];
+	int					 numSlots;
+	UITS_PAYLOAD_SEGMENT segments [PAYLOAD_TEMPLATE_MAX_SLOTS + 1];
+	int					 numSegments;
+} UITS_PAYLOAD_TEMPLATE;
+
+extern char *payloadTemplateSlotNames [];
+
+/*
+ * PUBLIC Functions
+ */
+
+UITS_PAYLOAD_WRITER	*uitsPayloadWriterCreate	(void);
+char				*uitsPayloadWrite			(UITS_PAYLOAD_WRITER *writer,
+												 int xmlSchemaType,
+												 UITS_element *metadataPtr,
+												 UITS_signature_desc *uitsSignatureDesc);
+void				uitsPayloadWriterFree		(UITS_PAYLOAD_WRITER *writer);
+
+UITS_PAYLOAD_TEMPLATE *uitsPayloadTemplateCreate	(int xmlSchemaType, UITS_element *metadataPtr);
+int					uitsPayloadTemplateGetSlot		(UITS_PAYLOAD_TEMPLATE *template, char *name);
+void				uitsPayloadTemplateGetValues	(UITS_PAYLOAD_TEMPLATE *template, char **slotValues);
+char				*uitsPayloadWriteTemplate		(UITS_PAYLOAD_WRITER *writer,
+													 UITS_PAYLOAD_TEMPLATE *template,
+													 char **slotValues,
+													 UITS_signature_desc *uitsSignatureDesc);
+char				*uitsPayloadWriteTemplateMetadata	(UITS_PAYLOAD_WRITER *writer,
+														 UITS_PAYLOAD_TEMPLATE *template,
+														 char **slotValues);
+char				*uitsPayloadWriterPutSignatureValue	(UITS_PAYLOAD_WRITER *writer,
+														 UITS_signature_desc *uitsSignatureDesc,
+														 unsigned char *encodedSignature);
+void				uitsPayloadTemplateFree			(UITS_PAYLOAD_TEMPLATE *template);
+
+/*
+ * PRIVATE Functions
+ */
+
+void	uitsPayloadWriterPutHeader		(UITS_PAYLOAD_WRITER *writer, int xmlSchemaType);
+void	uitsPayloadWriterPutSignature	(UITS_PAYLOAD_WRITER *writer, UITS_signature_desc *uitsSignatureDesc);
+UITS_PAYLOAD_SLOT *uitsPayloadTemplateFindSlot (UITS_PAYLOAD_TEMPLATE *template, const char *name, size_t nameLength);
+void	uitsPayloadWriterAddElements	(UITS_PAYLOAD_WRITER *writer, UITS_element *metadataPtr);
+UITS_PAYLOAD_ELEMENT *uitsPayloadWriterNewElement (UITS_PAYLOAD_WRITER *writer, const char *name, size_t nameLength);
+void	uitsPayloadWriterSetAttribute	(UITS_PAYLOAD_ELEMENT *element, const char *name, UITS_PAYLOAD_TEXT *value);
+int		uitsPayloadWriterNextToken		(const char **position, UITS_PAYLOAD_TEXT *token);
+void	uitsPayloadWriterPutElement		(UITS_PAYLOAD_WRITER *writer, UITS_PAYLOAD_ELEMENT *element);
+void	uitsPayloadWriterPutAttribute	(UITS_PAYLOAD_WRITER *writer, const char *name, const char *value, size_t valueLength);
+void	uitsPayloadWriterPutText		(UITS_PAYLOAD_WRITER *writer, const char *text, size_t textLength);
+void	uitsPayloadWriterPutString		(UITS_PAYLOAD_WRITER *writer, const char *string);
+void	uitsPayloadWriterPut			(UITS_PAYLOAD_WRITER *writer, const char *bytes, size_t length);
+
+#endif
+
+// EOF
@@ -0,0 +1,924 @@
+/*
+ *  uitsSchemaCheck.c
+ *  UITS_Tool
+ *
+ *  Native check of a payload against the UITS 1.1 schema, for the payloads this
+ *  tool writes. The schema in doc/uits.xsd is written out below as tables of
+ *  elements and attributes, and the payload is checked in one pass over its bytes:
+ *  element order and counts, the required and allowed attributes, and the values of
+ *  the attributes and elements. No document is built and no schema is loaded.
+ *
+ *  The check only accepts. Anything it isn't sure of, such as comments, CDATA,
+ *  character references, namespaced attributes, whitespace that the parser would
+ *  normalize or a schema file that isn't doc/uits.xsd, is left to libxml2, which
+ *  also reports the errors in payloads that aren't valid.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *schemaCheckModuleName = "uitsSchemaCheck.c";
+
+char *schemaCheckXSDFileName = NULL;		/* the schema file last looked at */
+int	 schemaCheckKnownXSDFlag = FALSE;		/* TRUE if it is the schema the tables are written from */
+
+/*
+ * The uits.xsd metadata and signature elements. Attributes from other namespaces,
+ * which the schema also allows, are left to libxml2.
+ */
+
+UITS_SCHEMA_ATTRIBUTE productIDSchemaAttributes [] = {
+	{"type",				SCHEMA_NCNAME,			TRUE},
+	{"completed",			SCHEMA_BOOLEAN,			FALSE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE assetIDSchemaAttributes [] = {
+	{"type",				SCHEMA_NCNAME,			TRUE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE versionSchemaAttributes [] = {
+	{"version",				SCHEMA_UNSIGNED_INT,	TRUE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE mediaSchemaAttributes [] = {
+	{"algorithm",			SCHEMA_NCNAME,			TRUE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE urlSchemaAttributes [] = {
+	{"type",				SCHEMA_NCNAME,			FALSE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE copyrightSchemaAttributes [] = {
+	{"value",				SCHEMA_NCNAME,			FALSE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE extraSchemaAttributes [] = {
+	{"type",				SCHEMA_NAME,			FALSE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_ATTRIBUTE signatureSchemaAttributes [] = {
+	{"algorithm",			SCHEMA_NCNAME,			TRUE},
+	{"canonicalization",	SCHEMA_NCNAME,			TRUE},
+	{"keyID",				SCHEMA_STRING,			TRUE},
+	{NULL, 0, 0}
+};
+
+UITS_SCHEMA_PARTICLE metadataSchema [] = {
+	{"nonce",		NULL,	1,	1,						SCHEMA_NONCE,		NULL},
+	{"Distributor",	NULL,	1,	1,						SCHEMA_STRING,		NULL},
+	{"Time",		NULL,	1,	1,						SCHEMA_DATETIME,	NULL},
+	{"ProductID",	NULL,	1,	1,						SCHEMA_STRING,		productIDSchemaAttributes},
+	{"AssetID",		NULL,	0,	1,						SCHEMA_NMTOKEN,		assetIDSchemaAttributes},
+	{"TID",			"UID",	1,	2,						SCHEMA_STRING,		versionSchemaAttributes},
+	{"Media",		NULL,	1,	1,						SCHEMA_BASE64,		mediaSchemaAttributes},
+	{"URL",			NULL,	0,	SCHEMA_CHECK_UNBOUNDED,	SCHEMA_ANYURI,		urlSchemaAttributes},
+	{"PA",			NULL,	0,	1,						SCHEMA_NCNAME,		NULL},
+	{"Copyright",	NULL,	0,	1,						SCHEMA_ANYURI,		copyrightSchemaAttributes},
+	{"Extra",		NULL,	0,	SCHEMA_CHECK_UNBOUNDED,	SCHEMA_STRING,		extraSchemaAttributes},
+	{NULL, NULL, 0, 0, 0, NULL}
+};
+
+UITS_SCHEMA_PARTICLE signatureSchema = {"signature", NULL, 1, 1, SCHEMA_BASE64, signatureSchemaAttributes};
+
+/*
+ *
+ * Function: uitsSchemaCheckPayload
+ * Purpose:	 Check a payload against the UITS schema without libxml2
+ * Returns:  OK if the payload is valid, ERROR if it couldn't be decided here and has
+ *			 to be validated by libxml2
+ *
+ */
+
+int uitsSchemaCheckPayload (char *payloadXMLString, char *XSDFileName)
+{
+	UITS_SCHEMA_SCANNER scanner;
+	int					result;
+
+	if (!uitsSchemaCheckKnownXSD(XSDFileName)) {
+		return (ERROR);
+	}
+
+	scanner.position	= payloadXMLString;
+	scanner.valueLength = 0;
+	scanner.valueSize	= SCHEMA_CHECK_VALUE_SIZE;
+	scanner.value		= malloc(scanner.valueSize);
+	uitsHandleErrorPTR(schemaCheckModuleName, "uitsSchemaCheckPayload", scanner.value, ERR_SCHEMA,
+					   "Couldn't allocate schema check buffer\n");
+
+	result = uitsSchemaCheckRoot(&scanner);
+
+	free(scanner.value);
+
+	dprintf("Native schema check %s\n", result == OK ? "passed" : "left the payload to libxml2");
+
+	return (result);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckKnownXSD
+ * Purpose:	 Find out if a schema file is the one the tables were written from. The
+ *			 answer is kept for the last file name.
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsSchemaCheckKnownXSD (char *XSDFileName)
+{
+	FILE		*xsdFP;
+	off_t		xsdLength;
+	UITS_digest	*xsdDigest;
+	char		*xsdDigestString;
+
+	if (schemaCheckXSDFileName && !strcmp(schemaCheckXSDFileName, XSDFileName)) {
+		return (schemaCheckKnownXSDFlag);
+	}
+
+	/* a missing file is reported by the libxml2 validation */
+	xsdFP = fopen(XSDFileName, "rb");
+	if (!xsdFP) {
+		return (FALSE);
+	}
+
+	fseeko(xsdFP, 0, SEEK_END);
+	xsdLength = ftello(xsdFP);
+	fseeko(xsdFP, 0, SEEK_SET);
+
+	xsdDigest		= uitsCreateDigestBuffered(xsdFP, xsdLength, "SHA256");
+	xsdDigestString = uitsDigestToString(xsdDigest);
+	fclose(xsdFP);
+
+	free(schemaCheckXSDFileName);
+	schemaCheckXSDFileName	= strdup(XSDFileName);
+	schemaCheckKnownXSDFlag = !strcmp(xsdDigestString, SCHEMA_CHECK_UITS_XSD_DIGEST) ||
+							  !strcmp(xsdDigestString, SCHEMA_CHECK_UITS_1_1_1_XSD_DIGEST);
+
+	vprintf("\tSchema file %s %s\n", XSDFileName,
+			schemaCheckKnownXSDFlag ? "is a UITS 1.1 schema" : "isn't known, payloads are validated by libxml2");
+
+	free(xsdDigestString);
+	free(xsdDigest->value);
+	free(xsdDigest);
+
+	return (schemaCheckKnownXSDFlag);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckRoot
+ * Purpose:	 Check the XML declaration, the root element with its namespace
+ *			 declarations, the metadata and the signature
+ * Returns:  OK if the payload is valid, ERROR if it couldn't be decided
+ *
+ */
+
+int uitsSchemaCheckRoot (UITS_SCHEMA_SCANNER *scanner)
+{
+	const char	*name;
+	size_t		nameLength;
+	int			uitsNamespaceFlag = FALSE;
+	int			xsiNamespaceFlag  = FALSE;
+
+	/* the declaration that the payload writer and mxml write, or none */
+	if (uitsSchemaCheckLiteral(scanner, "<?xml") == OK &&
+		uitsSchemaCheckLiteral(scanner, " version=\"1.0\" encoding=\"utf-8\"?>") != OK &&
+		uitsSchemaCheckLiteral(scanner, " version=\"1.0\" encoding=\"UTF-8\"?>") != OK) {
+		return (ERROR);
+	}
+	uitsSchemaCheckSkipSpace(scanner);
+
+	if (uitsSchemaCheckStartTag(scanner, &name, &nameLength) != OK || !uitsSchemaCheckNameIs(name, nameLength, "uits:UITS")) {
+		return (ERROR);
+	}
+
+	/* the root may only declare the uits and xsi prefixes */
+	while (uitsSchemaCheckAttribute(scanner, &name, &nameLength) == OK) {
+		if (uitsSchemaCheckNameIs(name, nameLength, "xmlns:uits") && !uitsNamespaceFlag &&
+			!strcmp(scanner->value, PAYLOAD_UITS_NAMESPACE)) {
+			uitsNamespaceFlag = TRUE;
+		} else if (uitsSchemaCheckNameIs(name, nameLength, "xmlns:xsi") && !xsiNamespaceFlag &&
+				   !strcmp(scanner->value, PAYLOAD_XSI_NAMESPACE)) {
+			xsiNamespaceFlag = TRUE;
+		} else {
+			return (ERROR);
+		}
+	}
+	uitsSchemaCheckSkipSpace(scanner);
+
+	if (!uitsNamespaceFlag || uitsSchemaCheckLiteral(scanner, ">") != OK) {
+		return (ERROR);
+	}
+
+	uitsSchemaCheckSkipSpace(scanner);
+	if (uitsSchemaCheckLiteral(scanner, "<metadata>") != OK ||
+		uitsSchemaCheckSequence(scanner, metadataSchema) != OK ||
+		uitsSchemaCheckEndTag(scanner, "metadata", 8) != OK) {
+		return (ERROR);
+	}
+
+	uitsSchemaCheckSkipSpace(scanner);
+	if (uitsSchemaCheckStartTag(scanner, &name, &nameLength) != OK ||
+		!uitsSchemaCheckNameIs(name, nameLength, signatureSchema.name) ||
+		uitsSchemaCheckElement(scanner, &signatureSchema, name, nameLength) != OK) {
+		return (ERROR);
+	}
+
+	/* elements from other namespaces after the signature are left to libxml2 */
+	uitsSchemaCheckSkipSpace(scanner);
+	if (uitsSchemaCheckEndTag(scanner, "uits:UITS", 9) != OK) {
+		return (ERROR);
+	}
+
+	uitsSchemaCheckSkipSpace(scanner);
+
+	return (*scanner->position ? ERROR : OK);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckSequence
+ * Purpose:	 Check the child elements of an element against a sequence of particles.
+ *			 The sequence is deterministic, so each child either matches the current
+ *			 particle or one after it.
+ * Returns:  OK if the children are valid, ERROR if they couldn't be decided
+ *
+ */
+
+int uitsSchemaCheckSequence (UITS_SCHEMA_SCANNER *scanner, UITS_SCHEMA_PARTICLE *particle)
+{
+	const char	*name;
+	size_t		nameLength;
+	int			numOccurs = 0;
+
+	while (TRUE) {
+		uitsSchemaCheckSkipSpace(scanner);
+		if (!strncmp(scanner->position, "</", 2)) {
+			break;
+		}
+
+		if (uitsSchemaCheckStartTag(scanner, &name, &nameLength) != OK) {
+			return (ERROR);
+		}
+
+		/* skip the particles that are done with, as long as they have occurred often enough */
+		while (particle->name) {
+			if ((uitsSchemaCheckNameIs(name, nameLength, particle->name) ||
+				 (particle->alternateName && uitsSchemaCheckNameIs(name, nameLength, particle->alternateName))) &&
+				(particle->maxOccurs == SCHEMA_CHECK_UNBOUNDED || numOccurs < particle->maxOccurs)) {
+				break;
+			}
+			if (numOccurs < particle->minOccurs) {
+				return (ERROR);
+			}
+			particle++;
+			numOccurs = 0;
+		}
+
+		if (!particle->name || uitsSchemaCheckElement(scanner, particle, name, nameLength) != OK) {
+			return (ERROR);
+		}
+		numOccurs++;
+	}
+
+	/* the rest of the sequence must be optional */
+	while (particle->name) {
+		if (numOccurs < particle->minOccurs) {
+			return (ERROR);
+		}
+		particle++;
+		numOccurs = 0;
+	}
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckElement
+ * Purpose:	 Check the attributes, text and end tag of an element whose start tag
+ *			 name has been read
+ * Returns:  OK if the element is valid, ERROR if it couldn't be decided
+ *
+ */
+
+int uitsSchemaCheckElement (UITS_SCHEMA_SCANNER *scanner,
+							UITS_SCHEMA_PARTICLE *particle,
+							const char *name,
+							size_t nameLength)
+{
+	UITS_SCHEMA_ATTRIBUTE	*attribute;
+	const char				*attributeName;
+	size_t					attributeNameLength;
+	unsigned int			attributesSeen = 0;
+	int						i;
+
+	while (uitsSchemaCheckAttribute(scanner, &attributeName, &attributeNameLength) == OK) {
+		for (i = 0, attribute = particle->attributes; attribute && attribute->name; i++, attribute++) {
+			if (uitsSchemaCheckNameIs(attributeName, attributeNameLength, attribute->name)) {
+				break;
+			}
+		}
+
+		/* other and repeated attributes are left to libxml2 */
+		if (!attribute || !attribute->name || (attributesSeen & (1 << i)) ||
+			uitsSchemaCheckValue(attribute->type, scanner->value, scanner->valueLength) != OK) {
+			return (ERROR);
+		}
+		attributesSeen |= 1 << i;
+	}
+
+	for (i = 0, attribute = particle->attributes; attribute && attribute->name; i++, attribute++) {
+		if (attribute->requiredFlag && !(attributesSeen & (1 << i))) {
+			return (ERROR);
+		}
+	}
+
+	uitsSchemaCheckSkipSpace(scanner);
+	if (uitsSchemaCheckLiteral(scanner, "/>") == OK) {
+		return (uitsSchemaCheckValue(particle->contentType, "", 0));
+	}
+
+	if (uitsSchemaCheckLiteral(scanner, ">") != OK ||
+		uitsSchemaCheckText(scanner, '<') != OK ||
+		uitsSchemaCheckValue(particle->contentType, scanner->value, scanner->valueLength) != OK) {
+		return (ERROR);
+	}
+
+	return (uitsSchemaCheckEndTag(scanner, name, nameLength));
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckStartTag
+ * Purpose:	 Read the "<name" of a start tag
+ * Returns:  OK, or ERROR if the next thing in the payload isn't a start tag
+ *
+ */
+
+int uitsSchemaCheckStartTag (UITS_SCHEMA_SCANNER *scanner, const char **name, size_t *nameLength)
+{
+	if (uitsSchemaCheckLiteral(scanner, "<") != OK) {
+		return (ERROR);
+	}
+
+	/* end tags, comments, processing instructions and CDATA have no name here */
+	*name		= scanner->position;
+	*nameLength = uitsSchemaCheckNameLength(*name);
+	if (!*nameLength) {
+		return (ERROR);
+	}
+
+	scanner->position += *nameLength;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckAttribute
+ * Purpose:	 Read an attribute of a start tag into the value buffer. If there is no
+ *			 attribute the position is left where it was.
+ * Returns:  OK, or ERROR if there is no attribute or it can't be read here
+ *
+ */
+
+int uitsSchemaCheckAttribute (UITS_SCHEMA_SCANNER *scanner, const char **name, size_t *nameLength)
+{
+	const char	*start = scanner->position;
+	char		quote;
+
+	uitsSchemaCheckSkipSpace(scanner);
+
+	*name		= scanner->position;
+	*nameLength = uitsSchemaCheckNameLength(*name);
+
+	if (scanner->position == start || !*nameLength) {
+		scanner->position = start;
+		return (ERROR);
+	}
+	scanner->position += *nameLength;
+
+	uitsSchemaCheckSkipSpace(scanner);
+	if (uitsSchemaCheckLiteral(scanner, "=") != OK) {
+		scanner->position = start;
+		return (ERROR);
+	}
+	uitsSchemaCheckSkipSpace(scanner);
+
+	quote = *scanner->position;
+	if ((quote != '"' && quote != '\'')) {
+		scanner->position = start;
+		return (ERROR);
+	}
+	scanner->position++;
+
+	if (uitsSchemaCheckText(scanner, quote) != OK) {
+		scanner->position = start;
+		return (ERROR);
+	}
+	scanner->position++;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckEndTag
+ * Purpose:	 Read the end tag of an element
+ * Returns:  OK, or ERROR if the next thing in the payload isn't that end tag
+ *
+ */
+
+int uitsSchemaCheckEndTag (UITS_SCHEMA_SCANNER *scanner, const char *name, size_t nameLength)
+{
+	if (uitsSchemaCheckLiteral(scanner, "</") != OK || strncmp(scanner->position, name, nameLength)) {
+		return (ERROR);
+	}
+	scanner->position += nameLength;
+
+	uitsSchemaCheckSkipSpace(scanner);
+
+	return (uitsSchemaCheckLiteral(scanner, ">"));
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckText
+ * Purpose:	 Read element text (up to '<') or an attribute value (up to its quote)
+ *			 into the value buffer, replacing the predefined entities. The text must
+ *			 be valid UTF-8 XML characters that the parser passes on unchanged.
+ * Returns:  OK, or ERROR if the text can't be decided here
+ *
+ */
+
+int uitsSchemaCheckText (UITS_SCHEMA_SCANNER *scanner, char terminator)
+{
+	const char	*position = scanner->position;
+	const char	*runStart;
+	size_t		charLength;
+
+	scanner->valueLength = 0;
+	scanner->value[0]	 = '\0';
+
+	while (*position != terminator) {
+		runStart = position;
+
+		while (*position != terminator && *position != '&') {
+			/* carriage returns, and tabs and line feeds in attribute values, are normalized by the parser */
+			if (*position == '<' || *position == '\r' ||
+				(terminator != '<' && (*position == '\t' || *position == '\n')) ||
+				!strncmp(position, "]]>", 3) ||
+				!uitsSchemaCheckChar((const unsigned char *) position, &charLength)) {
+				return (ERROR);
+			}
+			position += charLength;
+		}
+		uitsSchemaCheckAddValue(scanner, runStart, position - runStart);
+
+		if (*position == '&') {
+			if (!strncmp(position, "&amp;", 5)) {
+				uitsSchemaCheckAddValue(scanner, "&", 1);
+				position += 5;
+			} else if (!strncmp(position, "&lt;", 4)) {
+				uitsSchemaCheckAddValue(scanner, "<", 1);
+				position += 4;
+			} else if (!strncmp(position, "&gt;", 4)) {
+				uitsSchemaCheckAddValue(scanner, ">", 1);
+				position += 4;
+			} else if (!strncmp(position, "&quot;", 6)) {
+				uitsSchemaCheckAddValue(scanner, "\"", 1);
+				position += 6;
+			} else if (!strncmp(position, "&apos;", 6)) {
+				uitsSchemaCheckAddValue(scanner, "'", 1);
+				position += 6;
+			} else {
+				return (ERROR);
+			}
+		}
+	}
+
+	scanner->position = position;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckAddValue
+ * Purpose:	 Add bytes to the value buffer, which is kept null-terminated
+ *
+ */
+
+void uitsSchemaCheckAddValue (UITS_SCHEMA_SCANNER *scanner, const char *bytes, size_t length)
+{
+	if (scanner->valueLength + length + 1 > scanner->valueSize) {
+		while (scanner->valueLength + length + 1 > scanner->valueSize) {
+			scanner->valueSize *= 2;
+		}
+		scanner->value = realloc(scanner->value, scanner->valueSize);
+		uitsHandleErrorPTR(schemaCheckModuleName, "uitsSchemaCheckAddValue", scanner->value, ERR_SCHEMA,
+						   "Couldn't allocate schema check buffer\n");
+	}
+
+	memcpy(scanner->value + scanner->valueLength, bytes, length);
+	scanner->valueLength += length;
+	scanner->value[scanner->valueLength] = '\0';
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckChar
+ * Purpose:	 Decode one UTF-8 character
+ * Returns:  TRUE if it is a valid XML character, with its length in bytes, FALSE for
+ *			 invalid UTF-8, overlong forms, surrogates and characters XML doesn't allow
+ *
+ */
+
+int uitsSchemaCheckChar (const unsigned char *bytes, size_t *charLength)
+{
+	unsigned long character;
+	unsigned long minCharacter;
+	size_t		  i;
+
+	if (bytes[0] < 0x80) {
+		*charLength = 1;
+		return (bytes[0] >= 0x20 || bytes[0] == '\t' || bytes[0] == '\n' || bytes[0] == '\r');
+	}
+
+	if ((bytes[0] & 0xe0) == 0xc0) {
+		*charLength	 = 2;
+		character	 = bytes[0] & 0x1f;
+		minCharacter = 0x80;
+	} else if ((bytes[0] & 0xf0) == 0xe0) {
+		*charLength	 = 3;
+		character	 = bytes[0] & 0x0f;
+		minCharacter = 0x800;
+	} else if ((bytes[0] & 0xf8) == 0xf0) {
+		*charLength	 = 4;
+		character	 = bytes[0] & 0x07;
+		minCharacter = 0x10000;
+	} else {
+		return (FALSE);
+	}
+
+	for (i = 1; i < *charLength; i++) {
+		if ((bytes[i] & 0xc0) != 0x80) {
+			return (FALSE);
+		}
+		character = (character << 6) | (bytes[i] & 0x3f);
+	}
+
+	return (character >= minCharacter && character <= 0x10ffff &&
+			(character < 0xd800 || character > 0xdfff) && character != 0xfffe && character != 0xffff);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckLiteral
+ * Purpose:	 Read a literal string. The position only moves if it matches.
+ * Returns:  OK or ERROR if the payload doesn't have the string at the position
+ *
+ */
+
+int uitsSchemaCheckLiteral (UITS_SCHEMA_SCANNER *scanner, const char *literal)
+{
+	size_t length = strlen(literal);
+
+	if (strncmp(scanner->position, literal, length)) {
+		return (ERROR);
+	}
+	scanner->position += length;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckSkipSpace
+ * Purpose:	 Skip XML white space between markup
+ *
+ */
+
+void uitsSchemaCheckSkipSpace (UITS_SCHEMA_SCANNER *scanner)
+{
+	scanner->position += strspn(scanner->position, " \t\r\n");
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckNameLength
+ * Purpose:	 Measure an element or attribute name. Only ASCII names are read; a name
+ *			 with other characters is never one of the schema's names.
+ * Returns:  Length of the name in bytes, 0 if there isn't a name at the position
+ *
+ */
+
+size_t uitsSchemaCheckNameLength (const char *name)
+{
+	return (strspn(name, SCHEMA_CHECK_NAME_CHARS));
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckNameIs
+ * Purpose:	 Compare a name in the payload with a name from the schema
+ * Returns:  TRUE if they are the same
+ *
+ */
+
+int uitsSchemaCheckNameIs (const char *name, size_t nameLength, const char *expectedName)
+{
+	return (strlen(expectedName) == nameLength && !strncmp(name, expectedName, nameLength));
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckValue
+ * Purpose:	 Check an element or attribute value against its type. Values with
+ *			 white space that the type would collapse are left to libxml2.
+ * Returns:  OK if the value is valid, ERROR if it couldn't be decided
+ *
+ */
+
+int uitsSchemaCheckValue (int type, const char *value, size_t length)
+{
+	size_t numChars = 0;
+	size_t i;
+
+	switch (type) {
+
+		case SCHEMA_STRING:
+			return (OK);
+
+		case SCHEMA_NONCE:	/* the length is in characters, not bytes */
+			for (i = 0; i < length; i++) {
+				if ((value[i] & 0xc0) != 0x80) {
+					numChars++;
+				}
+			}
+			return (numChars == 8 ? OK : ERROR);
+
+		case SCHEMA_DATETIME:
+			return (uitsSchemaCheckDateTime(value, length));
+
+		case SCHEMA_NMTOKEN:
+			return (uitsSchemaCheckNameChars(value, length, SCHEMA_CHECK_NAME_CHARS, SCHEMA_CHECK_NAME_CHARS));
+
+		case SCHEMA_NCNAME:
+			/*
+			 * The enumerated values are in a union with xs:QName, so any name
+			 * without a prefix is valid. Prefixed names need the namespace in scope.
+			 */
+			return (uitsSchemaCheckNameChars(value, length, SCHEMA_CHECK_LETTERS "_", SCHEMA_CHECK_LETTERS SCHEMA_CHECK_DIGITS "._-"));
+
+		case SCHEMA_NAME:
+			return (uitsSchemaCheckNameChars(value, length, SCHEMA_CHECK_LETTERS "_:", SCHEMA_CHECK_NAME_CHARS));
+
+		case SCHEMA_BOOLEAN:
+			return ((!strcmp(value, "true") || !strcmp(value, "false") || !strcmp(value, "1") || !strcmp(value, "0")) ? OK : ERROR);
+
+		case SCHEMA_UNSIGNED_INT:
+			if (!length || strspn(value, SCHEMA_CHECK_DIGITS) != length) {
+				return (ERROR);
+			}
+			for (i = 0; i < length - 1 && value[i] == '0'; i++) {
+				;
+			}
+			return ((length - i <= 10 && strtoull(value + i, NULL, 10) <= 4294967295ULL) ? OK : ERROR);
+
+		case SCHEMA_BASE64:
+			return (uitsSchemaCheckBase64(value, length));
+
+		case SCHEMA_ANYURI:
+			return (uitsSchemaCheckAnyURI(value, length));
+
+		default:
+			return (ERROR);
+	}
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckNameChars
+ * Purpose:	 Check that a value is made of name characters
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsSchemaCheckNameChars (const char *value, size_t length, const char *firstChars, const char *otherChars)
+{
+	if (!length || !strchr(firstChars, value[0])) {
+		return (ERROR);
+	}
+
+	return (strspn(value + 1, otherChars) == length - 1 ? OK : ERROR);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckDigits
+ * Purpose:	 Read a fixed number of decimal digits
+ * Returns:  The number, or ERROR if it isn't all digits or is out of range
+ *
+ */
+
+int uitsSchemaCheckDigits (const char *value, int numDigits, int minValue, int maxValue)
+{
+	int number = 0;
+	int i;
+
+	for (i = 0; i < numDigits; i++) {
+		if (value[i] < '0' || value[i] > '9') {
+			return (ERROR);
+		}
+		number = number * 10 + value[i] - '0';
+	}
+
+	return ((number < minValue || number > maxValue) ? ERROR : number);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckDateTime
+ * Purpose:	 Check an xs:dateTime value of the form YYYY-MM-DDThh:mm:ss with an
+ *			 optional fraction of a second and time zone. Years before 1 or after 9999,
+ *			 the hour 24 and time zones of 14 hours are left to libxml2.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsSchemaCheckDateTime (const char *value, size_t length)
+{
+	int			daysInMonth [] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	const char	*end = value + length;
+	int			year;
+	int			month;
+	int			day;
+
+	if (length < 19 || value[4] != '-' || value[7] != '-' || value[10] != 'T' || value[13] != ':' || value[16] != ':') {
+		return (ERROR);
+	}
+
+	year  = uitsSchemaCheckDigits(value, 4, 1, 9999);
+	month = uitsSchemaCheckDigits(value + 5, 2, 1, 12);
+	day	  = uitsSchemaCheckDigits(value + 8, 2, 1, 31);
+	if (year == ERROR || month == ERROR || day == ERROR) {
+		return (ERROR);
+	}
+
+	if ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0) {
+		daysInMonth[1] = 29;
+	}
+	if (day > daysInMonth[month - 1]) {
+		return (ERROR);
+	}
+
+	if (uitsSchemaCheckDigits(value + 11, 2, 0, 23) == ERROR ||
+		uitsSchemaCheckDigits(value + 14, 2, 0, 59) == ERROR ||
+		uitsSchemaCheckDigits(value + 17, 2, 0, 59) == ERROR) {
+		return (ERROR);
+	}
+	value += 19;
+
+	if (value < end && *value == '.') {
+		value++;
+		if (value == end || *value < '0' || *value > '9') {
+			return (ERROR);
+		}
+		while (value < end && *value >= '0' && *value <= '9') {
+			value++;
+		}
+	}
+
+	if (value < end && *value == 'Z') {
+		value++;
+	} else if (value < end && (*value == '+' || *value == '-')) {
+		if (end - value < 6 || value[3] != ':' ||
+			uitsSchemaCheckDigits(value + 1, 2, 0, 13) == ERROR ||
+			uitsSchemaCheckDigits(value + 4, 2, 0, 59) == ERROR) {
+			return (ERROR);
+		}
+		value += 6;
+	}
+
+	return (value == end ? OK : ERROR);
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckBase64
+ * Purpose:	 Check an xs:base64Binary value. Line breaks, as in signatures written
+ *			 with line feeds, are allowed between the characters. The bits that the
+ *			 padding leaves over in the last character must be zero.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsSchemaCheckBase64 (const char *value, size_t length)
+{
+	int			base64Value;
+	int			lastBits = 0;
+	size_t		numChars = 0;
+	size_t		numPads	 = 0;
+	size_t		i;
+
+	for (i = 0; i < length; i++) {
+		if (value[i] == ' ' || value[i] == '\t' || value[i] == '\n') {
+			continue;
+		}
+		if (value[i] == '=') {
+			numPads++;
+			continue;
+		}
+
+		base64Value = uitsBase64CharValue((unsigned char) value[i]);
+		if (numPads || base64Value >= BASE64_SPACE) {
+			return (ERROR);
+		}
+		lastBits = base64Value;
+		numChars++;
+	}
+
+	switch (numPads) {
+
+		case 0:
+			return (numChars % 4 == 0 ? OK : ERROR);
+
+		case 1:
+			return ((numChars % 4 == 3 && !(lastBits & ~0x3c)) ? OK : ERROR);
+
+		case 2:
+			return ((numChars % 4 == 2 && !(lastBits & ~0x30)) ? OK : ERROR);
+
+		default:
+			return (ERROR);
+	}
+}
+
+/*
+ *
+ * Function: uitsSchemaCheckAnyURI
+ * Purpose:	 Check an xs:anyURI value. Only URIs made of the RFC 3986 characters, with
+ *			 a valid scheme and an authority of a host name and port, are decided here.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int uitsSchemaCheckAnyURI (const char *value, size_t length)
+{
+	size_t schemeLength;
+	size_t authorityLength;
+	size_t hostLength;
+	int	   numFragments = 0;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		if (!strchr(SCHEMA_CHECK_LETTERS SCHEMA_CHECK_DIGITS "-._~!$&'()*+,;=:@/?#%", value[i])) {
+			return (ERROR);
+		}
+		if (value[i] == '%' &&
+			(i + 2 >= length || !strchr(SCHEMA_CHECK_HEX_DIGITS, value[i + 1]) || !strchr(SCHEMA_CHECK_HEX_DIGITS, value[i + 2]))) {
+			return (ERROR);
+		}
+		if (value[i] == '#' && numFragments++) {
+			return (ERROR);
+		}
+	}
+
+	/* a colon before the first slash, question mark or hash ends the scheme */
+	schemeLength = strcspn(value, ":/?#");
+	if (schemeLength < length && value[schemeLength] == ':') {
+		if (uitsSchemaCheckNameChars(value, schemeLength, SCHEMA_CHECK_LETTERS, SCHEMA_CHECK_LETTERS SCHEMA_CHECK_DIGITS "+-.") != OK) {
+			return (ERROR);
+		}
+		value  += schemeLength + 1;
+		length -= schemeLength + 1;
+	}
+
+	if (length >= 2 && value[0] == '/' && value[1] == '/') {
+		value  += 2;
+		authorityLength = strcspn(value, "/?#");
+		hostLength		= strspn(value, SCHEMA_CHECK_LETTERS SCHEMA_CHECK_DIGITS "-._~");
+
+		if (hostLength < authorityLength &&
+			(value[hostLength] != ':' || strspn(value + hostLength + 1, SCHEMA_CHECK_DIGITS) != authorityLength - hostLength - 1)) {
+			return (ERROR);
+		}
+	}
+
+	return (OK);
+}
+
+// EOF
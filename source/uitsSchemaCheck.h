@@ -0,0 +1,122 @@
+/*
+ *  uitsSchemaCheck.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsschemacheck_h_
+#  define _uitsschemacheck_h_
+
+#define SCHEMA_CHECK_UNBOUNDED			-1
+#define SCHEMA_CHECK_VALUE_SIZE			1024		/* first size of the value buffer */
+
+#define SCHEMA_CHECK_LETTERS			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+#define SCHEMA_CHECK_DIGITS				"0123456789"
+#define SCHEMA_CHECK_HEX_DIGITS			"0123456789abcdefABCDEF"
+#define SCHEMA_CHECK_NAME_CHARS			SCHEMA_CHECK_LETTERS SCHEMA_CHECK_DIGITS "._:-"
+
+/*
+ * SHA256 of doc/uits.xsd, the schema that the tables in uitsSchemaCheck.c are written from,
+ * and of doc/uits-1.1.1.xsd. Version 1.1.1 only adds signature algorithm values, which the
+ * union with xs:QName already allowed.
+ */
+#define SCHEMA_CHECK_UITS_XSD_DIGEST		"af40df24e901dfcb275bb2be3bb8e94ea9c477fd723f7ada29370bfc73405499"
+#define SCHEMA_CHECK_UITS_1_1_1_XSD_DIGEST	"66150ef074dcf6be0fea288afe1988dc12c4b4c2f9234b68e8327a4be5d3fdbc"
+
+/*
+ * Types of element content and attribute values
+ */
+enum uitsSchemaCheckTypes {
+	SCHEMA_STRING,			/* xs:string, any text */
+	SCHEMA_NONCE,			/* xs:string of length 8 */
+	SCHEMA_DATETIME,		/* xs:dateTime */
+	SCHEMA_NMTOKEN,			/* xs:NMTOKEN */
+	SCHEMA_NCNAME,			/* an enumeration of NCNames in a union with xs:QName */
+	SCHEMA_NAME,			/* xs:Name */
+	SCHEMA_BOOLEAN,			/* xs:boolean */
+	SCHEMA_UNSIGNED_INT,	/* xs:unsignedInt */
+	SCHEMA_BASE64,			/* xs:base64Binary */
+	SCHEMA_ANYURI			/* xs:anyURI */
+};
+
+/*
+ * An attribute allowed on an element
+ */
+
+typedef struct {
+	char	*name;
+	int		type;
+	int		requiredFlag;
+} UITS_SCHEMA_ATTRIBUTE;
+
+/*
+ * One element of a sequence. An element with an alternate name is a choice
+ * between the two elements.
+ */
+
+typedef struct {
+	char					*name;
+	char					*alternateName;		/* NULL if the particle isn't a choice */
+	int						minOccurs;
+	int						maxOccurs;			/* or SCHEMA_CHECK_UNBOUNDED */
+	int						contentType;
+	UITS_SCHEMA_ATTRIBUTE	*attributes;		/* NULL-terminated list, or NULL for none */
+} UITS_SCHEMA_PARTICLE;
+
+/*
+ * Position in the payload, and the last text or attribute value read with its
+ * character and entity references replaced
+ */
+
+typedef struct {
+	const char	*position;
+	char		*value;
+	size_t		valueLength;
+	size_t		valueSize;
+} UITS_SCHEMA_SCANNER;
+
+/*
+ * PUBLIC Functions
+ */
+
+int		uitsSchemaCheckPayload			(char *payloadXMLString, char *XSDFileName);
+
+/*
+ * PRIVATE Functions
+ */
+
+int		uitsSchemaCheckKnownXSD			(char *XSDFileName);
+int		uitsSchemaCheckRoot				(UITS_SCHEMA_SCANNER *scanner);
+int		uitsSchemaCheckSequence			(UITS_SCHEMA_SCANNER *scanner, UITS_SCHEMA_PARTICLE *particles);
+int		uitsSchemaCheckElement			(UITS_SCHEMA_SCANNER *scanner, UITS_SCHEMA_PARTICLE *particle,
+										 const char *name, size_t nameLength);
+int		uitsSchemaCheckStartTag			(UITS_SCHEMA_SCANNER *scanner, const char **name, size_t *nameLength);
+int		uitsSchemaCheckAttribute		(UITS_SCHEMA_SCANNER *scanner, const char **name, size_t *nameLength);
+int		uitsSchemaCheckEndTag			(UITS_SCHEMA_SCANNER *scanner, const char *name, size_t nameLength);
+int		uitsSchemaCheckText				(UITS_SCHEMA_SCANNER *scanner, char terminator);
+void	uitsSchemaCheckAddValue			(UITS_SCHEMA_SCANNER *scanner, const char *bytes, size_t length);
+int		uitsSchemaCheckChar				(const unsigned char *bytes, size_t *charLength);
+int		uitsSchemaCheckLiteral			(UITS_SCHEMA_SCANNER *scanner, const char *literal);
+void	uitsSchemaCheckSkipSpace		(UITS_SCHEMA_SCANNER *scanner);
+size_t	uitsSchemaCheckNameLength		(const char *name);
+int		uitsSchemaCheckNameIs			(const char *name, size_t nameLength, const char *expectedName);
+int		uitsSchemaCheckValue			(int type, const char *value, size_t length);
+int		uitsSchemaCheckNameChars		(const char *value, size_t length, const char *firstChars, const char *otherChars);
+int		uitsSchemaCheckDigits			(const char *value, int numDigits, int minValue, int maxValue);
+int		uitsSchemaCheckDateTime			(const char *value, size_t length);
+int		uitsSchemaCheckBase64			(const char *value, size_t length);
+int		uitsSchemaCheckAnyURI			(const char *value, size_t length);
+
+#endif
+
+// EOF
@@ -0,0 +1,471 @@
+/*
+ *  uitsSignEngine.c
+ *  UITS_Tool
+ *
+ *  Signs payloads on a pool of worker threads, so that the payloads of a stamp run
+ *  can be written while earlier ones are being signed, and signing uses all of the
+ *  CPUs. Each worker reads its own copy of the private key when the engine is
+ *  created and keeps one signing context, so the workers share nothing while they
+ *  sign.
+ *
+ *  Requests are passed to the workers through a bounded queue that producers and
+ *  workers use without locks: each slot has a sequence number, and a position is
+ *  claimed with compare-and-swap. The lock and conditions are only used to put an
+ *  idle worker or a waiting caller to sleep, and are only taken when someone sleeps.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *signEngineModuleName = "uitsSignEngine.c";
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+pthread_mutex_t *signEngineSSLLocks = NULL;		/* OpenSSL before 1.1.0 leaves locking to the application */
+#endif
+
+/*
+ *
+ * Function: uitsSignEngineCreate
+ * Purpose:	 Start the worker threads. Each one reads the private key.
+ * Passed:   Private key file name, digest name (NULL to sign the message itself, see
+ *			 uitsGetSignatureAlgorithm), TRUE for multi-line base 64, number of workers
+ *			 (0 for one per CPU)
+ * Returns:  Pointer to the engine or exit on error
+ *
+ */
+
+UITS_SIGN_ENGINE *uitsSignEngineCreate (char *privateKeyFileName, char *digestName, int b64LFFlag, int numWorkers)
+{
+	UITS_SIGN_ENGINE *engine;
+	UITS_SIGN_WORKER *worker;
+	int				 result;
+	int				 i;
+
+	numWorkers = uitsSignEngineCountWorkers(numWorkers);
+
+	vprintf("Starting %d signing threads ...\n", numWorkers);
+
+	uitsSignEngineLockingSetup();
+
+	engine = calloc(1, sizeof(UITS_SIGN_ENGINE));
+	uitsHandleErrorPTR(signEngineModuleName, "uitsSignEngineCreate", engine, ERR_SSL, "Couldn't allocate signing engine\n");
+
+	engine->mdType	   = uitsGetSignatureDigest(digestName);
+	engine->b64LFFlag  = b64LFFlag;
+	engine->numWorkers = numWorkers;
+
+	for (i = 0; i < SIGN_ENGINE_QUEUE_SIZE; i++) {
+		engine->queue[i].sequence = i;
+	}
+
+	pthread_mutex_init(&engine->lock, NULL);
+	pthread_cond_init(&engine->workCond, NULL);
+	pthread_cond_init(&engine->doneCond, NULL);
+
+	for (i = 0; i < numWorkers; i++) {
+		worker = &engine->workers[i];
+		worker->engine	   = engine;
+		worker->privateKey = uitsReadPrivateKey(privateKeyFileName);
+		worker->ctx		   = EVP_MD_CTX_create();
+
+		result = pthread_create(&worker->thread, NULL, uitsSignEngineWorker, worker);
+		uitsHandleErrorINT(signEngineModuleName, "uitsSignEngineCreate", result, 0, ERR_SSL, "Couldn't start signing thread\n");
+	}
+
+	return (engine);
+}
+
+/*
+ *
+ * Function: uitsSignEngineSubmit
+ * Purpose:	 Queue a message to be signed. If the queue is full, wait for a worker to
+ *			 take a request from it.
+ *
+ */
+
+void uitsSignEngineSubmit (UITS_SIGN_ENGINE *engine, UITS_SIGN_REQUEST *request)
+{
+	request->signature	= NULL;
+	request->doneFlag	= FALSE;
+	request->submitTime = uitsSignEngineTime();
+
+	while (uitsSignEngineEnqueue(engine, request) != OK) {
+		pthread_mutex_lock(&engine->lock);
+		__sync_fetch_and_add(&engine->numWaiting, 1);
+		if (uitsSignEngineQueueDepth(engine) >= SIGN_ENGINE_QUEUE_SIZE) {
+			pthread_cond_wait(&engine->doneCond, &engine->lock);
+		}
+		__sync_fetch_and_sub(&engine->numWaiting, 1);
+		pthread_mutex_unlock(&engine->lock);
+	}
+
+	/* a worker that went idle before the request was queued has to be woken */
+	__sync_synchronize();
+	if (engine->numIdleWorkers) {
+		pthread_mutex_lock(&engine->lock);
+		pthread_cond_signal(&engine->workCond);
+		pthread_mutex_unlock(&engine->lock);
+	}
+}
+
+/*
+ *
+ * Function: uitsSignEngineWait
+ * Purpose:	 Wait for a request to be signed
+ * Returns:  The base 64 signature, which the caller frees
+ *
+ */
+
+unsigned char *uitsSignEngineWait (UITS_SIGN_ENGINE *engine, UITS_SIGN_REQUEST *request)
+{
+	if (!request->doneFlag) {
+		pthread_mutex_lock(&engine->lock);
+		__sync_fetch_and_add(&engine->numWaiting, 1);
+		while (!request->doneFlag) {
+			pthread_cond_wait(&engine->doneCond, &engine->lock);
+		}
+		__sync_fetch_and_sub(&engine->numWaiting, 1);
+		pthread_mutex_unlock(&engine->lock);
+	}
+
+	__sync_synchronize();
+
+	return (request->signature);
+}
+
+/*
+ *
+ * Function: uitsSignEngineQueueDepth
+ * Purpose:	 Get the number of requests that no worker has taken yet
+ * Returns:  The number of requests
+ *
+ */
+
+int uitsSignEngineQueueDepth (UITS_SIGN_ENGINE *engine)
+{
+	return ((int) (engine->enqueuePosition - engine->dequeuePosition));
+}
+
+/*
+ *
+ * Function: uitsSignEngineGetLatency
+ * Purpose:	 Get a percentile of the time from submitting a request to its signature,
+ *			 over the last SIGN_ENGINE_LATENCY_SAMPLES requests
+ * Returns:  Latency in microseconds, 0 if nothing has been signed
+ *
+ */
+
+long uitsSignEngineGetLatency (UITS_SIGN_ENGINE *engine, int percentile)
+{
+	long	*latencies;
+	size_t	numLatencies;
+	long	latency;
+
+	numLatencies = engine->numSigned;
+	if (numLatencies > SIGN_ENGINE_LATENCY_SAMPLES) {
+		numLatencies = SIGN_ENGINE_LATENCY_SAMPLES;
+	}
+	if (numLatencies == 0) {
+		return (0);
+	}
+
+	latencies = malloc(numLatencies * sizeof(long));
+	uitsHandleErrorPTR(signEngineModuleName, "uitsSignEngineGetLatency", latencies, ERR_SSL, "Couldn't allocate latencies\n");
+
+	memcpy(latencies, engine->latencies, numLatencies * sizeof(long));
+	qsort(latencies, numLatencies, sizeof(long), uitsSignEngineCompareLatency);
+
+	latency = latencies[(numLatencies - 1) * percentile / 100];
+	free(latencies);
+
+	return (latency);
+}
+
+/*
+ *
+ * Function: uitsSignEngineFree
+ * Purpose:	 Stop the workers once the queue is empty, and free the engine
+ *
+ */
+
+void uitsSignEngineFree (UITS_SIGN_ENGINE *engine)
+{
+	int i;
+
+	pthread_mutex_lock(&engine->lock);
+	engine->stopFlag = TRUE;
+	pthread_cond_broadcast(&engine->workCond);
+	pthread_mutex_unlock(&engine->lock);
+
+	for (i = 0; i < engine->numWorkers; i++) {
+		pthread_join(engine->workers[i].thread, NULL);
+		EVP_MD_CTX_destroy(engine->workers[i].ctx);
+		EVP_PKEY_free(engine->workers[i].privateKey);
+	}
+
+	vprintf("Signed %lu payloads, latency p50 %ldus p99 %ldus\n", (unsigned long) engine->numSigned,
+			uitsSignEngineGetLatency(engine, 50), uitsSignEngineGetLatency(engine, 99));
+
+	pthread_mutex_destroy(&engine->lock);
+	pthread_cond_destroy(&engine->workCond);
+	pthread_cond_destroy(&engine->doneCond);
+	free(engine);
+}
+
+/*
+ *
+ * Function: uitsSignEngineCountWorkers
+ * Purpose:	 Get the number of worker threads to start for a requested number
+ * Returns:  The requested number, or one per CPU for 0, at most SIGN_ENGINE_MAX_WORKERS
+ *
+ */
+
+int uitsSignEngineCountWorkers (int numWorkers)
+{
+	if (numWorkers <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (numWorkers <= 0) {
+			numWorkers = SIGN_ENGINE_DEFAULT_WORKERS;
+		}
+	}
+	if (numWorkers > SIGN_ENGINE_MAX_WORKERS) {
+		numWorkers = SIGN_ENGINE_MAX_WORKERS;
+	}
+
+	return (numWorkers);
+}
+
+/*
+ *
+ * Function: uitsSignEngineWorker
+ * Purpose:	 Worker thread: sign requests until the engine is stopped. Sleeps while the
+ *			 queue is empty.
+ *
+ */
+
+void *uitsSignEngineWorker (void *workerPtr)
+{
+	UITS_SIGN_WORKER  *worker = workerPtr;
+	UITS_SIGN_ENGINE  *engine = worker->engine;
+	UITS_SIGN_REQUEST *request;
+	size_t			  sampleIndex;
+	int				  stopFlag;
+
+	while (1) {
+		request = uitsSignEngineDequeue(engine);
+
+		if (!request) {
+			pthread_mutex_lock(&engine->lock);
+			__sync_fetch_and_add(&engine->numIdleWorkers, 1);
+			while (!engine->stopFlag && uitsSignEngineQueueDepth(engine) == 0) {
+				pthread_cond_wait(&engine->workCond, &engine->lock);
+			}
+			__sync_fetch_and_sub(&engine->numIdleWorkers, 1);
+			stopFlag = engine->stopFlag && uitsSignEngineQueueDepth(engine) == 0;
+			pthread_mutex_unlock(&engine->lock);
+
+			if (stopFlag) {
+				break;
+			}
+			continue;
+		}
+
+		request->signature = uitsSignMessage(worker->ctx, worker->privateKey, engine->mdType,
+											 request->message, request->messageLength, engine->b64LFFlag);
+
+		sampleIndex = __sync_fetch_and_add(&engine->numSigned, 1);
+		engine->latencies[sampleIndex % SIGN_ENGINE_LATENCY_SAMPLES] = uitsSignEngineTime() - request->submitTime;
+
+		__sync_synchronize();
+		request->doneFlag = TRUE;
+		__sync_synchronize();
+
+		if (engine->numWaiting) {
+			pthread_mutex_lock(&engine->lock);
+			pthread_cond_broadcast(&engine->doneCond);
+			pthread_mutex_unlock(&engine->lock);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsSignEngineEnqueue
+ * Purpose:	 Put a request in the queue. A slot is free for the producer at position
+ *			 p when its sequence is p.
+ * Returns:  OK, or ERROR if the queue is full
+ *
+ */
+
+int uitsSignEngineEnqueue (UITS_SIGN_ENGINE *engine, UITS_SIGN_REQUEST *request)
+{
+	UITS_SIGN_QUEUE_SLOT *slot;
+	size_t				 position = engine->enqueuePosition;
+	long				 difference;
+
+	while (1) {
+		slot = &engine->queue[position & (SIGN_ENGINE_QUEUE_SIZE - 1)];
+		__sync_synchronize();
+		difference = (long) slot->sequence - (long) position;
+
+		if (difference == 0) {
+			if (__sync_bool_compare_and_swap(&engine->enqueuePosition, position, position + 1)) {
+				break;
+			}
+		} else if (difference < 0) {
+			return (ERROR);
+		}
+		position = engine->enqueuePosition;
+	}
+
+	slot->request = request;
+	__sync_synchronize();
+	slot->sequence = position + 1;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsSignEngineDequeue
+ * Purpose:	 Take the oldest request from the queue. A slot holds a request for
+ *			 position p when its sequence is p + 1.
+ * Returns:  The request, or NULL if there isn't one
+ *
+ */
+
+UITS_SIGN_REQUEST *uitsSignEngineDequeue (UITS_SIGN_ENGINE *engine)
+{
+	UITS_SIGN_QUEUE_SLOT *slot;
+	UITS_SIGN_REQUEST	 *request;
+	size_t				 position = engine->dequeuePosition;
+	long				 difference;
+
+	while (1) {
+		slot = &engine->queue[position & (SIGN_ENGINE_QUEUE_SIZE - 1)];
+		__sync_synchronize();
+		difference = (long) slot->sequence - (long) (position + 1);
+
+		if (difference == 0) {
+			if (__sync_bool_compare_and_swap(&engine->dequeuePosition, position, position + 1)) {
+				break;
+			}
+		} else if (difference < 0) {
+			return (NULL);
+		}
+		position = engine->dequeuePosition;
+	}
+
+	request = slot->request;
+	__sync_synchronize();
+	slot->sequence = position + SIGN_ENGINE_QUEUE_SIZE;
+
+	return (request);
+}
+
+/*
+ *
+ * Function: uitsSignEngineTime
+ * Purpose:	 Get the time for latencies
+ * Returns:  Microseconds
+ *
+ */
+
+long uitsSignEngineTime (void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec * 1000000L + now.tv_usec);
+}
+
+/*
+ *
+ * Function: uitsSignEngineCompareLatency
+ * Purpose:	 qsort callback for latencies
+ *
+ */
+
+int uitsSignEngineCompareLatency (const void *latency1, const void *latency2)
+{
+	long difference = *(const long *) latency1 - *(const long *) latency2;
+
+	return ((difference > 0) - (difference < 0));
+}
+
+/*
+ *
+ * Function: uitsSignEngineLockingSetup
+ * Purpose:	 Give OpenSSL before 1.1.0 the locks it needs to be used from several
+ *			 threads. Later versions lock by themselves.
+ *
+ */
+
+void uitsSignEngineLockingSetup (void)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	int i;
+
+	if (signEngineSSLLocks) {
+		return;
+	}
+
+	signEngineSSLLocks = calloc(CRYPTO_num_locks(), sizeof(pthread_mutex_t));
+	uitsHandleErrorPTR(signEngineModuleName, "uitsSignEngineLockingSetup", signEngineSSLLocks, ERR_SSL,
+					   "Couldn't allocate OpenSSL locks\n");
+
+	for (i = 0; i < CRYPTO_num_locks(); i++) {
+		pthread_mutex_init(&signEngineSSLLocks[i], NULL);
+	}
+
+	CRYPTO_THREADID_set_callback(uitsSignEngineThreadID);
+	CRYPTO_set_locking_callback(uitsSignEngineLockingCB);
+#endif
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+
+/*
+ *
+ * Function: uitsSignEngineLockingCB
+ * Purpose:	 OpenSSL locking callback
+ *
+ */
+
+void uitsSignEngineLockingCB (int mode, int lockIndex, const char *file, int line)
+{
+	(void) file;	/* where the lock was taken, not needed here */
+	(void) line;
+
+	if (mode & CRYPTO_LOCK) {
+		pthread_mutex_lock(&signEngineSSLLocks[lockIndex]);
+	} else {
+		pthread_mutex_unlock(&signEngineSSLLocks[lockIndex]);
+	}
+}
+
+/*
+ *
+ * Function: uitsSignEngineThreadID
+ * Purpose:	 OpenSSL thread id callback
+ *
+ */
+
+void uitsSignEngineThreadID (CRYPTO_THREADID *threadID)
+{
+	CRYPTO_THREADID_set_pointer(threadID, (void *) pthread_self());
+}
+
+#endif
+
+// EOF
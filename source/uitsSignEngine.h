@@ -0,0 +1,112 @@
+/*
+ *  uitsSignEngine.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitssignengine_h_
+#  define _uitssignengine_h_
+
+#define SIGN_ENGINE_QUEUE_SIZE			256		/* requests waiting for a worker, a power of 2 */
+#define SIGN_ENGINE_MAX_WORKERS			64
+#define SIGN_ENGINE_DEFAULT_WORKERS		4		/* if the number of CPUs is unknown */
+#define SIGN_ENGINE_LATENCY_SAMPLES		4096	/* latencies kept for the percentiles */
+
+/*
+ * One message to sign. The message belongs to the caller and must not change
+ * until the request is done.
+ */
+
+typedef struct {
+	const unsigned char	*message;
+	size_t				messageLength;
+	unsigned char		*signature;			/* base 64, set by the worker, freed by the caller */
+	long				submitTime;			/* microseconds */
+	volatile int		doneFlag;
+} UITS_SIGN_REQUEST;
+
+/*
+ * Slot of the request queue. The sequence number tells producers and workers
+ * whose turn it is to use the slot.
+ */
+
+typedef struct {
+	volatile size_t		sequence;
+	UITS_SIGN_REQUEST	*request;
+} UITS_SIGN_QUEUE_SLOT;
+
+struct UITS_SIGN_ENGINE;
+
+/*
+ * A worker thread with its own copy of the key and its own signing context
+ */
+
+typedef struct {
+	struct UITS_SIGN_ENGINE	*engine;
+	pthread_t				thread;
+	EVP_PKEY				*privateKey;
+	EVP_MD_CTX				*ctx;
+} UITS_SIGN_WORKER;
+
+typedef struct UITS_SIGN_ENGINE {
+	const EVP_MD			*mdType;			/* NULL to sign the message itself */
+	int						b64LFFlag;
+	int						numWorkers;
+	UITS_SIGN_WORKER		workers [SIGN_ENGINE_MAX_WORKERS];
+
+	UITS_SIGN_QUEUE_SLOT	queue [SIGN_ENGINE_QUEUE_SIZE];
+	volatile size_t			enqueuePosition;
+	volatile size_t			dequeuePosition;
+
+	/* only used to sleep when there is nothing to do */
+	pthread_mutex_t			lock;
+	pthread_cond_t			workCond;			/* a request was queued */
+	pthread_cond_t			doneCond;			/* a request was signed */
+	volatile int			numIdleWorkers;
+	volatile int			numWaiting;
+	volatile int			stopFlag;
+
+	volatile size_t			numSigned;
+	long					latencies [SIGN_ENGINE_LATENCY_SAMPLES];	/* microseconds, the last ones signed */
+} UITS_SIGN_ENGINE;
+
+/*
+ * PUBLIC Functions
+ */
+
+UITS_SIGN_ENGINE	*uitsSignEngineCreate		(char *privateKeyFileName, char *digestName, int b64LFFlag, int numWorkers);
+void				uitsSignEngineSubmit		(UITS_SIGN_ENGINE *engine, UITS_SIGN_REQUEST *request);
+unsigned char		*uitsSignEngineWait			(UITS_SIGN_ENGINE *engine, UITS_SIGN_REQUEST *request);
+int					uitsSignEngineQueueDepth	(UITS_SIGN_ENGINE *engine);
+long				uitsSignEngineGetLatency	(UITS_SIGN_ENGINE *engine, int percentile);
+int					uitsSignEngineCountWorkers	(int numWorkers);
+void				uitsSignEngineFree			(UITS_SIGN_ENGINE *engine);
+void				uitsSignEngineLockingSetup	(void);
+
+/*
+ * PRIVATE Functions
+ */
+
+void	*uitsSignEngineWorker		(void *workerPtr);
+int		uitsSignEngineEnqueue		(UITS_SIGN_ENGINE *engine, UITS_SIGN_REQUEST *request);
+UITS_SIGN_REQUEST *uitsSignEngineDequeue (UITS_SIGN_ENGINE *engine);
+long	uitsSignEngineTime			(void);
+int		uitsSignEngineCompareLatency (const void *latency1, const void *latency2);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+void	uitsSignEngineLockingCB		(int mode, int lockIndex, const char *file, int line);
+void	uitsSignEngineThreadID		(CRYPTO_THREADID *threadID);
+#endif
+
+#endif
+
+// EOF
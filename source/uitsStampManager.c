@@ -0,0 +1,369 @@
+/*
+ *  uitsStampManager.c
+ *  UITS_Tool
+ *
+ *  Stamps one audio file with a different payload for each download. The asset is
+ *  prepared once: the format is identified, the media hash is calculated and an embed
+ *  plan is made (see uitsEmbedPlan.c), and the metadata that is the same for every
+ *  download is rendered into a payload template (see uitsPayloadWriter.c). For each
+ *  download only the per-user metadata (TID, UID) is copied into the template, the
+ *  payload is signed and the output is written from the plan, with the audio copied
+ *  inside the kernel. The private key is cached
+ *  by uitsOpenSSL.c, so the per-download cost is one signature plus writing the output.
+ *  Stamp lists can also be signed on several threads (see uitsSignEngine.c).
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *stampModuleName = "uitsStampManager.c";
+
+/*
+ *
+ * Function: uitsStampPrepareAsset
+ * Purpose:	 Do all of the work that is the same for every payload stamped into an
+ *			 audio file
+ * Passed:   Audio file name, media hash value (NULL to calculate it from the audio),
+ *			 TRUE to base 64 encode a calculated media hash, XSD file name
+ * Returns:  Pointer to the prepared asset or exit on error
+ *
+ */
+
+UITS_STAMP_ASSET *uitsStampPrepareAsset (char *audioFileName,
+										 char *mediaHashValue,
+										 int  b64MediaHashFlag,
+										 char *XSDFileName)
+{
+	UITS_STAMP_ASSET *asset;
+	char			 *hexMediaHash;
+
+	vprintf("Preparing %s for stamping ...\n", audioFileName);
+
+	asset = calloc(1, sizeof(UITS_STAMP_ASSET));
+	uitsHandleErrorPTR(stampModuleName, "uitsStampPrepareAsset", asset, ERR_CREATE, "Couldn't allocate stamp asset\n");
+
+	asset->audioFileName = audioFileName;
+	asset->XSDFileName	 = XSDFileName;
+	asset->audioCB		 = uitsAudioGetCB(audioFileName);
+	asset->payloadWriter = uitsPayloadWriterCreate();
+
+	/* the metadata description is filled in from the command line by now */
+	asset->payloadTemplate = uitsPayloadTemplateCreate(UITS_XML, uitsGetMetadataDesc());
+	asset->mediaSlot	   = uitsPayloadTemplateGetSlot(asset->payloadTemplate, "Media");
+	asset->tidSlot		   = uitsPayloadTemplateGetSlot(asset->payloadTemplate, "TID");
+	asset->uidSlot		   = uitsPayloadTemplateGetSlot(asset->payloadTemplate, "UID");
+
+	/* without a plan every stamp goes through the format's regular embed */
+	asset->plan = uitsEmbedPlanCreate(audioFileName);
+
+	if (mediaHashValue) {
+		asset->mediaHashValue = mediaHashValue;
+	} else {
+		asset->mediaHashValue = asset->audioCB->uitsAudioGetMediaHash(audioFileName);
+		uitsHandleErrorPTR(stampModuleName, "uitsStampPrepareAsset", asset->mediaHashValue, ERR_HASH,
+						   "Couldn't calculate media hash\n");
+
+		if (b64MediaHashFlag) {
+			hexMediaHash = asset->mediaHashValue;
+			asset->mediaHashValue = uitsBase64Encode(hexMediaHash, strlen(hexMediaHash), TRUE);
+			free(hexMediaHash);
+		}
+	}
+
+	vprintf("\tMedia hash: %s\n", asset->mediaHashValue);
+
+	return (asset);
+}
+
+/*
+ *
+ * Function: uitsStampAsset
+ * Purpose:	 Create a payload with the per-download TID and UID and write a copy of the
+ *			 asset with the payload embedded. The other metadata values come from the
+ *			 command line.
+ * Passed:   Prepared asset, output file name, TID and UID values (either may be NULL to
+ *			 use the command-line value), signature description, MP3 pad bytes
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsStampAsset (UITS_STAMP_ASSET *asset,
+					char *audioOutFileName,
+					char *tidValue,
+					char *uidValue,
+					UITS_signature_desc *uitsSignatureDesc,
+					int  numPadBytes)
+{
+	char	*slotValues [PAYLOAD_TEMPLATE_MAX_SLOTS];
+	char	*payloadXMLString;
+
+	uitsStampGetSlotValues(asset, audioOutFileName, tidValue, uidValue, slotValues);
+
+	payloadXMLString = uitsPayloadWriteTemplate(asset->payloadWriter, asset->payloadTemplate, slotValues, uitsSignatureDesc);
+
+	return (uitsStampWrite(asset, audioOutFileName, payloadXMLString, uitsSignatureDesc, numPadBytes));
+}
+
+/*
+ *
+ * Function: uitsStampList
+ * Purpose:	 Stamp an asset once for each line of a stamp list file. Each line is
+ *				output-file TID UID
+ *			 separated by white space. Use - for a TID or UID that isn't set. Blank lines
+ *			 and lines starting with # are skipped.
+ *			 With more than one signing thread, up to STAMP_PIPELINE_DEPTH payloads are
+ *			 signed by a uitsSignEngine while earlier ones are written. The files are
+ *			 still written in the order of the list.
+ * Passed:   Prepared asset, stamp list file name, signature description, MP3 pad bytes,
+ *			 number of signing threads (1 to sign inline, 0 for one per CPU)
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsStampList (UITS_STAMP_ASSET *asset,
+				   char *stampListFileName,
+				   UITS_signature_desc *uitsSignatureDesc,
+				   int  numPadBytes,
+				   int  numSignThreads)
+{
+	FILE			 *listFP;
+	char			 line[STAMP_LINE_SIZE];
+	char			 *audioOutFileName;
+	char			 *tidValue;
+	char			 *uidValue;
+	unsigned long	 lineNumber = 0;
+	UITS_SIGN_ENGINE *signEngine = NULL;
+	UITS_STAMP_SLOT	 *stampSlots = NULL;
+	int				 nextSlot = 0;
+	int				 i;
+
+	listFP = uitsIOOpen(stampListFileName, "r");
+	uitsHandleErrorPTR(stampModuleName, "uitsStampList", listFP, ERR_FILE, "Couldn't open stamp list file\n");
+
+	if (numSignThreads != 1) {
+		signEngine = uitsSignEngineCreate(uitsSignatureDesc->privateKeyFileName,
+										  uitsGetSignatureAlgorithm(uitsSignatureDesc->algorithm)->digestName,
+										  uitsSignatureDesc->b64LFFlag,
+										  numSignThreads);
+
+		stampSlots = calloc(STAMP_PIPELINE_DEPTH, sizeof(UITS_STAMP_SLOT));
+		uitsHandleErrorPTR(stampModuleName, "uitsStampList", stampSlots, ERR_CREATE, "Couldn't allocate stamp pipeline\n");
+		for (i = 0; i < STAMP_PIPELINE_DEPTH; i++) {
+			stampSlots[i].payloadWriter = uitsPayloadWriterCreate();
+		}
+	}
+
+	while (fgets(line, STAMP_LINE_SIZE, listFP)) {
+		lineNumber++;
+
+		audioOutFileName = strtok(line, " \t\r\n");
+		if (!audioOutFileName || audioOutFileName[0] == '#') {
+			continue;
+		}
+		tidValue = strtok(NULL, " \t\r\n");
+		uidValue = strtok(NULL, " \t\r\n");
+
+		if (!tidValue || !uidValue || strtok(NULL, " \t\r\n")) {
+			snprintf(errStr, ERRSTR_LEN, "Error: Stamp list line %lu must have an output file, TID and UID\n", lineNumber);
+			uitsHandleErrorINT(stampModuleName, "uitsStampList", ERROR, OK, ERR_PARAM, errStr);
+		}
+
+		if (strcmp(audioOutFileName, asset->audioFileName) == 0) {
+			snprintf(errStr, ERRSTR_LEN, "Error: Stamp list line %lu would overwrite the audio file\n", lineNumber);
+			uitsHandleErrorINT(stampModuleName, "uitsStampList", ERROR, OK, ERR_PARAM, errStr);
+		}
+
+		tidValue = strcmp(tidValue, STAMP_EMPTY_FIELD) ? tidValue : NULL;
+		uidValue = strcmp(uidValue, STAMP_EMPTY_FIELD) ? uidValue : NULL;
+
+		if (signEngine) {
+			/* the slot's last payload is the oldest one in the pipeline */
+			if (stampSlots[nextSlot].busyFlag) {
+				uitsStampFinishSlot(asset, signEngine, &stampSlots[nextSlot], uitsSignatureDesc, numPadBytes);
+			}
+			uitsStampSubmitSlot(asset, signEngine, &stampSlots[nextSlot], audioOutFileName, tidValue, uidValue);
+			nextSlot = (nextSlot + 1) % STAMP_PIPELINE_DEPTH;
+			continue;
+		}
+
+		err = uitsStampAsset(asset, audioOutFileName, tidValue, uidValue, uitsSignatureDesc, numPadBytes);
+		uitsHandleErrorINT(stampModuleName, "uitsStampList", err, OK, ERR_CREATE, "Couldn't stamp audio file\n");
+	}
+
+	fclose(listFP);
+
+	if (signEngine) {
+		for (i = 0; i < STAMP_PIPELINE_DEPTH; i++) {
+			if (stampSlots[nextSlot].busyFlag) {
+				uitsStampFinishSlot(asset, signEngine, &stampSlots[nextSlot], uitsSignatureDesc, numPadBytes);
+			}
+			uitsPayloadWriterFree(stampSlots[nextSlot].payloadWriter);
+			nextSlot = (nextSlot + 1) % STAMP_PIPELINE_DEPTH;
+		}
+		free(stampSlots);
+		uitsSignEngineFree(signEngine);
+	}
+
+	vprintf("Stamped %lu files\n", asset->numStamps);
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsStampGetSlotValues
+ * Purpose:	 Get the template slot values for one payload
+ *
+ */
+
+void uitsStampGetSlotValues (UITS_STAMP_ASSET *asset,
+							 char *audioOutFileName,
+							 char *tidValue,
+							 char *uidValue,
+							 char **slotValues)
+{
+	vprintf("Stamping %s ...\n", audioOutFileName);
+
+	/* Time, nonce and AssetID keep their command-line values; a Time without one is set when the payload is written */
+	uitsPayloadTemplateGetValues(asset->payloadTemplate, slotValues);
+
+	slotValues[asset->mediaSlot] = asset->mediaHashValue;
+	if (tidValue) {
+		slotValues[asset->tidSlot] = tidValue;
+	}
+	if (uidValue) {
+		slotValues[asset->uidSlot] = uidValue;
+	}
+
+	if (!slotValues[asset->tidSlot] && !slotValues[asset->uidSlot]) {
+		snprintf(errStr, ERRSTR_LEN, "Error: Can't stamp %s. No TID or UID value.\n", audioOutFileName);
+		uitsHandleErrorINT(stampModuleName, "uitsStampAsset", ERROR, OK, ERR_PARAM, errStr);
+	}
+}
+
+/*
+ *
+ * Function: uitsStampWrite
+ * Purpose:	 Write a copy of the asset with a signed payload embedded. The first payload
+ *			 for an asset is validated against the schema and its signature is checked;
+ *			 later payloads only differ in their values, so they are not validated again.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsStampWrite (UITS_STAMP_ASSET *asset,
+					char *audioOutFileName,
+					char *payloadXMLString,
+					UITS_signature_desc *uitsSignatureDesc,
+					int  numPadBytes)
+{
+	FILE	*audioOutFP;
+
+	if (!asset->validatedFlag) {
+		err = uitsVerifyPayloadString(payloadXMLString, asset->XSDFileName, VERIFY_LEVEL_SCHEMA, uitsSignatureDesc);
+		uitsHandleErrorINT(stampModuleName, "uitsStampAsset", err, OK, ERR_PAYLOAD, "Error: Couldn't validate XML payload\n");
+		asset->validatedFlag = TRUE;
+	}
+
+	if (asset->plan) {
+		audioOutFP = uitsIOOpen(audioOutFileName, "wb");
+		uitsHandleErrorPTR(stampModuleName, "uitsStampAsset", audioOutFP, ERR_FILE, "Couldn't open audio output file\n");
+
+		err = uitsEmbedPlanWrite(asset->plan, audioOutFP, payloadXMLString, numPadBytes);
+		uitsHandleErrorINT(stampModuleName, "uitsStampAsset", err, OK, ERR_EMBED, "Couldn't embed payload into audio\n");
+
+		err = fclose(audioOutFP);
+		uitsHandleErrorINT(stampModuleName, "uitsStampAsset", err, OK, ERR_FILE, "Couldn't write audio output file\n");
+	} else {
+		err = uitsAudioEmbedPayload(asset->audioFileName, audioOutFileName, payloadXMLString, numPadBytes);
+		uitsHandleErrorINT(stampModuleName, "uitsStampAsset", err, OK, ERR_EMBED, "Couldn't embed payload into audio\n");
+	}
+
+	asset->numStamps++;
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsStampSubmitSlot
+ * Purpose:	 Write a payload up to the end of its metadata in a pipeline slot, and
+ *			 queue the metadata to be signed
+ *
+ */
+
+void uitsStampSubmitSlot (UITS_STAMP_ASSET *asset,
+						  UITS_SIGN_ENGINE *signEngine,
+						  UITS_STAMP_SLOT *stampSlot,
+						  char *audioOutFileName,
+						  char *tidValue,
+						  char *uidValue)
+{
+	char	*slotValues [PAYLOAD_TEMPLATE_MAX_SLOTS];
+	char	*metadataString;
+
+	uitsStampGetSlotValues(asset, audioOutFileName, tidValue, uidValue, slotValues);
+
+	metadataString = uitsPayloadWriteTemplateMetadata(stampSlot->payloadWriter, asset->payloadTemplate, slotValues);
+
+	/* the line buffer is reused for the next line */
+	strcpy(stampSlot->audioOutFileName, audioOutFileName);
+
+	stampSlot->request.message		 = metadataString;
+	stampSlot->request.messageLength = strlen(metadataString);
+	stampSlot->busyFlag				 = TRUE;
+
+	uitsSignEngineSubmit(signEngine, &stampSlot->request);
+	dprintf("signing queue depth %d\n", uitsSignEngineQueueDepth(signEngine));
+}
+
+/*
+ *
+ * Function: uitsStampFinishSlot
+ * Purpose:	 Wait for the signature of a pipeline slot's payload, finish the payload and
+ *			 write the output file
+ *
+ */
+
+void uitsStampFinishSlot (UITS_STAMP_ASSET *asset,
+						  UITS_SIGN_ENGINE *signEngine,
+						  UITS_STAMP_SLOT *stampSlot,
+						  UITS_signature_desc *uitsSignatureDesc,
+						  int  numPadBytes)
+{
+	unsigned char	*encodedSignature;
+	char			*payloadXMLString;
+
+	encodedSignature = uitsSignEngineWait(signEngine, &stampSlot->request);
+	payloadXMLString = uitsPayloadWriterPutSignatureValue(stampSlot->payloadWriter, uitsSignatureDesc, encodedSignature);
+	free(encodedSignature);
+
+	err = uitsStampWrite(asset, stampSlot->audioOutFileName, payloadXMLString, uitsSignatureDesc, numPadBytes);
+	uitsHandleErrorINT(stampModuleName, "uitsStampList", err, OK, ERR_CREATE, "Couldn't stamp audio file\n");
+
+	stampSlot->busyFlag = FALSE;
+}
+
+/*
+ *
+ * Function: uitsStampFreeAsset
+ * Purpose:	 Free a prepared asset
+ *
+ */
+
+void uitsStampFreeAsset (UITS_STAMP_ASSET *asset)
+{
+	if (asset->plan) {
+		uitsEmbedPlanFree(asset->plan);
+	}
+	uitsPayloadTemplateFree(asset->payloadTemplate);
+	uitsPayloadWriterFree(asset->payloadWriter);
+	free(asset);
+}
+
+// EOF
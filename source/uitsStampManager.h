@@ -0,0 +1,91 @@
+/*
+ *  uitsStampManager.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsstampmanager_h_
+#  define _uitsstampmanager_h_
+
+#define STAMP_LINE_SIZE		4096
+#define STAMP_EMPTY_FIELD	"-"			/* stamp list placeholder for a value that isn't set */
+#define STAMP_PIPELINE_DEPTH	64		/* payloads being signed while earlier ones are written */
+
+/*
+ * An audio file that is stamped with many payloads. Everything that doesn't depend
+ * on the per-download metadata is worked out once when the asset is prepared.
+ */
+
+typedef struct {
+	char					*audioFileName;		/* the master file */
+	UITS_AUDIO_CALLBACKS	*audioCB;
+	UITS_EMBED_PLAN			*plan;				/* NULL if the format has no embed plan */
+	char					*mediaHashValue;	/* hex, or base 64 if requested */
+	char					*XSDFileName;
+	UITS_PAYLOAD_WRITER		*payloadWriter;		/* reused for every payload */
+	UITS_PAYLOAD_TEMPLATE	*payloadTemplate;	/* the metadata that is the same for every payload */
+	int						mediaSlot;			/* template slots filled in for each payload */
+	int						tidSlot;
+	int						uidSlot;
+	int						validatedFlag;		/* TRUE once a payload for this asset has passed validation */
+	unsigned long			numStamps;
+} UITS_STAMP_ASSET;
+
+/*
+ * A payload of a stamp list waiting for its signature
+ */
+
+typedef struct {
+	UITS_PAYLOAD_WRITER	*payloadWriter;
+	UITS_SIGN_REQUEST	request;
+	char				audioOutFileName [STAMP_LINE_SIZE];
+	int					busyFlag;
+} UITS_STAMP_SLOT;
+
+/*
+ * PUBLIC Functions
+ */
+
+UITS_STAMP_ASSET	*uitsStampPrepareAsset	(char *audioFileName,
+											 char *mediaHashValue,
+											 int  b64MediaHashFlag,
+											 char *XSDFileName);
+int					uitsStampAsset			(UITS_STAMP_ASSET *asset,
+											 char *audioOutFileName,
+											 char *tidValue,
+											 char *uidValue,
+											 UITS_signature_desc *uitsSignatureDesc,
+											 int  numPadBytes);
+int					uitsStampList			(UITS_STAMP_ASSET *asset,
+											 char *stampListFileName,
+											 UITS_signature_desc *uitsSignatureDesc,
+											 int  numPadBytes,
+											 int  numSignThreads);
+void				uitsStampFreeAsset		(UITS_STAMP_ASSET *asset);
+
+/*
+ * PRIVATE Functions
+ */
+
+void	uitsStampGetSlotValues	(UITS_STAMP_ASSET *asset, char *audioOutFileName, char *tidValue, char *uidValue,
+								 char **slotValues);
+int		uitsStampWrite			(UITS_STAMP_ASSET *asset, char *audioOutFileName, char *payloadXMLString,
+								 UITS_signature_desc *uitsSignatureDesc, int numPadBytes);
+void	uitsStampSubmitSlot		(UITS_STAMP_ASSET *asset, UITS_SIGN_ENGINE *signEngine, UITS_STAMP_SLOT *stampSlot,
+								 char *audioOutFileName, char *tidValue, char *uidValue);
+void	uitsStampFinishSlot		(UITS_STAMP_ASSET *asset, UITS_SIGN_ENGINE *signEngine, UITS_STAMP_SLOT *stampSlot,
+								 UITS_signature_desc *uitsSignatureDesc, int numPadBytes);
+
+#endif
+
+// EOF
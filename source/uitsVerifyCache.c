@@ -0,0 +1,426 @@
+/*
+ *  uitsVerifyCache.c
+ *  UITS_Tool
+ *
+ *  Cache of the payloads that passed schema validation, so that verifying the same
+ *  payload again (another copy of a file, or another stage of a pipeline) is a
+ *  SHA256 and a table lookup instead of the schema check. A payload is identified by
+ *  the SHA256 of all of its bytes. Only successes are recorded.
+ *
+ *  Only the schema check is skipped. The signature and the media hash are always
+ *  checked, so an entry can't make a payload with a bad signature or the wrong audio
+ *  pass. Anyone who can write to the cache file can at worst make a payload that
+ *  doesn't match the schema skip validation, and its signature is checked anyway.
+ *
+ *  The entries are only valid for one schema. Its SHA256 is kept with the entries,
+ *  and when the schema changes the entries are dropped.
+ *
+ *  The cache lives for the process, and can also be kept in a file between runs.
+ *  The file starts with a header line with the schema digest
+ *		# UITS verify cache 1 schema-digest
+ *  followed by an append-only log with one payload digest per line. If the file was
+ *  written for another schema, it is started again. A new file is created readable
+ *  and writable by its owner only, and lines that aren't a SHA256 are skipped when
+ *  it is loaded.
+ *
+ *  The cache can be used by several verification threads at once.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *verifyCacheModuleName = "uitsVerifyCache.c";
+
+char					*verifyCacheFileName = NULL;				/* NULL if the cache isn't kept in a file */
+char					verifyCacheSchema [VERIFY_CACHE_DIGEST_SIZE];		/* schema digest of the entries in the table */
+char					verifyCacheFileSchema [VERIFY_CACHE_DIGEST_SIZE];	/* schema digest in the header of the file */
+int						verifyCacheSchemaFlag = FALSE;			/* TRUE once the schema is known */
+char					*verifyCacheXSDFileName = NULL;			/* file the schema digest was last read from */
+UITS_VERIFY_CACHE_ENTRY *verifyCacheTable [VERIFY_CACHE_BUCKETS];
+pthread_mutex_t			verifyCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *
+ * Function: uitsVerifyCacheOpen
+ * Purpose:	 Keep the cache in a file, and load the file if it exists. The file is
+ *			 (re)written when the schema is set.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsVerifyCacheOpen (char *cacheFileName)
+{
+	FILE *cacheFP;
+
+	verifyCacheFileName = cacheFileName;
+
+	cacheFP = uitsIOOpen(verifyCacheFileName, "r");
+	if (cacheFP) {
+		fclose(cacheFP);
+		return (uitsVerifyCacheLoad());
+	}
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheSetSchema
+ * Purpose:	 Set the schema that payloads are validated against. The cached entries are
+ *			 dropped if they were recorded with another schema. If the schema file can't
+ *			 be read, the cache isn't used and the validation reports the error.
+ *
+ */
+
+void uitsVerifyCacheSetSchema (char *XSDFileName)
+{
+	EVP_MD_CTX	  *ctx;
+	unsigned char schemaDigest [EVP_MAX_MD_SIZE];
+	unsigned int  schemaDigestLength;
+	char		  schema [VERIFY_CACHE_DIGEST_SIZE];
+	FILE		  *cacheFP;
+	int			  result;
+
+	if (verifyCacheSchemaFlag && !strcmp(verifyCacheXSDFileName, XSDFileName)) {
+		return;
+	}
+
+	ctx = EVP_MD_CTX_create();
+	EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+	result = uitsVerifyCacheDigestFile(ctx, XSDFileName);
+	EVP_DigestFinal_ex(ctx, schemaDigest, &schemaDigestLength);
+	EVP_MD_CTX_destroy(ctx);
+
+	pthread_mutex_lock(&verifyCacheLock);
+
+	verifyCacheSchemaFlag = FALSE;
+	if (result != OK) {
+		pthread_mutex_unlock(&verifyCacheLock);
+		return;
+	}
+
+	uitsVerifyCacheHexDigest(schemaDigest, schemaDigestLength, schema);
+
+	if (strcmp(schema, verifyCacheSchema)) {
+		dprintf("Verify cache schema is now %s\n", schema);
+		uitsVerifyCacheClear();
+		strcpy(verifyCacheSchema, schema);
+	}
+
+	if (verifyCacheFileName && strcmp(schema, verifyCacheFileSchema)) {
+		vprintf("\tStarting verify cache file %s for this schema\n", verifyCacheFileName);
+		cacheFP = uitsVerifyCacheOpenFile("w");
+		uitsHandleErrorPTR(verifyCacheModuleName, "uitsVerifyCacheSetSchema", cacheFP, ERR_FILE,
+						   "Couldn't create verify cache file\n");
+
+		fprintf(cacheFP, "%s %s\n", VERIFY_CACHE_HEADER, schema);
+		err = fclose(cacheFP);
+		uitsHandleErrorINT(verifyCacheModuleName, "uitsVerifyCacheSetSchema", err, OK, ERR_FILE,
+						   "Couldn't write verify cache file\n");
+		strcpy(verifyCacheFileSchema, schema);
+	}
+
+	free(verifyCacheXSDFileName);
+	verifyCacheXSDFileName = strdup(XSDFileName);
+	verifyCacheSchemaFlag  = TRUE;
+
+	pthread_mutex_unlock(&verifyCacheLock);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheLookup
+ * Purpose:	 Find out if a payload passed schema validation before with the current schema
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsVerifyCacheLookup (char *payloadXMLString)
+{
+	char payloadDigest [VERIFY_CACHE_DIGEST_SIZE];
+	int	 found;
+
+	if (!verifyCacheSchemaFlag) {
+		return (FALSE);
+	}
+
+	uitsVerifyCacheGetDigest((unsigned char *) payloadXMLString, strlen(payloadXMLString), payloadDigest);
+
+	pthread_mutex_lock(&verifyCacheLock);
+	found = (uitsVerifyCacheFind(payloadDigest) != NULL);
+	pthread_mutex_unlock(&verifyCacheLock);
+
+	return (found);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheAdd
+ * Purpose:	 Record that a payload passed schema validation with the current schema
+ *
+ */
+
+void uitsVerifyCacheAdd (char *payloadXMLString)
+{
+	char payloadDigest [VERIFY_CACHE_DIGEST_SIZE];
+	FILE *cacheFP;
+
+	if (!verifyCacheSchemaFlag) {
+		return;
+	}
+
+	uitsVerifyCacheGetDigest((unsigned char *) payloadXMLString, strlen(payloadXMLString), payloadDigest);
+
+	pthread_mutex_lock(&verifyCacheLock);
+
+	if (uitsVerifyCacheFind(payloadDigest)) {
+		pthread_mutex_unlock(&verifyCacheLock);
+		return;
+	}
+
+	uitsVerifyCacheInsert(payloadDigest);
+
+	if (verifyCacheFileName) {
+		cacheFP = uitsVerifyCacheOpenFile("a");
+		uitsHandleErrorPTR(verifyCacheModuleName, "uitsVerifyCacheAdd", cacheFP, ERR_FILE, "Couldn't open verify cache file\n");
+
+		fprintf(cacheFP, "%s\n", payloadDigest);
+
+		if (fclose(cacheFP) != OK) {
+			uitsHandleErrorINT(verifyCacheModuleName, "uitsVerifyCacheAdd", ERROR, OK, ERR_FILE,
+							   "Couldn't write verify cache file\n");
+		}
+	}
+
+	pthread_mutex_unlock(&verifyCacheLock);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheLoad
+ * Purpose:	 Read the cache file into the hash table. Lines that aren't a 64 character
+ *			 hex digest are skipped. The entries are for the schema in the header.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int uitsVerifyCacheLoad (void)
+{
+	FILE *cacheFP;
+	char line[VERIFY_CACHE_LINE_SIZE];
+	char payloadDigest[VERIFY_CACHE_DIGEST_SIZE];
+	int	 numEntries = 0;
+
+	cacheFP = uitsIOOpen(verifyCacheFileName, "r");
+	uitsHandleErrorPTR(verifyCacheModuleName, "uitsVerifyCacheLoad", cacheFP, ERR_FILE, "Couldn't open verify cache file\n");
+
+	if (!fgets(line, VERIFY_CACHE_LINE_SIZE, cacheFP) ||
+		strncmp(line, VERIFY_CACHE_HEADER " ", strlen(VERIFY_CACHE_HEADER) + 1) ||
+		sscanf(line + strlen(VERIFY_CACHE_HEADER), "%64s", verifyCacheFileSchema) != 1 ||
+		!uitsVerifyCacheIsDigest(verifyCacheFileSchema)) {
+		fclose(cacheFP);
+		verifyCacheFileSchema[0] = '\0';
+		vprintf("\tVerify cache file %s has no header, starting it again\n", verifyCacheFileName);
+		return (OK);
+	}
+
+	uitsVerifyCacheClear();
+	strcpy(verifyCacheSchema, verifyCacheFileSchema);
+
+	while (fgets(line, VERIFY_CACHE_LINE_SIZE, cacheFP)) {
+		if (line[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%64s", payloadDigest) != 1 || !uitsVerifyCacheIsDigest(payloadDigest)) {
+			continue;
+		}
+		uitsVerifyCacheInsert(payloadDigest);
+		numEntries++;
+	}
+
+	fclose(cacheFP);
+
+	dprintf("Loaded %d schema-valid payloads from %s\n", numEntries, verifyCacheFileName);
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheOpenFile
+ * Purpose:	 Open the cache file for writing ("w") or appending ("a"). A file that doesn't
+ *			 exist yet is created with mode 0600, whatever the umask.
+ * Returns:  File pointer or NULL on error
+ *
+ */
+
+FILE *uitsVerifyCacheOpenFile (char *mode)
+{
+	FILE *cacheFP;
+	int	 fd;
+	int	 flags = O_WRONLY | O_CREAT | ((mode[0] == 'a') ? O_APPEND : O_TRUNC);
+
+	fd = open(verifyCacheFileName, flags, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		return (NULL);
+	}
+
+	cacheFP = fdopen(fd, mode);
+	if (!cacheFP) {
+		close(fd);
+	}
+
+	return (cacheFP);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheIsDigest
+ * Purpose:	 Check that a string is a hex SHA256 as written by uitsVerifyCacheHexDigest
+ * Returns:  TRUE or FALSE
+ *
+ */
+
+int uitsVerifyCacheIsDigest (char *digestString)
+{
+	return ((strlen(digestString) == VERIFY_CACHE_DIGEST_SIZE - 1) &&
+			(strspn(digestString, "0123456789abcdef") == VERIFY_CACHE_DIGEST_SIZE - 1));
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheClear
+ * Purpose:	 Drop every entry from the hash table
+ *
+ */
+
+void uitsVerifyCacheClear (void)
+{
+	UITS_VERIFY_CACHE_ENTRY *entry;
+	UITS_VERIFY_CACHE_ENTRY *nextEntry;
+	int						bucket;
+
+	for (bucket = 0; bucket < VERIFY_CACHE_BUCKETS; bucket++) {
+		for (entry = verifyCacheTable[bucket]; entry; entry = nextEntry) {
+			nextEntry = entry->next;
+			free(entry);
+		}
+		verifyCacheTable[bucket] = NULL;
+	}
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheDigestFile
+ * Purpose:	 Add the contents of a file to a digest
+ * Returns:  OK or ERROR if the file can't be read
+ *
+ */
+
+int uitsVerifyCacheDigestFile (EVP_MD_CTX *ctx, char *fileName)
+{
+	FILE		  *fp;
+	unsigned char buffer [VERIFY_CACHE_READ_SIZE];
+	size_t		  length;
+
+	fp = uitsIOOpen(fileName, "rb");
+	if (!fp) {
+		return (ERROR);
+	}
+
+	while ((length = fread(buffer, 1, VERIFY_CACHE_READ_SIZE, fp)) > 0) {
+		EVP_DigestUpdate(ctx, buffer, length);
+	}
+
+	fclose(fp);
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheGetDigest
+ * Purpose:	 Get the hex SHA256 of some bytes
+ *
+ */
+
+void uitsVerifyCacheGetDigest (const unsigned char *bytes, size_t length, char *digestString)
+{
+	unsigned char digest [EVP_MAX_MD_SIZE];
+	unsigned int  digestLength;
+
+	EVP_Digest(bytes, length, digest, &digestLength, EVP_sha256(), NULL);
+	uitsVerifyCacheHexDigest(digest, digestLength, digestString);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheHexDigest
+ * Purpose:	 Write a digest as a hex string
+ *
+ */
+
+void uitsVerifyCacheHexDigest (unsigned char *digest, unsigned int digestLength, char *digestString)
+{
+	unsigned int i;
+
+	for (i = 0; i < digestLength; i++) {
+		sprintf(digestString + i * 2, "%02x", digest[i]);
+	}
+	digestString[digestLength * 2] = '\0';
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheFind
+ * Purpose:	 Find the entry for a payload digest. The lock must be held.
+ * Returns:  The entry or NULL
+ *
+ */
+
+UITS_VERIFY_CACHE_ENTRY *uitsVerifyCacheFind (char *payloadDigest)
+{
+	UITS_VERIFY_CACHE_ENTRY *entry;
+
+	for (entry = verifyCacheTable[strtoul(payloadDigest + 56, NULL, 16) % VERIFY_CACHE_BUCKETS]; entry; entry = entry->next) {
+		if (!strcmp(entry->payloadDigest, payloadDigest)) {
+			return (entry);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsVerifyCacheInsert
+ * Purpose:	 Add a payload digest to the hash table. The lock must be held (or no
+ *			 threads started).
+ *
+ */
+
+void uitsVerifyCacheInsert (char *payloadDigest)
+{
+	UITS_VERIFY_CACHE_ENTRY *entry;
+	int						bucket;
+
+	if (uitsVerifyCacheFind(payloadDigest)) {
+		return;
+	}
+
+	entry = calloc(1, sizeof(UITS_VERIFY_CACHE_ENTRY));
+	uitsHandleErrorPTR(verifyCacheModuleName, "uitsVerifyCacheInsert", entry, ERR_VERIFY, "Couldn't allocate verify cache entry\n");
+
+	bucket = strtoul(payloadDigest + 56, NULL, 16) % VERIFY_CACHE_BUCKETS;
+
+	strcpy(entry->payloadDigest, payloadDigest);
+	entry->next			   = verifyCacheTable[bucket];
+	verifyCacheTable[bucket] = entry;
+}
+
+// EOF
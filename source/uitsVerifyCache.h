@@ -0,0 +1,60 @@
+/*
+ *  uitsVerifyCache.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsverifycache_h_
+#  define _uitsverifycache_h_
+
+#define VERIFY_CACHE_BUCKETS		4096
+#define VERIFY_CACHE_LINE_SIZE		256
+#define VERIFY_CACHE_HEADER			"# UITS verify cache 1"
+#define VERIFY_CACHE_DIGEST_SIZE	65			/* hex SHA256 and the terminator */
+#define VERIFY_CACHE_READ_SIZE		8192
+
+/*
+ * A payload that passed schema validation
+ */
+
+typedef struct UITS_VERIFY_CACHE_ENTRY {
+	char							payloadDigest [VERIFY_CACHE_DIGEST_SIZE];
+	struct UITS_VERIFY_CACHE_ENTRY	*next;
+} UITS_VERIFY_CACHE_ENTRY;
+
+/*
+ * PUBLIC Functions
+ */
+
+int		uitsVerifyCacheOpen			(char *cacheFileName);
+void	uitsVerifyCacheSetSchema	(char *XSDFileName);
+int		uitsVerifyCacheLookup		(char *payloadXMLString);
+void	uitsVerifyCacheAdd			(char *payloadXMLString);
+
+/*
+ * PRIVATE Functions
+ */
+
+int		uitsVerifyCacheLoad			(void);
+FILE	*uitsVerifyCacheOpenFile	(char *mode);
+int		uitsVerifyCacheIsDigest		(char *digestString);
+void	uitsVerifyCacheClear		(void);
+int		uitsVerifyCacheDigestFile	(EVP_MD_CTX *ctx, char *fileName);
+void	uitsVerifyCacheGetDigest	(const unsigned char *bytes, size_t length, char *digestString);
+void	uitsVerifyCacheHexDigest	(unsigned char *digest, unsigned int digestLength, char *digestString);
+UITS_VERIFY_CACHE_ENTRY *uitsVerifyCacheFind (char *payloadDigest);
+void	uitsVerifyCacheInsert		(char *payloadDigest);
+
+#endif
+
+// EOF
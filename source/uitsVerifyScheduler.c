@@ -0,0 +1,402 @@
+/*
+ *  uitsVerifyScheduler.c
+ *  UITS_Tool
+ *
+ *  Verifies the payloads of a list of media files for an audit run, and reports the
+ *  result for every file instead of stopping at the first one that fails.
+ *
+ *  The payloads are extracted first. The structure, signature and schema checks then
+ *  run, cheapest first, on a pool of worker threads, which share one copy of the public
+ *  key and the parsed schema and take the next payload as they finish one. Once the
+ *  workers are done, the reference media hashes are calculated on the calling thread
+ *  (with uitsMultiHashFiles, as the audio format managers keep state between calls)
+ *  for the payloads that passed, so a file that failed a cheaper check isn't read.
+ *
+ *  Media files that can't be read, or don't have a payload, are reported as PAYLOAD
+ *  and the run goes on. A damaged payload container still stops the run as it does
+ *  for a single verify.
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+#include "uits.h"
+
+char *verifySchedulerModuleName = "uitsVerifyScheduler.c";
+
+UITS_VERIFY_RESULT_NAME verifyResultNames [] = {
+	{ OK,			"OK" },
+	{ ERR_SCHEMA,	"SCHEMA" },
+	{ ERR_PAYLOAD,	"PAYLOAD" },
+	{ ERR_SIG,		"SIGNATURE" },
+	{ ERR_HASH,		"MEDIAHASH" },
+	{ 0, NULL }
+};
+
+/*
+ *
+ * Function: uitsVerifyList
+ * Purpose:	 Verify the payload of each media file in a list, one file name per line.
+ *			 Blank lines and lines starting with # are skipped. The report has a line
+ *				result file-name
+ *			 for each file, where the result is OK or the check that failed, and ends
+ *			 with a summary line starting with #.
+ * Passed:   List file name, xsd file name, verification level (uitsVerifyLevels),
+ *			 signature description, number of threads (1 for none, 0 for one per CPU),
+ *			 report file name (NULL for standard output)
+ * Returns:  OK if every payload verified, or exit with ERR_VERIFY after the report
+ *
+ */
+
+int uitsVerifyList (char *listFileName,
+					char *XSDFileName,
+					int  verifyLevel,
+					UITS_signature_desc *uitsSignatureDesc,
+					int  numThreads,
+					char *reportFileName)
+{
+	FILE				  *listFP;
+	char				  line[VERIFY_LIST_LINE_SIZE];
+	UITS_VERIFY_ITEM	  *items = NULL;
+	UITS_VERIFY_SCHEDULER *scheduler;
+	char				  **audioFileNames;
+	char				  **mediaHashValues = NULL;
+	int					  *hashItems;
+	int					  numHashItems = 0;
+	int					  numItems = 0;
+	int					  maxItems = 0;
+	int					  numFailed;
+	int					  i;
+
+	listFP = uitsIOOpen(listFileName, "r");
+	uitsHandleErrorPTR(verifySchedulerModuleName, "uitsVerifyList", listFP, ERR_FILE, "Couldn't open verify list file\n");
+
+	while (fgets(line, VERIFY_LIST_LINE_SIZE, listFP)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!line[0] || line[0] == '#') {
+			continue;
+		}
+		if (numItems == maxItems) {
+			maxItems = maxItems ? maxItems * 2 : 64;
+			items = realloc(items, maxItems * sizeof(UITS_VERIFY_ITEM));
+			uitsHandleErrorPTR(verifySchedulerModuleName, "uitsVerifyList", items, ERR_VERIFY,
+							   "Couldn't allocate verify list\n");
+		}
+		items[numItems].audioFileName	 = strdup(line);
+		items[numItems].payloadXMLString = NULL;
+		items[numItems].mediaValue		 = NULL;
+		items[numItems].result			 = OK;
+		numItems++;
+	}
+	fclose(listFP);
+
+	vprintf("Verifying %d payloads ...\n", numItems);
+
+	for (i = 0; i < numItems; i++) {
+		items[i].payloadXMLString = uitsAudioReadPayload(items[i].audioFileName);
+		if (!items[i].payloadXMLString) {
+			vprintf("No payload in %s\n", items[i].audioFileName);
+			items[i].result = ERR_PAYLOAD;
+		}
+	}
+
+	scheduler = uitsVerifySchedulerCreate(items, numItems, XSDFileName, verifyLevel, uitsSignatureDesc, numThreads);
+	uitsVerifySchedulerFinish(scheduler);
+
+	/* the media hash reads all of the audio, so only files that passed the other checks are hashed */
+	if (verifyLevel == VERIFY_LEVEL_FULL) {
+		audioFileNames = calloc(numItems + 1, sizeof(char *));
+		hashItems	   = calloc(numItems + 1, sizeof(int));
+		uitsHandleErrorPTR(verifySchedulerModuleName, "uitsVerifyList", audioFileNames, ERR_VERIFY,
+						   "Couldn't allocate verify list\n");
+		uitsHandleErrorPTR(verifySchedulerModuleName, "uitsVerifyList", hashItems, ERR_VERIFY,
+						   "Couldn't allocate verify list\n");
+		for (i = 0; i < numItems; i++) {
+			if (items[i].result == OK) {
+				hashItems[numHashItems]		 = i;
+				audioFileNames[numHashItems] = items[i].audioFileName;
+				numHashItems++;
+			}
+		}
+		dprintf("Hashing the audio of %d of %d files\n", numHashItems, numItems);
+
+		if (numHashItems) {
+			mediaHashValues = uitsMultiHashFiles(audioFileNames, numHashItems);
+			for (i = 0; i < numHashItems; i++) {
+				if (uitsMatchMediaHash(mediaHashValues[i], items[hashItems[i]].mediaValue) != OK) {
+					items[hashItems[i]].result = ERR_HASH;
+				}
+				free(mediaHashValues[i]);
+			}
+			free(mediaHashValues);
+		}
+		free(audioFileNames);
+		free(hashItems);
+	}
+
+	numFailed = uitsVerifySchedulerReport(items, numItems, reportFileName);
+
+	for (i = 0; i < numItems; i++) {
+		free(items[i].audioFileName);
+		free(items[i].payloadXMLString);
+		free(items[i].mediaValue);
+	}
+	free(items);
+
+	snprintf(errStr, ERRSTR_LEN, "Error: %d of %d payloads failed verification\n", numFailed, numItems);
+	uitsHandleErrorINT(verifySchedulerModuleName, "uitsVerifyList", numFailed, 0, ERR_VERIFY, errStr);
+
+	vprintf("All payloads verified!\n");
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: uitsVerifySchedulerCreate
+ * Purpose:	 Load the public key and the schema the level needs, and start the workers on
+ *			 the payloads
+ * Returns:  Pointer to the scheduler or exit on error
+ *
+ */
+
+UITS_VERIFY_SCHEDULER *uitsVerifySchedulerCreate (UITS_VERIFY_ITEM *items,
+												  int numItems,
+												  char *XSDFileName,
+												  int verifyLevel,
+												  UITS_signature_desc *uitsSignatureDesc,
+												  int numThreads)
+{
+	UITS_VERIFY_SCHEDULER *scheduler;
+	UITS_VERIFY_WORKER	  *worker;
+	int					  result;
+	int					  i;
+
+	scheduler = calloc(1, sizeof(UITS_VERIFY_SCHEDULER));
+	uitsHandleErrorPTR(verifySchedulerModuleName, "uitsVerifySchedulerCreate", scheduler, ERR_VERIFY,
+					   "Couldn't allocate verify scheduler\n");
+
+	scheduler->items	   = items;
+	scheduler->numItems	   = numItems;
+	scheduler->nextItem	   = 0;
+	scheduler->XSDFileName = XSDFileName;
+	scheduler->verifyLevel = verifyLevel;
+
+	/* everything the workers share is set up before they start */
+	if (verifyLevel >= VERIFY_LEVEL_SIGNATURE) {
+		scheduler->mdType = uitsGetSignatureDigest(uitsGetSignatureAlgorithm(uitsSignatureDesc->algorithm)->digestName);
+		scheduler->pubKey = uitsReadPublicKey(uitsSignatureDesc->pubKeyFileName);
+	}
+	if (verifyLevel >= VERIFY_LEVEL_SCHEMA) {
+		xmlInitParser();
+		scheduler->schema = uitsLoadSchema(XSDFileName);
+		uitsSchemaCheckKnownXSD(XSDFileName);
+		uitsVerifyCacheSetSchema(XSDFileName);
+	}
+
+	scheduler->threadsFlag = (numThreads != 1);
+	scheduler->numWorkers  = scheduler->threadsFlag ? uitsSignEngineCountWorkers(numThreads) : 1;
+
+	if (scheduler->threadsFlag) {
+		vprintf("Starting %d verification threads ...\n", scheduler->numWorkers);
+		uitsSignEngineLockingSetup();
+	}
+
+	for (i = 0; i < scheduler->numWorkers; i++) {
+		worker = &scheduler->workers[i];
+		worker->scheduler = scheduler;
+		worker->ctx		  = EVP_MD_CTX_create();
+
+		if (scheduler->threadsFlag) {
+			result = pthread_create(&worker->thread, NULL, uitsVerifySchedulerWorker, worker);
+			uitsHandleErrorINT(verifySchedulerModuleName, "uitsVerifySchedulerCreate", result, 0, ERR_VERIFY,
+							   "Couldn't start verification thread\n");
+		}
+	}
+
+	return (scheduler);
+}
+
+/*
+ *
+ * Function: uitsVerifySchedulerFinish
+ * Purpose:	 Wait for the workers to check every payload (or check them here if there
+ *			 are no threads), and free the scheduler
+ *
+ */
+
+void uitsVerifySchedulerFinish (UITS_VERIFY_SCHEDULER *scheduler)
+{
+	int i;
+
+	if (!scheduler->threadsFlag) {
+		uitsVerifySchedulerWorker(&scheduler->workers[0]);
+	}
+
+	for (i = 0; i < scheduler->numWorkers; i++) {
+		if (scheduler->threadsFlag) {
+			pthread_join(scheduler->workers[i].thread, NULL);
+		}
+		EVP_MD_CTX_destroy(scheduler->workers[i].ctx);
+	}
+
+	xmlSchemaFree(scheduler->schema);
+	EVP_PKEY_free(scheduler->pubKey);
+	free(scheduler);
+}
+
+/*
+ *
+ * Function: uitsVerifySchedulerWorker
+ * Purpose:	 Worker thread: check payloads until there are none left
+ *
+ */
+
+void *uitsVerifySchedulerWorker (void *workerPtr)
+{
+	UITS_VERIFY_WORKER	  *worker	 = workerPtr;
+	UITS_VERIFY_SCHEDULER *scheduler = worker->scheduler;
+	int					  itemIndex;
+
+	while ((itemIndex = __sync_fetch_and_add(&scheduler->nextItem, 1)) < scheduler->numItems) {
+		uitsVerifySchedulerCheck(scheduler, worker->ctx, &scheduler->items[itemIndex]);
+	}
+
+	return (NULL);
+}
+
+/*
+ *
+ * Function: uitsVerifySchedulerCheck
+ * Purpose:	 Check one payload up to the scheduler's level, cheapest first: read its values,
+ *			 check its signature, and check it against the schema. Sets the item's result
+ *			 instead of exiting, and keeps the payload's media hash for the media hash check.
+ *
+ */
+
+void uitsVerifySchedulerCheck (UITS_VERIFY_SCHEDULER *scheduler, EVP_MD_CTX *ctx, UITS_VERIFY_ITEM *item)
+{
+	UITS_PAYLOAD_SCANNER *scanner;
+	char				 *payloadXMLString = item->payloadXMLString;
+
+	/* the file had no payload, it's already marked */
+	if (!payloadXMLString) {
+		return;
+	}
+
+	scanner = uitsPayloadScannerCreate(NULL, NULL);
+
+	if (uitsPayloadScannerFeed(scanner, payloadXMLString, strlen(payloadXMLString)) != OK ||
+		uitsPayloadScannerFinish(scanner) != OK ||
+		scanner->metadataState != SCANNER_METADATA_DONE ||
+		!scanner->signatureValue ||
+		(scheduler->verifyLevel == VERIFY_LEVEL_FULL && !scanner->mediaValue)) {
+		item->result = ERR_PAYLOAD;
+	} else if (scheduler->verifyLevel >= VERIFY_LEVEL_SIGNATURE &&
+			   !uitsVerifyMessage(ctx, scheduler->pubKey, scheduler->mdType,
+								  (unsigned char *) payloadXMLString + scanner->metadataStart,
+								  scanner->metadataEnd - scanner->metadataStart,
+								  scanner->signatureValue)) {
+		item->result = ERR_SIG;
+	} else if (scheduler->verifyLevel >= VERIFY_LEVEL_SCHEMA && !uitsVerifyCacheLookup(payloadXMLString) &&
+			   uitsVerifySchedulerCheckSchema(scheduler, payloadXMLString) != OK) {
+		item->result = ERR_SCHEMA;
+	} else {
+		item->result	 = OK;
+		item->mediaValue = scanner->mediaValue;
+		scanner->mediaValue = NULL;
+		if (scheduler->verifyLevel >= VERIFY_LEVEL_SCHEMA) {
+			uitsVerifyCacheAdd(payloadXMLString);
+		}
+	}
+
+	uitsPayloadScannerFree(scanner);
+}
+
+/*
+ *
+ * Function: uitsVerifySchedulerCheckSchema
+ * Purpose:	 Check a payload against the schema, natively or else with libxml2 and the
+ *			 shared parsed schema
+ * Returns:  OK or ERROR if the payload isn't valid
+ *
+ */
+
+int uitsVerifySchedulerCheckSchema (UITS_VERIFY_SCHEDULER *scheduler, char *payloadXMLString)
+{
+	xmlDocPtr				doc;
+	xmlSchemaValidCtxtPtr	ctxt;
+	int						result;
+
+	if (uitsSchemaCheckPayload(payloadXMLString, scheduler->XSDFileName) == OK) {
+		return (OK);
+	}
+
+	doc = xmlReadMemory(payloadXMLString, strlen(payloadXMLString), "noname.xml", NULL, 0);
+	if (!doc) {
+		return (ERROR);
+	}
+
+	ctxt = xmlSchemaNewValidCtxt(scheduler->schema);
+	xmlSchemaSetValidErrors(ctxt, NULL, NULL, NULL);
+	result = xmlSchemaValidateDoc(ctxt, doc);
+
+	xmlSchemaFreeValidCtxt(ctxt);
+	xmlFreeDoc(doc);
+
+	return (result == 0 ? OK : ERROR);
+}
+
+/*
+ *
+ * Function: uitsVerifySchedulerReport
+ * Purpose:	 Write the result of each payload and a summary
+ * Returns:  The number of payloads that failed, or exit on error
+ *
+ */
+
+int uitsVerifySchedulerReport (UITS_VERIFY_ITEM *items, int numItems, char *reportFileName)
+{
+	UITS_VERIFY_RESULT_NAME *resultName;
+	FILE					*reportFP;
+	int						numResults [sizeof(verifyResultNames) / sizeof(verifyResultNames[0])] = { 0 };
+	int						numFailed = 0;
+	int						i;
+
+	if (reportFileName) {
+		vprintf("Writing verification report to file %s\n", reportFileName);
+		reportFP = uitsIOOpen(reportFileName, "w");
+		uitsHandleErrorPTR(verifySchedulerModuleName, "uitsVerifySchedulerReport", reportFP, ERR_FILE,
+						   "Couldn't open report file\n");
+	} else {
+		reportFP = stdout;
+	}
+
+	for (i = 0; i < numItems; i++) {
+		for (resultName = verifyResultNames; resultName->result != items[i].result; resultName++);
+		numResults[resultName - verifyResultNames]++;
+		if (items[i].result != OK) {
+			numFailed++;
+		}
+
+		err = fprintf(reportFP, "%s %s\n", resultName->name, items[i].audioFileName);
+		uitsHandleErrorINT(verifySchedulerModuleName, "uitsVerifySchedulerReport", (err < 0) ? ERROR : OK, OK, ERR_FILE,
+						   "Couldn't write verification report\n");
+	}
+
+	fprintf(reportFP, "# %d payloads: %d verified, %d failed schema validation, %d unreadable, %d bad signature, %d media hash mismatch\n",
+			numItems, numResults[0], numResults[1], numResults[2], numResults[3], numResults[4]);
+
+	if (reportFP != stdout) {
+		err = fclose(reportFP);
+		uitsHandleErrorINT(verifySchedulerModuleName, "uitsVerifySchedulerReport", err, OK, ERR_FILE,
+						   "Couldn't write verification report\n");
+	}
+
+	return (numFailed);
+}
+
+// EOF
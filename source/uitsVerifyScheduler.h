@@ -0,0 +1,100 @@
+/*
+ *  uitsVerifyScheduler.h
+ *  UITS_Tool
+ *
+ *  Copyright 2010 Universal Music Group. All rights reserved.
+ *
+ *  $Date$
+ *  $Revision$
+ *
+ */
+
+
+/*
+ * Prevent multiple inclusion...
+ */
+
+#ifndef _uitsverifyscheduler_h_
+#  define _uitsverifyscheduler_h_
+
+#define VERIFY_LIST_LINE_SIZE	1024
+
+/*
+ * Name of a result in the report
+ */
+
+typedef struct {
+	int		result;
+	char	*name;
+} UITS_VERIFY_RESULT_NAME;
+
+/*
+ * One payload of a verification list. The result is OK, or the error code of the
+ * first check that failed: ERR_PAYLOAD (the file has no payload, or its values
+ * couldn't be read), ERR_SIG, ERR_SCHEMA or ERR_HASH.
+ */
+
+typedef struct {
+	char	*audioFileName;
+	char	*payloadXMLString;
+	char	*mediaValue;			/* Media hash from the payload */
+	int		result;
+} UITS_VERIFY_ITEM;
+
+struct UITS_VERIFY_SCHEDULER;
+
+/*
+ * A worker thread with its own verification context
+ */
+
+typedef struct {
+	struct UITS_VERIFY_SCHEDULER	*scheduler;
+	pthread_t						thread;
+	EVP_MD_CTX						*ctx;
+} UITS_VERIFY_WORKER;
+
+/*
+ * The key and the schema are loaded once (if the level needs them) and only read by
+ * the workers
+ */
+
+typedef struct UITS_VERIFY_SCHEDULER {
+	UITS_VERIFY_ITEM	*items;
+	int					numItems;
+	volatile int		nextItem;			/* next item for a worker to take */
+	char				*XSDFileName;
+	int					verifyLevel;		/* one of uitsVerifyLevels */
+	xmlSchemaPtr		schema;				/* for payloads the native check leaves to libxml2 */
+	EVP_PKEY			*pubKey;
+	const EVP_MD		*mdType;			/* NULL to check the message itself */
+	int					threadsFlag;		/* FALSE to check the payloads on the calling thread */
+	int					numWorkers;
+	UITS_VERIFY_WORKER	workers [SIGN_ENGINE_MAX_WORKERS];
+} UITS_VERIFY_SCHEDULER;
+
+/*
+ * PUBLIC Functions
+ */
+
+int		uitsVerifyList					(char *listFileName,
+										 char *XSDFileName,
+										 int  verifyLevel,
+										 UITS_signature_desc *uitsSignatureDesc,
+										 int  numThreads,
+										 char *reportFileName);
+
+/*
+ * PRIVATE Functions
+ */
+
+UITS_VERIFY_SCHEDULER *uitsVerifySchedulerCreate (UITS_VERIFY_ITEM *items, int numItems, char *XSDFileName,
+												  int verifyLevel, UITS_signature_desc *uitsSignatureDesc, int numThreads);
+void	uitsVerifySchedulerFinish		(UITS_VERIFY_SCHEDULER *scheduler);
+void	*uitsVerifySchedulerWorker		(void *workerPtr);
+void	uitsVerifySchedulerCheck		(UITS_VERIFY_SCHEDULER *scheduler, EVP_MD_CTX *ctx, UITS_VERIFY_ITEM *item);
+int		uitsVerifySchedulerCheckSchema	(UITS_VERIFY_SCHEDULER *scheduler, char *payloadXMLString);
+int		uitsVerifySchedulerReport		(UITS_VERIFY_ITEM *items, int numItems, char *reportFileName);
+
+#endif
+
+// EOF
@@ -5,6 +5,11 @@
  *  Created by Chris Angelli on 5/17/10.
  *  Copyright 2010 Universal Music Group. All rights reserved.
  *
+ *  Supports RIFF/WAVE files and their 64-bit RF64/BW64 variants. In an
+ *  RF64 file the 32-bit RIFF and 'data' sizes are set to 0xFFFFFFFF and
+ *  the real sizes are stored in a 'ds64' chunk that must be the first
+ *  chunk after the WAVE form type.
+ *
  */
 
 #include "uits.h"
@@ -30,13 +35,15 @@ int wavIsValidFile (char *audioFileName)
 	char *formType = calloc(sizeof(char), 4);
 	int  isWAV = FALSE;
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(wavModuleName, "wavIsValidFile", audioFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	/* Read the first 8 bytes of the file and check to see if they represent an AIFF "FORM" chunk */
+	/* Read the first 8 bytes of the file and check to see if they represent a "RIFF", "RF64" or "BW64" chunk */
 	wavChunkHeader = wavReadChunkHeader(audioFP);
 	
- 	if (strncmp(wavChunkHeader->chunkID, "RIFF", 4) == 0) {
+ 	if ((strncmp(wavChunkHeader->chunkID, "RIFF", 4) == 0) ||
+		(strncmp(wavChunkHeader->chunkID, "RF64", 4) == 0) ||
+		(strncmp(wavChunkHeader->chunkID, "BW64", 4) == 0)) {
 		/* seek past header and read form type */
 		fseeko(audioFP, WAV_HEADER_SIZE, SEEK_CUR);
 		
@@ -46,7 +53,6 @@ int wavIsValidFile (char *audioFileName)
 		
 		if (strncmp(formType, "WAVE", 4) == 0){
 			vprintf("Audio file is WAV\n");
-			SetBigEndianFlag(FALSE);	/* wav files are always little-endian */
 			isWAV = TRUE;
 		}
 	} 
@@ -60,7 +66,7 @@ int wavIsValidFile (char *audioFileName)
  * Function: wavGetMediaHash
  * Purpose:	 Calcluate the media hash for a WAV file
  *			 The AIFF Media Hash is created using the following algorithm:
- *              1. Find the data chunk
+ *              1. Find the data chunk (using the ds64 size for RF64 files)
  *              2. Hash the audio frames in the data chunk, not including pad byte if it exists
  *
  * Returns:   Pointer to the hashed frame data
@@ -72,45 +78,32 @@ char *wavGetMediaHash (char *audioFileName)
 	UITS_digest			*mediaHash = NULL;
 	char				*mediaHashString = NULL;
 	
-	unsigned long	fileLength;
-	unsigned long	audioFrameStart, audioFrameEnd;
-	
-	WAV_CHUNK_HEADER *dataChunk;
-	
+	off_t			fileLength;
 	
-//	intelCPUFlag = 0;	/* all WAV files are always little-endian */
+	UITS_CONTAINER_ENTRY *dataChunk;
 
 	
-	audioFP = fopen(audioFileName, "rb");
+	audioFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(wavModuleName, "wavGetMediaHash", audioFP, ERR_FILE, "Couldn't open WAV audio file for reading\n");
 	
-	/* seek past the RIFF chunk */
-	/* RIFF chunk is 12 bytes: */
-	/*  chunk ID    (4-bytes)
-	 *  chunk size  (4-bytes)
-	 *  wave ID     (4-bytes)
-	 */
-	
-	fseeko(audioFP, 12, SEEK_CUR);
-	
-	/* now skip chunks until 'data' chunk */
 	/* get file size */
 	fileLength = uitsGetFileSize(audioFP);
 	
-	dataChunk = wavFindChunkHeader(audioFP, "data", fileLength);
+	/* find the 'data' chunk */
+	dataChunk = wavFindChunkHeader(audioFP, "data");
 	uitsHandleErrorPTR(wavModuleName, "wavGetMediaHash", dataChunk, ERR_WAV, 
 					   "Couldn't find 'data' chunk in audio file\n");
 	
-	/* move fp to start of data */
-	fseeko(audioFP, dataChunk->saveSeek, SEEK_SET);
-	
-	/*skip past ID and size */
-	fseeko(audioFP, 8L, SEEK_CUR);
+	if (dataChunk->offset + WAV_HEADER_SIZE + dataChunk->size > (unsigned long long) fileLength) {
+		uitsHandleErrorINT(wavModuleName, "wavGetMediaHash", ERROR, OK, ERR_WAV,
+						   "WAV 'data' chunk extends past end of file\n");
+	}
+
+	/* move fp to start of data, past ID and size */
+	fseeko(audioFP, dataChunk->offset + WAV_HEADER_SIZE, SEEK_SET);
 	
 	/* fp is (hopefully) at start of audio frame data */
-	audioFrameStart = ftello(audioFP);
-	
-	mediaHash = uitsCreateDigestBuffered (audioFP, dataChunk->chunkSize, "SHA256") ;
+	mediaHash = uitsCreateMediaDigest (audioFP, dataChunk->size) ;
 	mediaHashString = uitsDigestToString(mediaHash);
 	
 	fclose(audioFP);
@@ -124,9 +117,14 @@ char *wavGetMediaHash (char *audioFileName)
  * Function: wavEmbedPayload
  * Purpose:	 Embed the UITS payload into an WAV file
  *			 The following algorithm is used to embed the payload:
- *				1. Copy the input file to the output file
+ *				1. Clone the input file to the output file (nothing to do if embedding in place)
  *              2. Append an 'UITS' chunk with the payload
  *				3. Update the size of the RIFF chunk to reflect the additional 'UITS' chunk
+ *				   For RF64/BW64 files the 64-bit RIFF size in the ds64 chunk is updated instead.
+ *				   A RIFF file that would grow past 4GB is converted to RF64 if it has a
+ *				   'JUNK' chunk reserved for a ds64 chunk, otherwise it is an error.
+ *			 Steps 2 and 3 only touch the header and the end of the output file, so the audio
+ *			 data is never rewritten.
  *
  *
  * Returns:   OK or ERROR
@@ -139,13 +137,12 @@ int wavEmbedPayload  (char *audioFileName,
 {
 	FILE			*audioInFP, *audioOutFP;
 	WAV_CHUNK_HEADER *riffChunk = NULL;
-	WAV_CHUNK_HEADER *uitsChunk = NULL;
-	unsigned long	audioInFileSize;
+	UITS_CONTAINER_ENTRY *uitsChunk = NULL;
+	WAV_DS64_CHUNK	ds64Chunk;
 	
-	unsigned long	udtaChunkDataSize;
 	unsigned long	payloadXMLSize;
-	
-//	intelCPUFlag = 0;	/* all WAV files are always little-endian */
+	unsigned long	uitsChunkSize;
+	unsigned long long riffSize;
 
 	vprintf("About to embed payload for %s into %s\n", audioFileName, audioFileNameOut);
 	if (numPadBytes) {
@@ -153,58 +150,183 @@ int wavEmbedPayload  (char *audioFileName,
 	}
 	
 	payloadXMLSize = strlen(uitsPayloadXML);
+
+	/* the UITS chunk adds a header, the payload, and a pad byte if the payload size is odd */
+	uitsChunkSize = WAV_HEADER_SIZE + payloadXMLSize + (payloadXMLSize & 1);
 	
-	/* open the audio input and output files */
-	audioInFP = fopen(audioFileName, "rb");
+	/* open the audio input file */
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(wavModuleName, "wavEmbedPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioOutFP = fopen(audioFileNameOut, "wb");
-	uitsHandleErrorPTR(wavModuleName, "wavEmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
-	
-	/* calculate how long the input audio file is by seeking to EOF and saving size  */
-	audioInFileSize = uitsGetFileSize(audioInFP);
-	
-	
 	/* make sure there isn't an existing UITS payload */
-	fseeko(audioInFP, WAV_HEADER_SIZE + 4, SEEK_CUR);	/* seek past RIFF header and WAVE type */
-	uitsChunk = wavFindChunkHeader (audioInFP, "UITS", audioInFileSize);
+	uitsChunk = wavFindChunkHeader (audioInFP, "UITS");
 	if (uitsChunk) {
 		uitsHandleErrorPTR(wavModuleName, "wavEmbedPayload", NULL, ERR_WAV, 
 						   "Audio file already contains a UITS payload\n");
 	}
+	fclose(audioInFP);
 	
-	/* no existing payload, rewind and create new file */
-	rewind(audioInFP);
-	
-	/* copy the entire file */
-	uitsAudioBufferedCopy(audioInFP, audioOutFP, audioInFileSize);
+	/* no existing payload, clone the input and update the output in place */
+	uitsAudioCloneFile(audioFileName, audioFileNameOut);
 	
-	/* update the RIFF chunk to include the size of the new UITS chunk */
-	
-	rewind(audioOutFP);
-	rewind(audioInFP);
-	riffChunk = wavReadChunkHeader(audioInFP);
-	riffChunk->chunkSize += WAV_HEADER_SIZE + payloadXMLSize ;	/* UITS chunk size includes header + data */
-	fseeko(audioOutFP, 4, SEEK_CUR);
-	lswap(&riffChunk->chunkSize);
-	fwrite(&riffChunk->chunkSize, 1, 4, audioOutFP);
+	audioOutFP = uitsIOOpen(audioFileNameOut, "r+b");
+	uitsHandleErrorPTR(wavModuleName, "wavEmbedPayload", audioOutFP, ERR_FILE, "Couldn't open audio file for writing\n");
+
+	riffChunk = wavReadChunkHeader(audioOutFP);
+	
+	/* update the RIFF chunk (or ds64 chunk) to include the size of the new UITS chunk */
+	if (strncmp(riffChunk->chunkID, "RIFF", 4) == 0) {
+		riffSize = riffChunk->chunkSize + uitsChunkSize;	/* UITS chunk size includes header + data */
+	
+		if (riffSize <= WAV_MAX_RIFF_SIZE) {
+			fseeko(audioOutFP, 4, SEEK_SET);
+			wavWriteLE32(audioOutFP, riffSize);
+		} else {
+			vprintf("WAV file will be larger than 4GB, converting to RF64\n");
+			err = wavConvertToRF64(audioOutFP, audioOutFP, riffSize);
+			uitsHandleErrorINT(wavModuleName, "wavEmbedPayload", err, OK, ERR_WAV,
+							   "WAV file would be larger than 4GB and has no 'JUNK' chunk reserved for a 'ds64' chunk\n");
+		}
+	} else {
+		/* RF64/BW64: the 64-bit RIFF size is in the ds64 chunk */
+		err = wavReadDS64Chunk(audioOutFP, &ds64Chunk);
+		uitsHandleErrorINT(wavModuleName, "wavEmbedPayload", err, TRUE, ERR_WAV,
+						   "Couldn't find 'ds64' chunk in RF64 file\n");
+
+		fseeko(audioOutFP, ds64Chunk.saveSeek + WAV_HEADER_SIZE, SEEK_SET);
+		wavWriteLE64(audioOutFP, ds64Chunk.riffSize + uitsChunkSize);
+		wavFreeDS64Chunk(&ds64Chunk);
+	}
 	
 	
 	/* add an UITS chunk to the end of the output file*/	
 	fseeko(audioOutFP, 0, SEEK_END);
 	fwrite("UITS", 1, 4, audioOutFP);						/* 4-bytes ID */
-	lswap(&payloadXMLSize);								/* handle big vs little endianness */
-	fwrite(&payloadXMLSize, 1, 4, audioOutFP);			/* 4-bytes size */
+	wavWriteLE32(audioOutFP, payloadXMLSize);				/* 4-bytes size */
 	fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP);	/* UITS payload */
 	
 	/* the pad byte if necessary */
 	if (payloadXMLSize & 1) {
 		fwrite("\0", 1, 1, audioOutFP);
 	}
+
+	err = fclose(audioOutFP);
+	uitsHandleErrorINT(wavModuleName, "wavEmbedPayload", err, OK, ERR_FILE, "Couldn't write audio output file\n");
 	
+	/* the output file may have been indexed (and may be the input file) */
+	uitsContainerIndexInvalidate();
+
 	return(OK);
 }
 
+/*
+ *
+ * Function: wavEmbedPayloadStream
+ * Purpose:	 Embed the UITS payload into a WAV stream. The RIFF (or ds64) size is updated
+ *			 for the new chunk before the header is written, the chunks are copied through,
+ *			 and the UITS chunk is appended at the end of the stream. A RIFF file can't be
+ *			 converted to RF64 this way, so the output must stay under 4GB.
+ * Returns:  OK or exit on error
+ *
+ */
+
+int wavEmbedPayloadStream (UITS_AUDIO_STREAM *stream,
+						   FILE *audioOutFP,
+						   char *uitsPayloadXML,
+						   int  numPadBytes)
+{
+	unsigned char		riffHeader[WAV_RIFF_HEADER_SIZE];
+	unsigned char		chunkHeader[WAV_HEADER_SIZE];
+	unsigned char		*ds64Data = NULL;
+	unsigned long		ds64Size = 0;
+	unsigned long		payloadXMLSize;
+	unsigned long		uitsChunkSize;
+	unsigned long long	riffSize;
+	unsigned long long	chunkSize;
+	size_t				bytesRead;
+	
+	if (numPadBytes) {
+		vprintf("WARNING: Tried to add pad bytes to WAV file. This is not supported.\n");
+	}
+	
+	payloadXMLSize = strlen(uitsPayloadXML);
+	uitsChunkSize  = WAV_HEADER_SIZE + payloadXMLSize + (payloadXMLSize & 1);
+	
+	uitsAudioStreamRead(stream, riffHeader, WAV_RIFF_HEADER_SIZE);
+	
+	/* update the RIFF chunk (or ds64 chunk) to include the size of the new UITS chunk */
+	if (strncmp((char *) riffHeader, "RIFF", 4) == 0) {
+		riffSize = uitsReadLE32(&riffHeader[4]) + (unsigned long long) uitsChunkSize;
+		if (riffSize > WAV_MAX_RIFF_SIZE) {
+			uitsHandleErrorINT(wavModuleName, "wavEmbedPayloadStream", ERROR, OK, ERR_WAV,
+							   "WAV stream would be larger than 4GB, can't convert to RF64 while streaming\n");
+		}
+		uitsWriteLE32(&riffHeader[4], riffSize);
+		fwrite(riffHeader, 1, WAV_RIFF_HEADER_SIZE, audioOutFP);
+	} else {
+		/* RF64/BW64: the 64-bit RIFF size is in the ds64 chunk, which must be the first chunk */
+		bytesRead = uitsAudioStreamRead(stream, chunkHeader, WAV_HEADER_SIZE);
+		ds64Size  = uitsReadLE32(&chunkHeader[4]);
+		if ((bytesRead != WAV_HEADER_SIZE) || strncmp((char *) chunkHeader, "ds64", 4) || 
+			(ds64Size < WAV_DS64_MIN_SIZE) || (ds64Size > AUDIO_STREAM_MAX_PREFIX)) {
+			uitsHandleErrorINT(wavModuleName, "wavEmbedPayloadStream", ERROR, OK, ERR_WAV,
+							   "Couldn't find 'ds64' chunk in RF64 stream\n");
+		}
+		
+		ds64Size += ds64Size & 1;
+		ds64Data  = malloc(ds64Size);
+		bytesRead = uitsAudioStreamRead(stream, ds64Data, ds64Size);
+		uitsHandleErrorINT(wavModuleName, "wavEmbedPayloadStream", bytesRead, ds64Size, ERR_WAV,
+						   "Couldn't read 'ds64' chunk from RF64 stream\n");
+		
+		uitsWriteLE64(ds64Data, uitsReadLE64(ds64Data) + uitsChunkSize);
+		
+		fwrite(riffHeader, 1, WAV_RIFF_HEADER_SIZE, audioOutFP);
+		fwrite(chunkHeader, 1, WAV_HEADER_SIZE, audioOutFP);
+		fwrite(ds64Data, 1, ds64Size, audioOutFP);
+	}
+	
+	/* copy the chunks, checking for an existing UITS payload on the way */
+	while ((bytesRead = uitsAudioStreamRead(stream, chunkHeader, WAV_HEADER_SIZE)) == WAV_HEADER_SIZE) {
+		if (strncmp((char *) chunkHeader, "UITS", 4) == 0) {
+			uitsHandleErrorINT(wavModuleName, "wavEmbedPayloadStream", ERROR, OK, ERR_WAV,
+							   "Audio stream already contains a UITS payload\n");
+		}
+		fwrite(chunkHeader, 1, WAV_HEADER_SIZE, audioOutFP);
+		
+		chunkSize = uitsReadLE32(&chunkHeader[4]);
+		if (chunkSize == WAV_RF64_SIZE_MARKER && ds64Data) {
+			if (strncmp((char *) chunkHeader, "data", 4) != 0) {
+				break;		/* size is in the ds64 table, copy everything that is left */
+			}
+			chunkSize = uitsReadLE64(&ds64Data[8]);
+		}
+		chunkSize += chunkSize & 1;
+		
+		if (uitsAudioStreamCopy(stream, audioOutFP, (off_t) chunkSize) != (off_t) chunkSize) {
+			break;			/* truncated last chunk, copied as is */
+		}
+	}
+	
+	/* anything after the last complete chunk is passed through */
+	fwrite(chunkHeader, 1, (bytesRead < WAV_HEADER_SIZE) ? bytesRead : 0, audioOutFP);
+	uitsAudioStreamCopy(stream, audioOutFP, -1);
+	
+	/* add an UITS chunk to the end of the output */
+	fwrite("UITS", 1, 4, audioOutFP);						/* 4-bytes ID */
+	wavWriteLE32(audioOutFP, payloadXMLSize);				/* 4-bytes size */
+	fwrite(uitsPayloadXML, 1, payloadXMLSize, audioOutFP);	/* UITS payload */
+	
+	/* the pad byte if necessary */
+	if (payloadXMLSize & 1) {
+		fwrite("\0", 1, 1, audioOutFP);
+	}
+	
+	free(ds64Data);
+	
+	return (ferror(audioOutFP) ? ERROR : OK);
+}
+
 /*
  *
  * Function: wavExtractPayload
@@ -216,45 +338,51 @@ int wavEmbedPayload  (char *audioFileName,
 char *wavExtractPayload (char *audioFileName) 
 {
 	
-	WAV_CHUNK_HEADER *uitsChunkHeader = NULL;
+	UITS_CONTAINER_ENTRY *uitsChunkHeader = NULL;
 	FILE			*audioInFP;
-	unsigned long	audioInFileSize;
 	char			*payloadXML;
 	int				payloadXMLSize;
 	
-//	intelCPUFlag = 0;	/* all WAV files are always little-endian */
 	/* open the audio input file */
-	audioInFP = fopen(audioFileName, "rb");
+	audioInFP = uitsIOOpen(audioFileName, "rb");
 	uitsHandleErrorPTR(wavModuleName, "wavExtractPayload", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	audioInFileSize = uitsGetFileSize(audioInFP);
-	
-	/* seek past start of 'RIFF' chunk header and type (4 bytes)*/
-	
-	fseeko(audioInFP, WAV_HEADER_SIZE + 4, SEEK_CUR);
-	
 	/* find a 'UITS' chunk */	
-	uitsChunkHeader = wavFindChunkHeader (audioInFP, "UITS", audioInFileSize);
-	uitsHandleErrorPTR(wavModuleName, "wavExtractPayload", uitsChunkHeader, ERR_WAV, 
-					   "Coudln't find UITS payload in WAV file\n");
+	uitsChunkHeader = wavFindChunkHeader (audioInFP, "UITS");
+	if (!uitsChunkHeader) {
+		vprintf("Couldn't find UITS payload in WAV file\n");
+		fclose(audioInFP);
+		return (NULL);
+	}
+	
+	fseeko(audioInFP, uitsChunkHeader->offset + WAV_HEADER_SIZE, SEEK_SET);	/* seek past ID and Size in header */
 	
-	fseeko(audioInFP, uitsChunkHeader->saveSeek, SEEK_SET);	/* seek to start of chunk */
-	fseeko(audioInFP, WAV_HEADER_SIZE, SEEK_CUR);				/* seek past ID and Size in header */
+	/* the chunk size can be 64-bit (ds64), but the payload is read in one piece */
+	if (uitsChunkHeader->size > INT_MAX || uitsChunkHeader->size >= SIZE_MAX) {
+		uitsHandleErrorINT(wavModuleName, "wavExtractPayload", ERROR, OK, ERR_WAV,
+						   "UITS payload chunk is too large\n");
+	}
 	
 	/* alloc space with an extra null-terminator byte */
-	payloadXML = calloc((uitsChunkHeader->chunkSize + 1), 1);	
-	payloadXMLSize = uitsChunkHeader->chunkSize;
+	payloadXML = calloc((uitsChunkHeader->size + 1), 1);
+	uitsHandleErrorPTR(wavModuleName, "wavExtractPayload", payloadXML, ERR_WAV, 
+					   "Couldn't allocate space for UITS payload\n");
+	payloadXMLSize = (int) uitsChunkHeader->size;
 	
 	err = fread(payloadXML, 1L, payloadXMLSize, audioInFP);
 	uitsHandleErrorINT(wavModuleName, "wavExtractPayload", err, payloadXMLSize,  ERR_FILE, 
 					   "Couldn't read UITS payload\n");
 	
+	fclose(audioInFP);
+
 	return (payloadXML);
 }
 
 /*
  * Function: wavReadChunkHeader
  * Purpose:  Read the 4-byte WAV chunk ID and  4-byte WAV chunk size
+ *			 The size is the 32-bit size from the chunk header. For RF64 files, a size of
+ *			 0xFFFFFFFF means the real size is in the ds64 chunk (see uitsContainerIndexWalk).
  * Passed:   File pointer (should point to start of tag)
  * Returns:  Pointer to header structure or NULL if error
  *
@@ -264,22 +392,16 @@ WAV_CHUNK_HEADER *wavReadChunkHeader (FILE *fpin)
 {
 	WAV_CHUNK_HEADER *chunkHeader = calloc(sizeof(WAV_CHUNK_HEADER), 1);
 	unsigned char	  header[WAV_HEADER_SIZE];
-	unsigned long     chunkSize;
 	
 	
 	chunkHeader->saveSeek = ftello(fpin);
 	err = fread(header, 1L, WAV_HEADER_SIZE, fpin);
-	uitsHandleErrorINT(wavModuleName, "wavExtractPayload", err, WAV_HEADER_SIZE, ERR_FILE, 
+	uitsHandleErrorINT(wavModuleName, "wavReadChunkHeader", err, WAV_HEADER_SIZE, ERR_FILE,
 					   "Couldn't read wav chunk header\n");
 	
-	
-	//	vprintf("%c%c%c%c\n", header[4], header[5], header[6], header[7]);
-	
 	memcpy (chunkHeader->chunkID, &header[0], 4); 
 	
-	memcpy(&chunkSize, &header[4], 4);
-	lswap(&chunkSize);
-	chunkHeader->chunkSize = chunkSize;	/* size does NOT include 8 header bytes */
+	chunkHeader->chunkSize = uitsReadLE32(&header[4]);	/* size does NOT include 8 header bytes */
 	
  	
 	/* return file pointer to original position */
@@ -292,54 +414,288 @@ WAV_CHUNK_HEADER *wavReadChunkHeader (FILE *fpin)
 /*
  *
  * Function: wavFindChunkHeader
- * Purpose:	 Find an WAV chunk header within a WAV file
+ * Purpose:	 Find a top-level chunk in a WAV file
  *           Chunk header format is :
  *               id:   4-bytes
  *               size: 4-bytes (if size is odd, data is padded to even size)
  *
+ *			 The chunks are looked up in the file's container index, so the file is only
+ *			 walked once no matter how many chunks are searched for. In RF64 files the
+ *			 index has the 64-bit sizes from the ds64 chunk.
  *           The file pointer is returned to it's original position
- * Passed:   File pointer (should point to file location to start search)
+ * Passed:   File pointer
  *			 ID of chunk to find
- *           Chunk Type (NULL if don't care)
- *			 Location to end searching
- * Returns:  Pointer to header structure or NULL if error
+ * Returns:  Pointer to the index entry (owned by the index) or NULL if not found
  */
 
 
-WAV_CHUNK_HEADER *wavFindChunkHeader (FILE *fpin, char *chunkID, unsigned long endSeek)
+UITS_CONTAINER_ENTRY *wavFindChunkHeader (FILE *fpin, char *chunkID)
 {
-	WAV_CHUNK_HEADER *chunkHeader = calloc(sizeof(WAV_CHUNK_HEADER), 1);
-	unsigned long	saveSeek, bytesLeft;
-	unsigned long sizeWithPad;
-	int	chunkTypeLen = 0;
-	char *currChunkType = NULL;
-	int chunkFound = FALSE;
+	UITS_CONTAINER_INDEX *index;
 	
+	index = uitsContainerIndexGet(fpin, CONTAINER_RIFF);
+	
+	return (uitsContainerIndexFindChild(index, NULL, chunkID, NULL));
+}
+
+/*
+ *
+ * Function: wavReadDS64Chunk
+ * Purpose:	 Read the ds64 chunk of an RF64/BW64 file. The ds64 chunk is always the first
+ *			 chunk after the RIFF header and has the following format:
+ *				id:				'ds64'
+ *				size:			4-bytes
+ *				riffSize:		8-bytes
+ *				dataSize:		8-bytes
+ *				sampleCount:	8-bytes
+ *				tableLength:	4-bytes
+ *				table:			tableLength entries of 4-byte chunk id and 8-byte chunk size
+ *
+ *           The file pointer is returned to it's original position
+ * Passed:   File pointer, pointer to ds64 structure to fill in
+ * Returns:  TRUE if a ds64 chunk was read, FALSE otherwise
+ */
+
+int wavReadDS64Chunk (FILE *fpin, WAV_DS64_CHUNK *ds64Chunk)
+{
+	WAV_CHUNK_HEADER *chunkHeader;
+	unsigned char	ds64Data[WAV_DS64_MIN_SIZE];
+	unsigned char	tableEntry[WAV_DS64_TABLE_ENTRY_SIZE];
+	unsigned long	i;
+	off_t			saveSeek;
+	int				foundDS64 = FALSE;
+
 	saveSeek = ftello(fpin);
+
+	memset(ds64Chunk, 0, sizeof(WAV_DS64_CHUNK));
+
+	fseeko(fpin, WAV_RIFF_HEADER_SIZE, SEEK_SET);
+	chunkHeader = wavReadChunkHeader(fpin);
+
+	if ((strncmp(chunkHeader->chunkID, "ds64", 4) == 0) && (chunkHeader->chunkSize >= WAV_DS64_MIN_SIZE)) {
+		fseeko(fpin, WAV_HEADER_SIZE, SEEK_CUR);
+		err = fread(ds64Data, 1, WAV_DS64_MIN_SIZE, fpin);
+		uitsHandleErrorINT(wavModuleName, "wavReadDS64Chunk", err, WAV_DS64_MIN_SIZE, ERR_WAV,
+						   "Couldn't read ds64 chunk\n");
+
+		ds64Chunk->saveSeek		= chunkHeader->saveSeek;
+		ds64Chunk->riffSize		= uitsReadLE64(&ds64Data[0]);
+		ds64Chunk->dataSize		= uitsReadLE64(&ds64Data[8]);
+		ds64Chunk->sampleCount	= uitsReadLE64(&ds64Data[16]);
+		ds64Chunk->tableLength	= uitsReadLE32(&ds64Data[24]);
+
+		/* don't trust a table length that doesn't fit in the chunk */
+		if (ds64Chunk->tableLength > (chunkHeader->chunkSize - WAV_DS64_MIN_SIZE) / WAV_DS64_TABLE_ENTRY_SIZE) {
+			ds64Chunk->tableLength = (chunkHeader->chunkSize - WAV_DS64_MIN_SIZE) / WAV_DS64_TABLE_ENTRY_SIZE;
+		}
+
+		if (ds64Chunk->tableLength) {
+			ds64Chunk->table = calloc(ds64Chunk->tableLength, sizeof(WAV_DS64_TABLE_ENTRY));
+			uitsHandleErrorPTR(wavModuleName, "wavReadDS64Chunk", ds64Chunk->table, ERR_WAV,
+							   "Couldn't allocate ds64 table\n");
+			for (i = 0; i < ds64Chunk->tableLength; i++) {
+				err = fread(tableEntry, 1, WAV_DS64_TABLE_ENTRY_SIZE, fpin);
+				uitsHandleErrorINT(wavModuleName, "wavReadDS64Chunk", err, WAV_DS64_TABLE_ENTRY_SIZE, ERR_WAV,
+								   "Couldn't read ds64 table entry\n");
+				memcpy(ds64Chunk->table[i].chunkID, &tableEntry[0], 4);
+				ds64Chunk->table[i].chunkSize = uitsReadLE64(&tableEntry[4]);
+			}
+		}
+		foundDS64 = TRUE;
+	}
+	
+	free(chunkHeader);
+	fseeko(fpin, saveSeek, SEEK_SET);
+	return (foundDS64);
+}
+
+/*
+ *
+ * Function: wavFreeDS64Chunk
+ * Purpose:	 Free the table read by wavReadDS64Chunk
+ *
+ */
+
+void wavFreeDS64Chunk (WAV_DS64_CHUNK *ds64Chunk)
+{
+	free(ds64Chunk->table);
+	ds64Chunk->table		= NULL;
+	ds64Chunk->tableLength	= 0;
+}
 	
-	bytesLeft = endSeek - saveSeek;
+/*
+ *
+ * Function: wavGetDS64ChunkSize
+ * Purpose:	 Look up the 64-bit size of a chunk in the ds64 chunk
+ *
+ * Returns:  The 64-bit size, or the RF64 size marker if the chunk isn't in the ds64 chunk
+ */
+
+unsigned long long wavGetDS64ChunkSize (WAV_DS64_CHUNK *ds64Chunk, unsigned char *chunkID)
+{
+	unsigned long i;
+
+	if (strncmp(chunkID, "data", 4) == 0) {
+		return (ds64Chunk->dataSize);
+	}
+
+	for (i = 0; i < ds64Chunk->tableLength; i++) {
+		if (strncmp(ds64Chunk->table[i].chunkID, chunkID, 4) == 0) {
+			return (ds64Chunk->table[i].chunkSize);
+		}
+	}
+
+	return (WAV_RF64_SIZE_MARKER);
+}
+
+/*
+ *
+ * Function: wavConvertToRF64
+ * Purpose:	 Convert the output copy of a RIFF file into an RF64 file. This is only possible
+ *			 if the first chunk is a 'JUNK' chunk big enough to hold a ds64 chunk, which is
+ *			 how RF64-aware writers reserve space (EBU Tech 3306). The 'JUNK' chunk is
+ *			 overwritten in place, so no other data moves.
+ * Passed:   Input file pointer, output file pointer, new 64-bit RIFF size
+ * Returns:  OK or ERROR if there is no reserved space
+ */
+
+int wavConvertToRF64 (FILE *audioInFP, FILE *audioOutFP, unsigned long long riffSize)
+{
+	WAV_CHUNK_HEADER *junkChunk;
+	UITS_CONTAINER_ENTRY *dataChunk;
+	UITS_CONTAINER_ENTRY *fmtChunk;
+	unsigned char	 blockAlignBytes[2];
+	unsigned long	 blockAlign = 0;
+	unsigned long long sampleCount = 0;
+
+	fseeko(audioInFP, WAV_RIFF_HEADER_SIZE, SEEK_SET);
+	junkChunk = wavReadChunkHeader(audioInFP);
+
+	if ((strncmp(junkChunk->chunkID, "JUNK", 4) != 0) || (junkChunk->chunkSize < WAV_DS64_MIN_SIZE)) {
+		return (ERROR);
+	}
+
+	dataChunk = wavFindChunkHeader(audioInFP, "data");
+	uitsHandleErrorPTR(wavModuleName, "wavConvertToRF64", dataChunk, ERR_WAV,
+					   "Couldn't find 'data' chunk in audio file\n");
+
+	/* sample count is the number of sample frames: data size / block align from the 'fmt ' chunk */
+	fmtChunk = wavFindChunkHeader(audioInFP, "fmt ");
+	if (fmtChunk && (fmtChunk->size >= 14)) {
+		fseeko(audioInFP, fmtChunk->offset + WAV_HEADER_SIZE + 12, SEEK_SET);
+		err = fread(blockAlignBytes, 1, 2, audioInFP);
+		uitsHandleErrorINT(wavModuleName, "wavConvertToRF64", err, 2, ERR_WAV, "Couldn't read WAV block align\n");
+		blockAlign = uitsReadLE16(blockAlignBytes);
+	}
+	if (blockAlign) {
+		sampleCount = dataChunk->size / blockAlign;
+	}
+
+	/* RF64 header with the size marker */
+	fseeko(audioOutFP, 0, SEEK_SET);
+	fwrite("RF64", 1, 4, audioOutFP);
+	wavWriteLE32(audioOutFP, WAV_RF64_SIZE_MARKER);
+
+	/* the JUNK chunk becomes the ds64 chunk, keeping its size so nothing else moves */
+	fseeko(audioOutFP, junkChunk->saveSeek, SEEK_SET);
+	fwrite("ds64", 1, 4, audioOutFP);
+	wavWriteLE32(audioOutFP, junkChunk->chunkSize);
+	wavWriteLE64(audioOutFP, riffSize);
+	wavWriteLE64(audioOutFP, dataChunk->size);
+	wavWriteLE64(audioOutFP, sampleCount);
+	wavWriteLE32(audioOutFP, 0);		/* no table entries */
+
+	return (OK);
+}
+
+/*
+ *  Little-endian helpers for writing WAV header fields
+ *
+ */
+
+int wavWriteLE32 (FILE *fpout, unsigned long value)
+{
+	unsigned char bytes[4];
+
+	uitsWriteLE32(bytes, value);
+
+	err = fwrite(bytes, 1, 4, fpout);
+	uitsHandleErrorINT(wavModuleName, "wavWriteLE32", err, 4, ERR_FILE, "Couldn't write WAV header field\n");
+
+	return (OK);
+}
+
+int wavWriteLE64 (FILE *fpout, unsigned long long value)
+{
+	unsigned char bytes[8];
+
+	uitsWriteLE64(bytes, value);
+
+	err = fwrite(bytes, 1, 8, fpout);
+	uitsHandleErrorINT(wavModuleName, "wavWriteLE64", err, 8, ERR_FILE, "Couldn't write WAV header field\n");
+
+	return (OK);
+}
+
+/*
+ *
+ * Function: wavGetEmbedPlan
+ * Purpose:	 Plan the payload embedding for a WAV file. The UITS chunk is appended, so only
+ *			 the RIFF size (or the 64-bit RIFF size in the ds64 chunk of an RF64 file) changes.
+ * Returns:  OK or ERROR
+ *
+ */
+
+int wavGetEmbedPlan (char *audioFileName, UITS_EMBED_PLAN *plan)
+{
+	FILE				*audioInFP;
+	WAV_CHUNK_HEADER	*riffChunk;
+	WAV_DS64_CHUNK		ds64Chunk;
 	
+	audioInFP = uitsIOOpen(audioFileName, "rb");
+	uitsHandleErrorPTR(wavModuleName, "wavGetEmbedPlan", audioInFP, ERR_FILE, "Couldn't open audio file for reading\n");
 	
-	/* read chunks until finding the chunk ID (and possibly type) or end of search */
-	while (!chunkFound && bytesLeft) {
-		chunkHeader = aiffReadChunkHeader(fpin);
-		/* seek past header */
-		fseeko(fpin, WAV_HEADER_SIZE, SEEK_CUR);
-		bytesLeft -= WAV_HEADER_SIZE;
-		
-		if (strncmp(chunkHeader->chunkID, chunkID, 4) == 0) {
-				chunkFound = TRUE;
-		}		
-		/* seek past data and pad byte (if necessary) */
-		sizeWithPad = chunkHeader->chunkSize;
-		sizeWithPad += (chunkHeader->chunkSize & 0x01);
-		fseeko(fpin, sizeWithPad, SEEK_CUR);
-		bytesLeft -= sizeWithPad;
+	/* make sure there isn't an existing UITS payload */
+	if (wavFindChunkHeader(audioInFP, "UITS")) {
+		uitsHandleErrorPTR(wavModuleName, "wavGetEmbedPlan", NULL, ERR_WAV, "Audio file already contains a UITS payload\n");
 	}
 	
-	fseeko(fpin, saveSeek, SEEK_SET);
-    return (chunkFound ? chunkHeader : NULL);
+	fseeko(audioInFP, 0, SEEK_SET);
+	riffChunk = wavReadChunkHeader(audioInFP);
 	
+	if (strncmp(riffChunk->chunkID, "RIFF", 4) == 0) {
+		/* files close to 4GB are left to the regular embed, which converts them to RF64 */
+		if (riffChunk->chunkSize > WAV_MAX_RIFF_SIZE - AUDIO_STREAM_MAX_PREFIX) {
+			free(riffChunk);
+			fclose(audioInFP);
+			return (ERROR);
+		}
+		err = uitsEmbedPlanReadHeader(plan, audioInFP, WAV_RIFF_HEADER_SIZE);
+		if (err == OK) {
+			err = uitsEmbedPlanAddPatch(plan, 4, PLAN_FIELD_LE32, WAV_HEADER_SIZE, TRUE);
+		}
+	} else {
+		err = wavReadDS64Chunk(audioInFP, &ds64Chunk);
+		uitsHandleErrorINT(wavModuleName, "wavGetEmbedPlan", err, TRUE, ERR_WAV, "Couldn't find 'ds64' chunk in RF64 file\n");
+		
+		err = uitsEmbedPlanReadHeader(plan, audioInFP, ds64Chunk.saveSeek + WAV_HEADER_SIZE + 8);
+		if (err == OK) {
+			err = uitsEmbedPlanAddPatch(plan, ds64Chunk.saveSeek + WAV_HEADER_SIZE, PLAN_FIELD_LE64, WAV_HEADER_SIZE, TRUE);
+		}
+		wavFreeDS64Chunk(&ds64Chunk);
+	}
+	free(riffChunk);
+	fclose(audioInFP);
+	
+	/* 'UITS', payload size, payload, pad byte */
+	plan->trailerFlag	 = TRUE;
+	plan->trailerPadFlag = TRUE;
+	plan->trailerLength	 = WAV_HEADER_SIZE;
+	memcpy(plan->trailer, "UITS", 4);
+	plan->trailerPatch.offset	 = 4;
+	plan->trailerPatch.fieldType = PLAN_FIELD_LE32;
+	
+	return (err);
 }
 
 // EOF
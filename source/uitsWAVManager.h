@@ -19,17 +19,36 @@
 
 
 #define WAV_HEADER_SIZE 8
+#define WAV_RIFF_HEADER_SIZE		12			/* 'RIFF', size, 'WAVE' */
+#define WAV_MAX_RIFF_SIZE			0xFFFFFFFFUL	/* largest size a 32-bit RIFF header can hold */
+#define WAV_RF64_SIZE_MARKER		0xFFFFFFFFUL	/* RF64: real size is in the ds64 chunk */
+#define WAV_DS64_MIN_SIZE			28			/* riffSize, dataSize, sampleCount, tableLength */
+#define WAV_DS64_TABLE_ENTRY_SIZE	12			/* chunk id, 64-bit chunk size */
 
 /* 
  * Structures
  */
 
 typedef struct {
-	unsigned char   chunkID[4];
-	unsigned long	chunkSize;		
-	unsigned long   saveSeek;	/* saved seek location for the header start */
+	unsigned char		chunkID[4];
+	unsigned long long	chunkSize;		
+	off_t				saveSeek;	/* saved seek location for the header start */
 } WAV_CHUNK_HEADER;
 
+typedef struct {
+	unsigned char		chunkID[4];
+	unsigned long long	chunkSize;
+} WAV_DS64_TABLE_ENTRY;
+
+typedef struct {
+	unsigned long long	riffSize;
+	unsigned long long	dataSize;
+	unsigned long long	sampleCount;
+	unsigned long		tableLength;
+	WAV_DS64_TABLE_ENTRY *table;
+	off_t				saveSeek;	/* saved seek location for the ds64 header start */
+} WAV_DS64_CHUNK;
+
 /* 
  * PUBLIC Functions 
  */
@@ -41,10 +60,18 @@ int wavEmbedPayload	(char *audioFileName,
 						 char *uitsPayloadXML,
 						 int  numPadBytes);
 
+int wavEmbedPayloadStream	(UITS_AUDIO_STREAM *stream,
+							 FILE *audioOutFP,
+							 char *uitsPayloadXML,
+							 int  numPadBytes);
+
 char *wavExtractPayload (char *audioFileName); 
 
 char *wavGetMediaHash	(char *audioFileName);
 
+int wavGetEmbedPlan		(char *audioFileName, 
+						 UITS_EMBED_PLAN *plan);
+
 
 /*
  * PRIVATE Functions
@@ -52,7 +79,15 @@ char *wavGetMediaHash	(char *audioFileName);
 
 WAV_CHUNK_HEADER *wavReadChunkHeader (FILE *audioInFP);
 char			 *wavReadChunkData   (FILE *audioInFP);
-WAV_CHUNK_HEADER *wavFindChunkHeader (FILE *fpin, char *chunkID, unsigned long endSeek);
+UITS_CONTAINER_ENTRY *wavFindChunkHeader (FILE *fpin, char *chunkID);
+
+int				 wavReadDS64Chunk	 (FILE *fpin, WAV_DS64_CHUNK *ds64Chunk);
+void			 wavFreeDS64Chunk	 (WAV_DS64_CHUNK *ds64Chunk);
+unsigned long long wavGetDS64ChunkSize (WAV_DS64_CHUNK *ds64Chunk, unsigned char *chunkID);
+int				 wavConvertToRF64	 (FILE *audioInFP, FILE *audioOutFP, unsigned long long riffSize);
+
+int					wavWriteLE32	(FILE *fpout, unsigned long value);
+int					wavWriteLE64	(FILE *fpout, unsigned long long value);
 
 
 #endif
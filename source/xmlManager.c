@@ -208,11 +208,7 @@ mxml_node_t * uitsPayloadPopulateSignature (mxml_node_t * xmlRootNode, UITS_sign
 	// create a signed hash value for the signature value
 	
 	/* create hash of metadata */
-	if (!strcmp(uitsSignatureDesc->algorithm, "RSA2048")) {
-		signatureDigestName = "SHA256";
-	} else if (!strcmp(uitsSignatureDesc->algorithm, "DSA2048")) {
-		signatureDigestName = "SHA224";
-	}
+	signatureDigestName = uitsGetSignatureAlgorithm(uitsSignatureDesc->algorithm)->digestName;
 	
 	/* create signature for metadata using the private key */
 	metadataString = uitsGetMetadataStringMXML ( xmlRootNode);
@@ -241,7 +237,8 @@ mxml_node_t * uitsPayloadPopulateSignature (mxml_node_t * xmlRootNode, UITS_sign
 /*
  *
  * Function:  uitsVerifyPayloadXML ()
- * Purpose:	 Validate the UITS payload against the UITS wsd schema, verify the mediahash, and verify the signature
+ * Purpose:	 Verify the UITS payload up to a verification level: the signature, then the
+ *			 schema, then the media hash, cheapest first
  *			 This validation uses the libxml2 library
  * Returns: OK or exit on error
  */
@@ -249,7 +246,7 @@ mxml_node_t * uitsPayloadPopulateSignature (mxml_node_t * xmlRootNode, UITS_sign
 int  uitsVerifyPayloadXML (mxml_node_t * xmlRootNode, 
 						   char *payloadXMLString, 
 						   char *XSDFileName, 
-						   int mediaHashNoVerifyFlag, 
+						   int verifyLevel, 
 						   UITS_signature_desc *uitsSignatureDesc) 
 {
 	char		*metadataString;
@@ -260,16 +257,60 @@ int  uitsVerifyPayloadXML (mxml_node_t * xmlRootNode,
 	
 	char		*mediaHash;
 	
-	/* validate the xml against the uits.xsd schema */
-	vprintf("\tAbout to validate payload XML against schema\n");
+	// To verify the signature we need the metadata element text, the public key file, and the signature
+	metadataString	= uitsGetMetadataString ( payloadXMLString);	
+	signatureString = uitsGetElementText( xmlRootNode, "signature");
 	
-	err = uitsValidatePayloadSchema (xmlRootNode, XSDFileName);
-	uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadXML", err, 0, ERR_SCHEMA, 
-					   "Error: Couldn't verify the schema\n");
+	uitsHandleErrorPTR(xmlManagerFileName, "uitsVerifyPayloadXML", metadataString,  ERR_PAYLOAD,
+					   "Error: Couldn't get metadata from payload XML\n");
+	uitsHandleErrorPTR(xmlManagerFileName, "uitsVerifyPayloadXML", signatureString,  ERR_SIG,
+					   "Error: Couldn't get signature value from payload XML\n");
+	
+	vprintf("\tPayload structure verified\n");
+	
+	if (verifyLevel >= VERIFY_LEVEL_SIGNATURE) {
+		vprintf("metadataString length: %d metadataString: %s\n", strlen(metadataString), metadataString);
+		vprintf("signatureString: %s\n", signatureString);
+		
+		// CMA Note: Disabled until spec is clarified
+		// Verify that the public key file is the correct one for this payload
+		
+		signatureElementNode = mxmlFindElement( xmlRootNode,  xmlRootNode, "signature", NULL, NULL, MXML_DESCEND);
+		//	uitsHandleErrorPTR(xmlManagerFileName, " uitsVerifyPayloadXML", signatureElementNode, ERR_SIG,
+		//					"Error: Couldn't find XML signature element node\n");
+		
+		//	pubKeyId = mxmlElementGetAttr(signatureElementNode, "keyID");
+		//	uitsHandleErrorPTR(xmlManagerFileName, " uitsVerifyPayloadXML", pubKeyId, ERR_SIG,
+		//					"Error: Couldn't get get keyId attribute value\n");
+		
+		//	err = uitsValidatePubKeyID (uitsSignatureDesc->pubKeyFileName, pubKeyId);
+		//	uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadXML", err, OK, ERR_SIG,
+		//					"Error: Public key in file does not match keyID attribute in payload.\n");
+		//	
+		/* convert the algorithm name to a digest name */
+		signatureDigestName = uitsGetSignatureAlgorithm(uitsSignatureDesc->algorithm)->digestName;
+		
+		vprintf("\tAbout to verify signature with Public Key in file: %s\n", uitsSignatureDesc->pubKeyFileName );
+		err = uitsVerifySignature(uitsSignatureDesc->pubKeyFileName, metadataString, signatureString, signatureDigestName);
+		
+		uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadXML", err, 1, ERR_SIG,
+						   "Error: Couldn't validate signature\n");
+		
+		vprintf("\tPayload signature verified\n");
+	}
 	
-	vprintf("\tPayload passed schema validation\n");
+	if (verifyLevel >= VERIFY_LEVEL_SCHEMA) {
+		/* validate the xml against the uits.xsd schema */
+		vprintf("\tAbout to validate payload XML against schema\n");
+		
+		err = uitsValidatePayloadSchema (xmlRootNode, XSDFileName);
+		uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadXML", err, 0, ERR_SCHEMA, 
+						   "Error: Couldn't verify the schema\n");
+		
+		vprintf("\tPayload passed schema validation\n");
+	}
 	
-	if (!mediaHashNoVerifyFlag) {	// don't verify media hash if set 
+	if (verifyLevel == VERIFY_LEVEL_FULL) {
 		/* verify that the media hash is correct */
 		vprintf("\tAbout to verify media hash in payload XML\n");
 		mediaHash = uitsGetElementText(xmlRootNode, "Media");
@@ -283,93 +324,180 @@ int  uitsVerifyPayloadXML (mxml_node_t * xmlRootNode,
 		vprintf("\tMedia hash verified\n");
 	}
 	
+	return (OK);
+	
+}
+
+
+/*
+ *
+ * Function:  uitsVerifyPayloadString ()
+ * Purpose:	 Verify a payload string up to a verification level. The checks run cheapest
+ *			 first, so that a payload that fails one doesn't pay for the rest: the structure
+ *			 (the values can be read), the signature, the schema, and the media hash. The
+ *			 values are found by one forward scan of the payload, which digests the
+ *			 metadata element for the signature as it is read.
+ * Returns: OK or exit on error
+ */
+
+int  uitsVerifyPayloadString (char *payloadXMLString, 
+							  char *XSDFileName, 
+							  int verifyLevel, 
+							  UITS_signature_desc *uitsSignatureDesc) 
+{
+	xmlDocPtr				doc;
+	UITS_PAYLOAD_SCANNER	*scanner;
+	UITS_SIGNATURE_VERIFIER	*verifier = NULL;
+	char					*signatureDigestName;
+	
 	// To verify the signature we need the metadata element text, the public key file, and the signature
-	metadataString	= uitsGetMetadataString ( payloadXMLString);	
-	signatureString = uitsGetElementText( xmlRootNode, "signature");
+	if (verifyLevel >= VERIFY_LEVEL_SIGNATURE) {
+		/* convert the algorithm name to a digest name */
+		signatureDigestName = uitsGetSignatureAlgorithm(uitsSignatureDesc->algorithm)->digestName;
+		
+		vprintf("\tAbout to verify signature with Public Key in file: %s\n", uitsSignatureDesc->pubKeyFileName );
+		verifier = uitsVerifySignatureStart(uitsSignatureDesc->pubKeyFileName, signatureDigestName);
+		scanner	 = uitsPayloadScannerCreate(uitsVerifyMetadataCB, verifier);
+	} else {
+		scanner = uitsPayloadScannerCreate(NULL, NULL);
+	}
 	
-	vprintf("metadataString length: %d metadataString: %s\n", strlen(metadataString), metadataString);
-	vprintf("signatureString: %s\n", signatureString);
-	
-	// CMA Note: Disabled until spec is clarified
-	// Verify that the public key file is the correct one for this payload
-	
-	signatureElementNode = mxmlFindElement( xmlRootNode,  xmlRootNode, "signature", NULL, NULL, MXML_DESCEND);
-	//	uitsHandleErrorPTR(xmlManagerFileName, " uitsVerifyPayloadXML", signatureElementNode, ERR_SIG,
-	//					"Error: Couldn't find XML signature element node\n");
-	
-	//	pubKeyId = mxmlElementGetAttr(signatureElementNode, "keyID");
-	//	uitsHandleErrorPTR(xmlManagerFileName, " uitsVerifyPayloadXML", pubKeyId, ERR_SIG,
-	//					"Error: Couldn't get get keyId attribute value\n");
-	
-	//	err = uitsValidatePubKeyID (uitsSignatureDesc->pubKeyFileName, pubKeyId);
-	//	uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadXML", err, OK, ERR_SIG,
-	//					"Error: Public key in file does not match keyID attribute in payload.\n");
-	//	
-	/* convert the algorithm name to a digest name */
-	if (!strcmp(uitsSignatureDesc->algorithm, "RSA2048")) {
-		signatureDigestName = "SHA256";
-	} else if (!strcmp(uitsSignatureDesc->algorithm, "DSA2048")) {
-		signatureDigestName = "SHA224";
+	/* check the structure */
+	vprintf("\tAbout to read payload XML\n");
+	
+	err = uitsPayloadScannerFeed(scanner, payloadXMLString, strlen(payloadXMLString));
+	if (err == OK) {
+		err = uitsPayloadScannerFinish(scanner);
 	}
+	uitsHandleErrorINT(xmlManagerFileName, "uitsVerifyPayloadString", err, OK, ERR_PAYLOAD,
+					   "Error: Couldn't parse payload XML\n");
 	
-	vprintf("\tAbout to verify signature with Public Key in file: %s\n", uitsSignatureDesc->pubKeyFileName );
-	err = uitsVerifySignature(uitsSignatureDesc->pubKeyFileName, metadataString, signatureString, signatureDigestName);
+	uitsHandleErrorINT(xmlManagerFileName, "uitsVerifyPayloadString", scanner->metadataState, SCANNER_METADATA_DONE, ERR_PAYLOAD,
+					   "Error: Couldn't get metadata from payload XML\n");
+	uitsHandleErrorPTR(xmlManagerFileName, "uitsVerifyPayloadString", scanner->signatureValue,  ERR_SIG,
+					   "Error: Couldn't get signature value from payload XML\n");
 	
-	uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadXML", err, 1, ERR_SIG,
-					   "Error: Couldn't validate signature\n");
+	vprintf("\tPayload structure verified\n");
 	
-	vprintf("\tPayload signature verified\n");
+	/* check the signature */
+	if (verifier) {
+		vprintf("signatureString: %s\n", scanner->signatureValue);
+		
+		err = uitsVerifySignatureFinish(verifier, scanner->signatureValue);
+		uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadString", err, 1, ERR_SIG,
+						   "Error: Couldn't validate signature\n");
+		
+		vprintf("\tPayload signature verified\n");
+	}
 	
-	return (OK);
+	/* validate the xml against the uits.xsd schema */
+	if (verifyLevel >= VERIFY_LEVEL_SCHEMA) {
+		vprintf("\tAbout to validate payload XML against schema\n");
+		
+		/* a payload that passed before with the same schema isn't checked again, and
+		   payloads of the usual shape don't need libxml2 to load and apply the schema */
+		uitsVerifyCacheSetSchema(XSDFileName);
+		if (uitsVerifyCacheLookup(payloadXMLString)) {
+			vprintf("\tPayload schema validation found in verify cache\n");
+		} else if (uitsSchemaCheckPayload(payloadXMLString, XSDFileName) != OK) {
+			doc = xmlReadMemory(payloadXMLString, strlen(payloadXMLString), "noname.xml", NULL, 0);	
+			uitsHandleErrorPTR(xmlManagerFileName, "uitsVerifyPayloadString", doc,  ERR_PAYLOAD,
+							   "Error: Couldn't parse xml buffer\n");
+			
+			err = uitsValidatePayloadDoc (doc, XSDFileName);
+			uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadString", err, 0, ERR_SCHEMA, 
+							   "Error: Couldn't verify the schema\n");
+			
+			xmlFreeDoc(doc);
+			xmlSchemaCleanupTypes();
+			xmlCleanupParser();
+		}
+		
+		vprintf("\tPayload passed schema validation\n");
+		uitsVerifyCacheAdd(payloadXMLString);
+	}
 	
+	/* the media hash reads all of the audio, so it's last */
+	if (verifyLevel == VERIFY_LEVEL_FULL) {
+		vprintf("\tAbout to verify media hash in payload XML\n");
+		uitsHandleErrorPTR(xmlManagerFileName, "uitsVerifyPayloadString", scanner->mediaValue,  ERR_PAYLOAD,
+						   "Error: Couldn't get Media hash value from payload XML for validation\n");
+		
+		err = uitsVerifyMediaHash (scanner->mediaValue);
+		uitsHandleErrorINT(xmlManagerFileName, " uitsVerifyPayloadString", err, 0, ERR_HASH,
+						   "Error: Couldn't verify the media hash\n");
+		
+		vprintf("\tMedia hash verified\n");
+	}
+	
+	uitsPayloadScannerFree(scanner);
+	
+	return (OK);
 }
 
+/*
+ *
+ * Function:  uitsVerifyMetadataCB ()
+ * Purpose:	 Payload scanner callback that passes the metadata element to the signature verifier
+ *
+ */
+
+void uitsVerifyMetadataCB (void *context, const char *bytes, size_t length)
+{
+	uitsVerifySignatureUpdate((UITS_SIGNATURE_VERIFIER *) context, (const unsigned char *) bytes, length);
+}
 
 /* 
  * Function: uitsValidatePayloadSchema
- * Purpose:	 Use libxml2 to validate the xml in the payload schema against the xsd 
+ * Purpose:	 Validate the xml in the payload schema against the xsd, with the native
+ *			 check in uitsSchemaCheck.c or else with libxml2
  * Returns:  OK or exit on error
  */
 
 int uitsValidatePayloadSchema (mxml_node_t * xmlRootNode, char *XSDFileName) 
 {
 	xmlDocPtr				doc;
-	xmlSchemaPtr			schema = NULL;
-	xmlSchemaParserCtxtPtr	ctxt;
 	char					*xmlString;
-	FILE					*tempFP;
-	
-	xmlLineNumbersDefault(1);
-	
-	/* make sure that the xsd file exists */
-	tempFP = fopen(XSDFileName, "r");
-	dprintf("XSDFilename: %s\n", XSDFileName);
-	uitsHandleErrorPTR(xmlManagerFileName, "uitsValidatePayloadSchema", tempFP, ERR_FILE, "Error: Could not open xsd file\n");
-	fclose(tempFP);
-	
-	ctxt = xmlSchemaNewParserCtxt(XSDFileName);
-	
-	if (!silentFlag) {
-		xmlSchemaSetParserErrors(ctxt, (xmlSchemaValidityErrorFunc) fprintf, (xmlSchemaValidityWarningFunc) fprintf, stderr);
-	} else {
-		xmlSchemaSetParserErrors(ctxt, NULL, NULL, NULL);
-		
-	}
-	
-	schema = xmlSchemaParse(ctxt);
-	xmlSchemaFreeParserCtxt(ctxt);
-	//xmlSchemaDump(stdout, schema); //To print schema dump
-	
 	
 	/* Convert the mxml tree data structure to a libxml doc structure */	
 	xmlString = uitsMXMLToXMLString(xmlRootNode);
 	uitsHandleErrorPTR(xmlManagerFileName, "uitsValidatePayloadSchema", xmlString, ERR_PAYLOAD,
 					   "Error: Couldn't generate xml string for validation\n");
 	
+	if (uitsSchemaCheckPayload(xmlString, XSDFileName) == OK) {
+		free(xmlString);
+		return (OK);
+	}
+	
 	doc = xmlReadMemory(xmlString, strlen(xmlString), "noname.xml", NULL, 0);	
 	uitsHandleErrorPTR(xmlManagerFileName, "uitsValidatePayloadSchema", doc,  ERR_PAYLOAD,
 					   "Error: Couldn't parse xml buffer\n");
 	
+	err = uitsValidatePayloadDoc(doc, XSDFileName);
+	
+	xmlFreeDoc(doc);
+	free(xmlString);
+	
+	xmlSchemaCleanupTypes();
+	xmlCleanupParser();
+	xmlMemoryDump();
+	
+	return (err);
+}
+
+/* 
+ * Function: uitsValidatePayloadDoc
+ * Purpose:	 Use libxml2 to validate a parsed payload against the xsd 
+ * Returns:  OK or exit on error
+ */
+
+int uitsValidatePayloadDoc (xmlDocPtr doc, char *XSDFileName) 
+{
+	xmlSchemaPtr			schema = NULL;
+	xmlSchemaValidCtxtPtr	ctxt;
+	
+	schema = uitsLoadSchema(XSDFileName);
+	
 	ctxt = xmlSchemaNewValidCtxt(schema);
 	if (!silentFlag) {
 		xmlSchemaSetValidErrors(ctxt, (xmlSchemaValidityErrorFunc) fprintf, (xmlSchemaValidityWarningFunc) fprintf, stderr);
@@ -378,22 +506,54 @@ int uitsValidatePayloadSchema (mxml_node_t * xmlRootNode, char *XSDFileName)
 	}
 	
 	err = xmlSchemaValidateDoc(ctxt, doc);
-	uitsHandleErrorINT(xmlManagerFileName, "uitsValidatePayloadSchema", err, 0, ERR_SCHEMA,
+	uitsHandleErrorINT(xmlManagerFileName, "uitsValidatePayloadDoc", err, 0, ERR_SCHEMA,
 					   "Error: Payload XML failed validation\n");
 	
 	
 	xmlSchemaFreeValidCtxt(ctxt);
-	xmlFreeDoc(doc);
 	// free the resource
 	if(schema != NULL)
 		xmlSchemaFree(schema);
 	
-	xmlSchemaCleanupTypes();
-	xmlCleanupParser();
-	xmlMemoryDump();
+	return (OK);
+}
+
+/* 
+ * Function: uitsLoadSchema
+ * Purpose:	 Use libxml2 to read and parse the xsd. A parsed schema can be shared by
+ *			 threads that each validate with their own validation context.
+ * Returns:  The schema, which the caller frees, or exit on error
+ */
+
+xmlSchemaPtr uitsLoadSchema (char *XSDFileName) 
+{
+	xmlSchemaPtr			schema = NULL;
+	xmlSchemaParserCtxtPtr	ctxt;
+	FILE					*tempFP;
 	
+	xmlLineNumbersDefault(1);
 	
-	return (OK);
+	/* make sure that the xsd file exists */
+	tempFP = fopen(XSDFileName, "r");
+	dprintf("XSDFilename: %s\n", XSDFileName);
+	uitsHandleErrorPTR(xmlManagerFileName, "uitsLoadSchema", tempFP, ERR_FILE, "Error: Could not open xsd file\n");
+	fclose(tempFP);
+	
+	ctxt = xmlSchemaNewParserCtxt(XSDFileName);
+	
+	if (!silentFlag) {
+		xmlSchemaSetParserErrors(ctxt, (xmlSchemaValidityErrorFunc) fprintf, (xmlSchemaValidityWarningFunc) fprintf, stderr);
+	} else {
+		xmlSchemaSetParserErrors(ctxt, NULL, NULL, NULL);
+		
+	}
+	
+	schema = xmlSchemaParse(ctxt);
+	xmlSchemaFreeParserCtxt(ctxt);
+	//xmlSchemaDump(stdout, schema); //To print schema dump
+	uitsHandleErrorPTR(xmlManagerFileName, "uitsLoadSchema", schema, ERR_SCHEMA, "Error: Couldn't parse xsd file\n");
+	
+	return (schema);
 }
 
 /* 
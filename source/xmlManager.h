@@ -30,14 +30,22 @@ mxml_node_t * uitsCreatePayloadXML (int xmlSchemaType, UITS_element *metadataPtr
 int  uitsVerifyPayloadXML (mxml_node_t * xmlRootNode, 
 						   char *payloadXMLString, 
 						   char *XSDFileName, 
-						   int mediaHashNoVerifyFlag, 
+						   int verifyLevel, 
 						   UITS_signature_desc *uitsSignatureDesc);
 
 mxml_node_t *uitsPayloadPopulateMetadata (mxml_node_t *xmlRootNode, UITS_element *metadataPtr);	// create the metadata node
 
 mxml_node_t *uitsPayloadPopulateSignature (mxml_node_t *xmlRootNode, UITS_signature_desc *uitsSignatureDesc);	// create the signature node	
 
+int  uitsVerifyPayloadString (char *payloadXMLString, 
+							  char *XSDFileName, 
+							  int verifyLevel, 
+							  UITS_signature_desc *uitsSignatureDesc);	// verify a payload string without building a tree
+void uitsVerifyMetadataCB (void *context, const char *bytes, size_t length);	// pass scanned metadata to the signature verifier
+
 int uitsValidatePayloadSchema (mxml_node_t * xmlRootNode, char *XSDFileName);	// verify the payload against the xsd schema
+int uitsValidatePayloadDoc (xmlDocPtr doc, char *XSDFileName);				// verify a parsed payload against the xsd schema
+xmlSchemaPtr uitsLoadSchema (char *XSDFileName);								// read and parse the xsd schema
 
 
 char *uitsGetMetadataStringMXML (mxml_node_t * xmlRootNode);			// get the metadata XML string from an mxml root node
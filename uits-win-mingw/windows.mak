@@ -10,6 +10,8 @@
 #          the fseeko/ftello calls are replaced with calls to fseek/ftell via
 #          compile time defines (-Dfseeko-fseek). This will cause problems with
 #          audio files that are larger than 2GB.
+#          fseeko/ftello now map to the 64-bit fseeko64/ftello64 instead, and
+#          _FILE_OFFSET_BITS=64 makes off_t 64 bits wide to match.
 #  $Date$
 #  $Revision$
 # 
@@ -19,10 +21,10 @@
 #
 
 CC      = gcc
-OPTIM   = -Os -g -Dfseeko=fseek -Dftello=ftell -DNO_UUID
+OPTIM   = -Os -g -D_FILE_OFFSET_BITS=64 -Dfseeko=fseeko64 -Dftello=ftello64 -DNO_UUID
 CFLAGS  = $(OPTIM) -I libxml2/include -I ssl/include -I mxml/include -I FLAC/include
 LDFLAGS = $(OPTIM) -luuid
-OBJECTS = main.o xmlManager.o cmePayloadManager.o uitsAudioFileManager.o uitsMP3Manager.o uitsMP4Manager.o uitsPayloadManager.o uitsOpenSSL.o uitsAIFFManager.o uitsFLACManager.o uitsWAVManager.o uitsError.o uitsGenericManager.o uitsHTMLManager.o uitsWindows_uuid_parse.o uitsWindows_strcasestr.o
+OBJECTS = main.o xmlManager.o uitsSchemaCheck.o cmePayloadManager.o uitsAudioFileManager.o uitsEmbedPlan.o uitsHashCache.o uitsMultiHash.o uitsIOManager.o uitsContainerIndex.o uitsMP3Manager.o uitsMP4Manager.o uitsPayloadManager.o uitsPayloadWriter.o uitsPayloadScanner.o uitsOpenSSL.o uitsBase64.o uitsAIFFManager.o uitsFLACManager.o uitsWAVManager.o uitsError.o uitsGenericManager.o uitsStampManager.o uitsSignEngine.o uitsVerifyScheduler.o uitsVerifyCache.o uitsHTMLManager.o uitsWindows_uuid_parse.o uitsWindows_strcasestr.o
 
 RM = rm
 
@@ -39,7 +41,7 @@ vpath %.c ../source
 #
 
 UITS_Tool.exe :$(OBJECTS)
-	$(CC) $(LDFLAGS) -o UITS_Tool.exe   $(OBJECTS) mxml/lib/libmxml.a libxml2/lib/libxml2.a FLAC/lib/libFLAC.a -lwsock32 ssl/lib/libcrypto.a -lgdi32 ssl/lib/libssl.a 
+	$(CC) $(LDFLAGS) -o UITS_Tool.exe   $(OBJECTS) mxml/lib/libmxml.a libxml2/lib/libxml2.a FLAC/lib/libFLAC.a -lwsock32 ssl/lib/libcrypto.a -lgdi32 ssl/lib/libssl.a -lpthread
 
 
 #